@@ -1,5 +1,6 @@
 #include "AsyncSocketBase.hxx"
 #include "AsyncSocketBaseHandler.hxx"
+#include <boost/static_assert.hpp>
 #include <rutil/WinLeakCheck.hxx>
 #include <rutil/Logger.hxx>
 #include "ReTurnSubsystem.hxx"
@@ -10,6 +11,9 @@ using namespace std;
 
 #define NO_CHANNEL ((unsigned short)-1)
 
+// Receive buffers must fit in a DataBufferPool block
+BOOST_STATIC_ASSERT(RECEIVE_BUFFER_SIZE <= reTurn::DataBufferPool::LargeBlockSize);
+
 namespace reTurn {
 
 AsyncSocketBase::AsyncSocketBase(asio::io_service& ioService) : 
@@ -55,7 +59,7 @@ AsyncSocketBase::doSend(const StunTuple& destination, unsigned short channel, bo
    else
    {
       // Add Turn Framing
-      boost::shared_ptr<DataBuffer> frame = allocateBuffer(4);
+      boost::shared_ptr<DataBuffer> frame = DataBufferPool::createBuffer(4);
       channel = htons(channel);
       memcpy(&(*frame)[0], &channel, 2);
       unsigned short msgsize = htons((unsigned short)data->size());
@@ -115,7 +119,7 @@ AsyncSocketBase::doReceive()
    if(!mReceiving)
    {
       mReceiving=true;
-      mReceiveBuffer = allocateBuffer(RECEIVE_BUFFER_SIZE);
+      mReceiveBuffer = DataBufferPool::createBuffer(RECEIVE_BUFFER_SIZE);  // no need to zero, it is about to be overwritten
       transportReceive();
    }
 }
@@ -132,7 +136,7 @@ AsyncSocketBase::doFramedReceive()
    if(!mReceiving)
    {
       mReceiving=true;
-      mReceiveBuffer = allocateBuffer(RECEIVE_BUFFER_SIZE);
+      mReceiveBuffer = DataBufferPool::createBuffer(RECEIVE_BUFFER_SIZE);  // no need to zero, it is about to be overwritten
       transportFramedReceive();
    }
 }
@@ -164,7 +168,12 @@ AsyncSocketBase::close()
 boost::shared_ptr<DataBuffer>  
 AsyncSocketBase::allocateBuffer(unsigned int size)
 {
-   return boost::shared_ptr<DataBuffer>(new DataBuffer(size));
+   boost::shared_ptr<DataBuffer> buffer = DataBufferPool::createBuffer(size);
+   if(size > 0)
+   {
+      memset(buffer->mutableData(), 0, size);
+   }
+   return buffer;
 }
 
 } // namespace
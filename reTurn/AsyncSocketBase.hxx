@@ -18,6 +18,12 @@
 
 namespace reTurn {
 
+#ifdef SO_REUSEPORT
+/// SO_REUSEPORT:  allows several sockets to bind the same address and port, with
+/// the OS spreading incoming datagrams and connections across them
+typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> ReusePortOption;
+#endif
+
 class AsyncSocketBaseHandler;
 class AsyncSocketBaseDestroyedHandler;
 
@@ -46,6 +52,8 @@ public:
    bool isConnected() { return mConnected; }
    asio::ip::address& getConnectedAddress() { return mConnectedAddress; }
    unsigned short getConnectedPort() { return mConnectedPort; }
+   /// The ioService whose thread services this socket
+   asio::io_service& getIOService() { return mIOService; }
 
    virtual void setOnBeforeSocketClosedFp(boost::function<void(unsigned int)> fp) { mOnBeforeSocketCloseFp = fp; }
 
@@ -63,7 +71,7 @@ public:
    virtual void onSendSuccess() = 0;
    virtual void onSendFailure(const asio::error_code& e) = 0;
 
-   /// Utility API
+   /// Utility API - buffers come from the calling thread's DataBufferPool, and are zeroed
    static boost::shared_ptr<DataBuffer> allocateBuffer(unsigned int size);
 
    // Stubbed out async handlers needed by Protocol specific Subclasses of this - the requirement for these 
@@ -122,7 +130,7 @@ private:
       unsigned int mBufferStartPos;
    };
    /// Queue of data to send
-   typedef std::deque<SendData> SendDataQueue;
+   typedef std::deque<SendData, DataBufferPoolAllocator<SendData> > SendDataQueue;
    SendDataQueue mSendDataQueue;
 };
 
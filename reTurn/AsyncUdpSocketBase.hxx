@@ -20,6 +20,8 @@ public:
    virtual unsigned int getSocketDescriptor();
 
    virtual asio::error_code bind(const asio::ip::address& address, unsigned short port);
+   /// As above, optionally setting SO_REUSEPORT - has no effect where the OS does not support it
+   asio::error_code bind(const asio::ip::address& address, unsigned short port, bool reusePort);
    virtual void connect(const std::string& address, unsigned short port);  
 
    virtual void transportReceive();
@@ -1,10 +1,190 @@
 #include "DataBuffer.hxx"
 #include <memory.h>
 #include <assert.h>
+#include <boost/make_shared.hpp>
+#include <rutil/Lock.hxx>
+#include <rutil/Mutex.hxx>
+#include <rutil/ThreadIf.hxx>
 #include <rutil/WinLeakCheck.hxx>
 
 namespace reTurn {
 
+namespace
+{
+
+struct FreeBlock
+{
+   FreeBlock* mNext;
+};
+
+// The free lists of one thread
+class BlockCache
+{
+public:
+   enum SizeClass { Small, Large, NumSizeClasses };
+
+   BlockCache()
+   {
+      for(int i = 0; i < NumSizeClasses; i++)
+      {
+         mFree[i] = 0;
+         mCount[i] = 0;
+      }
+   }
+
+   ~BlockCache()
+   {
+      for(int i = 0; i < NumSizeClasses; i++)
+      {
+         while(mFree[i])
+         {
+            FreeBlock* block = mFree[i];
+            mFree[i] = block->mNext;
+            ::operator delete(block);
+         }
+      }
+   }
+
+   void* allocate(SizeClass sizeClass)
+   {
+      FreeBlock* block = mFree[sizeClass];
+      if(block)
+      {
+         mFree[sizeClass] = block->mNext;
+         --mCount[sizeClass];
+         return block;
+      }
+      return ::operator new(sizeClass == Small ? DataBufferPool::SmallBlockSize : DataBufferPool::LargeBlockSize);
+   }
+
+   void deallocate(void* p, SizeClass sizeClass)
+   {
+      if(mCount[sizeClass] >= (sizeClass == Small ? (unsigned int)DataBufferPool::MaxCachedSmallBlocks : (unsigned int)DataBufferPool::MaxCachedLargeBlocks))
+      {
+         ::operator delete(p);
+         return;
+      }
+      FreeBlock* block = (FreeBlock*)p;
+      block->mNext = mFree[sizeClass];
+      mFree[sizeClass] = block;
+      ++mCount[sizeClass];
+   }
+
+private:
+   FreeBlock* mFree[NumSizeClasses];
+   unsigned int mCount[NumSizeClasses];
+};
+
+resip::Mutex cacheKeyMutex;
+volatile bool cacheKeyCreated = false;
+resip::ThreadIf::TlsKey cacheKey;
+
+void deleteBlockCache(void* cache)
+{
+   delete (BlockCache*)cache;
+}
+
+BlockCache& 
+getBlockCache()
+{
+   if(!cacheKeyCreated)
+   {
+      resip::Lock lock(cacheKeyMutex);
+      if(!cacheKeyCreated)
+      {
+         resip::ThreadIf::tlsKeyCreate(cacheKey, deleteBlockCache);
+         cacheKeyCreated = true;
+      }
+   }
+   BlockCache* cache = (BlockCache*)resip::ThreadIf::tlsGetValue(cacheKey);
+   if(!cache)
+   {
+      cache = new BlockCache;
+      resip::ThreadIf::tlsSetValue(cacheKey, cache);
+   }
+   return *cache;
+}
+
+}
+
+void* 
+DataBufferPool::allocate(std::size_t size)
+{
+   if(size <= SmallBlockSize)
+   {
+      return getBlockCache().allocate(BlockCache::Small);
+   }
+   else if(size <= LargeBlockSize)
+   {
+      return getBlockCache().allocate(BlockCache::Large);
+   }
+   return ::operator new(size);
+}
+
+void 
+DataBufferPool::deallocate(void* p, std::size_t size)
+{
+   if(!p)
+   {
+      return;
+   }
+   if(size <= SmallBlockSize)
+   {
+      getBlockCache().deallocate(p, BlockCache::Small);
+   }
+   else if(size <= LargeBlockSize)
+   {
+      getBlockCache().deallocate(p, BlockCache::Large);
+   }
+   else
+   {
+      ::operator delete(p);
+   }
+}
+
+void 
+DataBufferPool::smallBlockDeallocator(char* data)
+{
+   deallocate(data, SmallBlockSize);
+}
+
+void 
+DataBufferPool::largeBlockDeallocator(char* data)
+{
+   deallocate(data, LargeBlockSize);
+}
+
+boost::shared_ptr<DataBuffer> 
+DataBufferPool::createBuffer(unsigned int size)
+{
+   char* data = 0;
+   DataBuffer::deallocator dealloc = ArrayDeallocator;
+   if(size == 0)
+   {
+      // nothing to allocate
+   }
+   else if(size <= SmallBlockSize)
+   {
+      data = (char*)allocate(SmallBlockSize);
+      dealloc = smallBlockDeallocator;
+   }
+   else if(size <= LargeBlockSize)
+   {
+      data = (char*)allocate(LargeBlockSize);
+      dealloc = largeBlockDeallocator;
+   }
+   else
+   {
+      data = new char[size];
+   }
+
+   boost::shared_ptr<DataBuffer> buffer = boost::allocate_shared<DataBuffer>(DataBufferPoolAllocator<DataBuffer>(), 0u, dealloc);
+   buffer->mBuffer = data;
+   buffer->mStart = data;
+   buffer->mSize = size;
+   return buffer;
+}
+
 void ArrayDeallocator(char* data)
 {
    delete [] data;
@@ -1,6 +1,10 @@
 #ifndef DATA_BUFFER_HXX
 #define DATA_BUFFER_HXX
 
+#include <cstddef>
+#include <new>
+#include <boost/shared_ptr.hpp>
+
 namespace reTurn {
 
 void ArrayDeallocator(char* data);
@@ -28,12 +32,84 @@ public:
    unsigned int& mutableSize();
 
 private:
+   friend class DataBufferPool;
+
    char* mBuffer;
    unsigned int mSize;
    char* mStart;
    deallocator mDealloc;
 };
 
+/**
+  Per-thread cache of fixed-size memory blocks for the relay data path.
+
+  Every packet that is relayed needs a receive buffer, often a framing or
+  Data indication buffer, and the shared_ptr bookkeeping for each.  Taking
+  these from the heap costs several malloc/free pairs per packet.  Instead,
+  blocks are kept on a free list owned by the calling thread, so in the steady
+  state no locking or heap access is needed.  A block is returned to the cache
+  of whichever thread frees it, so buffers may safely be handed between
+  threads.
+
+  There are two block sizes:  SmallBlockSize covers shared_ptr control blocks
+  (with the DataBuffer itself) and short buffers, LargeBlockSize covers a full
+  receive buffer.  Anything larger comes straight from the heap.
+*/
+class DataBufferPool
+{
+public:
+   enum 
+   { 
+      SmallBlockSize = 128,
+      LargeBlockSize = 4096,   // RECEIVE_BUFFER_SIZE
+      MaxCachedSmallBlocks = 4096,
+      MaxCachedLargeBlocks = 1024
+   };
+
+   static void* allocate(std::size_t size);
+   static void deallocate(void* p, std::size_t size);
+
+   /// Creates a DataBuffer whose storage and shared_ptr control block both come from 
+   /// the pool.  Note:  Unlike DataBuffer(size), the contents are not zeroed.
+   static boost::shared_ptr<DataBuffer> createBuffer(unsigned int size);
+
+private:
+   static void smallBlockDeallocator(char* data);
+   static void largeBlockDeallocator(char* data);
+};
+
+/// Standard allocator that takes its memory from the DataBufferPool
+template<class T>
+class DataBufferPoolAllocator
+{
+public:
+   typedef T value_type;
+   typedef T* pointer;
+   typedef const T* const_pointer;
+   typedef T& reference;
+   typedef const T& const_reference;
+   typedef std::size_t size_type;
+   typedef std::ptrdiff_t difference_type;
+
+   template<class U> struct rebind { typedef DataBufferPoolAllocator<U> other; };
+
+   DataBufferPoolAllocator() {}
+   template<class U> DataBufferPoolAllocator(const DataBufferPoolAllocator<U>&) {}
+
+   pointer address(reference x) const { return &x; }
+   const_pointer address(const_reference x) const { return &x; }
+   pointer allocate(size_type n, const void* = 0) { return (pointer)DataBufferPool::allocate(n * sizeof(T)); }
+   void deallocate(pointer p, size_type n) { DataBufferPool::deallocate(p, n * sizeof(T)); }
+   size_type max_size() const { return ((size_type)-1) / sizeof(T); }
+   void construct(pointer p, const T& val) { new((void*)p) T(val); }
+   void destroy(pointer p) { p->~T(); }
+};
+
+template<class T, class U>
+inline bool operator==(const DataBufferPoolAllocator<T>&, const DataBufferPoolAllocator<U>&) { return true; }
+template<class T, class U>
+inline bool operator!=(const DataBufferPoolAllocator<T>&, const DataBufferPoolAllocator<U>&) { return false; }
+
 }
 
 #endif 
@@ -876,7 +876,8 @@ RequestHandler::processTurnSendIndication(TurnAllocationManager& turnAllocationM
    // Shouldn't have more than one xor-peer-address attribute in this request
    StunMessage::setTupleFromStunAtrAddress(remoteAddress, request.mTurnXorPeerAddress[0]);
 
-   boost::shared_ptr<DataBuffer> data(new DataBuffer(request.mTurnData->data(), request.mTurnData->size()));
+   boost::shared_ptr<DataBuffer> data = DataBufferPool::createBuffer((unsigned int)request.mTurnData->size());
+   memcpy(data->mutableData(), request.mTurnData->data(), request.mTurnData->size());
    allocation->sendDataToPeer(remoteAddress, data, false /* isFramed? */);
 }
 
@@ -9,7 +9,7 @@
 
 namespace reTurn {
 
-TlsServer::TlsServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port)
+TlsServer::TlsServer(asio::io_service& ioService, RequestHandler& requestHandler, const asio::ip::address& address, unsigned short port, bool reusePort)
 : mIOService(ioService),
   mAcceptor(ioService),
   mContext(ioService, asio::ssl::context::tlsv1),  // TLSv1.0
@@ -58,6 +58,12 @@ TlsServer::TlsServer(asio::io_service& ioService, RequestHandler& requestHandler
 
    mAcceptor.open(endpoint.protocol());
    mAcceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+   if(reusePort)
+   {
+      mAcceptor.set_option(ReusePortOption(true));
+   }
+#endif
 #ifdef USE_IPV6
 #ifdef __linux__
    if(address.is_v6())
@@ -34,7 +34,8 @@ TurnAllocation::TurnAllocation(TurnManager& turnManager,
    mRequestedTuple(requestedTuple),
    mTurnManager(turnManager),
    mTurnAllocationManager(turnAllocationManager),
-   mAllocationTimer(turnManager.getIOService()),
+   mIOService(localTurnSocket->getIOService()),
+   mAllocationTimer(mIOService),
    mLocalTurnSocket(localTurnSocket),
    mBadChannelErrorLogged(false),
    mNoPermissionToPeerLogged(false),
@@ -78,7 +79,7 @@ TurnAllocation::startRelay()
 {
    if(mRequestedTuple.getTransportType() == StunTuple::UDP)
    {
-      mUdpRelayServer.reset(new UdpRelayServer(mTurnManager.getIOService(), *this));
+      mUdpRelayServer.reset(new UdpRelayServer(mIOService, *this));
       if(!mUdpRelayServer->startReceiving())
       {
          stopRelay();  // Ensure allocation timer is stopped
@@ -82,6 +82,9 @@ private:
 
    TurnManager& mTurnManager;
    TurnAllocationManager& mTurnAllocationManager;
+   // The ioService of the socket the allocation was made on - the relay and
+   // timers run there too, so the allocation is only ever touched by one thread
+   asio::io_service& mIOService;
    asio::deadline_timer mAllocationTimer;
 
    AsyncSocketBase* mLocalTurnSocket;
@@ -6,6 +6,7 @@
 #ifdef USE_SSL
 #include <asio/ssl.hpp>
 #endif
+#include <rutil/Mutex.hxx>
 #include "ReTurnConfig.hxx"
 #include "StunTuple.hxx"
 
@@ -19,6 +20,7 @@ public:
 
    asio::io_service& getIOService() { return mIOService; }
 
+   // Port allocation is shared by all of the server threads, so these are thread safe
    unsigned short allocateAnyPort(StunTuple::TransportType transport);
    unsigned short allocateEvenPort(StunTuple::TransportType transport);
    unsigned short allocateOddPort(StunTuple::TransportType transport);
@@ -37,6 +39,7 @@ private:
       PortStateReserved
    } PortState;
    typedef std::map<unsigned short, PortState> PortAllocationMap;
+   resip::Mutex mMutex;  // protects the port allocation maps
    PortAllocationMap mUdpAllocationPorts;  // .slg. expand to be a map/hash table per ip address/interface
    PortAllocationMap mTcpAllocationPorts;
    unsigned short mLastAllocatedUdpPort;
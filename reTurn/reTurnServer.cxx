@@ -1,6 +1,10 @@
 #include <iostream>
 #include <csignal>
 #include <string>
+#include <vector>
+#ifndef WIN32
+#include <unistd.h>
+#endif
 #include <asio.hpp>
 #ifdef USE_SSL
 #include <asio/ssl.hpp>
@@ -23,6 +27,96 @@
 
 #define RESIPROCATE_SUBSYSTEM ReTurnSubsystem::RETURN
 
+namespace
+{
+
+// The STUN/TURN transports run by one IO thread.  With more than one IO thread,
+// every thread binds its own copy of each transport to the same address and port
+// (using SO_REUSEPORT), and the OS spreads incoming traffic across them.
+class TransportSet
+{
+public:
+   TransportSet(asio::io_service& ioService, reTurn::RequestHandler& requestHandler, const reTurn::ReTurnConfig& reTurnConfig, bool reusePort)
+   {
+      mUdpTurnServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort, reusePort));
+      mTcpTurnServer.reset(new reTurn::TcpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort, reusePort));
+      if(reTurnConfig.mTlsTurnPort != 0)
+      {
+         mTlsTurnServer.reset(new reTurn::TlsServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTlsTurnPort, reusePort));
+      }
+
+#ifdef USE_IPV6
+      mUdpV6TurnServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort, reusePort));
+      mTcpV6TurnServer.reset(new reTurn::TcpServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort, reusePort));
+      if(reTurnConfig.mTlsTurnPort != 0)
+      {
+         mTlsV6TurnServer.reset(new reTurn::TlsServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTlsTurnPort, reusePort));
+      }
+#endif
+
+      if(reTurnConfig.mAltStunPort != 0) // if alt stun port is non-zero, then RFC3489 support is enabled
+      {
+         mA1p2StunUdpServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mAltStunPort, reusePort));
+         mA2p1StunUdpServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mTurnPort, reusePort));
+         mA2p2StunUdpServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mAltStunPort, reusePort));
+         mUdpTurnServer->setAlternateUdpServers(mA1p2StunUdpServer.get(), mA2p1StunUdpServer.get(), mA2p2StunUdpServer.get());
+         mA1p2StunUdpServer->setAlternateUdpServers(mUdpTurnServer.get(), mA2p2StunUdpServer.get(), mA2p1StunUdpServer.get());
+         mA2p1StunUdpServer->setAlternateUdpServers(mA2p2StunUdpServer.get(), mUdpTurnServer.get(), mA1p2StunUdpServer.get());
+         mA2p2StunUdpServer->setAlternateUdpServers(mA2p1StunUdpServer.get(), mA1p2StunUdpServer.get(), mUdpTurnServer.get());
+      }
+   }
+
+   void start()
+   {
+      if(mA1p2StunUdpServer)
+      {
+         mA1p2StunUdpServer->start();
+         mA2p1StunUdpServer->start();
+         mA2p2StunUdpServer->start();
+      }
+
+      mUdpTurnServer->start();
+      mTcpTurnServer->start();
+      if(mTlsTurnServer)
+      {
+         mTlsTurnServer->start();
+      }
+
+#ifdef USE_IPV6
+      mUdpV6TurnServer->start();
+      mTcpV6TurnServer->start();
+      if(mTlsV6TurnServer)
+      {
+         mTlsV6TurnServer->start();
+      }
+#endif
+   }
+
+private:
+   boost::shared_ptr<reTurn::UdpServer> mUdpTurnServer;  // also a1p1StunUdpServer
+   boost::shared_ptr<reTurn::TcpServer> mTcpTurnServer;
+   boost::shared_ptr<reTurn::TlsServer> mTlsTurnServer;
+   boost::shared_ptr<reTurn::UdpServer> mA1p2StunUdpServer;
+   boost::shared_ptr<reTurn::UdpServer> mA2p1StunUdpServer;
+   boost::shared_ptr<reTurn::UdpServer> mA2p2StunUdpServer;
+
+#ifdef USE_IPV6
+   boost::shared_ptr<reTurn::UdpServer> mUdpV6TurnServer;
+   boost::shared_ptr<reTurn::TcpServer> mTcpV6TurnServer;
+   boost::shared_ptr<reTurn::TlsServer> mTlsV6TurnServer;
+#endif
+};
+
+void stopIOServices(std::vector<boost::shared_ptr<asio::io_service> >& ioServices)
+{
+   for(unsigned int i = 0; i < ioServices.size(); i++)
+   {
+      ioServices[i]->stop();
+   }
+}
+
+}
+
 #if defined(_WIN32)
 
 boost::function0<void> console_ctrl_function;
@@ -99,74 +193,49 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
       resip::GenericLogImpl::MaxLineCount = reTurnConfig.mLoggingFileMaxLineCount;
 
       // Initialize server.
-      asio::io_service ioService;                                // The one and only ioService for the stunServer
-      reTurn::TurnManager turnManager(ioService, reTurnConfig);  // The one and only Turn Manager
-
-      boost::shared_ptr<reTurn::UdpServer> udpTurnServer;  // also a1p1StunUdpServer
-      boost::shared_ptr<reTurn::TcpServer> tcpTurnServer;
-      boost::shared_ptr<reTurn::TlsServer> tlsTurnServer;
-      boost::shared_ptr<reTurn::UdpServer> a1p2StunUdpServer;
-      boost::shared_ptr<reTurn::UdpServer> a2p1StunUdpServer;
-      boost::shared_ptr<reTurn::UdpServer> a2p2StunUdpServer;
-
-#ifdef USE_IPV6
-      boost::shared_ptr<reTurn::UdpServer> udpV6TurnServer;
-      boost::shared_ptr<reTurn::TcpServer> tcpV6TurnServer;
-      boost::shared_ptr<reTurn::TlsServer> tlsV6TurnServer;
-#endif
-
-      // The one and only RequestHandler - if altStunPort is non-zero, then assume RFC3489 support is enabled and pass settings to request handler
-      reTurn::RequestHandler requestHandler(turnManager, 
-         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnAddress : 0, 
-         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnPort : 0, 
-         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunAddress : 0, 
-         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunPort : 0); 
-
-      udpTurnServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort));
-      tcpTurnServer.reset(new reTurn::TcpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTurnPort));
-      if(reTurnConfig.mTlsTurnPort != 0)
+      unsigned int numThreads = reTurnConfig.mIOThreads;
+      if(numThreads == 0)
       {
-         tlsTurnServer.reset(new reTurn::TlsServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mTlsTurnPort));
+#ifndef WIN32
+         long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+         numThreads = cpus > 0 ? (unsigned int)cpus : 1;
+#else
+         numThreads = 1;
+#endif
       }
-
-#ifdef USE_IPV6
-      udpV6TurnServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort));
-      tcpV6TurnServer.reset(new reTurn::TcpServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTurnPort));
-      if(reTurnConfig.mTlsTurnPort != 0)
+#ifndef SO_REUSEPORT
+      if(numThreads > 1)
       {
-         tlsV6TurnServer.reset(new reTurn::TlsServer(ioService, requestHandler, reTurnConfig.mTurnV6Address, reTurnConfig.mTlsTurnPort));
+         WarningLog(<< "IOThreads = " << numThreads << " requires SO_REUSEPORT, which is not available on this platform; using 1 thread");
+         numThreads = 1;
       }
 #endif
 
-      if(reTurnConfig.mAltStunPort != 0) // if alt stun port is non-zero, then RFC3489 support is enabled
+      // One ioService per thread - each runs its own set of transports, and every allocation
+      // (relay socket and timers) lives on the ioService of the transport that created it
+      std::vector<boost::shared_ptr<asio::io_service> > ioServices;
+      for(unsigned int i = 0; i < numThreads; i++)
       {
-         a1p2StunUdpServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mTurnAddress, reTurnConfig.mAltStunPort));
-         a2p1StunUdpServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mTurnPort));
-         a2p2StunUdpServer.reset(new reTurn::UdpServer(ioService, requestHandler, reTurnConfig.mAltStunAddress, reTurnConfig.mAltStunPort));
-         udpTurnServer->setAlternateUdpServers(a1p2StunUdpServer.get(), a2p1StunUdpServer.get(), a2p2StunUdpServer.get());
-         a1p2StunUdpServer->setAlternateUdpServers(udpTurnServer.get(), a2p2StunUdpServer.get(), a2p1StunUdpServer.get());
-         a2p1StunUdpServer->setAlternateUdpServers(a2p2StunUdpServer.get(), udpTurnServer.get(), a1p2StunUdpServer.get());
-         a2p2StunUdpServer->setAlternateUdpServers(a2p1StunUdpServer.get(), a1p2StunUdpServer.get(), udpTurnServer.get());
-         a1p2StunUdpServer->start();
-         a2p1StunUdpServer->start();
-         a2p2StunUdpServer->start();
+         ioServices.push_back(boost::shared_ptr<asio::io_service>(new asio::io_service));
       }
+      reTurn::TurnManager turnManager(*ioServices[0], reTurnConfig);  // The one and only Turn Manager
 
-      udpTurnServer->start();
-      tcpTurnServer->start();
-      if(tlsTurnServer)
+      // The one and only RequestHandler - if altStunPort is non-zero, then assume RFC3489 support is enabled and pass settings to request handler
+      reTurn::RequestHandler requestHandler(turnManager, 
+         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnAddress : 0, 
+         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mTurnPort : 0, 
+         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunAddress : 0, 
+         reTurnConfig.mAltStunPort != 0 ? &reTurnConfig.mAltStunPort : 0); 
+
+      std::vector<boost::shared_ptr<TransportSet> > transportSets;
+      for(unsigned int i = 0; i < numThreads; i++)
       {
-         tlsTurnServer->start();
+         transportSets.push_back(boost::shared_ptr<TransportSet>(new TransportSet(*ioServices[i], requestHandler, reTurnConfig, numThreads > 1)));
       }
-
-#ifdef USE_IPV6
-      udpV6TurnServer->start();
-      tcpV6TurnServer->start();
-      if(tlsV6TurnServer)
+      for(unsigned int i = 0; i < numThreads; i++)
       {
-         tlsV6TurnServer->start();
+         transportSets[i]->start();
       }
-#endif
 
       // Drop privileges (can do this now that sockets are bound)
       if(!reTurnConfig.mRunAsUser.empty())
@@ -175,25 +244,29 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
          dropPrivileges(reTurnConfig.mRunAsUser, reTurnConfig.mRunAsGroup);
       }
 
-      ReTurnUserFileScanner userFileScanner(ioService, reTurnConfig);
+      ReTurnUserFileScanner userFileScanner(*ioServices[0], reTurnConfig);
       userFileScanner.start();
 
 #ifdef _WIN32
       // Set console control handler to allow server to be stopped.
-      console_ctrl_function = boost::bind(&asio::io_service::stop, &ioService);
+      console_ctrl_function = boost::bind(&stopIOServices, boost::ref(ioServices));
       SetConsoleCtrlHandler(console_ctrl_handler, TRUE);
 #else
-      // Block all signals for background thread.
+      // Block all signals for background threads.
       sigset_t new_mask;
       sigfillset(&new_mask);
       sigset_t old_mask;
       pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
 #endif
 
-      // Run the ioService until stopped.
-      // Create a pool of threads to run all of the io_services.
-      boost::shared_ptr<asio::thread> thread(new asio::thread(
-         boost::bind(&asio::io_service::run, &ioService)));
+      // Run each ioService on its own thread until stopped.
+      InfoLog(<< "Starting " << numThreads << " IO thread(s)");
+      std::vector<boost::shared_ptr<asio::thread> > threads;
+      for(unsigned int i = 0; i < numThreads; i++)
+      {
+         threads.push_back(boost::shared_ptr<asio::thread>(new asio::thread(
+            boost::bind(&asio::io_service::run, ioServices[i].get()))));
+      }
 
 #ifndef _WIN32
       // Restore previous signals.
@@ -208,11 +281,14 @@ reTurn::ReTurnServerProcess::main(int argc, char* argv[])
       pthread_sigmask(SIG_BLOCK, &wait_mask, 0);
       int sig = 0;
       sigwait(&wait_mask, &sig);
-      ioService.stop();
+      stopIOServices(ioServices);
 #endif
 
-      // Wait for thread to exit
-      thread->join();
+      // Wait for threads to exit
+      for(unsigned int i = 0; i < threads.size(); i++)
+      {
+         threads[i]->join();
+      }
    }
    catch (std::exception& e)
    {
@@ -0,0 +1,253 @@
+// Checks the DataBufferPool, and measures the cost of the per packet buffer
+// handling on the relay data path, plus the throughput of a UDP relay over
+// loopback.
+
+#include <cassert>
+#include <deque>
+#include <iostream>
+#include <string.h>
+#include <asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <rutil/Log.hxx>
+#include <rutil/Logger.hxx>
+#include <rutil/Timer.hxx>
+
+#include "../AsyncUdpSocketBase.hxx"
+#include "../DataBuffer.hxx"
+#include "../StunTuple.hxx"
+
+using namespace reTurn;
+using namespace std;
+
+#define RESIPROCATE_SUBSYSTEM resip::Subsystem::TEST
+
+static const unsigned int PacketSize = 172;  // 20ms of G.711, plus RTP header
+
+static void
+testPool()
+{
+   cerr << "!! Test pool" << endl;
+
+   boost::shared_ptr<DataBuffer> small = DataBufferPool::createBuffer(4);
+   boost::shared_ptr<DataBuffer> large = DataBufferPool::createBuffer(RECEIVE_BUFFER_SIZE);
+   boost::shared_ptr<DataBuffer> huge = DataBufferPool::createBuffer(DataBufferPool::LargeBlockSize + 1);
+   boost::shared_ptr<DataBuffer> empty = DataBufferPool::createBuffer(0);
+   assert(small->size() == 4);
+   assert(large->size() == RECEIVE_BUFFER_SIZE);
+   assert(huge->size() == DataBufferPool::LargeBlockSize + 1);
+   assert(empty->size() == 0);
+   memset(large->mutableData(), 'x', large->size());
+   memset(huge->mutableData(), 'y', huge->size());
+
+   // Freed blocks are handed out again, most recently freed first
+   const char* largeData = large->data();
+   large.reset();
+   boost::shared_ptr<DataBuffer> again = DataBufferPool::createBuffer(PacketSize);
+   assert(again->data() == largeData);
+
+   // allocateBuffer zeroes, even when it reuses a block
+   again.reset();
+   boost::shared_ptr<DataBuffer> zeroed = AsyncSocketBase::allocateBuffer(PacketSize);
+   for(unsigned int i = 0; i < PacketSize; i++)
+   {
+      assert((*zeroed)[i] == 0);
+   }
+
+   // offset and truncate still work on pooled buffers
+   zeroed->offset(4);
+   zeroed->truncate(10);
+   assert(zeroed->size() == 10);
+
+   // The pool allocator works with standard containers
+   deque<int, DataBufferPoolAllocator<int> > queue;
+   for(int i = 0; i < 10000; i++)
+   {
+      queue.push_back(i);
+   }
+   for(int i = 0; i < 10000; i++)
+   {
+      assert(queue.front() == i);
+      queue.pop_front();
+   }
+}
+
+class SendData
+{
+public:
+   SendData(boost::shared_ptr<DataBuffer>& frame, boost::shared_ptr<DataBuffer>& data) : mFrame(frame), mData(data) {}
+   boost::shared_ptr<DataBuffer> mFrame;
+   boost::shared_ptr<DataBuffer> mData;
+};
+
+// What the relay does for each ChannelData packet it forwards:  a receive
+// buffer, a framing buffer, and a trip through the send queue.
+template<class Queue>
+static void
+relayPackets(int count, bool pooled)
+{
+   Queue queue;
+   for(int i = 0; i < count; i++)
+   {
+      boost::shared_ptr<DataBuffer> data = pooled ? DataBufferPool::createBuffer(RECEIVE_BUFFER_SIZE) : 
+                                                    boost::shared_ptr<DataBuffer>(new DataBuffer(RECEIVE_BUFFER_SIZE));
+      data->truncate(PacketSize);
+      boost::shared_ptr<DataBuffer> frame = pooled ? DataBufferPool::createBuffer(4) : 
+                                                     boost::shared_ptr<DataBuffer>(new DataBuffer(4));
+      queue.push_back(SendData(frame, data));
+      // Keep a few packets queued, as a busy socket would
+      if(queue.size() > 8)
+      {
+         queue.pop_front();
+      }
+   }
+}
+
+static void
+testBufferPerformance()
+{
+   const int count = 1000000;
+   cerr << "!! Buffer handling for " << count << " relayed packets" << endl;
+
+   UInt64 start = resip::Timer::getTimeMicroSec();
+   relayPackets<deque<SendData> >(count, false);
+   UInt64 heap = resip::Timer::getTimeMicroSec();
+   relayPackets<deque<SendData, DataBufferPoolAllocator<SendData> > >(count, true);
+   UInt64 pool = resip::Timer::getTimeMicroSec();
+
+   cerr << "heap: " << (heap - start)/1000 << "ms (" << (double)(heap - start)*1000/count << "ns/packet)" << endl;
+   cerr << "pool: " << (pool - heap)/1000 << "ms (" << (double)(pool - heap)*1000/count << "ns/packet)" << endl;
+}
+
+// Relays everything it receives back to the sender, ChannelData framed, the
+// way a TURN server relays peer data to a client.
+class EchoRelay : public AsyncUdpSocketBase
+{
+public:
+   EchoRelay(asio::io_service& ioService) : AsyncUdpSocketBase(ioService), mRelayed(0) {}
+
+   virtual void onReceiveSuccess(const asio::ip::address& address, unsigned short port, boost::shared_ptr<DataBuffer>& data)
+   {
+      ++mRelayed;
+      doSend(StunTuple(StunTuple::UDP, address, port), 0x4000, data);
+      doReceive();
+   }
+   virtual void onReceiveFailure(const asio::error_code& e)
+   {
+      if(e != asio::error::operation_aborted)
+      {
+         doReceive();
+      }
+   }
+   virtual void onSendSuccess() {}
+   virtual void onSendFailure(const asio::error_code& e) {}
+
+   asio::ip::udp::endpoint localEndpoint() { return mSocket.local_endpoint(); }
+
+   unsigned long mRelayed;
+};
+
+static void
+testRelayThroughput()
+{
+   const int count = 200000;
+   const int window = 32;
+   cerr << "!! Relay throughput over loopback, " << count << " packets of " << PacketSize << " bytes" << endl;
+
+   asio::io_service ioService;
+   boost::shared_ptr<EchoRelay> relay(new EchoRelay(ioService));
+   asio::error_code ec = relay->bind(asio::ip::address::from_string("127.0.0.1"), 0);
+   assert(!ec);
+   asio::ip::udp::endpoint relayEndpoint = relay->localEndpoint();
+   relay->receive();
+   asio::thread thread(boost::bind(&asio::io_service::run, &ioService));
+
+   asio::io_service clientService;
+   asio::ip::udp::socket client(clientService, asio::ip::udp::endpoint(asio::ip::address::from_string("127.0.0.1"), 0));
+   struct timeval timeout = { 1, 0 };
+   setsockopt(client.native(), SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+   char packet[PacketSize];
+   memset(packet, 0xa5, sizeof(packet));
+   char received[RECEIVE_BUFFER_SIZE];
+   asio::ip::udp::endpoint sender;
+
+   int sent = 0;
+   int echoed = 0;
+   int lost = 0;
+   UInt64 start = resip::Timer::getTimeMicroSec();
+   while(echoed + lost < count)
+   {
+      while(sent < count && sent - echoed - lost < window)
+      {
+         client.send_to(asio::buffer(packet, sizeof(packet)), relayEndpoint);
+         ++sent;
+      }
+      size_t size = client.receive_from(asio::buffer(received, sizeof(received)), sender, 0, ec);
+      if(ec)
+      {
+         // Timed out - count whatever is still outstanding as lost
+         lost = sent - echoed;
+         continue;
+      }
+      assert(size == PacketSize + 4);
+      ++echoed;
+   }
+   UInt64 elapsed = resip::Timer::getTimeMicroSec() - start;
+
+   ioService.stop();
+   thread.join();
+
+   cerr << "relayed " << echoed << " packets (" << lost << " lost) in " << elapsed/1000 << "ms: " 
+        << (elapsed ? (UInt64)echoed*1000000/elapsed : 0) << " packets/s" << endl;
+   assert(echoed > 0);
+}
+
+int 
+main(int argc, char* argv[])
+{
+   resip::Log::initialize(resip::Log::Cout, resip::Log::Warning, argv[0]);
+
+   testPool();
+   testBufferPerformance();
+   testRelayThroughput();
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+
+/* ====================================================================
+
+ Copyright (c) 2007-2008, Plantronics, Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are 
+ met:
+
+ 1. Redistributions of source code must retain the above copyright 
+    notice, this list of conditions and the following disclaimer. 
+
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution. 
+
+ 3. Neither the name of Plantronics nor the names of its contributors 
+    may be used to endorse or promote products derived from this 
+    software without specific prior written permission. 
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==================================================================== */
@@ -27,6 +27,142 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::REPRO
 
+// Returns the address bytes of address in network order, and sets numBits
+// to their length in bits; returns 0 for address families we don't know.
+static const unsigned char*
+addressBits(const Tuple& address, int& numBits)
+{
+   if(address.getSockaddr().sa_family == AF_INET)
+   {
+      numBits = 32;
+      return (const unsigned char*)&((const sockaddr_in&)address.getSockaddr()).sin_addr;
+   }
+#ifdef USE_IPV6
+   else if(address.getSockaddr().sa_family == AF_INET6)
+   {
+      numBits = 128;
+      return (const unsigned char*)&((const sockaddr_in6&)address.getSockaddr()).sin6_addr;
+   }
+#endif
+   numBits = 0;
+   return 0;
+}
+
+static inline int
+bitAt(const unsigned char* bits, int i)
+{
+   return (bits[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+
+AclStore::AclTable::TrieNode::TrieNode()
+{
+   mChildren[0] = 0;
+   mChildren[1] = 0;
+}
+
+
+AclStore::AclTable::AclTable() :
+   mV4Trie(1),
+   mV6Trie(1)
+{
+}
+
+
+void
+AclStore::AclTable::add(const TlsPeerNameRecord& record)
+{
+   Data name(record.mTlsPeerName);
+   mTlsPeerNames.insert(name.lowercase());
+}
+
+
+void
+AclStore::AclTable::add(const AddressRecord& record)
+{
+   int numBits = 0;
+   const unsigned char* bits = addressBits(record.mAddressTuple, numBits);
+   if(!bits)
+   {
+      return;
+   }
+   Trie& trie = numBits == 32 ? mV4Trie : mV6Trie;
+
+   // The record can only match addresses that share its first mask bits,
+   // so it goes at that depth on its own address's path.
+   const int depth = resipMin((int)record.mMask, numBits);
+   size_t node = 0;
+   for(int i = 0; i < depth; ++i)
+   {
+      const int bit = bitAt(bits, i);
+      if(trie[node].mChildren[bit] == 0)
+      {
+         trie[node].mChildren[bit] = trie.size();
+         trie.push_back(TrieNode());
+      }
+      node = trie[node].mChildren[bit];
+   }
+   trie[node].mAddresses.push_back(mAddresses.size());
+   mAddresses.push_back(record);
+}
+
+
+bool
+AclStore::AclTable::isTlsPeerNameTrusted(const Data& tlsPeerName) const
+{
+   Data name(tlsPeerName);
+   return mTlsPeerNames.find(name.lowercase()) != mTlsPeerNames.end();
+}
+
+
+bool
+AclStore::AclTable::isAddressTrusted(const Tuple& address) const
+{
+   int numBits = 0;
+   const unsigned char* bits = addressBits(address, numBits);
+   if(!bits)
+   {
+      return false;
+   }
+   const Trie& trie = numBits == 32 ? mV4Trie : mV6Trie;
+
+   // Every record that could match is on this address's path; the full
+   // check (port, transport and mask) is still done by the record itself.
+   size_t node = 0;
+   for(int i = 0; ; ++i)
+   {
+      const std::vector<size_t>& records = trie[node].mAddresses;
+      for(std::vector<size_t>::const_iterator r = records.begin(); r != records.end(); ++r)
+      {
+         const AddressRecord& rec = mAddresses[*r];
+         if(rec.mAddressTuple.isEqualWithMask(address, rec.mMask, rec.mAddressTuple.getPort() == 0))
+         {
+            return true;
+         }
+      }
+      if(i == numBits || (node = trie[node].mChildren[bitAt(bits, i)]) == 0)
+      {
+         return false;
+      }
+   }
+}
+
+
+void
+AclStore::publishAclTable()
+{
+   AclTable* table = new AclTable;
+   for(TlsPeerNameList::const_iterator i = mTlsPeerNameList.begin(); i != mTlsPeerNameList.end(); ++i)
+   {
+      table->add(*i);
+   }
+   for(AddressList::const_iterator i = mAddressList.begin(); i != mAddressList.end(); ++i)
+   {
+      table->add(*i);
+   }
+   mAclTable.reset(table);
+}
+
 AclStore::AclStore(AbstractDb& db):
    mDb(db)
 {  
@@ -52,6 +188,7 @@ AclStore::AclStore(AbstractDb& db):
    } 
    mTlsPeerNameCursor = mTlsPeerNameList.begin();
    mAddressCursor = mAddressList.begin();
+   publishAclTable();
 }
 
 AclStore::~AclStore()
@@ -114,6 +251,7 @@ AclStore::addAcl(const resip::Data& tlsPeerName,
          WriteLock lock(mMutex);
          mAddressList.push_back(addressRecord);
          mAddressCursor = mAddressList.begin();  // Put cursor back at start
+         publishAclTable();
       }
    }
    else
@@ -125,6 +263,7 @@ AclStore::addAcl(const resip::Data& tlsPeerName,
          WriteLock lock(mMutex);
          mTlsPeerNameList.push_back(tlsPeerNameRecord); 
          mTlsPeerNameCursor = mTlsPeerNameList.begin(); // Put cursor back at start
+         publishAclTable();
       }
    }
    return true;
@@ -311,6 +450,7 @@ AclStore::eraseAcl(const resip::Data& key)
       if(findAddressKey(key))
       {
          mAddressCursor = mAddressList.erase(mAddressCursor);
+         publishAclTable();
       }
    }
    else
@@ -319,6 +459,7 @@ AclStore::eraseAcl(const resip::Data& key)
       if(findTlsPeerNameKey(key))
       {
          mTlsPeerNameCursor = mTlsPeerNameList.erase(mTlsPeerNameCursor);
+         publishAclTable();
       }
    }
 }
@@ -496,16 +637,13 @@ AclStore::getAddressMask( const resip::Data& key )
 bool 
 AclStore::isTlsPeerNameTrusted(const std::list<Data>& tlsPeerNames)
 {
-   ReadLock lock(mMutex);
+   SnapshotPtr<AclTable>::Reader table(mAclTable);
    for(std::list<Data>::const_iterator it = tlsPeerNames.begin(); it != tlsPeerNames.end(); it++)
    {
-      for(TlsPeerNameList::iterator i = mTlsPeerNameList.begin(); i != mTlsPeerNameList.end(); i++)
+      if(table->isTlsPeerNameTrusted(*it))
       {
-         if(isEqualNoCase(i->mTlsPeerName, *it))
-         {
-            InfoLog (<< "AclStore - Tls peer name IS trusted: " << *it);
-            return true;
-         }
+         InfoLog (<< "AclStore - Tls peer name IS trusted: " << *it);
+         return true;
       }
    }
    return false;
@@ -515,15 +653,8 @@ AclStore::isTlsPeerNameTrusted(const std::list<Data>& tlsPeerNames)
 bool 
 AclStore::isAddressTrusted(const Tuple& address)
 {
-   ReadLock lock(mMutex);
-   for(AddressList::iterator i = mAddressList.begin(); i != mAddressList.end(); i++)
-   {
-      if(i->mAddressTuple.isEqualWithMask(address, i->mMask, i->mAddressTuple.getPort() == 0))
-      {
-         return true;
-      }
-   }
-   return false;
+   SnapshotPtr<AclTable>::Reader table(mAclTable);
+   return table->isAddressTrusted(address);
 }
 
 
@@ -2,8 +2,11 @@
 #define REPRO_ACLSTORE_HXX
 
 #include <list>
+#include <set>
+#include <vector>
 #include "rutil/Data.hxx"
 #include "rutil/RWMutex.hxx"
+#include "rutil/SnapshotPtr.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/Tuple.hxx"
 #include "repro/AbstractDb.hxx"
@@ -88,6 +91,42 @@ class AclStore
       TlsPeerNameList::iterator mTlsPeerNameCursor;
       AddressList mAddressList;
       AddressList::iterator mAddressCursor;
+
+      // Read-only view of the lists above that the isXxxTrusted() checks
+      // work from, without taking mMutex. Address ACLs are kept in a binary
+      // trie per IP version, at the depth given by their mask, so checking
+      // an address only looks at the ACLs on that address's path through
+      // the trie.
+      class AclTable
+      {
+         public:
+            AclTable();
+            void add(const TlsPeerNameRecord& record);
+            void add(const AddressRecord& record);
+            bool isTlsPeerNameTrusted(const resip::Data& tlsPeerName) const;
+            bool isAddressTrusted(const resip::Tuple& address) const;
+
+         private:
+            class TrieNode
+            {
+               public:
+                  TrieNode();
+                  // Indices into mNodes; 0 (the root) means no child
+                  size_t mChildren[2];
+                  // Indices into mAddresses
+                  std::vector<size_t> mAddresses;
+            };
+            typedef std::vector<TrieNode> Trie;
+
+            std::set<resip::Data> mTlsPeerNames; // lowercase
+            AddressList mAddresses;
+            Trie mV4Trie;
+            Trie mV6Trie;
+      };
+
+      // Rebuilds the AclTable from the lists; call with mMutex write-locked.
+      void publishAclTable();
+      resip::SnapshotPtr<AclTable> mAclTable;
 };
 
 }
@@ -23,6 +23,72 @@ bool FilterStore::FilterOp::operator<(const FilterOp& rhs) const
 }
 
 
+FilterStore::ConditionHeader::ConditionHeader(const Data& headerName) :
+   mKind(Extension),
+   mType(Headers::UNKNOWN),
+   mName(headerName)
+{
+   if(isEqualNoCase(headerName, "request-line"))
+   {
+      mKind = RequestLine;
+   }
+   else
+   {
+      mType = Headers::getType(headerName.c_str(), headerName.size());
+      if(mType != Headers::UNKNOWN)
+      {
+         mKind = Standard;
+      }
+   }
+}
+
+
+void
+FilterStore::FilterTable::add(const FilterOp& filter)
+{
+   Filter f;
+   f.mOp = filter;
+   f.mCondition1 = -1;
+   f.mCondition2 = -1;
+   if(!filter.filterRecord.mCondition1Header.empty() && filter.pcond1)
+   {
+      f.mCondition1 = headerIndex(filter.filterRecord.mCondition1Header);
+   }
+   if(!filter.filterRecord.mCondition2Header.empty() && filter.pcond2)
+   {
+      f.mCondition2 = headerIndex(filter.filterRecord.mCondition2Header);
+   }
+   mFilters.push_back(f);
+}
+
+
+int
+FilterStore::FilterTable::headerIndex(const Data& headerName)
+{
+   for(size_t i = 0; i < mHeaders.size(); ++i)
+   {
+      if(isEqualNoCase(mHeaders[i].mName, headerName))
+      {
+         return (int)i;
+      }
+   }
+   mHeaders.push_back(ConditionHeader(headerName));
+   return (int)mHeaders.size() - 1;
+}
+
+
+void
+FilterStore::publishFilterTable()
+{
+   FilterTable* table = new FilterTable;
+   for(FilterOpList::const_iterator i = mFilterOperators.begin(); i != mFilterOperators.end(); ++i)
+   {
+      table->add(*i);
+   }
+   mFilterTable.reset(table);
+}
+
+
 FilterStore::FilterStore(AbstractDb& db):
    mDb(db)
 {  
@@ -72,6 +138,7 @@ FilterStore::FilterStore(AbstractDb& db):
       key = mDb.nextFilterKey();
    } 
    mCursor = mFilterOperators.begin();
+   publishFilterTable();
 }
 
 
@@ -160,8 +227,9 @@ FilterStore::addFilter(const resip::Data& cond1Header,
    {
       WriteLock lock(mMutex);
       mFilterOperators.insert( filter );
+      mCursor = mFilterOperators.begin(); 
+      publishFilterTable();
    }
-   mCursor = mFilterOperators.begin(); 
 
    return true;
 }
@@ -205,6 +273,7 @@ FilterStore::eraseFilter(const resip::Data& key)
    {
       WriteLock lock(mMutex);
 
+      std::vector<regex_t*> erased;
       FilterOpList::iterator it = mFilterOperators.begin();
       while (it != mFilterOperators.end())
       {
@@ -214,13 +283,11 @@ FilterStore::eraseFilter(const resip::Data& key)
             it++;
             if(i->pcond1)
             {
-               regfree(i->pcond1);
-               delete i->pcond1;
+               erased.push_back(i->pcond1);
             }
             if(i->pcond2)
             {
-               regfree(i->pcond2);
-               delete i->pcond2;
+               erased.push_back(i->pcond2);
             }
             mFilterOperators.erase(i);
          }
@@ -229,8 +296,17 @@ FilterStore::eraseFilter(const resip::Data& key)
             it++;
          }
       }
+      mCursor = mFilterOperators.begin();  // reset the cursor since it may have been on deleted filter
+
+      // Once the new table is published, nothing can be using the erased
+      // filters' regexes anymore.
+      publishFilterTable();
+      for(std::vector<regex_t*>::iterator i = erased.begin(); i != erased.end(); ++i)
+      {
+         regfree(*i);
+         delete *i;
+      }
    }
-   mCursor = mFilterOperators.begin();  // reset the cursor since it may have been on deleted filter
 }
 
 
@@ -325,30 +401,29 @@ FilterStore::getFilterRecord(const resip::Data& key)
 
 
 void
-FilterStore::getHeaderFromSipMessage(const SipMessage& msg, const Data& headerName, list<Data>& headerList)
+FilterStore::getHeaderFromSipMessage(const SipMessage& msg, const ConditionHeader& header, list<Data>& headerList)
 {
-   // First see if header string is "request-line"
-   if(isEqualNoCase(headerName, "request-line"))
+   if(header.mKind == ConditionHeader::RequestLine)
    {
       headerList.push_back(Data::from(msg.header(h_RequestLine)));
-      return;
    }
-  
-   // Next check to see if it is a standard header
-   Headers::Type headerType = Headers::getType(headerName.c_str(), headerName.size());
-   if(headerType != Headers::UNKNOWN)
+   else if(header.mKind == ConditionHeader::Standard)
    {
       Data headerData;
-      const HeaderFieldValueList* hfv = msg.getRawHeader(headerType);
+      const HeaderFieldValueList* hfv = msg.getRawHeader(header.mType);
+      if(!hfv)
+      {
+         return;
+      }
       for(HeaderFieldValueList::const_iterator it = hfv->begin(); it != hfv->end(); it++)
       {
          it->toShareData(headerData);
          headerList.push_back(headerData);
       }
    }
-   else // Check if custom header
+   else // Custom header
    {
-      ExtensionHeader exHeader(headerName);
+      ExtensionHeader exHeader(header.mName);
       if(msg.exists(exHeader))
       {
          const StringCategories& exHeaders = msg.header(exHeader);
@@ -426,17 +501,21 @@ FilterStore::process(const SipMessage& request,
                      short& action,
                      Data& actionData)
 {
-   if(mFilterOperators.empty()) return false;  // If there are no filters bail early to save a few cycles (size check is atomic enough, we don't need a lock)
-
-   ReadLock lock(mMutex);
+   SnapshotPtr<FilterTable>::Reader table(mFilterTable);
+   if(table->mFilters.empty()) return false;  // If there are no filters bail early to save a few cycles
 
    Data method(request.methodStr());
    Data event(request.exists(h_Event) ? request.header(h_Event).value() : Data::Empty);
 
-   for (FilterOpList::iterator it = mFilterOperators.begin();
-        it != mFilterOperators.end(); it++)
+   // Values of the headers in table->mHeaders, fetched from the request the
+   // first time a condition needs them
+   std::vector<list<Data> > headers(table->mHeaders.size());
+   std::vector<bool> fetched(table->mHeaders.size(), false);
+
+   for (std::vector<FilterTable::Filter>::const_iterator it = table->mFilters.begin();
+        it != table->mFilters.end(); it++)
    {
-      const AbstractDb::FilterRecord& rec = it->filterRecord;
+      const AbstractDb::FilterRecord& rec = it->mOp.filterRecord;
 
       if(!rec.mMethod.empty())
       {
@@ -455,20 +534,23 @@ FilterStore::process(const SipMessage& request,
          }
       }
 
-      // Get requests SIP headers from SipMessage
-      list<Data> condition1Headers;
-      list<Data> condition2Headers;
       actionData = rec.mActionData;
-      if(!rec.mCondition1Header.empty() && it->pcond1)
+      if(it->mCondition1 >= 0)
       {
-         getHeaderFromSipMessage(request, rec.mCondition1Header, condition1Headers);
+         // Get requests SIP headers from SipMessage
+         if(!fetched[it->mCondition1])
+         {
+            getHeaderFromSipMessage(request, table->mHeaders[it->mCondition1], headers[it->mCondition1]);
+            fetched[it->mCondition1] = true;
+         }
+         const list<Data>& condition1Headers = headers[it->mCondition1];
 
          // Check condition 1 regex
-         list<Data>::iterator hit = condition1Headers.begin();
+         list<Data>::const_iterator hit = condition1Headers.begin();
          bool match = false;
          for(; hit != condition1Headers.end() && match == false; hit++)
          {
-            match = applyRegex(1, *hit, rec.mCondition1Regex, it->pcond1, actionData);
+            match = applyRegex(1, *hit, rec.mCondition1Regex, it->mOp.pcond1, actionData);
             DebugLog( << "  Cond1 HeaderName=" << rec.mCondition1Header << ", Value=" << *hit << ", Regex=" << rec.mCondition1Regex << ", match=" << match);
          }
          if(!match)
@@ -477,16 +559,21 @@ FilterStore::process(const SipMessage& request,
             continue;
          }
       }
-      if(!rec.mCondition2Header.empty() && it->pcond2)
+      if(it->mCondition2 >= 0)
       {
-         getHeaderFromSipMessage(request, rec.mCondition2Header, condition2Headers);
+         if(!fetched[it->mCondition2])
+         {
+            getHeaderFromSipMessage(request, table->mHeaders[it->mCondition2], headers[it->mCondition2]);
+            fetched[it->mCondition2] = true;
+         }
+         const list<Data>& condition2Headers = headers[it->mCondition2];
 
          // Check condition 2 regex
-         list<Data>::iterator hit = condition2Headers.begin();
+         list<Data>::const_iterator hit = condition2Headers.begin();
          bool match = false;
          for(; hit != condition2Headers.end() && match == false; hit++)
          {
-            match = applyRegex(2, *hit, rec.mCondition2Regex, it->pcond2, actionData);
+            match = applyRegex(2, *hit, rec.mCondition2Regex, it->mOp.pcond2, actionData);
             DebugLog( << "  Cond2 HeaderName=" << rec.mCondition2Header << ", Value=" << *hit << ", Regex=" << rec.mCondition2Regex << ", match=" << match);
          }
          if(!match)
@@ -511,27 +598,27 @@ FilterStore::test(const resip::Data& cond1Header,
                   short& action,
                   resip::Data& actionData)
 {
-   ReadLock lock(mMutex);
+   SnapshotPtr<FilterTable>::Reader table(mFilterTable);
 
-   for (FilterOpList::iterator it = mFilterOperators.begin();
-        it != mFilterOperators.end(); it++)
+   for (std::vector<FilterTable::Filter>::const_iterator it = table->mFilters.begin();
+        it != table->mFilters.end(); it++)
    {
-      const AbstractDb::FilterRecord& rec = it->filterRecord;
+      const AbstractDb::FilterRecord& rec = it->mOp.filterRecord;
       actionData = rec.mActionData;
 
       // Check condition 1 regex
-      if(!rec.mCondition1Header.empty() && it->pcond1)
+      if(it->mCondition1 >= 0)
       {
-         if(!applyRegex(1, cond1Header, rec.mCondition1Regex, it->pcond1, actionData))
+         if(!applyRegex(1, cond1Header, rec.mCondition1Regex, it->mOp.pcond1, actionData))
          {
             continue;
          }
       }
 
       // Check condition 2 regex
-      if(!rec.mCondition2Header.empty() && it->pcond2)
+      if(it->mCondition2 >= 0)
       {
-         if(!applyRegex(2, cond2Header, rec.mCondition2Regex, it->pcond2, actionData))
+         if(!applyRegex(2, cond2Header, rec.mCondition2Regex, it->mOp.pcond2, actionData))
          {
             continue;
          }
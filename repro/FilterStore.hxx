@@ -9,9 +9,12 @@
 
 #include <set>
 #include <list>
+#include <vector>
 
 #include "rutil/Data.hxx"
 #include "rutil/RWMutex.hxx"
+#include "rutil/SnapshotPtr.hxx"
+#include "resip/stack/HeaderTypes.hxx"
 
 #include "repro/AbstractDb.hxx"
 
@@ -91,8 +94,25 @@ class FilterStore
                    const resip::Data& method,
                    const resip::Data& event) const;
 
+      // A condition's header name, resolved once when the filter table is
+      // built rather than for every request.
+      class ConditionHeader
+      {
+         public:
+            explicit ConditionHeader(const resip::Data& headerName);
+
+            enum Kind
+            {
+               RequestLine,
+               Standard,
+               Extension
+            };
+            Kind mKind;
+            resip::Headers::Type mType;
+            resip::Data mName;
+      };
       void getHeaderFromSipMessage(const resip::SipMessage& msg, 
-                                   const resip::Data& headerName, 
+                                   const ConditionHeader& header, 
                                    std::list<resip::Data>& headerList);
       bool applyRegex(int conditionNum,
                       const resip::Data& header, 
@@ -116,6 +136,38 @@ class FilterStore
       typedef std::multiset<FilterOp> FilterOpList;
       FilterOpList mFilterOperators; 
       FilterOpList::iterator mCursor;
+
+      // Read-only view of mFilterOperators that process() and test() work
+      // from, without taking mMutex. The compiled regexes are shared with
+      // mFilterOperators, and must not be freed until a table that no
+      // longer refers to them is published.
+      class FilterTable
+      {
+         public:
+            void add(const FilterOp& filter);
+
+            class Filter
+            {
+               public:
+                  FilterOp mOp;
+                  // Index into mHeaders of the header each condition
+                  // checks, or -1 if the condition is not checked.
+                  int mCondition1;
+                  int mCondition2;
+            };
+            std::vector<Filter> mFilters;
+            // Distinct headers that conditions look at; process() gets each
+            // one from the request at most once.
+            std::vector<ConditionHeader> mHeaders;
+
+         private:
+            int headerIndex(const resip::Data& headerName);
+      };
+
+      // Rebuilds the FilterTable from mFilterOperators; call with mMutex
+      // write-locked.
+      void publishFilterTable();
+      resip::SnapshotPtr<FilterTable> mFilterTable;
 };
 
  }
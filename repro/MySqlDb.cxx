@@ -15,8 +15,11 @@
 
 #include "rutil/Data.hxx"
 #include "rutil/DataStream.hxx"
+#include "rutil/LatencyHistogram.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/ParseBuffer.hxx"
+#include "rutil/Timer.hxx"
 
 #include "repro/AbstractDb.hxx"
 #include "repro/MySqlDb.hxx"
@@ -64,22 +67,67 @@ class MySQLInitializer
 };
 static MySQLInitializer g_MySQLInitializer;
 
+// One connection to the server, along with the statements prepared on it.
+// Only the thread that has it out of the pool touches it, latencies included.
+class MySqlDb::Connection
+{
+   public:
+      Connection() : mConn(0), mInTransaction(false) {}
+
+      MYSQL* mConn;
+      typedef std::map<Data, MYSQL_STMT*> StatementMap;
+      StatementMap mStatements;
+      bool mInTransaction;
+      LatencyHistogram mLatency[MaxQueryType];
+};
+
+// Borrows a connection from the pool for as long as it is in scope.
+class MySqlDb::ConnectionLease
+{
+   public:
+      ConnectionLease(const MySqlDb& db) : mDb(db), mConnection(db.acquireConnection()) {}
+      ~ConnectionLease() { mDb.releaseConnection(mConnection); }
+
+      Connection& operator*() const { return *mConnection; }
+      Connection* operator->() const { return mConnection; }
+
+   private:
+      ConnectionLease(const ConnectionLease&);
+      ConnectionLease& operator=(const ConnectionLease&);
+
+      const MySqlDb& mDb;
+      Connection* mConnection;
+};
+
+static const char* queryTypeNames[MySqlDb::MaxQueryType] =
+{
+   "user auth",
+   "record read",
+   "record write",
+   "record erase",
+   "silo read",
+   "other"
+};
+
 MySqlDb::MySqlDb(const Data& server, 
                  const Data& user, 
                  const Data& password, 
                  const Data& databaseName, 
                  unsigned int port, 
-                 const Data& customUserAuthQuery) :
+                 const Data& customUserAuthQuery,
+                 unsigned int connectionPoolSize) :
    mDBServer(server),
    mDBUser(user),
    mDBPassword(password),
    mDBName(databaseName),
    mDBPort(port),
    mCustomUserAuthQuery(customUserAuthQuery),
-   mConn(0),
-   mConnected(false)
+   mConnected(false),
+   mConnectionPoolSize(connectionPoolSize > 0 ? connectionPoolSize : 1),
+   mConnectionWaits(0)
 { 
-   InfoLog( << "Using MySQL DB with server=" << server << ", user=" << user << ", dbName=" << databaseName << ", port=" << port);
+   InfoLog( << "Using MySQL DB with server=" << server << ", user=" << user << ", dbName=" << databaseName << ", port=" << port
+            << ", connectionPoolSize=" << mConnectionPoolSize);
 
    for (int i=0;i<MaxTable;i++)
    {
@@ -93,14 +141,30 @@ MySqlDb::MySqlDb(const Data& server,
    }
    else
    {
-      connectToDatabase();
+      // Open the first connection now, so that isSane() tells us whether the
+      // server is there; the others are opened when they are needed.
+      ConnectionLease conn(*this);
+      connectToDatabase(*conn);
    }
 }
 
 
 MySqlDb::~MySqlDb()
 {
-   disconnectFromDatabase();
+   for (int i=0;i<MaxTable;i++)
+   {
+      if (mResult[i])
+      {
+         mysql_free_result(mResult[i]);
+         mResult[i]=0;
+      }
+   }
+
+   for(std::vector<Connection*>::iterator it = mConnections.begin(); it != mConnections.end(); ++it)
+   {
+      disconnectFromDatabase(**it);
+      delete *it;
+   }
 }
 
 void
@@ -113,44 +177,104 @@ MySqlDb::initialize() const
    }
 }
 
+MySqlDb::Connection*
+MySqlDb::acquireConnection() const
+{
+   initialize();
+
+   Lock lock(mMutex);
+
+   // A thread in the middle of a transaction must carry on using the
+   // connection it began it on.
+   if(!mTransactions.empty())
+   {
+      TransactionMap::iterator it = mTransactions.find(ThreadIf::selfId());
+      if(it != mTransactions.end())
+      {
+         return it->second;
+      }
+   }
+
+   if(mIdleConnections.empty())
+   {
+      if(mConnections.size() < mConnectionPoolSize)
+      {
+         // Not connected yet - whoever has it will connect it, outside of the lock
+         mConnections.push_back(new Connection);
+         return mConnections.back();
+      }
+      ++mConnectionWaits;
+      do
+      {
+         mConnectionAvailable.wait(mMutex);
+      } while(mIdleConnections.empty());
+   }
+
+   Connection* conn = mIdleConnections.back();
+   mIdleConnections.pop_back();
+   return conn;
+}
+
 void
-MySqlDb::disconnectFromDatabase() const
+MySqlDb::releaseConnection(Connection* conn) const
 {
-   if(mConn)
+   Lock lock(mMutex);
+   if(!conn->mInTransaction)
    {
-      for (int i=0;i<MaxTable;i++)
+      mIdleConnections.push_back(conn);
+      mConnectionAvailable.signal();
+   }
+}
+
+void
+MySqlDb::setInTransaction(Connection& conn, bool inTransaction) const
+{
+   Lock lock(mMutex);
+   conn.mInTransaction = inTransaction;
+   if(inTransaction)
+   {
+      mTransactions[ThreadIf::selfId()] = &conn;
+   }
+   else
+   {
+      mTransactions.erase(ThreadIf::selfId());
+   }
+}
+
+void
+MySqlDb::disconnectFromDatabase(Connection& conn) const
+{
+   if(conn.mConn)
+   {
+      for(Connection::StatementMap::iterator it = conn.mStatements.begin(); it != conn.mStatements.end(); ++it)
       {
-         if (mResult[i])
-         {  
-            mysql_free_result(mResult[i]); 
-            mResult[i]=0;
-         }
+         mysql_stmt_close(it->second);
       }
+      conn.mStatements.clear();
    
-      mysql_close(mConn);
-      mConn = 0;
-      mConnected = false;
+      mysql_close(conn.mConn);
+      conn.mConn = 0;
    }
 }
 
 int 
-MySqlDb::connectToDatabase() const
+MySqlDb::connectToDatabase(Connection& conn) const
 {
    // Disconnect from database first (if required)
-   disconnectFromDatabase();
+   disconnectFromDatabase(conn);
 
    // Now try to connect
-   assert(mConn == 0);
-   assert(mConnected == false);
+   assert(conn.mConn == 0);
 
-   mConn = mysql_init(0);
-   if(mConn == 0)
+   conn.mConn = mysql_init(0);
+   if(conn.mConn == 0)
    {
       ErrLog( << "MySQL init failed: insufficient memory.");
+      mConnected = false;
       return CR_OUT_OF_MEMORY;
    }
 
-   MYSQL* ret = mysql_real_connect(mConn,
+   MYSQL* ret = mysql_real_connect(conn.mConn,
                                    mDBServer.c_str(),   // hostname
                                    mDBUser.c_str(),     // user
                                    mDBPassword.c_str(), // password
@@ -161,10 +285,10 @@ MySqlDb::connectToDatabase() const
 
    if (ret == 0)
    { 
-      int rc = mysql_errno(mConn);
-      ErrLog( << "MySQL connect failed: error=" << rc << ": " << mysql_error(mConn));
-      mysql_close(mConn); 
-      mConn = 0;
+      int rc = mysql_errno(conn.mConn);
+      ErrLog( << "MySQL connect failed: error=" << rc << ": " << mysql_error(conn.mConn));
+      mysql_close(conn.mConn);
+      conn.mConn = 0;
       mConnected = false;
       return rc;
    }
@@ -176,45 +300,50 @@ MySqlDb::connectToDatabase() const
 }
 
 int
-MySqlDb::query(const Data& queryCommand, MYSQL_RES** result) const
+MySqlDb::query(const Data& queryCommand, MYSQL_RES** result, QueryType type) const
 {
-   int rc = 0;
+   ConnectionLease conn(*this);
+   return query(*conn, queryCommand, result, type);
+}
 
-   initialize();
+int
+MySqlDb::query(Connection& conn, const Data& queryCommand, MYSQL_RES** result, QueryType type) const
+{
+   int rc = 0;
 
    DebugLog( << "MySqlDb::query: executing query: " << queryCommand);
 
-   Lock lock(mMutex);
-   if(mConn == 0 || !mConnected)
+   UInt64 start = Timer::getTimeMicroSec();
+   if(conn.mConn == 0)
    {
-      rc = connectToDatabase();
+      rc = connectToDatabase(conn);
    }
    if(rc == 0)
    {
-      assert(mConn!=0);
-      assert(mConnected);
-      rc = mysql_query(mConn,queryCommand.c_str());
+      assert(conn.mConn!=0);
+      rc = mysql_query(conn.mConn,queryCommand.c_str());
       if(rc != 0)
       {
-         rc = mysql_errno(mConn);
+         rc = mysql_errno(conn.mConn);
          if(rc == CR_SERVER_GONE_ERROR ||
             rc == CR_SERVER_LOST)
          {
             // First failure is a connection error - try to re-connect and then try again
-            rc = connectToDatabase();
+            rc = connectToDatabase(conn);
             if(rc == 0)
             {
                // OK - we reconnected - try query again
-               rc = mysql_query(mConn,queryCommand.c_str());
+               rc = mysql_query(conn.mConn,queryCommand.c_str());
                if( rc != 0)
                {
-                  ErrLog( << "MySQL query failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+                  rc = mysql_errno(conn.mConn);
+                  ErrLog( << "MySQL query failed: error=" << rc << ": " << mysql_error(conn.mConn));
                }
             }
          }
          else
          {
-            ErrLog( << "MySQL query failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+            ErrLog( << "MySQL query failed: error=" << rc << ": " << mysql_error(conn.mConn));
          }
       }
    }
@@ -222,16 +351,17 @@ MySqlDb::query(const Data& queryCommand, MYSQL_RES** result) const
    // Now store result - if pointer to result pointer was supplied and no errors
    if(rc == 0 && result)
    {
-      *result = mysql_store_result(mConn);
+      *result = mysql_store_result(conn.mConn);
       if(*result == 0)
       {
-         rc = mysql_errno(mConn);
+         rc = mysql_errno(conn.mConn);
          if(rc != 0)
          {
-            ErrLog( << "MySQL store result failed: error=" << rc << ": " << mysql_error(mConn));
+            ErrLog( << "MySQL store result failed: error=" << rc << ": " << mysql_error(conn.mConn));
          }
       }
    }
+   conn.mLatency[type].record(Timer::getTimeMicroSec() - start);
 
    if(rc != 0)
    {
@@ -240,11 +370,199 @@ MySqlDb::query(const Data& queryCommand, MYSQL_RES** result) const
    return rc;
 }
 
+int
+MySqlDb::execute(QueryType type,
+                 const Data& statement,
+                 const Data* params[],
+                 unsigned int paramCount,
+                 std::vector<Data>* values) const
+{
+   int rc = 0;
+
+   DebugLog( << "MySqlDb::execute: executing statement: " << statement);
+
+   ConnectionLease conn(*this);
+   UInt64 start = Timer::getTimeMicroSec();
+   if(conn->mConn == 0)
+   {
+      rc = connectToDatabase(*conn);
+   }
+   if(rc == 0)
+   {
+      rc = runStatement(*conn, statement, params, paramCount, values);
+      if(rc == CR_SERVER_GONE_ERROR ||
+         rc == CR_SERVER_LOST)
+      {
+         // First failure is a connection error - try to re-connect (which
+         // prepares the statement again) and then try again
+         rc = connectToDatabase(*conn);
+         if(rc == 0)
+         {
+            rc = runStatement(*conn, statement, params, paramCount, values);
+         }
+      }
+   }
+   conn->mLatency[type].record(Timer::getTimeMicroSec() - start);
+
+   if(rc != 0)
+   {
+      ErrLog( << " SQL Statement was: " << statement) ;
+   }
+   return rc;
+}
+
+int
+MySqlDb::runStatement(Connection& conn,
+                      const Data& statement,
+                      const Data* params[],
+                      unsigned int paramCount,
+                      std::vector<Data>* values) const
+{
+   assert(paramCount <= MaxStatementParams);
+
+   MYSQL_STMT* stmt = 0;
+   Connection::StatementMap::iterator it = conn.mStatements.find(statement);
+   if(it != conn.mStatements.end())
+   {
+      stmt = it->second;
+   }
+   else
+   {
+      stmt = mysql_stmt_init(conn.mConn);
+      if(stmt == 0)
+      {
+         ErrLog( << "MySQL statement init failed: insufficient memory.");
+         return CR_OUT_OF_MEMORY;
+      }
+      if(mysql_stmt_prepare(stmt, statement.data(), (unsigned long)statement.size()) != 0)
+      {
+         int rc = mysql_stmt_errno(stmt);
+         ErrLog( << "MySQL prepare failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+         mysql_stmt_close(stmt);
+         return rc;
+      }
+      conn.mStatements[statement] = stmt;
+   }
+
+   MYSQL_BIND bind[MaxStatementParams];
+   unsigned long lengths[MaxStatementParams];
+   memset(bind, 0, sizeof(bind));
+   for(unsigned int i = 0; i < paramCount; i++)
+   {
+      lengths[i] = (unsigned long)params[i]->size();
+      bind[i].buffer_type = MYSQL_TYPE_STRING;
+      bind[i].buffer = (void*)params[i]->data();
+      bind[i].buffer_length = lengths[i];
+      bind[i].length = &lengths[i];
+   }
+   if(mysql_stmt_bind_param(stmt, bind) != 0 ||
+      mysql_stmt_execute(stmt) != 0)
+   {
+      int rc = mysql_stmt_errno(stmt);
+      if(rc != CR_SERVER_GONE_ERROR && rc != CR_SERVER_LOST)
+      {
+         ErrLog( << "MySQL execute failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+      }
+      return rc;
+   }
+
+   if(values)
+   {
+      // Most values fit in here; longer ones are fetched again into a Data
+      // of the right size.
+      char buffer[512];
+      unsigned long length = 0;
+      my_bool isNull = 0;
+      MYSQL_BIND result;
+      memset(&result, 0, sizeof(result));
+      result.buffer_type = MYSQL_TYPE_STRING;
+      result.buffer = buffer;
+      result.buffer_length = sizeof(buffer);
+      result.length = &length;
+      result.is_null = &isNull;
+
+      int rc = mysql_stmt_bind_result(stmt, &result);
+      int fetched = 0;
+      while(rc == 0 &&
+            ((fetched = mysql_stmt_fetch(stmt)) == 0 || fetched == MYSQL_DATA_TRUNCATED))
+      {
+         if(isNull)
+         {
+            values->push_back(Data::Empty);
+         }
+         else if(length <= sizeof(buffer))
+         {
+            values->push_back(Data(buffer, (Data::size_type)length));
+         }
+         else
+         {
+            values->push_back(Data::Empty);
+            MYSQL_BIND column = result;
+            column.buffer = values->back().getBuf((Data::size_type)length);
+            column.buffer_length = length;
+            rc = mysql_stmt_fetch_column(stmt, &column, 0, 0);
+         }
+      }
+      if(rc != 0 || fetched == 1)
+      {
+         rc = mysql_stmt_errno(stmt);
+         if(rc == 0)
+         {
+            rc = CR_UNKNOWN_ERROR;
+         }
+         ErrLog( << "MySQL fetch failed: error=" << rc << ": " << mysql_stmt_error(stmt));
+         // Throw away any rows that weren't read, or the next statement run
+         // on this connection fails with "commands out of sync".
+         mysql_stmt_reset(stmt);
+      }
+      mysql_stmt_free_result(stmt);
+      return rc;
+   }
+   return 0;
+}
+
+void
+MySqlDb::getQueryLatency(QueryType type, LatencyHistogram& latency) const
+{
+   assert(type < MaxQueryType);
+   Lock lock(mMutex);
+   for(std::vector<Connection*>::const_iterator it = mConnections.begin(); it != mConnections.end(); ++it)
+   {
+      latency.merge((*it)->mLatency[type]);
+   }
+}
+
+void
+MySqlDb::logQueryStatistics() const
+{
+   for(int type = 0; type < MaxQueryType; type++)
+   {
+      LatencyHistogram latency;
+      getQueryLatency((QueryType)type, latency);
+      if(latency.count() > 0)
+      {
+         InfoLog( << "MySQL " << queryTypeNames[type] << " queries: count=" << latency.count()
+                  << " mean=" << latency.mean() << "us p50=" << latency.valueAtPercentile(50)
+                  << "us p99=" << latency.valueAtPercentile(99) << "us max=" << latency.max() << "us");
+      }
+   }
+   Lock lock(mMutex);
+   InfoLog( << "MySQL connections: " << mConnections.size() << "/" << mConnectionPoolSize
+            << " open, " << mIdleConnections.size() << " idle, waited for one " << mConnectionWaits << " times");
+}
+
 int
 MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields) const
 {
+   return singleResultQuery(queryCommand, fields, OtherQuery);
+}
+
+int
+MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields, QueryType type) const
+{
+   ConnectionLease conn(*this);
    MYSQL_RES* result=0;
-   int rc = query(queryCommand, &result);
+   int rc = query(*conn, queryCommand, &result, type);
       
    if(rc == 0)
    {
@@ -263,10 +581,10 @@ MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields)
       }
       else
       {
-         rc = mysql_errno(mConn);
+         rc = mysql_errno(conn->mConn);
          if(rc != 0)
          {
-            ErrLog( << "MySQL fetch row failed: error=" << rc << ": " << mysql_error(mConn));
+            ErrLog( << "MySQL fetch row failed: error=" << rc << ": " << mysql_error(conn->mConn));
          }
       }
       mysql_free_result(result);
@@ -275,9 +593,22 @@ MySqlDb::singleResultQuery(const Data& queryCommand, std::vector<Data>& fields)
 }
 
 resip::Data& 
-MySqlDb::escapeString(const resip::Data& str, resip::Data& escapedStr) const
+MySqlDb::escapeString(Connection& conn, const resip::Data& str, resip::Data& escapedStr) const
 {
-   escapedStr.truncate2(mysql_real_escape_string(mConn, (char*)escapedStr.getBuf(str.size()*2+1), str.c_str(), str.size()));
+   if(conn.mConn == 0)
+   {
+      connectToDatabase(conn);
+   }
+   char* buf = escapedStr.getBuf(str.size()*2+1);
+   if(conn.mConn)
+   {
+      escapedStr.truncate2(mysql_real_escape_string(conn.mConn, buf, str.c_str(), str.size()));
+   }
+   else
+   {
+      // No connection to take the character set from - the query will fail anyway
+      escapedStr.truncate2(mysql_escape_string(buf, str.c_str(), str.size()));
+   }
    return escapedStr;
 }
 
@@ -345,7 +676,7 @@ MySqlDb::getUser( const AbstractDb::Key& key ) const
    
    if (result==0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL store result failed: query returned no result set");
       return ret;
    }
 
@@ -374,28 +705,36 @@ MySqlDb::getUserAuthInfo(  const AbstractDb::Key& key ) const
 { 
    std::vector<Data> ret;
 
-   Data command;
+   Data user;
+   Data domain;
+   getUserAndDomainFromKey(key, user, domain);
+
+   // Note: domain is empty when querying for HTTP admin user - for this special user,
+   // we will only check the repro db, by not adding the UNION statement below
+   if(!mCustomUserAuthQuery.empty() && !domain.empty())
    {
-      DataStream ds(command);
-      Data user;
-      Data domain;
-      getUserAndDomainFromKey(key, user, domain);
-      ds << "SELECT passwordHash FROM users WHERE user = '" << user << "' AND domain = '" << domain << "' ";
-   
-      // Note: domain is empty when querying for HTTP admin user - for this special user, 
-      // we will only check the repro db, by not adding the UNION statement below
-      if(!mCustomUserAuthQuery.empty() && !domain.empty())  
+      Data command;
       {
+         DataStream ds(command);
+         ds << "SELECT passwordHash FROM users WHERE user = '" << user << "' AND domain = '" << domain << "' ";
          ds << " UNION " << mCustomUserAuthQuery;
-         ds.flush();
-         command.replace("$user", user);
-         command.replace("$domain", domain);
+      }
+      command.replace("$user", user);
+      command.replace("$domain", domain);
+   
+      if(singleResultQuery(command, ret, UserAuthQuery) != 0 || ret.size() == 0)
+      {
+         return Data::Empty;
       }
    }
-
-   if(singleResultQuery(command, ret) != 0 || ret.size() == 0)
+   else
    {
-      return Data::Empty;
+      static const Data statement("SELECT passwordHash FROM users WHERE user=? AND domain=?");
+      const Data* params[] = { &user, &domain };
+      if(execute(UserAuthQuery, statement, params, 2, &ret) != 0 || ret.size() == 0)
+      {
+         return Data::Empty;
+      }
    }
    
    DebugLog( << "Auth password is " << ret.front());
@@ -423,7 +762,7 @@ MySqlDb::firstUserKey()
 
    if(mResult[UserTable] == 0)
    {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+      ErrLog( << "MySQL store result failed: query returned no result set");
       return Data::Empty;
    }
    
@@ -459,32 +798,30 @@ MySqlDb::dbWriteRecord(const Table table,
                        const resip::Data& pData)
 {
    Data command;
+   Data value(pData.base64encode());
 
    // Check if there is a secondary key or not and get it's value
    char* secondaryKey;
    unsigned int secondaryKeyLen;
-   Data escapedKey;
    if(AbstractDb::getSecondaryKey(table, pKey, pData, (void**)&secondaryKey, &secondaryKeyLen) == 0)
    {
-      Data escapedSKey;
       Data sKey(Data::Share, secondaryKey, secondaryKeyLen);
-      DataStream ds(command);
-      ds << "REPLACE INTO " << tableName(table)
-         << " SET attr='" << escapeString(pKey, escapedKey)
-         << "', attr2='" << escapeString(sKey, escapedSKey)
-         << "', value='"  << pData.base64encode()
-         << "'";
+      {
+         DataStream ds(command);
+         ds << "REPLACE INTO " << tableName(table) << " SET attr=?, attr2=?, value=?";
+      }
+      const Data* params[] = { &pKey, &sKey, &value };
+      return execute(RecordWriteQuery, command, params, 3) == 0;
    }
    else
    {
-      DataStream ds(command);
-      ds << "REPLACE INTO " << tableName(table) 
-         << " SET attr='" << escapeString(pKey, escapedKey)
-         << "', value='"  << pData.base64encode()
-         << "'";
+      {
+         DataStream ds(command);
+         ds << "REPLACE INTO " << tableName(table) << " SET attr=?, value=?";
+      }
+      const Data* params[] = { &pKey, &value };
+      return execute(RecordWriteQuery, command, params, 2) == 0;
    }
-
-   return query(command, 0) == 0;
 }
 
 bool 
@@ -493,37 +830,20 @@ MySqlDb::dbReadRecord(const Table table,
                       resip::Data& pData) const
 { 
    Data command;
-   Data escapedKey;
    {
       DataStream ds(command);
-      ds << "SELECT value FROM " << tableName(table) 
-         << " WHERE attr='" << escapeString(pKey, escapedKey)
-         << "'";
+      ds << "SELECT value FROM " << tableName(table) << " WHERE attr=?";
    }
 
-   MYSQL_RES* result = 0;
-   if(query(command, &result) != 0)
+   std::vector<Data> values;
+   const Data* params[] = { &pKey };
+   if(execute(RecordReadQuery, command, params, 1, &values) != 0 || values.empty())
    {
       return false;
    }
 
-   if (result == 0)
-   {
-      ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
-      return false;
-   }
-   else
-   {
-      bool success = false;
-      MYSQL_ROW row=mysql_fetch_row(result);
-      if(row)
-      {
-         pData = Data(Data::Share, row[0], (Data::size_type)strlen(row[0])).base64decode();
-         success = true;
-      }
-      mysql_free_result(result);
-      return success;
-   }
+   pData = values.front().base64decode();
+   return true;
 }
 
 
@@ -535,18 +855,18 @@ MySqlDb::dbEraseRecord(const Table table,
    Data command;
    {
       DataStream ds(command);
-      Data escapedKey;
       ds << "DELETE FROM " << tableName(table);
       if(isSecondaryKey)
       {
-         ds << " WHERE attr2='" << escapeString(pKey, escapedKey) << "'";
+         ds << " WHERE attr2=?";
       }
       else
       {
-         ds << " WHERE attr='" << escapeString(pKey, escapedKey) << "'";
+         ds << " WHERE attr=?";
       }
    }   
-   query(command, 0);
+   const Data* params[] = { &pKey };
+   execute(RecordEraseQuery, command, params, 1);
 }
 
 
@@ -575,7 +895,7 @@ MySqlDb::dbNextKey(const Table table, bool first)
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+         ErrLog( << "MySQL store result failed: query returned no result set");
          return Data::Empty;
       }
    }
@@ -615,6 +935,7 @@ MySqlDb::dbNextRecord(const Table table,
          mResult[table] = 0;
       }
       
+      ConnectionLease conn(*this);
       Data command;
       {
          DataStream ds(command);
@@ -624,7 +945,7 @@ MySqlDb::dbNextRecord(const Table table,
             Data escapedKey;
             // dbNextRecord is used to iterator through database tables that support duplication records
             // it is only appropriate for MySQL tables that contain the attr2 non-unique index (secondary key)
-            ds << " WHERE attr2='" << escapeString(key, escapedKey) << "'";
+            ds << " WHERE attr2='" << escapeString(*conn, key, escapedKey) << "'";
          }
          if(forUpdate)
          {
@@ -632,14 +953,14 @@ MySqlDb::dbNextRecord(const Table table,
          }
       }
 
-      if(query(command, &mResult[table]) != 0)
+      if(query(*conn, command, &mResult[table]) != 0)
       {
          return false;
       }
 
       if (mResult[table] == 0)
       {
-         ErrLog( << "MySQL store result failed: error=" << mysql_errno(mConn) << ": " << mysql_error(mConn));
+         ErrLog( << "MySQL store result failed: query returned no result set");
          return false;
       }
    }
@@ -663,13 +984,42 @@ MySqlDb::dbNextRecord(const Table table,
 }
 
 bool 
+MySqlDb::getSiloRecords(const Key& skey, AbstractDb::SiloRecordList& recordList)
+{
+   // Read them all at once, rather than through dbNextRecord, which keeps one
+   // result set per table and so can't be used from more than one thread.
+   static const Data statement("SELECT value FROM siloavp WHERE attr2=?");
+   std::vector<Data> values;
+   const Data* params[] = { &skey };
+   if(execute(SiloReadQuery, statement, params, 1, &values) != 0)
+   {
+      return false;
+   }
+
+   AbstractDb::SiloRecord rec;
+   for(std::vector<Data>::iterator it = values.begin(); it != values.end(); ++it)
+   {
+      Data data(it->base64decode());
+      decodeSiloRecord(data, rec);
+      recordList.push_back(rec);
+   }
+   return true;
+}
+
+bool
 MySqlDb::dbBeginTransaction(const Table table)
 {
+   ConnectionLease conn(*this);
    Data command("SET SESSION TRANSACTION ISOLATION LEVEL REPEATABLE READ");
-   if(query(command, 0) == 0)
+   if(query(*conn, command, 0) == 0)
    {
       command = "START TRANSACTION";
-      return query(command, 0) == 0;
+      if(query(*conn, command, 0) == 0)
+      {
+         // Everything up to the commit or rollback must go to this connection
+         setInTransaction(*conn, true);
+         return true;
+      }
    }
    return false;
 }
@@ -677,15 +1027,21 @@ MySqlDb::dbBeginTransaction(const Table table)
 bool 
 MySqlDb::dbCommitTransaction(const Table table)
 {
+   ConnectionLease conn(*this);
    Data command("COMMIT");
-   return query(command, 0) == 0;
+   bool success = query(*conn, command, 0) == 0;
+   setInTransaction(*conn, false);
+   return success;
 }
 
 bool 
 MySqlDb::dbRollbackTransaction(const Table table)
 {
+   ConnectionLease conn(*this);
    Data command("ROLLBACK");
-   return query(command, 0) == 0;
+   bool success = query(*conn, command, 0) == 0;
+   setInTransaction(*conn, false);
+   return success;
 }
 
 static const char usersavp[] = "usersavp";
@@ -7,17 +7,35 @@
 #include <mysql/mysql.h>
 #endif
 
+#include <map>
+#include <vector>
+
 #include "rutil/Data.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/Condition.hxx"
+#include "rutil/ThreadIf.hxx"
 #include "repro/AbstractDb.hxx"
 
 namespace resip
 {
   class TransactionUser;
+  class LatencyHistogram;
 }
 
 namespace repro
 {
 
+/**
+   @brief AbstractDb backed by a MySQL server.
+
+   Queries run on a pool of up to connectionPoolSize connections, opened as
+   they are first needed, so that as many threads (auth grabbers, async
+   processor workers) can be talking to the server at once; a thread that
+   finds them all busy waits for one to come back.  The queries made for
+   every request (user auth, record and silo reads and writes) are prepared
+   once per connection and then only executed.  A thread that begins a
+   transaction keeps its connection until it commits or rolls back.
+*/
 class MySqlDb: public AbstractDb
 {
    public:
@@ -26,9 +44,28 @@ class MySqlDb: public AbstractDb
               const resip::Data& password, 
               const resip::Data& databaseName, 
               unsigned int port, 
-              const resip::Data& customUserAuthQuery);
+              const resip::Data& customUserAuthQuery,
+              unsigned int connectionPoolSize = 1);
       
       virtual ~MySqlDb();
+
+      /// The kinds of query whose latency is kept (see getQueryLatency()).
+      typedef enum
+      {
+         UserAuthQuery = 0,
+         RecordReadQuery,
+         RecordWriteQuery,
+         RecordEraseQuery,
+         SiloReadQuery,
+         OtherQuery,
+         MaxQueryType
+      } QueryType;
+
+      /// Adds the latencies (in microseconds, including any reconnect) of
+      /// every query of the given type made so far to latency.
+      void getQueryLatency(QueryType type, resip::LatencyHistogram& latency) const;
+      /// Logs the query latencies and how busy the connection pool has been.
+      void logQueryStatistics() const;
       
       virtual bool isSane() {return mConnected;}
 
@@ -39,6 +76,8 @@ class MySqlDb: public AbstractDb
       virtual Key firstUserKey();// return empty if no more
       virtual Key nextUserKey(); // return empty if no more 
 
+      virtual bool getSiloRecords(const Key& skey, SiloRecordList& recordList);
+
       // Perform a query that expects a single result/row - returns all column/field data in a vector
       virtual int singleResultQuery(const resip::Data& queryCommand, std::vector<resip::Data>& fields) const;
 
@@ -64,11 +103,34 @@ class MySqlDb: public AbstractDb
       virtual bool dbCommitTransaction(const Table table);
       virtual bool dbRollbackTransaction(const Table table);
 
+      class Connection;
+      class ConnectionLease;
+      friend class ConnectionLease;
+
+      enum { MaxStatementParams = 3 };
+
       void initialize() const;
-      void disconnectFromDatabase() const;
-      int connectToDatabase() const;
-      int query(const resip::Data& queryCommand, MYSQL_RES** result) const;
-      resip::Data& escapeString(const resip::Data& str, resip::Data& escapedStr) const;
+      Connection* acquireConnection() const;
+      void releaseConnection(Connection* conn) const;
+      void setInTransaction(Connection& conn, bool inTransaction) const;
+      void disconnectFromDatabase(Connection& conn) const;
+      int connectToDatabase(Connection& conn) const;
+      int query(const resip::Data& queryCommand, MYSQL_RES** result, QueryType type = OtherQuery) const;
+      int query(Connection& conn, const resip::Data& queryCommand, MYSQL_RES** result, QueryType type = OtherQuery) const;
+      int singleResultQuery(const resip::Data& queryCommand, std::vector<resip::Data>& fields, QueryType type) const;
+      // Runs a prepared statement, binding params to its ?s in order; if values
+      // is given, it gets the first column of each row returned.
+      int execute(QueryType type, 
+                  const resip::Data& statement, 
+                  const resip::Data* params[], 
+                  unsigned int paramCount, 
+                  std::vector<resip::Data>* values = 0) const;
+      int runStatement(Connection& conn, 
+                       const resip::Data& statement, 
+                       const resip::Data* params[], 
+                       unsigned int paramCount, 
+                       std::vector<resip::Data>* values) const;
+      resip::Data& escapeString(Connection& conn, const resip::Data& str, resip::Data& escapedStr) const;
 
       resip::Data mDBServer;
       resip::Data mDBUser;
@@ -77,13 +139,20 @@ class MySqlDb: public AbstractDb
       unsigned int mDBPort;
       resip::Data mCustomUserAuthQuery;
 
-      mutable MYSQL* mConn;
       mutable MYSQL_RES* mResult[MaxTable];
       mutable volatile bool mConnected;
-      // when multiple threads are in use with the same connection, you need to 
-      // mutex calls to mysql_query and mysql_store_result: 
-      // http://dev.mysql.com/doc/refman/5.1/en/threaded-clients.html
+
+      // A connection may only be used by one thread at a time (see 
+      // http://dev.mysql.com/doc/refman/5.1/en/threaded-clients.html), so 
+      // each query borrows one from the pool for as long as it runs.
+      const unsigned int mConnectionPoolSize;
+      mutable std::vector<Connection*> mConnections;
+      mutable std::vector<Connection*> mIdleConnections;
+      typedef std::map<resip::ThreadIf::Id, Connection*> TransactionMap;
+      mutable TransactionMap mTransactions;  // connections kept by the thread in a transaction
+      mutable unsigned long mConnectionWaits;  // times a thread found every connection busy
       mutable resip::Mutex mMutex;  
+      mutable resip::Condition mConnectionAvailable;
 
       const char* tableName( Table table ) const;
       void userWhereClauseToDataStream(const Key& key, resip::DataStream& ds) const;
@@ -35,9 +35,11 @@
 #include "resip/stack/EventStackThread.hxx"
 #include "resip/stack/InteropHelper.hxx"
 #include "resip/stack/ConnectionManager.hxx"
+#include "resip/stack/SipCapture.hxx"
 #include "resip/stack/WsCookieContextFactory.hxx"
 
 #include "resip/dum/InMemorySyncRegDb.hxx"
+#include "resip/dum/ShardedRegistrationDatabase.hxx"
 #include "resip/dum/MasterProfile.hxx"
 #include "resip/dum/DialogUsageManager.hxx"
 #include "resip/dum/DumThread.hxx"
@@ -246,8 +248,14 @@ ReproRunner::run(int argc, char** argv)
                    mProxyConfig->getConfigData("LogLevel", "INFO", true), 
                    mArgv[0], 
                    mProxyConfig->getConfigData("LogFilename", "repro.log", true).c_str(),
-                   isEqualNoCase(loggingType, "file") ? &g_ReproLogger : 0, // if logging to file then write WARNINGS, and Errors to console still
+                   isEqualNoCase(loggingType, "file") || isEqualNoCase(loggingType, "file-async") ? &g_ReproLogger : 0, // if logging to file then write WARNINGS, and Errors to console still
                    syslogFacilityName);
+   if(Log::isAsync())
+   {
+      Log::setAsync(true,
+                    mProxyConfig->getConfigBool("LogAsyncBlockWhenFull", false) ? Log::BlockWhenFull : Log::DropWhenFull,
+                    mProxyConfig->getConfigUnsignedLong("LogAsyncBufferSize", 1024*1024));
+   }
 
    InfoLog( << "Starting repro version " << VersionUtils::instance().releaseVersion() << "...");
 
@@ -633,6 +641,13 @@ ReproRunner::createSipStack()
    {
       security->addCAFile(caFile);
    }
+   security->setTlsSessionCache(mProxyConfig->getConfigUnsignedLong("TLSSessionCacheSize", 0),
+                                mProxyConfig->getConfigUnsignedLong("TLSSessionCacheTimeout", 3600));
+   security->setTlsSessionTickets(mProxyConfig->getConfigBool("TLSSessionTickets", false),
+                                  mProxyConfig->getConfigUnsignedLong("TLSSessionTicketKeyLifetime", 3600));
+   security->setTlsClientSessionReuse(mProxyConfig->getConfigUnsignedLong("TLSClientSessionCacheSize", 0));
+   security->setTlsHandshakeThreads(mProxyConfig->getConfigUnsignedLong("TLSHandshakeThreads", 0),
+                                    mProxyConfig->getConfigUnsignedLong("TLSHandshakeQueueSize", 1000));
 #endif
 
 #ifdef USE_SIGCOMP
@@ -701,11 +716,28 @@ ReproRunner::createSipStack()
       mSipStack->setEnumDomains(enumDomains);
    }
 
+   // Come back up with the DNS cache we had before, and keep a copy of it
+   Data dnsCacheSnapshotFile = mProxyConfig->getConfigData("DNSCacheSnapshotFile", "", true);
+   if (!dnsCacheSnapshotFile.empty())
+   {
+      mSipStack->getDnsStub().setDnsCacheSnapshot(dnsCacheSnapshotFile,
+                                                  mProxyConfig->getConfigInt("DNSCacheSnapshotInterval", 300));
+   }
+
    // Add External Stats handler
    mSipStack->setExternalStatsHandler(this);
 
-   // Set Transport SipMessage Logging Handler - if enabled
-   if(mProxyConfig->getConfigBool("EnableSipMessageLogging", false))
+   // Set Transport SipMessage Logging Handler - if enabled.  Capturing to a file takes precedence
+   // over logging, since it is cheap enough to leave on under load.
+   Data sipMessageCaptureFile = mProxyConfig->getConfigData("SipMessageCaptureFile", "", true);
+   if(!sipMessageCaptureFile.empty())
+   {
+       mSipStack->setTransportSipMessageLoggingHandler(SharedPtr<SipCapture>(new SipCapture(sipMessageCaptureFile,
+          mProxyConfig->getConfigUnsignedLong("SipMessageCaptureFileMaxBytes", 100*1024*1024),
+          mProxyConfig->getConfigUnsignedLong("SipMessageCaptureFileCount", 10),
+          mProxyConfig->getConfigUnsignedLong("SipMessageCaptureBufferSize", 4*1024*1024))));
+   }
+   else if(mProxyConfig->getConfigBool("EnableSipMessageLogging", false))
    {
        mSipStack->setTransportSipMessageLoggingHandler(SharedPtr<ReproSipMessageLoggingHandler>(new ReproSipMessageLoggingHandler));
    }
@@ -828,6 +860,12 @@ ReproRunner::createDatastore()
    assert(!mAbstractDb);
    assert(!mRuntimeAbstractDb);
 #ifdef USE_MYSQL
+   // Unless told otherwise (pool size 0), allow for every thread that may query at
+   // once: the auth grabbers, the async processor workers and one more (ie. the stack).
+   unsigned long defaultPoolSize = resipMax(mProxyConfig->getConfigInt("NumAuthGrabberWorkerThreads", 2), 0) +
+                                   resipMax(mProxyConfig->getConfigInt("NumAsyncProcessorWorkerThreads", 2), 0) + 1;
+   unsigned long poolSize = mProxyConfig->getConfigUnsignedLong("MySQLConnectionPoolSize", 0);
+   unsigned long runtimePoolSize = mProxyConfig->getConfigUnsignedLong("RuntimeMySQLConnectionPoolSize", 0);
    Data mySQLServer;
    mProxyConfig->getConfigValue("MySQLServer", mySQLServer);
    if(!mySQLServer.empty())
@@ -837,7 +875,8 @@ ReproRunner::createDatastore()
                        mProxyConfig->getConfigData("MySQLPassword", Data::Empty),
                        mProxyConfig->getConfigData("MySQLDatabaseName", Data::Empty),
                        mProxyConfig->getConfigUnsignedLong("MySQLPort", 0),
-                       mProxyConfig->getConfigData("MySQLCustomUserAuthQuery", Data::Empty));
+                       mProxyConfig->getConfigData("MySQLCustomUserAuthQuery", Data::Empty),
+                       poolSize > 0 ? poolSize : defaultPoolSize);
    }
    Data runtimeMySQLServer;
    mProxyConfig->getConfigValue("RuntimeMySQLServer", runtimeMySQLServer);
@@ -848,7 +887,8 @@ ReproRunner::createDatastore()
                        mProxyConfig->getConfigData("RuntimeMySQLPassword", Data::Empty),
                        mProxyConfig->getConfigData("RuntimeMySQLDatabaseName", Data::Empty),
                        mProxyConfig->getConfigUnsignedLong("RuntimeMySQLPort", 0),
-                       mProxyConfig->getConfigData("MySQLCustomUserAuthQuery", Data::Empty));
+                       mProxyConfig->getConfigData("MySQLCustomUserAuthQuery", Data::Empty),
+                       runtimePoolSize > 0 ? runtimePoolSize : defaultPoolSize);
    }
 #endif
    if (!mAbstractDb)
@@ -876,7 +916,20 @@ ReproRunner::createDatastore()
    if(!mRestarting)  // If we are restarting then we left the InMemoryRegistrationDb intact at shutdown - don't recreate
    {
       assert(!mRegistrationPersistenceManager);
-      mRegistrationPersistenceManager = new InMemorySyncRegDb(mRegSyncPort ? 86400 /* 24 hours */ : 0 /* removeLingerSecs */);  // !slg! could make linger time a setting
+      int regDbShards = mProxyConfig->getConfigInt("RegistrationDatabaseShards", 0);
+      if(regDbShards > 0 && !mRegSyncPort)
+      {
+         mRegistrationPersistenceManager = new ShardedRegistrationDatabase(true /* checkExpiry */, regDbShards,
+                                                                           60 /* sweepIntervalSecs */);
+      }
+      else
+      {
+         if(regDbShards > 0)
+         {
+            WarningLog(<< "RegistrationDatabaseShards is ignored when RegSyncPort is set");
+         }
+         mRegistrationPersistenceManager = new InMemorySyncRegDb(mRegSyncPort ? 86400 /* 24 hours */ : 0 /* removeLingerSecs */);  // !slg! could make linger time a setting
+      }
    }
    assert(mRegistrationPersistenceManager);
 
@@ -1241,6 +1294,13 @@ ReproRunner::createRegSync()
    assert(!mRegSyncServerV4);
    assert(!mRegSyncServerV6);
    assert(!mRegSyncServerThread);
+   if(mRegSyncPort != 0 && !dynamic_cast<InMemorySyncRegDb*>(mRegistrationPersistenceManager))
+   {
+      // Only possible if RegSyncPort was set by a restart; the registration
+      // database is kept across restarts.
+      ErrLog(<< "Registration sync needs the unsharded registration database - restart repro to enable it");
+      return;
+   }
    if(mRegSyncPort != 0)
    {
       std::list<RegSyncServer*> regSyncServerList;
@@ -1860,6 +1920,19 @@ ReproRunner::operator()(resip::StatisticsMessage &statsMessage)
    {
        (*it)->handleStatisticsMessage(statsMessage);
    }
+#ifdef USE_MYSQL
+   // Log the database's query latencies alongside the stack's statistics
+   MySqlDb* mySqlDb = dynamic_cast<MySqlDb*>(mAbstractDb);
+   if(mySqlDb)
+   {
+      mySqlDb->logQueryStatistics();
+   }
+   mySqlDb = dynamic_cast<MySqlDb*>(mRuntimeAbstractDb);
+   if(mySqlDb)
+   {
+      mySqlDb->logQueryStatistics();
+   }
+#endif
    return true;
 }
 
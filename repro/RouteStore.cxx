@@ -1,4 +1,8 @@
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
 #include "rutil/Logger.hxx"
 #include "rutil/ParseBuffer.hxx"
 #include "rutil/Lock.hxx"
@@ -21,6 +25,145 @@ bool RouteStore::RouteOp::operator<(const RouteOp& rhs) const
 }
 
 
+RouteStore::RouteTable::RouteTable()
+{
+}
+
+
+RouteStore::RouteTable::~RouteTable()
+{
+}
+
+
+RouteStore::RouteTable::TrieNode::~TrieNode()
+{
+   for(std::map<char, TrieNode*>::iterator i = mChildren.begin(); i != mChildren.end(); ++i)
+   {
+      delete i->second;
+   }
+}
+
+
+void
+RouteStore::RouteTable::add(const RouteOp& route)
+{
+   // Routes without a usable regex can never match; leave them out.
+   if(!route.preq)
+   {
+      return;
+   }
+
+   const size_t index = mRoutes.size();
+   mRoutes.push_back(route);
+
+   Data prefix = literalPrefix(route.routeRecord.mMatchingPattern);
+   if(prefix.empty())
+   {
+      mUnindexed.push_back(index);
+      return;
+   }
+
+   TrieNode* node = &mRoot;
+   for(Data::size_type i = 0; i < prefix.size(); ++i)
+   {
+      TrieNode*& child = node->mChildren[prefix[i]];
+      if(!child)
+      {
+         child = new TrieNode;
+      }
+      node = child;
+   }
+   node->mRoutes.push_back(index);
+}
+
+
+void
+RouteStore::RouteTable::candidates(const Data& uri, std::vector<size_t>& result) const
+{
+   result = mUnindexed;
+   bool merged = false;
+   const TrieNode* node = &mRoot;
+   for(Data::size_type i = 0; i < uri.size(); ++i)
+   {
+      std::map<char, TrieNode*>::const_iterator child = node->mChildren.find(uri[i]);
+      if(child == node->mChildren.end())
+      {
+         break;
+      }
+      node = child->second;
+      if(!node->mRoutes.empty())
+      {
+         result.insert(result.end(), node->mRoutes.begin(), node->mRoutes.end());
+         merged = true;
+      }
+   }
+
+   // Indices are route order; keep the routes in that order.
+   if(merged)
+   {
+      std::sort(result.begin(), result.end());
+   }
+}
+
+
+// Returns the literal text that every string matched by pattern must start
+// with, or empty if the pattern is not anchored or starts with something
+// other than a literal. Anything we are not sure about ends the prefix.
+Data
+RouteStore::literalPrefix(const Data& pattern)
+{
+   if(pattern.empty() || pattern[0] != '^' || pattern.find("|") != Data::npos)
+   {
+      return Data::Empty;
+   }
+
+   Data prefix;
+   Data::size_type i = 1;
+   while(i < pattern.size())
+   {
+      char c = pattern[i];
+      if(c == '\\')
+      {
+         if(i + 1 >= pattern.size() || isalnum((unsigned char)pattern[i+1]))
+         {
+            break;
+         }
+         c = pattern[i+1];
+         i += 2;
+      }
+      else if(strchr(".[]()*+?{}^$", c))
+      {
+         break;
+      }
+      else
+      {
+         ++i;
+      }
+
+      // A quantifier that allows zero repetitions makes this character
+      // optional.
+      if(i < pattern.size() && strchr("*?{", pattern[i]))
+      {
+         break;
+      }
+      prefix += c;
+   }
+   return prefix;
+}
+
+
+void
+RouteStore::publishRouteTable()
+{
+   RouteTable* table = new RouteTable;
+   for(RouteOpList::const_iterator i = mRouteOperators.begin(); i != mRouteOperators.end(); ++i)
+   {
+      table->add(*i);
+   }
+   mRouteTable.reset(table);
+}
+
+
 RouteStore::RouteStore(AbstractDb& db):
    mDb(db)
 {  
@@ -55,6 +198,7 @@ RouteStore::RouteStore(AbstractDb& db):
       key = mDb.nextRouteKey();
    } 
    mCursor = mRouteOperators.begin();
+   publishRouteTable();
 }
 
 
@@ -123,8 +267,9 @@ RouteStore::addRoute(const resip::Data& method,
    {
       WriteLock lock(mMutex);
       mRouteOperators.insert( route );
+      mCursor = mRouteOperators.begin(); 
+      publishRouteTable();
    }
-   mCursor = mRouteOperators.begin(); 
 
    return true;
 }
@@ -165,6 +310,7 @@ RouteStore::eraseRoute(const resip::Data& key )
    {
       WriteLock lock(mMutex);
 
+      std::vector<regex_t*> erased;
       RouteOpList::iterator it = mRouteOperators.begin();
       while ( it != mRouteOperators.end() )
       {
@@ -174,12 +320,7 @@ RouteStore::eraseRoute(const resip::Data& key )
             it++;
             if ( i->preq )
             {
-               regfree ( i->preq );
-               delete i->preq;
-
-               // !abr! Can't modify elements in a set
-               //i->preq = 0;
-
+               erased.push_back(i->preq);
             }
             mRouteOperators.erase(i);
          }
@@ -188,8 +329,17 @@ RouteStore::eraseRoute(const resip::Data& key )
             it++;
          }
       }
+      mCursor = mRouteOperators.begin();  // reset the cursor since it may have been on deleted route
+
+      // Once the new table is published, nothing can be using the erased
+      // routes' regexes anymore.
+      publishRouteTable();
+      for(std::vector<regex_t*>::iterator i = erased.begin(); i != erased.end(); ++i)
+      {
+         regfree(*i);
+         delete *i;
+      }
    }
-   mCursor = mRouteOperators.begin();  // reset the cursor since it may have been on deleted route
 }
 
 
@@ -285,19 +435,29 @@ RouteStore::process(const resip::Uri& ruri,
                     const resip::Data& event )
 {
    RouteStore::UriList targetSet;
-   if(mRouteOperators.empty()) return targetSet;  // If there are no routes bail early to save a few cycles (size check is atomic enough, we don't need a lock)
+   SnapshotPtr<RouteTable>::Reader routes(mRouteTable);
+   if(routes->mRoutes.empty()) return targetSet;  // If there are no routes bail early to save a few cycles
 
-   ReadLock lock(mMutex);
+   Data uri;
+   {
+      DataStream s(uri);
+      s << ruri;
+      s.flush();
+   }
 
-   for (RouteOpList::iterator it = mRouteOperators.begin();
-        it != mRouteOperators.end(); it++)
+   std::vector<size_t> candidates;
+   routes->candidates(uri, candidates);
+
+   for (std::vector<size_t>::const_iterator it = candidates.begin();
+        it != candidates.end(); it++)
    {
+      const RouteOp& route = routes->mRoutes[*it];
       DebugLog( << "Consider route " // << *it
                 << " reqUri=" << ruri
                 << " method=" << method 
                 << " event=" << event );
 
-      const AbstractDb::RouteRecord& rec = it->routeRecord;
+      const AbstractDb::RouteRecord& rec = route.routeRecord;
       
       if(!rec.mMethod.empty())
       {
@@ -318,22 +478,15 @@ RouteStore::process(const resip::Uri& ruri,
       }
       const Data& rewrite = rec.mRewriteExpression;
       const Data& match = rec.mMatchingPattern;
-      if ( it->preq ) 
+      if ( route.preq ) 
       {
          int ret;
          // TODO - !cj! www.pcre.org looks like it has better performance
          // !mbg! is this true now that the compiled regexp is used?
-         Data uri;
-         {
-            DataStream s(uri);
-            s << ruri;
-            s.flush();
-         }
-         
          const int nmatch=10;
          regmatch_t pmatch[nmatch];
          
-         ret = regexec(it->preq, uri.c_str(), nmatch, pmatch, 0/*eflags*/);
+         ret = regexec(route.preq, uri.c_str(), nmatch, pmatch, 0/*eflags*/);
          if ( ret != 0 )
          {
             // did not match 
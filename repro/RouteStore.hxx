@@ -7,10 +7,13 @@
 #include <regex.h>
 #endif
 
+#include <map>
 #include <set>
+#include <vector>
 
 #include "rutil/Data.hxx"
 #include "rutil/RWMutex.hxx"
+#include "rutil/SnapshotPtr.hxx"
 #include "resip/stack/Uri.hxx"
 
 #include "repro/AbstractDb.hxx"
@@ -78,6 +81,44 @@ class RouteStore
       typedef std::multiset<RouteOp> RouteOpList;
       RouteOpList mRouteOperators; 
       RouteOpList::iterator mCursor;
+
+      // Read-only view of mRouteOperators that process() works from. Routes
+      // whose pattern starts with a literal prefix (eg; "^sip:1800") are
+      // indexed by that prefix in a trie, so a request URI only has to be
+      // run against the regexes of routes it could possibly match. The
+      // compiled regexes are shared with mRouteOperators, and must not be
+      // freed until a table that no longer refers to them is published.
+      class RouteTable
+      {
+         public:
+            RouteTable();
+            ~RouteTable();
+            void add(const RouteOp& route);
+            // Indices (in route order) of the routes that may match uri
+            void candidates(const resip::Data& uri, std::vector<size_t>& result) const;
+
+            std::vector<RouteOp> mRoutes;
+
+         private:
+            RouteTable(const RouteTable&);
+            RouteTable& operator=(const RouteTable&);
+
+            class TrieNode
+            {
+               public:
+                  ~TrieNode();
+                  std::map<char, TrieNode*> mChildren;
+                  std::vector<size_t> mRoutes;
+            };
+            TrieNode mRoot;
+            std::vector<size_t> mUnindexed;
+      };
+
+      static resip::Data literalPrefix(const resip::Data& pattern);
+      // Rebuilds the RouteTable from mRouteOperators; call with mMutex
+      // write-locked.
+      void publishRouteTable();
+      resip::SnapshotPtr<RouteTable> mRouteTable;
 };
 
  }
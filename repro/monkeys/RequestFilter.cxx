@@ -70,13 +70,19 @@ RequestFilter::RequestFilter(ProxyConfig& config,
 
    if(!mySQLServer.empty())
    {
+      // Queries are made from the async processor workers, so by default
+      // allow a connection for each of them
+      unsigned long defaultPoolSize = resipMax(config.getConfigInt("NumAsyncProcessorWorkerThreads", 2), 1);
+      unsigned long poolSize = config.getConfigUnsignedLong(mySQLSettingPrefix + "MySQLConnectionPoolSize", 0);
+
       // Initialize My SQL using Global settings
       mMySqlDb = new MySqlDb(mySQLServer, 
                     config.getConfigData(mySQLSettingPrefix + "MySQLUser", ""), 
                     config.getConfigData(mySQLSettingPrefix + "MySQLPassword", ""),
                     config.getConfigData(mySQLSettingPrefix + "MySQLDatabaseName", ""),
                     config.getConfigUnsignedLong(mySQLSettingPrefix + "MySQLPort", 0),
-                    Data::Empty);
+                    Data::Empty,
+                    poolSize > 0 ? poolSize : defaultPoolSize);
    }
 #endif
 }
@@ -0,0 +1,121 @@
+#if !defined(REPRO_TEST_MEMORYDB_HXX)
+#define REPRO_TEST_MEMORYDB_HXX
+
+#include <map>
+
+#include "repro/AbstractDb.hxx"
+#include "rutil/Data.hxx"
+
+namespace repro
+{
+
+// An AbstractDb that keeps its tables in memory, for testing the stores.
+class MemoryDb : public AbstractDb
+{
+   public:
+      virtual bool isSane() { return true; }
+
+   protected:
+      virtual bool dbWriteRecord(const Table table, const resip::Data& key, const resip::Data& data)
+      {
+         mTables[table][key] = data;
+         return true;
+      }
+
+      virtual bool dbReadRecord(const Table table, const resip::Data& key, resip::Data& data) const
+      {
+         std::map<resip::Data, resip::Data>::const_iterator i = mTables[table].find(key);
+         if(i == mTables[table].end())
+         {
+            return false;
+         }
+         data = i->second;
+         return true;
+      }
+
+      virtual void dbEraseRecord(const Table table, const resip::Data& key, bool isSecondaryKey=false)
+      {
+         mTables[table].erase(key);
+      }
+
+      virtual resip::Data dbNextKey(const Table table, bool first=false)
+      {
+         if(first)
+         {
+            mCursors[table] = mTables[table].begin();
+         }
+         if(mCursors[table] == mTables[table].end())
+         {
+            return resip::Data::Empty;
+         }
+         return (mCursors[table]++)->first;
+      }
+
+      virtual bool dbNextRecord(const Table table, const resip::Data& key, resip::Data& data,
+                                bool forUpdate, bool first=false)
+      {
+         return false;
+      }
+
+      virtual bool dbBeginTransaction(const Table table) { return true; }
+      virtual bool dbCommitTransaction(const Table table) { return true; }
+      virtual bool dbRollbackTransaction(const Table table) { return true; }
+
+   private:
+      mutable std::map<resip::Data, resip::Data> mTables[MaxTable];
+      std::map<resip::Data, resip::Data>::iterator mCursors[MaxTable];
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
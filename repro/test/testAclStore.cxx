@@ -0,0 +1,213 @@
+#include <cassert>
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include "repro/AclStore.hxx"
+#include "repro/test/MemoryDb.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Random.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+// What AclStore::isAddressTrusted() did before ACLs were indexed: check the
+// address against every ACL.
+static bool
+naiveIsAddressTrusted(AclStore& store, const Tuple& address)
+{
+   for(AclStore::Key key = store.getFirstAddressKey(); !key.empty(); key = store.getNextAddressKey(key))
+   {
+      Tuple acl = store.getAddressTuple(key);
+      if(acl.isEqualWithMask(address, store.getAddressMask(key), acl.getPort() == 0))
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+static Data
+randomV4()
+{
+   UInt32 a = Random::getRandom();
+   // Keep to a few /8s so that ACLs and addresses overlap.
+   return Data((a >> 24) % 4 + 10) + "." + Data((a >> 16) & 0xff) + "." +
+          Data((a >> 8) & 0xff) + "." + Data(a & 0xff);
+}
+
+static void
+testBasics()
+{
+   cerr << "!! Test basics" << endl;
+   MemoryDb db;
+   AclStore store(db);
+   assert(!store.isAddressTrusted(Tuple("10.1.2.3", 5060, UDP)));
+
+   assert(store.addAcl("10.1.0.0/16", 0, UDP));
+   assert(store.addAcl("192.168.1.10", 5060, UDP));
+   assert(store.addAcl("Server1.Example.com", 0, 0));
+
+   assert(store.isAddressTrusted(Tuple("10.1.2.3", 5060, UDP)));
+   assert(store.isAddressTrusted(Tuple("10.1.255.255", 1234, UDP)));
+   assert(!store.isAddressTrusted(Tuple("10.1.2.3", 5060, TCP)));
+   assert(!store.isAddressTrusted(Tuple("10.2.0.1", 5060, UDP)));
+   assert(store.isAddressTrusted(Tuple("192.168.1.10", 5060, UDP)));
+   assert(!store.isAddressTrusted(Tuple("192.168.1.10", 5061, UDP)));
+   assert(!store.isAddressTrusted(Tuple("192.168.1.10", 5060, TCP)));
+   assert(!store.isAddressTrusted(Tuple("192.168.1.11", 5060, UDP)));
+
+   list<Data> names;
+   names.push_back("other.example.com");
+   assert(!store.isTlsPeerNameTrusted(names));
+   names.push_back("server1.EXAMPLE.com");
+   assert(store.isTlsPeerNameTrusted(names));
+
+#ifdef USE_IPV6
+   assert(store.addAcl("[2001:db8::]/64", 0, UDP));
+   assert(store.isAddressTrusted(Tuple("2001:db8::1", 5060, UDP)));
+   assert(!store.isAddressTrusted(Tuple("2001:db9::1", 5060, UDP)));
+   assert(!store.isAddressTrusted(Tuple("::ffff:10.1.2.3", 5060, UDP)));
+#endif
+
+   // Changes are seen by the next check.
+   store.eraseAcl(Data::Empty, "10.1.0.0", 16, 0, V4, UDP);
+   assert(!store.isAddressTrusted(Tuple("10.1.2.3", 5060, UDP)));
+   store.eraseAcl("Server1.Example.com", Data::Empty, 0, 0, 0, 0);
+   assert(!store.isTlsPeerNameTrusted(names));
+}
+
+static void
+testAgainstLinearScan()
+{
+   cerr << "!! Test against linear scan" << endl;
+   MemoryDb db;
+   AclStore store(db);
+   for(int i = 0; i < 500; ++i)
+   {
+      const short mask = 16 + Random::getRandom() % 17;
+      const short port = (Random::getRandom() % 4 == 0) ? 5060 : 0;
+      store.addAcl(Data::Empty, randomV4(), mask, port, V4, Random::getRandom() % 2 ? UDP : TCP);
+   }
+   int trusted = 0;
+   for(int i = 0; i < 5000; ++i)
+   {
+      Tuple address(randomV4(), Random::getRandom() % 2 ? 5060 : 5070, Random::getRandom() % 2 ? UDP : TCP);
+      const bool expected = naiveIsAddressTrusted(store, address);
+      assert(store.isAddressTrusted(address) == expected);
+      trusted += expected;
+   }
+   cerr << trusted << " of 5000 addresses trusted" << endl;
+}
+
+static void
+testPerformance()
+{
+   const int numAcls = 10000;
+   const int numLookups = 10000;
+   cerr << "!! Performance with " << numAcls << " ACLs" << endl;
+
+   MemoryDb db;
+   for(int i = 0; i < numAcls; ++i)
+   {
+      AbstractDb::AclRecord rec;
+      rec.mAddress = Data("172.") + Data(16 + i / 65536) + "." + Data((i / 256) % 256) + "." + Data(i % 256);
+      rec.mMask = 32;
+      rec.mPort = 0;
+      rec.mFamily = V4;
+      rec.mTransport = UDP;
+      db.addAcl(":" + rec.mAddress + "/32:0:1:1", rec);
+   }
+   AclStore store(db);
+
+   vector<Tuple> addresses;
+   for(int i = 0; i < numLookups; ++i)
+   {
+      // Half of them are trusted
+      const int acl = Random::getRandom() % numAcls;
+      addresses.push_back(Tuple(i % 2 ? randomV4() : Data("172.") + Data(16 + acl / 65536) + "." + Data((acl / 256) % 256) + "." + Data(acl % 256),
+                                5060, UDP));
+   }
+
+   UInt64 start = Timer::getTimeMicroSec();
+   for(vector<Tuple>::const_iterator i = addresses.begin(); i != addresses.end(); ++i)
+   {
+      store.isAddressTrusted(*i);
+   }
+   UInt64 indexed = Timer::getTimeMicroSec() - start;
+
+   start = Timer::getTimeMicroSec();
+   for(int i = 0; i < 100; ++i)
+   {
+      naiveIsAddressTrusted(store, addresses[i]);
+   }
+   UInt64 naive = Timer::getTimeMicroSec() - start;
+
+   cerr << "indexed: " << (double)indexed / numLookups << "us per lookup, "
+        << "linear scan: " << (double)naive / 100 << "us per lookup" << endl;
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cerr, Log::Warning, argv[0]);
+   testBasics();
+   testAgainstLinearScan();
+   testPerformance();
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,254 @@
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "repro/AbstractDb.hxx"
+#include "repro/RouteStore.hxx"
+#include "repro/test/MemoryDb.hxx"
+#include "resip/stack/Uri.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace repro;
+using namespace resip;
+using namespace std;
+
+// What RouteStore::process() did before routes were compiled: run every
+// route's regex against the request URI, in order.
+class NaiveRoutes
+{
+   public:
+      ~NaiveRoutes()
+      {
+         for(vector<Route>::iterator i = mRoutes.begin(); i != mRoutes.end(); ++i)
+         {
+            regfree(i->preq);
+            delete i->preq;
+         }
+      }
+
+      void add(const Data& pattern, const Data& rewrite)
+      {
+         Route route;
+         route.preq = new regex_t;
+         int ret = regcomp(route.preq, pattern.c_str(), REG_EXTENDED | REG_NOSUB);
+         assert(ret == 0);
+         route.rewrite = rewrite;
+         mRoutes.push_back(route);
+      }
+
+      RouteStore::UriList process(const Uri& ruri) const
+      {
+         RouteStore::UriList result;
+         for(vector<Route>::const_iterator i = mRoutes.begin(); i != mRoutes.end(); ++i)
+         {
+            Data uri;
+            {
+               DataStream s(uri);
+               s << ruri;
+            }
+            if(regexec(i->preq, uri.c_str(), 0, 0, 0) == 0)
+            {
+               result.push_back(Uri(i->rewrite));
+            }
+         }
+         return result;
+      }
+
+   private:
+      struct Route
+      {
+         regex_t* preq;
+         Data rewrite;
+      };
+      vector<Route> mRoutes;
+};
+
+static bool
+sameTargets(const RouteStore::UriList& lhs, const RouteStore::UriList& rhs)
+{
+   if(lhs.size() != rhs.size())
+   {
+      return false;
+   }
+   for(size_t i = 0; i < lhs.size(); ++i)
+   {
+      if(Data::from(lhs[i]) != Data::from(rhs[i]))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+static void
+testBasics()
+{
+   cerr << "!! Test basics" << endl;
+   MemoryDb db;
+   RouteStore store(db);
+   Uri ruri("sip:18005551234@example.com");
+   assert(store.process(ruri, "INVITE", Data::Empty).empty());
+
+   assert(store.addRoute(Data::Empty, Data::Empty, "^sip:1800", "sip:tollfree@gw1.example.com", 2));
+   assert(store.addRoute(Data::Empty, Data::Empty, "^sip:1(800|888)", "sip:tollfree@gw2.example.com", 3));
+   assert(store.addRoute(Data::Empty, Data::Empty, "^sip:([0-9]+)@example\\.com$", "sip:$1@pstn.example.com", 1));
+   assert(store.addRoute("MESSAGE", Data::Empty, "^sip:1800", "sip:im@example.com", 0));
+   assert(store.addRoute(Data::Empty, Data::Empty, "^sip:18x?00", "sip:optional@example.com", 4));
+   assert(store.addRoute(Data::Empty, Data::Empty, "^sip:1900", "sip:premium@example.com", 5));
+   assert(!store.addRoute(Data::Empty, Data::Empty, "^sip:1800", "sip:duplicate@example.com", 6));
+
+   RouteStore::UriList targets = store.process(ruri, "INVITE", Data::Empty);
+   assert(targets.size() == 4);
+   assert(Data::from(targets[0]) == "sip:18005551234@pstn.example.com");
+   assert(Data::from(targets[1]) == "sip:tollfree@gw1.example.com");
+   assert(Data::from(targets[2]) == "sip:tollfree@gw2.example.com");
+   assert(Data::from(targets[3]) == "sip:optional@example.com");
+
+   targets = store.process(ruri, "MESSAGE", Data::Empty);
+   assert(targets.size() == 5);
+   assert(Data::from(targets[0]) == "sip:im@example.com");
+
+   store.eraseRoute(Data::Empty, Data::Empty, "^sip:1800");
+   targets = store.process(ruri, "INVITE", Data::Empty);
+   assert(targets.size() == 3);
+   assert(Data::from(targets[1]) == "sip:tollfree@gw2.example.com");
+
+   assert(store.updateRoute("::^sip:1900", Data::Empty, Data::Empty, "^sip:18005", "sip:updated@example.com", 0));
+   targets = store.process(ruri, "INVITE", Data::Empty);
+   assert(targets.size() == 4);
+   assert(Data::from(targets[0]) == "sip:updated@example.com");
+}
+
+static void
+testManyRoutes()
+{
+   const int numRoutes = 10000;
+   const int numLookups = 200;
+   cerr << "!! " << numRoutes << " routes" << endl;
+
+   MemoryDb db;
+   NaiveRoutes naive;
+   for(int i = 0; i < numRoutes; ++i)
+   {
+      // Mostly per-prefix routes, as you would see for a dial plan, with a
+      // few that have to be tried against every request.
+      Data pattern;
+      Data rewrite;
+      if(i % 1000 == 999)
+      {
+         pattern = "@domain" + Data(i) + "\\.example\\.com$";
+         rewrite = "sip:domain" + Data(i) + "@gw.example.com";
+      }
+      else
+      {
+         pattern = "^sip:1" + Data(100000 + i) + "[0-9]*@";
+         rewrite = "sip:prefix" + Data(i) + "@gw.example.com";
+      }
+      AbstractDb::RouteRecord rec;
+      rec.mMatchingPattern = pattern;
+      rec.mRewriteExpression = rewrite;
+      rec.mOrder = 0;
+      assert(db.addRoute("::" + pattern, rec));
+      naive.add(pattern, rewrite);
+   }
+   // Load them the way repro does at startup.
+   RouteStore store(db);
+
+   vector<Uri> uris;
+   for(int i = 0; i < numLookups; ++i)
+   {
+      const int route = (i * 7919) % (numRoutes + numRoutes/10);
+      uris.push_back(Uri("sip:1" + Data(100000 + route) + "5551234@domain" + 
+                         Data(route) + ".example.com"));
+   }
+
+   int matches = 0;
+   for(vector<Uri>::const_iterator i = uris.begin(); i != uris.end(); ++i)
+   {
+      RouteStore::UriList targets = store.process(*i, "INVITE", Data::Empty);
+      assert(sameTargets(targets, naive.process(*i)));
+      matches += (int)targets.size();
+   }
+   assert(matches > 0);
+
+   UInt64 start = Timer::getTimeMicroSec();
+   for(vector<Uri>::const_iterator i = uris.begin(); i != uris.end(); ++i)
+   {
+      naive.process(*i);
+   }
+   UInt64 naiveTime = Timer::getTimeMicroSec() - start;
+
+   start = Timer::getTimeMicroSec();
+   for(vector<Uri>::const_iterator i = uris.begin(); i != uris.end(); ++i)
+   {
+      store.process(*i, "INVITE", Data::Empty);
+   }
+   UInt64 storeTime = Timer::getTimeMicroSec() - start;
+
+   cerr << "regex per route: " << naiveTime/numLookups << "us per lookup" << endl;
+   cerr << "RouteStore:      " << storeTime/numLookups << "us per lookup" << endl;
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cerr, Log::Warning, argv[0]);
+   testBasics();
+   testManyRoutes();
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
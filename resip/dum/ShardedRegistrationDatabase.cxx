@@ -0,0 +1,533 @@
+#include <map>
+
+#include "resip/dum/ShardedRegistrationDatabase.hxx"
+#include "rutil/Condition.hxx"
+#include "rutil/DnsUtil.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+using namespace resip;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::DUM
+
+// Number of AORs whose contacts have expired that are cleaned up each time
+// a registration is updated
+static const unsigned int ExpiredPerUpdate = 4;
+
+ShardedRegistrationDatabase::AorKey::AorKey(const Uri& aor)
+{
+   // Same fields, and same host canonicalization, as Uri::operator<
+   mKey.reserve(aor.host().size() + aor.user().size() + aor.userParameters().size() + 8);
+   if(DnsUtil::isIpV6Address(aor.host()))
+   {
+      mKey = DnsUtil::canonicalizeIpV6Address(aor.host());
+   }
+   else
+   {
+      mKey = aor.host();
+      mKey.lowercase();
+   }
+   mKey += '\0';
+   mKey += Data(aor.port());
+   mKey += '\0';
+   mKey += aor.user();
+   mKey += '\0';
+   mKey += aor.userParameters();
+   mHash = mKey.hash();
+}
+
+bool
+ShardedRegistrationDatabase::AorKey::operator==(const AorKey& rhs) const
+{
+   return mHash == rhs.mHash && mKey == rhs.mKey;
+}
+
+bool
+ShardedRegistrationDatabase::AorKey::operator<(const AorKey& rhs) const
+{
+   return mKey < rhs.mKey;
+}
+
+HashValueImp(resip::ShardedRegistrationDatabase::AorKey, data.hash());
+
+class ShardedRegistrationDatabase::Record
+{
+   public:
+      Record(const AorKey& key, const Uri& aor) :
+         mKey(key),
+         mAor(aor),
+         mRegistered(false),
+         mLocked(false),
+         mIndexed(false)
+      {
+      }
+
+      const AorKey mKey;
+      const Uri mAor;
+      ContactList mContacts;
+      // False until contacts are added, and again once the AOR is removed;
+      // an unregistered record is only kept while it is locked.
+      bool mRegistered;
+      bool mLocked;
+      // Our entry in Shard::mExpiries, if mIndexed
+      bool mIndexed;
+      std::multimap<UInt64, Record*>::iterator mExpiry;
+};
+
+class ShardedRegistrationDatabase::Shard
+{
+   public:
+      Mutex mMutex;
+      Condition mRecordUnlocked;
+      HashMap<AorKey, Record*> mRecords;
+      // Registered records by when their first contact expires; only kept
+      // if mCheckExpiry is set.
+      std::multimap<UInt64, Record*> mExpiries;
+};
+
+class ShardedRegistrationDatabase::Sweeper : public ThreadIf
+{
+   public:
+      Sweeper(ShardedRegistrationDatabase& db, unsigned int intervalSecs) :
+         mDb(db),
+         mIntervalMs(intervalSecs * 1000)
+      {
+      }
+
+      virtual void thread()
+      {
+         while(!waitForShutdown(mIntervalMs))
+         {
+            mDb.removeExpired();
+         }
+      }
+
+   private:
+      ShardedRegistrationDatabase& mDb;
+      const int mIntervalMs;
+};
+
+ShardedRegistrationDatabase::ShardedRegistrationDatabase(bool checkExpiry,
+                                                         unsigned int numShards,
+                                                         unsigned int sweepIntervalSecs) :
+   mCheckExpiry(checkExpiry),
+   mSweeper(0)
+{
+   if(numShards == 0)
+   {
+      numShards = 1;
+   }
+   for(unsigned int i = 0; i < numShards; ++i)
+   {
+      mShards.push_back(new Shard);
+   }
+   if(mCheckExpiry && sweepIntervalSecs > 0)
+   {
+      mSweeper = new Sweeper(*this, sweepIntervalSecs);
+      mSweeper->run();
+   }
+}
+
+ShardedRegistrationDatabase::~ShardedRegistrationDatabase()
+{
+   if(mSweeper)
+   {
+      mSweeper->shutdown();
+      mSweeper->join();
+      delete mSweeper;
+   }
+   for(std::vector<Shard*>::iterator s = mShards.begin(); s != mShards.end(); ++s)
+   {
+      for(HashMap<AorKey, Record*>::iterator it = (*s)->mRecords.begin();
+          it != (*s)->mRecords.end(); ++it)
+      {
+         delete it->second;
+      }
+      delete *s;
+   }
+   mShards.clear();
+}
+
+ShardedRegistrationDatabase::Shard&
+ShardedRegistrationDatabase::shardFor(const AorKey& key)
+{
+   // The low bits of the hash also pick the bucket inside the shard's
+   // HashMap; use the high bits to pick the shard.
+   return *mShards[(key.hash() >> 16) % mShards.size()];
+}
+
+ShardedRegistrationDatabase::Record*
+ShardedRegistrationDatabase::find(Shard& shard, const AorKey& key)
+{
+   HashMap<AorKey, Record*>::iterator it = shard.mRecords.find(key);
+   return it == shard.mRecords.end() ? 0 : it->second;
+}
+
+ShardedRegistrationDatabase::Record&
+ShardedRegistrationDatabase::findOrCreate(Shard& shard, const AorKey& key, const Uri& aor)
+{
+   Record*& rec = shard.mRecords[key];
+   if(!rec)
+   {
+      rec = new Record(key, aor);
+   }
+   return *rec;
+}
+
+void
+ShardedRegistrationDatabase::unregister(Shard& shard, Record& rec)
+{
+   unindex(shard, rec);
+   rec.mContacts.clear();
+   rec.mRegistered = false;
+   if(!rec.mLocked)
+   {
+      shard.mRecords.erase(rec.mKey);
+      delete &rec;
+   }
+}
+
+void
+ShardedRegistrationDatabase::index(Shard& shard, Record& rec)
+{
+   if(!mCheckExpiry)
+   {
+      return;
+   }
+
+   UInt64 next = NeverExpire;
+   for(ContactList::const_iterator it = rec.mContacts.begin(); it != rec.mContacts.end(); ++it)
+   {
+      next = resipMin(next, it->mRegExpires);
+   }
+
+   if(rec.mIndexed)
+   {
+      if(rec.mExpiry->first == next)
+      {
+         return;
+      }
+      unindex(shard, rec);
+   }
+   if(next != NeverExpire)
+   {
+      rec.mExpiry = shard.mExpiries.insert(std::make_pair(next, &rec));
+      rec.mIndexed = true;
+   }
+}
+
+void
+ShardedRegistrationDatabase::unindex(Shard& shard, Record& rec)
+{
+   if(rec.mIndexed)
+   {
+      shard.mExpiries.erase(rec.mExpiry);
+      rec.mIndexed = false;
+   }
+}
+
+bool
+ShardedRegistrationDatabase::removeExpired(Shard& shard, Record& rec, UInt64 now)
+{
+   if(!mCheckExpiry || !rec.mRegistered)
+   {
+      return true;
+   }
+   if(rec.mIndexed && rec.mExpiry->first > now)
+   {
+      return true;
+   }
+
+   for(ContactList::iterator it = rec.mContacts.begin(); it != rec.mContacts.end(); )
+   {
+      if(it->mRegExpires <= now)
+      {
+         DebugLog(<< "ContactInstanceRecord expired: " << it->mContact);
+         it = rec.mContacts.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+
+   if(rec.mContacts.empty())
+   {
+      const bool locked = rec.mLocked;
+      unregister(shard, rec);
+      return locked;
+   }
+   index(shard, rec);
+   return true;
+}
+
+unsigned int
+ShardedRegistrationDatabase::removeExpired(Shard& shard, UInt64 now, unsigned int limit)
+{
+   unsigned int count = 0;
+   std::multimap<UInt64, Record*>::iterator it = shard.mExpiries.begin();
+   while(count < limit && it != shard.mExpiries.end() && it->first <= now)
+   {
+      // Re-indexing a record only ever moves it past now, so the next
+      // entry stays valid.
+      Record& rec = *(it++)->second;
+      removeExpired(shard, rec, now);
+      ++count;
+   }
+   return count;
+}
+
+unsigned int
+ShardedRegistrationDatabase::removeExpired()
+{
+   unsigned int count = 0;
+   if(mCheckExpiry)
+   {
+      UInt64 now = Timer::getTimeSecs();
+      for(std::vector<Shard*>::iterator s = mShards.begin(); s != mShards.end(); ++s)
+      {
+         Lock g((*s)->mMutex);
+         count += removeExpired(**s, now, (unsigned int)-1);
+      }
+   }
+   return count;
+}
+
+void
+ShardedRegistrationDatabase::addAor(const Uri& aor, const ContactList& contacts)
+{
+   AorKey key(aor);
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   Record& rec = findOrCreate(shard, key, aor);
+   rec.mContacts = contacts;
+   rec.mRegistered = true;
+   index(shard, rec);
+}
+
+void
+ShardedRegistrationDatabase::removeAor(const Uri& aor)
+{
+   AorKey key(aor);
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   Record* rec = find(shard, key);
+   if(rec && rec->mRegistered)
+   {
+      DebugLog (<< "Removed " << rec->mContacts.size() << " entries");
+      unregister(shard, *rec);
+   }
+}
+
+bool
+ShardedRegistrationDatabase::aorIsRegistered(const Uri& aor)
+{
+   AorKey key(aor);
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   Record* rec = find(shard, key);
+   if(!rec || !removeExpired(shard, *rec, Timer::getTimeSecs()))
+   {
+      return false;
+   }
+   return rec->mRegistered;
+}
+
+void
+ShardedRegistrationDatabase::lockRecord(const Uri& aor)
+{
+   AorKey key(aor);
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+
+   // The record can be dropped while we wait for it, so look it up again
+   // each time.
+   for(;;)
+   {
+      Record& rec = findOrCreate(shard, key, aor);
+      if(!rec.mLocked)
+      {
+         rec.mLocked = true;
+         return;
+      }
+      shard.mRecordUnlocked.wait(shard.mMutex);
+   }
+}
+
+void
+ShardedRegistrationDatabase::unlockRecord(const Uri& aor)
+{
+   AorKey key(aor);
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   Record* rec = find(shard, key);
+
+   // The record must have been inserted when we locked it in the first place
+   assert(rec && rec->mLocked);
+
+   rec->mLocked = false;
+   if(!rec->mRegistered)
+   {
+      shard.mRecords.erase(key);
+      delete rec;
+   }
+   shard.mRecordUnlocked.broadcast();
+}
+
+RegistrationPersistenceManager::update_status_t
+ShardedRegistrationDatabase::updateContact(const resip::Uri& aor,
+                                           const ContactInstanceRecord& rec)
+{
+   AorKey key(aor);
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   if(mCheckExpiry)
+   {
+      removeExpired(shard, Timer::getTimeSecs(), ExpiredPerUpdate);
+   }
+
+   Record& record = findOrCreate(shard, key, aor);
+   record.mRegistered = true;
+
+   update_status_t status = CONTACT_CREATED;
+   ContactList::iterator j;
+
+   // See if the contact is already present. We use URI matching rules here.
+   for (j = record.mContacts.begin(); j != record.mContacts.end(); j++)
+   {
+      if (*j == rec)
+      {
+         *j = rec;
+         status = CONTACT_UPDATED;
+         break;
+      }
+   }
+
+   if(status == CONTACT_CREATED)
+   {
+      // This is a new contact, so we add it to the list.
+      record.mContacts.push_back(rec);
+   }
+   index(shard, record);
+   return status;
+}
+
+void
+ShardedRegistrationDatabase::removeContact(const Uri& aor,
+                                           const ContactInstanceRecord& rec)
+{
+   AorKey key(aor);
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   Record* record = find(shard, key);
+   if(!record || !record->mRegistered)
+   {
+      return;
+   }
+
+   // See if the contact is present. We use URI matching rules here.
+   for (ContactList::iterator j = record->mContacts.begin(); j != record->mContacts.end(); j++)
+   {
+      if (*j == rec)
+      {
+         record->mContacts.erase(j);
+         if (record->mContacts.empty())
+         {
+            unregister(shard, *record);
+         }
+         else
+         {
+            index(shard, *record);
+         }
+         return;
+      }
+   }
+}
+
+void
+ShardedRegistrationDatabase::getContacts(const Uri& aor, ContactList& container)
+{
+   AorKey key(aor);
+   Shard& shard = shardFor(key);
+   Lock g(shard.mMutex);
+   Record* rec = find(shard, key);
+   if(!rec || !removeExpired(shard, *rec, Timer::getTimeSecs()))
+   {
+      container.clear();
+      return;
+   }
+   container = rec->mContacts;
+}
+
+void
+ShardedRegistrationDatabase::getAors(UriList& container)
+{
+   container.clear();
+   for(std::vector<Shard*>::iterator s = mShards.begin(); s != mShards.end(); ++s)
+   {
+      Lock g((*s)->mMutex);
+      for(HashMap<AorKey, Record*>::const_iterator it = (*s)->mRecords.begin();
+          it != (*s)->mRecords.end(); ++it)
+      {
+         // not the placeholders lockRecord() makes for unregistered AORs
+         if(it->second->mRegistered)
+         {
+            container.push_back(it->second->mAor);
+         }
+      }
+   }
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
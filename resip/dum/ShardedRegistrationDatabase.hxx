@@ -0,0 +1,159 @@
+#if !defined(RESIP_SHARDEDREGISTRATIONDATABASE_HXX)
+#define RESIP_SHARDEDREGISTRATIONDATABASE_HXX
+
+#include <vector>
+
+#include "resip/dum/RegistrationPersistenceManager.hxx"
+#include "rutil/HashMap.hxx"
+
+namespace resip
+{
+
+/**
+  In-memory persistence manager for large numbers of registrations.
+
+  Behaves like InMemoryRegistrationDatabase, but AORs are spread over a
+  number of shards by a hash of the AOR, and each shard has its own lock.
+  Requests for different AORs rarely contend with each other, and lookups
+  are hash lookups rather than a walk down a tree comparing whole Uris.
+
+  If checkExpiry is set, each shard also keeps its AORs ordered by the time
+  their next contact expires. Expired contacts are then removed a few at a
+  time as registrations are updated, and removeExpired() removes all of
+  them, without looking at AORs that have nothing to expire. Shards that
+  see no updates are only cleaned up by removeExpired(), which a thread of
+  our own calls every sweepIntervalSecs if that is set.
+*/
+class ShardedRegistrationDatabase : public RegistrationPersistenceManager
+{
+   public:
+      /**
+       * @param checkExpiry if set, then expired contacts are removed, and
+       *                    aorIsRegistered() and getContacts() never report
+       *                    them.
+       * @param numShards   number of independently locked parts the
+       *                    database is split into.
+       * @param sweepIntervalSecs if set (and checkExpiry is), how often a
+       *                    background thread calls removeExpired().
+       */
+      ShardedRegistrationDatabase(bool checkExpiry = false, unsigned int numShards = 64,
+                                  unsigned int sweepIntervalSecs = 0);
+      virtual ~ShardedRegistrationDatabase();
+
+      virtual void addAor(const Uri& aor, const ContactList& contacts);
+      virtual void removeAor(const Uri& aor);
+      virtual bool aorIsRegistered(const Uri& aor);
+
+      virtual void lockRecord(const Uri& aor);
+      virtual void unlockRecord(const Uri& aor);
+
+      virtual update_status_t updateContact(const resip::Uri& aor,
+                                            const ContactInstanceRecord& rec);
+      virtual void removeContact(const Uri& aor,
+                                 const ContactInstanceRecord& rec);
+
+      virtual void getContacts(const Uri& aor, ContactList& container);
+
+      /// return all the AOR in the DB
+      virtual void getAors(UriList& container);
+
+      /// Removes all expired contacts now (only if checkExpiry is set).
+      /// @return the number of AORs that were looked at
+      unsigned int removeExpired();
+
+      /**
+         The parts of an AOR that Uri::operator< compares, flattened into a
+         string along with its hash, so they are worked out once per request.
+      */
+      class AorKey
+      {
+         public:
+            explicit AorKey(const Uri& aor);
+            bool operator==(const AorKey& rhs) const;
+            bool operator<(const AorKey& rhs) const;
+            size_t hash() const { return mHash; }
+
+         private:
+            Data mKey;
+            size_t mHash;
+      };
+
+   private:
+      class Record;
+      class Shard;
+      class Sweeper;
+
+      Shard& shardFor(const AorKey& key);
+      Record* find(Shard& shard, const AorKey& key);
+      Record& findOrCreate(Shard& shard, const AorKey& key, const Uri& aor);
+      // Forgets rec's contacts, and drops rec unless it is locked.
+      void unregister(Shard& shard, Record& rec);
+      // Brings rec's entry in the expiry index up to date
+      void index(Shard& shard, Record& rec);
+      void unindex(Shard& shard, Record& rec);
+      // Removes rec's expired contacts; returns false if none were left,
+      // and rec was dropped.
+      bool removeExpired(Shard& shard, Record& rec, UInt64 now);
+      // Removes expired contacts from up to limit of the shard's AORs
+      unsigned int removeExpired(Shard& shard, UInt64 now, unsigned int limit);
+
+      const bool mCheckExpiry;
+      std::vector<Shard*> mShards;
+      Sweeper* mSweeper;
+};
+
+}
+
+HashValue(resip::ShardedRegistrationDatabase::AorKey);
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,326 @@
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <vector>
+
+#include "resip/dum/InMemoryRegistrationDatabase.hxx"
+#include "resip/dum/ShardedRegistrationDatabase.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/Random.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+static ContactInstanceRecord
+contact(const Data& uri, UInt64 expires)
+{
+   ContactInstanceRecord rec;
+   rec.mContact = NameAddr(Uri(uri));
+   rec.mRegExpires = expires;
+   rec.mLastUpdated = Timer::getTimeSecs();
+   return rec;
+}
+
+static Uri
+aor(int i)
+{
+   return Uri("sip:user" + Data(i) + "@example.com");
+}
+
+static set<Data>
+contactSet(RegistrationPersistenceManager& db, const Uri& aor)
+{
+   ContactList contacts;
+   db.getContacts(aor, contacts);
+   set<Data> result;
+   for(ContactList::const_iterator i = contacts.begin(); i != contacts.end(); ++i)
+   {
+      result.insert(Data::from(i->mContact.uri()));
+   }
+   return result;
+}
+
+static void
+testBasics()
+{
+   cerr << "!! Test basics" << endl;
+   ShardedRegistrationDatabase db;
+   const UInt64 later = Timer::getTimeSecs() + 3600;
+
+   // Equal AORs find the same record, whatever the host's case.
+   assert(db.updateContact(Uri("sip:alice@Example.COM"), contact("sip:alice@1.2.3.4", later)) ==
+          RegistrationPersistenceManager::CONTACT_CREATED);
+   assert(db.aorIsRegistered(Uri("sip:alice@example.com")));
+   assert(db.updateContact(Uri("sip:alice@example.com"), contact("sip:alice@1.2.3.4", later + 1)) ==
+          RegistrationPersistenceManager::CONTACT_UPDATED);
+   assert(!db.aorIsRegistered(Uri("sip:alice@example.com:5070")));
+   assert(!db.aorIsRegistered(Uri("sip:bob@example.com")));
+
+   db.updateContact(Uri("sip:alice@example.com"), contact("sip:alice@5.6.7.8", later));
+   assert(contactSet(db, Uri("sip:alice@example.com")).size() == 2);
+
+   db.removeContact(Uri("sip:alice@example.com"), contact("sip:alice@1.2.3.4", 0));
+   assert(contactSet(db, Uri("sip:alice@example.com")).size() == 1);
+   db.removeContact(Uri("sip:alice@example.com"), contact("sip:alice@5.6.7.8", 0));
+   assert(!db.aorIsRegistered(Uri("sip:alice@example.com")));
+
+   // A locked record survives being removed until it is unlocked.
+   db.lockRecord(Uri("sip:carol@example.com"));
+   db.updateContact(Uri("sip:carol@example.com"), contact("sip:carol@1.2.3.4", later));
+   db.removeAor(Uri("sip:carol@example.com"));
+   assert(!db.aorIsRegistered(Uri("sip:carol@example.com")));
+   db.unlockRecord(Uri("sip:carol@example.com"));
+
+   // Locking an AOR doesn't make it one.
+   db.lockRecord(Uri("sip:dave@example.com"));
+   RegistrationPersistenceManager::UriList aors;
+   db.getAors(aors);
+   assert(aors.empty());
+   db.unlockRecord(Uri("sip:dave@example.com"));
+}
+
+static void
+testExpiry()
+{
+   cerr << "!! Test expiry" << endl;
+   ShardedRegistrationDatabase db(true, 4);
+   const UInt64 now = Timer::getTimeSecs();
+   for(int i = 0; i < 100; ++i)
+   {
+      db.updateContact(aor(i), contact("sip:a@1.2.3.4", i % 2 ? now - 1 : now + 3600));
+      if(i % 4 == 0)
+      {
+         db.updateContact(aor(i), contact("sip:b@1.2.3.4", now - 1));
+      }
+   }
+   assert(!db.aorIsRegistered(aor(1)));
+   assert(contactSet(db, aor(0)).size() == 1);
+   db.removeExpired();
+
+   RegistrationPersistenceManager::UriList aors;
+   db.getAors(aors);
+   assert(aors.size() == 50);
+   // Nothing is left to expire, so nothing needs to be looked at.
+   assert(db.removeExpired() == 0);
+
+   // Never-expiring contacts are never reaped.
+   db.updateContact(aor(1), contact("sip:a@1.2.3.4", NeverExpire));
+   assert(db.removeExpired() == 0);
+   assert(db.aorIsRegistered(aor(1)));
+}
+
+// Expired contacts go away without anything else happening to the database.
+static void
+testSweeper()
+{
+   cerr << "!! Test sweeper" << endl;
+   ShardedRegistrationDatabase db(true, 4, 1);
+   const UInt64 now = Timer::getTimeSecs();
+   for(int i = 0; i < 10; ++i)
+   {
+      db.updateContact(aor(i), contact("sip:a@1.2.3.4", now - 1));
+   }
+
+   RegistrationPersistenceManager::UriList aors;
+   const UInt64 deadline = Timer::getTimeMs() + 5000;
+   do
+   {
+      sleepMs(100);
+      db.getAors(aors);
+   } while(!aors.empty() && Timer::getTimeMs() < deadline);
+   assert(aors.empty());
+}
+
+// Runs the same operations against both databases and checks they agree.
+static void
+testAgainstInMemory()
+{
+   cerr << "!! Test against InMemoryRegistrationDatabase" << endl;
+   InMemoryRegistrationDatabase expected;
+   ShardedRegistrationDatabase db(false, 8);
+   const UInt64 later = Timer::getTimeSecs() + 3600;
+   for(int n = 0; n < 20000; ++n)
+   {
+      const Uri a = aor(Random::getRandom() % 200);
+      const ContactInstanceRecord rec = contact("sip:c" + Data(Random::getRandom() % 3) + "@1.2.3.4", later);
+      switch(Random::getRandom() % 4)
+      {
+         case 0:
+         case 1:
+            assert(db.updateContact(a, rec) == expected.updateContact(a, rec));
+            break;
+         case 2:
+            db.removeContact(a, rec);
+            expected.removeContact(a, rec);
+            break;
+         case 3:
+            db.lockRecord(a);
+            expected.lockRecord(a);
+            db.removeAor(a);
+            expected.removeAor(a);
+            db.unlockRecord(a);
+            expected.unlockRecord(a);
+            break;
+      }
+      assert(db.aorIsRegistered(a) == expected.aorIsRegistered(a));
+      assert(contactSet(db, a) == contactSet(expected, a));
+   }
+}
+
+class Registerer : public ThreadIf
+{
+   public:
+      Registerer(RegistrationPersistenceManager& db, int first, int count) :
+         mDb(db), mFirst(first), mCount(count) {}
+      virtual void thread()
+      {
+         const UInt64 later = Timer::getTimeSecs() + 3600;
+         for(int i = mFirst; i < mFirst + mCount; ++i)
+         {
+            const Uri a = aor(i % 1000);
+            mDb.lockRecord(a);
+            mDb.updateContact(a, contact("sip:c" + Data(i) + "@1.2.3.4", later));
+            ContactList contacts;
+            mDb.getContacts(a, contacts);
+            assert(!contacts.empty());
+            mDb.removeContact(a, contact("sip:c" + Data(i) + "@1.2.3.4", later));
+            mDb.unlockRecord(a);
+         }
+      }
+
+   private:
+      RegistrationPersistenceManager& mDb;
+      const int mFirst;
+      const int mCount;
+};
+
+static void
+testThreads()
+{
+   cerr << "!! Test threads" << endl;
+   ShardedRegistrationDatabase db(true, 16);
+   vector<Registerer*> threads;
+   for(int i = 0; i < 4; ++i)
+   {
+      threads.push_back(new Registerer(db, i * 20000, 20000));
+      threads.back()->run();
+   }
+   for(int i = 0; i < 4; ++i)
+   {
+      threads[i]->join();
+      delete threads[i];
+   }
+   RegistrationPersistenceManager::UriList aors;
+   db.getAors(aors);
+   assert(aors.empty());
+}
+
+static void
+timeRegistrations(const char* name, RegistrationPersistenceManager& db, int count)
+{
+   const ContactInstanceRecord rec(contact("sip:c@1.2.3.4", Timer::getTimeSecs() + 3600));
+   vector<Uri> aors;
+   for(int i = 0; i < count; ++i)
+   {
+      aors.push_back(aor(i));
+   }
+
+   UInt64 start = Timer::getTimeMicroSec();
+   for(int i = 0; i < count; ++i)
+   {
+      db.lockRecord(aors[i]);
+      db.updateContact(aors[i], rec);
+      db.unlockRecord(aors[i]);
+   }
+   UInt64 registered = Timer::getTimeMicroSec();
+   ContactList contacts;
+   for(int i = 0; i < count; ++i)
+   {
+      db.getContacts(aors[(i * 7919) % count], contacts);
+   }
+   UInt64 done = Timer::getTimeMicroSec();
+   cerr << name << ": register " << (registered - start) / 1000 << "ms, look up "
+        << (done - registered) / 1000 << "ms" << endl;
+}
+
+static void
+testPerformance()
+{
+   const int count = 200000;
+   cerr << "!! Performance with " << count << " AORs" << endl;
+   {
+      InMemoryRegistrationDatabase db;
+      timeRegistrations("InMemoryRegistrationDatabase", db, count);
+   }
+   {
+      ShardedRegistrationDatabase db(true);
+      timeRegistrations("ShardedRegistrationDatabase", db, count);
+   }
+}
+
+int
+main(int argc, char* argv[])
+{
+   Log::initialize(Log::Cerr, Log::Warning, argv[0]);
+   testBasics();
+   testExpiry();
+   testSweeper();
+   testAgainstInMemory();
+   testThreads();
+   testPerformance();
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
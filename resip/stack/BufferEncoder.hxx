@@ -0,0 +1,132 @@
+#if !defined(RESIP_BUFFERENCODER_HXX)
+#define RESIP_BUFFERENCODER_HXX
+
+#include <vector>
+
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+
+namespace resip
+{
+
+/**
+   @internal
+   @brief Collects the pieces of an encoded message, and then copies them into
+   a buffer in one go, growing it at most once.
+
+   Bytes that will stay put until writeTo() (the raw header values of a
+   received message, header names, static separators) are only referred to,
+   never copied twice. Whatever must be encoded through a stream (headers or a
+   start line that have been modified, contents) is written to stream() and
+   ended with endStream(); those bytes wait in a scratch buffer.
+
+   Used by SipMessage::encodeToBuffer().
+*/
+class BufferEncoder
+{
+   public:
+      BufferEncoder();
+
+      void append(const char* start, Data::size_type length)
+      {
+         if(length)
+         {
+            Piece piece = {start, 0, length};
+            mPieces.push_back(piece);
+            mSize += length;
+         }
+      }
+
+      void append(const Data& data)
+      {
+         append(data.data(), data.size());
+      }
+
+      EncodeStream& stream()
+      {
+         return mStream;
+      }
+
+      /// Ends whatever was written to stream() since the last call.
+      void endStream();
+
+      /// Number of bytes appended so far
+      Data::size_type size() const
+      {
+         return mSize;
+      }
+
+      /// Appends everything to buffer.
+      void writeTo(Data& buffer) const;
+
+   private:
+      struct Piece
+      {
+         const char* start; // 0 for pieces in mScratch
+         Data::size_type offset;
+         Data::size_type length;
+      };
+
+      std::vector<Piece> mPieces;
+      Data mScratch;
+      oDataStream mStream;
+      Data::size_type mStreamed;
+      Data::size_type mSize;
+
+      BufferEncoder(const BufferEncoder&);
+      BufferEncoder& operator=(const BufferEncoder&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -154,44 +154,28 @@ Connection::performWrite()
    {
       mSendingTransmissionFormat = WebSocketData;
    }
-   else if(mSendingTransmissionFormat == WebSocketData)
+   else if(mSendingTransmissionFormat == WebSocketData &&
+           mSendPos == 0 && !mOutstandingSends.front()->framed)
    {
-      SendData *dataWs, *oldSd;
-      const Data& dataRaw = mOutstandingSends.front()->data;
-      UInt64 dataSize = 1 + 1 + dataRaw.size();
-      UInt64 lSize = (UInt64)dataRaw.size();
-      UInt8* uBuffer;
-
-      if(lSize > 0x7D && lSize <= 0xFFFF)
-      {
-         dataSize += 2;
-      }
-      else if(lSize > 0xFFFF)
-      {
-         dataSize += 8;
-      }
-
-      oldSd = mOutstandingSends.front();
-      dataWs = new SendData(oldSd->destination,
-            Data(Data::Take, new char[(int)dataSize], (Data::size_type)dataSize),
-            oldSd->transactionId,
-            oldSd->sigcompId,
-            false);
-      assert(dataWs && dataWs->data.data());
-      uBuffer = (UInt8*)dataWs->data.data();
+      // The frame header goes out ahead of the (possibly shared) payload,
+      // rather than copying the payload in behind it.
+      SendData* sd = mOutstandingSends.front();
+      UInt64 lSize = (UInt64)sd->data.size();
+      UInt8 uBuffer[10];
+      int headerSize;
 
       uBuffer[0] = 0x82;
       if(lSize <= 0x7D)
       {
          uBuffer[1] = (UInt8)lSize;
-         uBuffer = &uBuffer[2];
+         headerSize = 2;
       }
       else if(lSize <= 0xFFFF)
       {
          uBuffer[1] = 0x7E;
          uBuffer[2] = (UInt8)((lSize >> 8) & 0xFF);
          uBuffer[3] = (UInt8)(lSize & 0xFF);
-         uBuffer = &uBuffer[4];
+         headerSize = 4;
       }
       else
       {
@@ -204,13 +188,10 @@ Connection::performWrite()
          uBuffer[7] = (UInt8)((lSize >> 16) & 0xFF);
          uBuffer[8] = (UInt8)((lSize >> 8) & 0xFF);
          uBuffer[9] = (UInt8)(lSize & 0xFF);
-         uBuffer = &uBuffer[10];
+         headerSize = 10;
       }
-
-      memcpy(uBuffer, dataRaw.data(), dataRaw.size());
-      mOutstandingSends.front() = dataWs;
-      dataWs = 0;
-      delete oldSd;
+      sd->header = Data((const char*)uBuffer, headerSize);
+      sd->framed = true;
    }
 
 #ifdef USE_SIGCOMP
@@ -247,9 +228,27 @@ Connection::performWrite()
       mTransport->callSocketFunc(getSocket());
    }
 
+   if (!canWritev())
+   {
+      // A write that has to be retried (TLS, after SSL_ERROR_WANT_WRITE)
+      // must be handed the same buffer again, so this is not done per write.
+      mOutstandingSends.front()->joinHeader();
+   }
+   const Data& header = mOutstandingSends.front()->header;
    const Data& data = mOutstandingSends.front()->data;
+   const Data::size_type total = header.size() + data.size();
 
-   int nBytes = write(data.data() + mSendPos,int(data.size() - mSendPos));
+   int nBytes;
+   if (mSendPos < header.size())
+   {
+      nBytes = writev(header.data() + mSendPos, int(header.size() - mSendPos),
+                      data.data(), int(data.size()));
+   }
+   else
+   {
+      Data::size_type pos = mSendPos - header.size();
+      nBytes = write(data.data() + pos, int(data.size() - pos));
+   }
 
    //DebugLog (<< "Tried to send " << data.size() - mSendPos << " bytes, sent " << nBytes << " bytes");
 
@@ -270,7 +269,7 @@ Connection::performWrite()
       // Safe because of the conditional above ( < 0 ).
       Data::size_type bytesWritten = static_cast<Data::size_type>(nBytes);
       mSendPos += bytesWritten;
-      if (mSendPos == data.size())
+      if (mSendPos == total)
       {
          mSendPos = 0;
          removeFrontOutstandingSend();
@@ -308,6 +307,18 @@ Connection::ensureWritable()
    }
 }
 
+bool
+Connection::suspendPolling()
+{
+   return getConnectionManager().suspendPolling(this);
+}
+
+void
+Connection::resumePolling()
+{
+   getConnectionManager().resumePolling(this);
+}
+
 ConnectionManager&
 Connection::getConnectionManager() const
 {
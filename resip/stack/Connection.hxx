@@ -109,12 +109,26 @@ class Connection : public ConnectionBase,
       virtual int read(char* /* buffer */, const int /* count */) { return 0; }
       /// pure virtual, but need concrete Connection for book-ends of lists
       virtual int write(const char* /* buffer */, const int /* count */) { return 0; }
+      /** Writes first, then second, in one go; returns what write() would
+          for the two together. Only used if canWritev(). */
+      virtual int writev(const char* /* first */, const int /* firstCount */,
+                         const char* /* second */, const int /* secondCount */) { return -1; }
+      /** false if the connection only has write(); a SendData's header is
+          then joined onto its data, once, before any of it is written. */
+      virtual bool canWritev() const { return false; }
       virtual void onDoubleCRLF();
       virtual void onSingleCRLF();
 
       /* callback method of FdPollItemIf */
       virtual void processPollEvent(FdPollEventMask mask);
 
+      /** Stops polling this connection's socket, for while something other
+          than the transport thread is using the connection, and restores it
+          afterwards. Only possible when the transport uses a FdPollGrp.
+          @return false if polling could not be suspended */
+      bool suspendPolling();
+      void resumePolling();
+
    private:
       ConnectionManager& getConnectionManager() const;
       void removeFrontOutstandingSend();
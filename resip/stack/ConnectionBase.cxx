@@ -179,6 +179,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
 
          assert(mTransport);
          mMessage = new SipMessage(&mTransport->getTuple());
+         mRxBytes.clear();
          
          DebugLog(<< "ConnectionBase::process setting source " << mWho);
          mMessage->setSource(mWho);
@@ -272,6 +273,7 @@ ConnectionBase::preparseNewBytes(int bytesRead)
             return true;
          }
 
+         keepRxBytes(mBuffer, unprocessedCharPtr - mBuffer);
          mMessage->addBuffer(mBuffer);
          mBuffer=0;
 
@@ -403,6 +405,8 @@ ConnectionBase::preparseNewBytes(int bytesRead)
                }
 
                // The message body is complete.
+               keepRxBytes(unprocessedCharPtr, contentLength);
+               logRxBytes();
                mMessage->setBody(unprocessedCharPtr, (UInt32)contentLength);
                CongestionManager::RejectionBehavior b=mTransport->getRejectionBehaviorForIncoming();
                if (b==CongestionManager::REJECTING_NON_ESSENTIAL
@@ -473,6 +477,8 @@ ConnectionBase::preparseNewBytes(int bytesRead)
          mBufferPos += bytesRead;
          if (mBufferPos == contentLength)
          {
+            keepRxBytes(mBuffer, contentLength);
+            logRxBytes();
             mMessage->addBuffer(mBuffer);
             mMessage->setBody(mBuffer, (UInt32)contentLength);
             mBuffer=0;
@@ -701,6 +707,34 @@ ConnectionBase::wsProcessHandshake(int bytesRead, bool &dropConnection)
    return true;
 }
 
+void
+ConnectionBase::keepRxBytes(const char* data, size_t len)
+{
+   if (mTransport && mTransport->getSipMessageLoggingHandler())
+   {
+      if (mRxBytes.empty())
+      {
+         // Leading CRLFs are keepalives the header scanner skips over
+         while (len > 0 && (*data == '\r' || *data == '\n'))
+         {
+            ++data;
+            --len;
+         }
+      }
+      mRxBytes.append(data, (Data::size_type)len);
+   }
+}
+
+void
+ConnectionBase::logRxBytes()
+{
+   if (!mRxBytes.empty())
+   {
+      mTransport->logRxBytes(mWho, mRxBytes.data(), mRxBytes.size());
+      mRxBytes.clear();
+   }
+}
+
 bool
 ConnectionBase::scanMsgHeader(int bytesRead)
 {
@@ -818,6 +852,7 @@ ConnectionBase::wsProcessData(int bytesRead)
       Data::size_type msg_len = msg->size();
       // cast permitted, as it is borrowed:
       char *sipBuffer = (char *)msg->data();
+      mTransport->logRxBytes(mWho, sipBuffer, msg_len);
       mMessage->addBuffer(sipBuffer);
       mMsgHeaderScanner.prepareForMessage(mMessage);
       char *unprocessedCharPtr;
@@ -904,6 +939,7 @@ ConnectionBase::decompressNewBytes(int bytesRead)
 
     char *sipBuffer = new char[bytesUncompressed];
     memmove(sipBuffer, uncompressed, bytesUncompressed);
+    mTransport->logRxBytes(mWho, sipBuffer, bytesUncompressed);
     mMessage->addBuffer(sipBuffer);
     mMsgHeaderScanner.prepareForMessage(mMessage);
     char *unprocessedCharPtr;
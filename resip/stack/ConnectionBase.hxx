@@ -103,6 +103,8 @@ class ConnectionBase
       std::auto_ptr<Data> makeWsHandshakeResponse();
       bool isUsingSecWebSocketKey();
       bool isUsingDeprecatedSecWebSocketKeys();
+      void keepRxBytes(const char* data, size_t len);
+      void logRxBytes();
    protected:
       virtual void onDoubleCRLF(){}
       virtual void onSingleCRLF(){}
@@ -121,6 +123,9 @@ class ConnectionBase
       char* mBuffer;
       size_t mBufferPos;
       size_t mBufferSize;
+      // The bytes of mMessage as received, only kept while the transport has
+      // a SipMessageLoggingHandler
+      Data mRxBytes;
       WsFrameExtractor mWsFrameExtractor;
 
       static char connectionStates[MAX][32];
@@ -179,6 +179,27 @@ ConnectionManager::removeFromWritable(Connection* conn)
    }
 }
 
+bool
+ConnectionManager::suspendPolling(Connection* conn)
+{
+   // Without a FdPollGrp the fdset is rebuilt from the read list on every
+   // pass, so there is nothing to suspend.
+   if ( mPollGrp && conn->mPollItemHandle )
+   {
+      mPollGrp->modPollItem(conn->mPollItemHandle, FPEM_Error);
+      return true;
+   }
+   return false;
+}
+
+void
+ConnectionManager::resumePolling(Connection* conn)
+{
+   assert(mPollGrp);
+   mPollGrp->modPollItem(conn->mPollItemHandle, 
+                         conn->mInWritable ? FPEM_Read|FPEM_Write|FPEM_Error : FPEM_Read|FPEM_Error);
+}
+
 void
 ConnectionManager::addConnection(Connection* connection)
 {
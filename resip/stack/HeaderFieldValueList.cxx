@@ -5,6 +5,7 @@
 
 #include <cassert>
 
+#include "resip/stack/BufferEncoder.hxx"
 #include "resip/stack/HeaderFieldValue.hxx"
 #include "resip/stack/HeaderFieldValueList.hxx"
 #include "resip/stack/ParserContainerBase.hxx"
@@ -136,6 +137,72 @@ HeaderFieldValueList::encode(const Data& headerName, EncodeStream& str) const
    return str;
 }
 
+void
+HeaderFieldValueList::encode(int headerEnum, BufferEncoder& encoder) const
+{
+   const Data& headerName = Headers::getHeaderName(static_cast<Headers::Type>(headerEnum));
+
+   if (getParserContainer() != 0)
+   {
+      getParserContainer()->encode(headerName, encoder);
+   }
+   else
+   {
+      if (!headerName.empty())
+      {
+         encoder.append(headerName);
+         encoder.append(": ", 2);
+      }
+
+      for (HeaderFieldValueList::const_iterator j = begin();
+           j != end(); j++)
+      {
+         if (j != begin())
+         {
+            if (Headers::isCommaEncoding(static_cast<Headers::Type>(headerEnum)))
+            {
+               encoder.append(", ", 2);
+            }
+            else
+            {
+               encoder.append("\r\n", 2);
+               encoder.append(headerName);
+               encoder.append(": ", 2);
+            }
+         }
+         encoder.append(j->getBuffer(), j->getLength());
+      }
+      encoder.append("\r\n", 2);
+   }
+}
+
+void
+HeaderFieldValueList::encode(const Data& headerName, BufferEncoder& encoder) const
+{
+   if (getParserContainer() != 0)
+   {
+      getParserContainer()->encode(headerName, encoder);
+   }
+   else
+   {
+      if (!headerName.empty())
+      {
+         encoder.append(headerName);
+         encoder.append(": ", 2);
+      }
+      for (HeaderFieldValueList::const_iterator j = begin();
+           j != end(); j++)
+      {
+         if (j != begin())
+         {
+            encoder.append(", ", 2);
+         }
+         encoder.append(j->getBuffer(), j->getLength());
+      }
+      encoder.append("\r\n", 2);
+   }
+}
+
 EncodeStream&
 HeaderFieldValueList::encodeEmbedded(const Data& headerName, EncodeStream& str) const
 {
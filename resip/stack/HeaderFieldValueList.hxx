@@ -13,6 +13,7 @@ namespace resip
 class Data;
 class ParserContainerBase;
 class HeaderFieldValue;
+class BufferEncoder;
 
 /**
    @internal
@@ -44,6 +45,8 @@ class HeaderFieldValueList
 
       EncodeStream& encode(int headerEnum, EncodeStream& str) const;
       EncodeStream& encode(const Data& headerName, EncodeStream& str) const;
+      void encode(int headerEnum, BufferEncoder& encoder) const;
+      void encode(const Data& headerName, BufferEncoder& encoder) const;
       EncodeStream& encodeEmbedded(const Data& headerName, EncodeStream& str) const;
 
       bool empty() const {return mHeaders.empty();}
@@ -35,8 +35,16 @@ InternalTransport::InternalTransport(Fifo<TransactionMessage>& rxFifo,
    mInterruptorHandle(0),
    mTxFifoOutBuffer(mTxFifo),
    mPollGrp(NULL),
-   mPollItemHandle(NULL)
-{}
+   mPollItemHandle(NULL),
+   mTxLatencyRecorder(0)
+{
+   if((transportFlags & RESIP_TRANSPORT_FLAG_LOCKFREE_TXFIFO) &&
+      !mTxFifo.setLockFree(true))
+   {
+      WarningLog(<< "Lock-free tx fifo is not supported on this platform; "
+                    "falling back to a locking fifo.");
+   }
+}
 
 InternalTransport::~InternalTransport()
 {
@@ -190,6 +198,10 @@ InternalTransport::hasDataToSend() const
 void
 InternalTransport::send(std::auto_ptr<SendData> data)
 {
+   if(mTxLatencyRecorder)
+   {
+      data->queuedTime = Timer::getTimeMicroSec();
+   }
    mTxFifo.add(data.release());
 }
 
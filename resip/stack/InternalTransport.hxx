@@ -9,6 +9,8 @@
 #include "rutil/Fifo.hxx"
 #include "rutil/Socket.hxx"
 #include "rutil/FdPoll.hxx"
+#include "rutil/LatencyHistogram.hxx"
+#include "rutil/Timer.hxx"
 #include "resip/stack/Message.hxx"
 #include "resip/stack/Transport.hxx"
 #include "resip/stack/Tuple.hxx"
@@ -80,6 +82,11 @@ class InternalTransport : public Transport
             mCongestionManager->registerFifo(&mTxFifo);
          }
       }
+
+      virtual void setFifoLatencyRecorder(LatencyRecorder* recorder)
+      {
+         mTxLatencyRecorder=recorder;
+      }
    protected:
       friend class SipStack;
 
@@ -97,6 +104,16 @@ class InternalTransport : public Transport
       FdPollGrp *mPollGrp;      // not owned by transport, just used
       // FdPollItemIf *mPollItem;	// owned by the transport
       FdPollItemHandle mPollItemHandle; // owned by the transport
+      LatencyRecorder* mTxLatencyRecorder; // not owned, may be 0
+
+      // To be called by the transport thread once it takes data off mTxFifo.
+      void recordTxFifoLatency(const SendData& data)
+      {
+         if(mTxLatencyRecorder && data.queuedTime)
+         {
+            mTxLatencyRecorder->recordLatency(Timer::getTimeMicroSec() - data.queuedTime);
+         }
+      }
 };
 
 
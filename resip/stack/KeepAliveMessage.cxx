@@ -46,6 +46,12 @@ KeepAliveMessage::encode(EncodeStream& str) const
    return str;
 }
 
+void
+KeepAliveMessage::encodeToBuffer(Data& buffer) const
+{
+   buffer += Symbols::CRLFCRLF;
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
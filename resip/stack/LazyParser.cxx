@@ -5,6 +5,7 @@
 
 #include <cassert>
 
+#include "resip/stack/BufferEncoder.hxx"
 #include "resip/stack/Headers.hxx"
 #include "resip/stack/HeaderFieldValue.hxx"
 #include "resip/stack/LazyParser.hxx"
@@ -115,6 +116,20 @@ LazyParser::encode(EncodeStream& str) const
    }
 }
 
+void
+LazyParser::encode(BufferEncoder& encoder) const
+{
+   if (mState == DIRTY)
+   {
+      encodeParsed(encoder.stream());
+      encoder.endStream();
+   }
+   else
+   {
+      encoder.append(mHeaderField.getBuffer(), mHeaderField.getLength());
+   }
+}
+
 #ifndef  RESIP_USE_STL_STREAMS
 EncodeStream&
 resip::operator<<(EncodeStream&s, const LazyParser& lp)
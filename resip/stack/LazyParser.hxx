@@ -14,6 +14,7 @@ namespace resip
 
 class ParseBuffer;
 class Data;
+class BufferEncoder;
 
 /**
    @brief The base-class for all lazily-parsed SIP grammar elements.
@@ -84,6 +85,13 @@ class LazyParser
       */
       EncodeStream& encode(EncodeStream& str) const;
 
+      /**
+         @internal
+         @brief As encode(EncodeStream&), but an element that has not been
+            modified hands over its original bytes as they are.
+      */
+      void encode(BufferEncoder& encoder) const;
+
       /**
          @brief Returns true iff a parse has been attempted.
          @note This means that this will return true if a parse failed earlier.
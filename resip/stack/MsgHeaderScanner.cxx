@@ -5,6 +5,10 @@
 #include <ctype.h>
 #include <limits.h>
 #include <stdio.h>
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define RESIP_MSG_HEADER_SCANNER_X86_SIMD
+#include <immintrin.h>
+#endif
 #include "resip/stack/HeaderTypes.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/MsgHeaderScanner.hxx"
@@ -412,6 +416,188 @@ static void initStateMachine()
                   sMsgStart); // Arbitrary but possibly handy.
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//   In the status line and value scanning states below, most characters leave
+//   the state machine where it is and do nothing but add their text properties,
+//   so a run of them can be skipped in one go.  A skip function returns the
+//   first character at or after "charPtr" that the state machine has to see
+//   (a "stop" character), having added the text properties of the characters
+//   it skipped.  The stop characters are those that matter in any of these
+//   states; stopping where one state doesn't need to is harmless.
+//   The chunk terminating sentinel is a stop character, so a skip never goes
+//   past "termCharPtr".  The block versions only load whole blocks that end at
+//   or before it, and leave the tail to the scalar version.
+
+typedef char *(*SkipFunction)(char * charPtr,
+                              const char * termCharPtr,
+                              MsgHeaderScanner::TextPropBitMask * textPropBitMask);
+
+static bool fastScanStateArray[numStates];
+static bool stopCharArray[UCHAR_MAX+1];
+static SkipFunction skipFunction = 0;
+static MsgHeaderScanner::FastScanEnum fastScan = MsgHeaderScanner::fsNone;
+
+static void initStopCharArray()
+{
+   for (const char *charPtr = "\r\n,<>\"\\"; *charPtr; ++charPtr)
+   {
+      stopCharArray[c2i(*charPtr)] = true;
+   }
+   stopCharArray[c2i(chunkTermSentinelChar)] = true;
+}
+
+static char *
+skipScalar(char * charPtr,
+           const char * termCharPtr,
+           MsgHeaderScanner::TextPropBitMask * textPropBitMask)
+{
+   MsgHeaderScanner::TextPropBitMask localTextPropBitMask = 0;
+   while (!stopCharArray[(unsigned char) (*charPtr)])
+   {
+      localTextPropBitMask |= charInfoArray[(unsigned char) (*charPtr)].textPropBitMask;
+      ++charPtr;
+   }
+   *textPropBitMask |= localTextPropBitMask;
+   return charPtr;
+}
+
+#if defined(RESIP_MSG_HEADER_SCANNER_X86_SIMD)
+
+// Each argument has one bit per character of a block; "skippedBits" marks the
+// characters that were skipped.  (Line breaks and backslashes are stop
+// characters, so the state machine accounts for those itself.)
+static inline void
+addBlockTextProps(unsigned int skippedBits,
+                  unsigned int whitespaceBits,
+                  unsigned int percentBits,
+                  unsigned int semicolonBits,
+                  unsigned int parenBits,
+                  MsgHeaderScanner::TextPropBitMask * textPropBitMask)
+{
+   if (whitespaceBits & skippedBits)
+   {
+      *textPropBitMask |= MsgHeaderScanner::tpbmContainsWhitespace;
+   }
+   if (percentBits & skippedBits)
+   {
+      *textPropBitMask |= MsgHeaderScanner::tpbmContainsPercent;
+   }
+   if (semicolonBits & skippedBits)
+   {
+      *textPropBitMask |= MsgHeaderScanner::tpbmContainsSemicolon;
+   }
+   if (parenBits & skippedBits)
+   {
+      *textPropBitMask |= MsgHeaderScanner::tpbmContainsParen;
+   }
+}
+
+__attribute__((target("sse2")))
+static char *
+skipSse2(char * charPtr,
+         const char * termCharPtr,
+         MsgHeaderScanner::TextPropBitMask * textPropBitMask)
+{
+   const __m128i cr = _mm_set1_epi8('\r');
+   const __m128i lf = _mm_set1_epi8('\n');
+   const __m128i sentinel = _mm_set1_epi8(chunkTermSentinelChar);
+   const __m128i comma = _mm_set1_epi8(',');
+   const __m128i leftAngle = _mm_set1_epi8('<');
+   const __m128i rightAngle = _mm_set1_epi8('>');
+   const __m128i quote = _mm_set1_epi8('"');
+   const __m128i backslash = _mm_set1_epi8('\\');
+   const __m128i space = _mm_set1_epi8(' ');
+   const __m128i tab = _mm_set1_epi8('\t');
+   const __m128i percent = _mm_set1_epi8('%');
+   const __m128i semicolon = _mm_set1_epi8(';');
+   const __m128i leftParen = _mm_set1_epi8('(');
+   const __m128i rightParen = _mm_set1_epi8(')');
+
+   while (termCharPtr - charPtr >= 15)
+   {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(charPtr));
+      __m128i stop =
+         _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, cr),
+                                                _mm_cmpeq_epi8(block, lf)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(block, sentinel),
+                                                _mm_cmpeq_epi8(block, comma))),
+                      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, leftAngle),
+                                                _mm_cmpeq_epi8(block, rightAngle)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(block, quote),
+                                                _mm_cmpeq_epi8(block, backslash))));
+      unsigned int stopBits = (unsigned int)_mm_movemask_epi8(stop);
+      unsigned int skippedBits = stopBits ? (stopBits & (0u - stopBits)) - 1 : 0xffffu;
+      addBlockTextProps(skippedBits,
+                        (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, space),
+                                                                     _mm_cmpeq_epi8(block, tab))),
+                        (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, percent)),
+                        (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, semicolon)),
+                        (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, leftParen),
+                                                                     _mm_cmpeq_epi8(block, rightParen))),
+                        textPropBitMask);
+      if (stopBits)
+      {
+         return charPtr + __builtin_ctz(stopBits);
+      }
+      charPtr += 16;
+   }
+   return skipScalar(charPtr, termCharPtr, textPropBitMask);
+}
+
+__attribute__((target("avx2")))
+static char *
+skipAvx2(char * charPtr,
+         const char * termCharPtr,
+         MsgHeaderScanner::TextPropBitMask * textPropBitMask)
+{
+   const __m256i cr = _mm256_set1_epi8('\r');
+   const __m256i lf = _mm256_set1_epi8('\n');
+   const __m256i sentinel = _mm256_set1_epi8(chunkTermSentinelChar);
+   const __m256i comma = _mm256_set1_epi8(',');
+   const __m256i leftAngle = _mm256_set1_epi8('<');
+   const __m256i rightAngle = _mm256_set1_epi8('>');
+   const __m256i quote = _mm256_set1_epi8('"');
+   const __m256i backslash = _mm256_set1_epi8('\\');
+   const __m256i space = _mm256_set1_epi8(' ');
+   const __m256i tab = _mm256_set1_epi8('\t');
+   const __m256i percent = _mm256_set1_epi8('%');
+   const __m256i semicolon = _mm256_set1_epi8(';');
+   const __m256i leftParen = _mm256_set1_epi8('(');
+   const __m256i rightParen = _mm256_set1_epi8(')');
+
+   while (termCharPtr - charPtr >= 31)
+   {
+      __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(charPtr));
+      __m256i stop =
+         _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, cr),
+                                                         _mm256_cmpeq_epi8(block, lf)),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(block, sentinel),
+                                                         _mm256_cmpeq_epi8(block, comma))),
+                         _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, leftAngle),
+                                                         _mm256_cmpeq_epi8(block, rightAngle)),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(block, quote),
+                                                         _mm256_cmpeq_epi8(block, backslash))));
+      unsigned int stopBits = (unsigned int)_mm256_movemask_epi8(stop);
+      unsigned int skippedBits = stopBits ? (stopBits & (0u - stopBits)) - 1 : 0xffffffffu;
+      addBlockTextProps(skippedBits,
+                        (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, space),
+                                                                           _mm256_cmpeq_epi8(block, tab))),
+                        (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, percent)),
+                        (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, semicolon)),
+                        (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, leftParen),
+                                                                           _mm256_cmpeq_epi8(block, rightParen))),
+                        textPropBitMask);
+      if (stopBits)
+      {
+         return charPtr + __builtin_ctz(stopBits);
+      }
+      charPtr += 32;
+   }
+   return skipSse2(charPtr, termCharPtr, textPropBitMask);
+}
+
+#endif // defined(RESIP_MSG_HEADER_SCANNER_X86_SIMD)
+
 // Debug follows
 #if defined(RESIP_MSG_HEADER_SCANNER_DEBUG)  
 
@@ -917,6 +1103,8 @@ MsgHeaderScanner::scanChunk(char * chunk,
    MsgHeaderScanner::ScanChunkResult result;
    CharInfo* localCharInfoArray = charInfoArray;
    TransitionInfo (*localStateMachine)[numCharCategories] = stateMachine;
+   bool *localFastScanStateArray = fastScanStateArray;
+   SkipFunction localSkipFunction = skipFunction;
    State localState = mState;
    char *charPtr = chunk + mPrevScanChunkNumSavedTextChars;
    char *termCharPtr = chunk + chunkLength;
@@ -950,7 +1138,17 @@ MsgHeaderScanner::scanChunk(char * chunk,
       printStateTransition(localState, *charPtr, transitionAction);
 #endif
       localState = transitionInfo->nextState;
-      if (transitionAction == taNone) continue;
+      if (transitionAction == taNone)
+      {
+         if (localFastScanStateArray[(unsigned)localState])
+         {
+            // The loop advances "charPtr" first, so stop just short.
+            charPtr = localSkipFunction(charPtr + 1,
+                                        termCharPtr,
+                                        &localTextPropBitMask) - 1;
+         }
+         continue;
+      }
       // END message header character scan block END
       // The loop remainder is executed about 4-5 times per message header line.
       switch (transitionAction)
@@ -1067,9 +1265,92 @@ MsgHeaderScanner::initialize()
 {
    initCharInfoArray();
    initStateMachine();
+   initStopCharArray();
+#if defined(RESIP_MSG_HEADER_SCANNER_X86_SIMD)
+   __builtin_cpu_init();
+#endif
+   if (!setFastScan(fsAvx2) && !setFastScan(fsSse2))
+   {
+      setFastScan(fsScalar);
+   }
    return true;
 }
 
+bool
+MsgHeaderScanner::setFastScan(MsgHeaderScanner::FastScanEnum newFastScan)
+{
+   if (!mInitialized)
+   {
+      // Sets its own choice first, so that ours sticks.
+      mInitialized = true;
+      initialize();
+   }
+
+   SkipFunction newSkipFunction = 0;
+   switch (newFastScan)
+   {
+      case fsNone:
+         break;
+      case fsScalar:
+         newSkipFunction = skipScalar;
+         break;
+#if defined(RESIP_MSG_HEADER_SCANNER_X86_SIMD)
+      case fsSse2:
+         if (__builtin_cpu_supports("sse2"))
+         {
+            newSkipFunction = skipSse2;
+         }
+         break;
+      case fsAvx2:
+         if (__builtin_cpu_supports("avx2"))
+         {
+            newSkipFunction = skipAvx2;
+         }
+         break;
+#endif
+      default:
+         break;
+   }
+   if (newFastScan != fsNone && newSkipFunction == 0)
+   {
+      return false;
+   }
+
+   bool enabled = (newFastScan != fsNone);
+   fastScanStateArray[sScanStatusLine] = enabled;
+   fastScanStateArray[sScan1Value] = enabled;
+   fastScanStateArray[sScanNValue] = enabled;
+   fastScanStateArray[sScanNValueInQuotes] = enabled;
+   fastScanStateArray[sScanNValueInAngles] = enabled;
+   skipFunction = newSkipFunction;
+   fastScan = newFastScan;
+   return true;
+}
+
+MsgHeaderScanner::FastScanEnum
+MsgHeaderScanner::getFastScan()
+{
+   if (!mInitialized)
+   {
+      mInitialized = true;
+      initialize();
+   }
+   return fastScan;
+}
+
+const char*
+MsgHeaderScanner::getFastScanName(MsgHeaderScanner::FastScanEnum which)
+{
+   switch (which)
+   {
+      case fsNone: return "none";
+      case fsScalar: return "scalar";
+      case fsSse2: return "sse2";
+      case fsAvx2: return "avx2";
+   }
+   return "unknown";
+}
+
 
 } //namespace resip
 
@@ -121,6 +121,24 @@ class MsgHeaderScanner
       // !ah! for documentation generation
       static int dumpStateMachine(int fd); 
 
+      // Inside the status line and values, runs of characters the state
+      // machine has nothing to do with are skipped over in blocks instead of
+      // one character at a time.  The fastest implementation this CPU
+      // supports is chosen when the first scanner is constructed.
+      enum FastScanEnum
+      {
+         fsNone,       // Every character goes through the state machine.
+         fsScalar,
+         fsSse2,
+         fsAvx2
+      };
+
+      // For tests and benchmarks; not thread safe.  Returns false (and
+      // changes nothing) if "fastScan" isn't supported here.
+      static bool setFastScan(MsgHeaderScanner::FastScanEnum fastScan);
+      static MsgHeaderScanner::FastScanEnum getFastScan();
+      static const char* getFastScanName(MsgHeaderScanner::FastScanEnum which);
+
    private:
 
 
@@ -131,7 +149,7 @@ class MsgHeaderScanner
       MsgHeaderScanner & operator=(const MsgHeaderScanner & from);
 
       // Automatically called when 1st MsgHeaderScanner constructed.
-      bool initialize();
+      static bool initialize();
       static bool mInitialized;
 
 
@@ -1,6 +1,7 @@
 #include <cassert>
 
 #include "resip/stack/ParserContainerBase.hxx"
+#include "resip/stack/BufferEncoder.hxx"
 #include "resip/stack/Embedded.hxx"
 
 using namespace resip;
@@ -114,6 +115,55 @@ ParserContainerBase::encode(const Data& headerName,
    return str;
 }
 
+void
+ParserContainerBase::encode(const Data& headerName, 
+                            BufferEncoder& encoder) const
+{
+   if (!mParsers.empty())
+   {
+      if (!headerName.empty())
+      {
+         encoder.append(headerName);
+         encoder.append(": ", 2);
+      }
+         
+      for (Parsers::const_iterator i = mParsers.begin(); 
+           i != mParsers.end(); ++i)
+      {
+         if (i != mParsers.begin())
+         {
+            if (Headers::isCommaEncoding(mType))
+            {
+               encoder.append(", ", 2);
+            }
+            else
+            {
+               encoder.append("\r\n", 2);
+               encoder.append(headerName);
+               encoder.append(": ", 2);
+            }
+         }
+
+         i->encode(encoder);
+      }
+
+      encoder.append("\r\n", 2);
+   }
+}
+
+void
+ParserContainerBase::HeaderKit::encode(BufferEncoder& encoder) const
+{
+   if(pc)
+   {
+      pc->encode(encoder);
+   }
+   else
+   {
+      encoder.append(hfv.getBuffer(), hfv.getLength());
+   }
+}
+
 EncodeStream&
 ParserContainerBase::encodeEmbedded(const Data& headerName, 
                                     EncodeStream& str) const
@@ -14,6 +14,7 @@ namespace resip
 
 class HeaderFieldValueList;
 class PoolBase;
+class BufferEncoder;
 
 /**
   @class ParserContainerBase
@@ -86,6 +87,12 @@ class ParserContainerBase
         */
       EncodeStream& encode(const Data& headerName, EncodeStream& str) const;
 
+      /**
+        @internal
+        @brief as above, for SipMessage::encodeToBuffer()
+        */
+      void encode(const Data& headerName, BufferEncoder& encoder) const;
+
       /**
         @internal
         @brief the actual mechanics of parsing
@@ -171,6 +178,8 @@ class ParserContainerBase
                }
                return str;
             }
+
+            void encode(BufferEncoder& encoder) const;
             
             ParserCategory* pc;
             HeaderFieldValue hfv;
@@ -2,6 +2,7 @@
 #define RESIP_SendData_HXX
 
 #include "rutil/Data.hxx"
+#include "rutil/SharedPtr.hxx"
 #include "resip/stack/Tuple.hxx"
 
 namespace resip
@@ -20,7 +21,7 @@ class SendData
          EnableFlowTimer
       };
 
-      SendData() : isAlreadyCompressed(false), command(NoCommand)
+      SendData() : framed(false), isAlreadyCompressed(false), command(NoCommand), queuedTime(0)
       {}
 
       SendData(const Tuple& dest,
@@ -30,10 +31,12 @@ class SendData
                bool isCompressed = false): 
          destination(dest),
          data(pdata),
+         framed(false),
          transactionId(tid),
          sigcompId(scid),
          isAlreadyCompressed(isCompressed),
-         command(NoCommand)
+         command(NoCommand),
+         queuedTime(0)
       {
       }
 
@@ -41,21 +44,113 @@ class SendData
       SendData(const Tuple& dest, char* buffer, int length) : 
          destination(dest),
          data(Data::Take, buffer, length),
+         framed(false),
          transactionId(Data::Empty),
          sigcompId(Data::Empty),
          isAlreadyCompressed(false),
-         command(NoCommand)
+         command(NoCommand),
+         queuedTime(0)
       {
       }
 
+      /// If data has been share()d, the copy shares it too, rather than
+      /// copying it.
+      SendData(const SendData& rhs) :
+         destination(rhs.destination),
+         header(rhs.header),
+         framed(rhs.framed),
+         transactionId(rhs.transactionId),
+         sigcompId(rhs.sigcompId),
+         isAlreadyCompressed(rhs.isAlreadyCompressed),
+         command(rhs.command),
+         queuedTime(rhs.queuedTime),
+         mShared(rhs.mShared)
+      {
+         if(mShared.get())
+         {
+            data.setBuf(Data::Share, mShared->data(), mShared->size());
+         }
+         else
+         {
+            data = rhs.data;
+         }
+      }
+
+      SendData& operator=(const SendData& rhs)
+      {
+         if(this != &rhs)
+         {
+            destination = rhs.destination;
+            header = rhs.header;
+            framed = rhs.framed;
+            transactionId = rhs.transactionId;
+            sigcompId = rhs.sigcompId;
+            isAlreadyCompressed = rhs.isAlreadyCompressed;
+            command = rhs.command;
+            queuedTime = rhs.queuedTime;
+            mShared = rhs.mShared;
+            if(mShared.get())
+            {
+               data.setBuf(Data::Share, mShared->data(), mShared->size());
+            }
+            else
+            {
+               data = rhs.data;
+            }
+         }
+         return *this;
+      }
+
       SendData* clone() const
       {
          return new SendData(*this);
       }
 
+      /**
+         Moves data into a reference-counted buffer that every copy made from
+         now on (clone()s for retransmissions, say) points at instead of
+         copying it. data is read-only from here on; anything that needs to
+         change it has to replace it, which leaves the other copies alone.
+      */
+      void share()
+      {
+         if(!mShared.get())
+         {
+            mShared.reset(new Data);
+            mShared->takeBuf(data);
+            data.setBuf(Data::Share, mShared->data(), mShared->size());
+         }
+      }
+
+      /// Moves header onto the front of data, for connections that can only
+      /// write one buffer. data is replaced, not changed, if it is shared.
+      void joinHeader()
+      {
+         if(!header.empty())
+         {
+            Data both(header.size() + data.size(), Data::Preallocate);
+            both.append(header.data(), header.size());
+            both.append(data.data(), data.size());
+            data.takeBuf(both);
+            mShared.reset();
+            header.clear();
+         }
+      }
+
       void clear()
       {
-         data.clear();
+         if(mShared.get())
+         {
+            // stop pointing into the buffer before letting go of it
+            data = Data::Empty;
+            mShared.reset();
+         }
+         else
+         {
+            data.clear();
+         }
+         header.clear();
+         framed = false;
       }
 
       bool empty() const
@@ -65,12 +160,25 @@ class SendData
 
       Tuple destination;
       Data data;
+      // Framing that goes on the wire ahead of data (a WebSocket frame header,
+      // say), so that data never has to be copied to make room for it.
+      Data header;
+      // Set once the framing has been worked out, so that it isn't added
+      // again after joinHeader() has moved header into data.
+      bool framed;
       Data transactionId;
       Data sigcompId;
       bool isAlreadyCompressed;
 
       // .bwc. Used for special commands: ie. to close connections, and enable flow timers
       SendDataCommand command;
+
+      // When this was queued for the transport, if someone wants to know how
+      // long it waits there (see InternalTransport::setFifoLatencyRecorder())
+      UInt64 queuedTime;
+
+   private:
+      SharedPtr<Data> mShared;
 };
 
 }
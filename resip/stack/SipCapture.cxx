@@ -0,0 +1,491 @@
+#include <cstdio>
+#include <cstring>
+
+#ifndef WIN32
+#include <sys/time.h>
+#endif
+
+#include "resip/stack/SipCapture.hxx"
+#include "resip/stack/SendData.hxx"
+#include "rutil/AtomicOps.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/ThreadRecordRings.hxx"
+#include "rutil/Timer.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+using namespace resip;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
+
+namespace
+{
+
+// What is known about a message, captured along with it
+struct CaptureHeader
+{
+   UInt64 mTime;            // microseconds since the epoch
+   UInt8 mSource[16];
+   UInt8 mDestination[16];
+   UInt16 mSourcePort;
+   UInt16 mDestinationPort;
+   UInt8 mIpVersion;        // 4 or 6
+   UInt8 mTransport;        // TransportType
+   UInt8 mDirection;        // SipCapture::Direction
+   UInt8 mRetransmit;
+};
+
+UInt64
+wallClockMicroSec()
+{
+#ifdef WIN32
+   FILETIME ft;
+   ::GetSystemTimeAsFileTime(&ft);
+   ULARGE_INTEGER li;
+   li.LowPart = ft.dwLowDateTime;
+   li.HighPart = ft.dwHighDateTime;
+   // FILETIME counts 100ns intervals since 1601
+   return li.QuadPart/10 - 11644473600000000ULL;
+#else
+   struct timeval now;
+   gettimeofday(&now, 0);
+   return UInt64(now.tv_sec)*1000000 + now.tv_usec;
+#endif
+}
+
+void
+copyAddress(const Tuple& tuple, UInt8* address, UInt16& port)
+{
+   memset(address, 0, 16);
+   if (tuple.ipVersion() == V4)
+   {
+      memcpy(address, &reinterpret_cast<const sockaddr_in&>(tuple.getSockaddr()).sin_addr, 4);
+   }
+#ifdef USE_IPV6
+   else
+   {
+      memcpy(address, &reinterpret_cast<const sockaddr_in6&>(tuple.getSockaddr()).sin6_addr, 16);
+   }
+#endif
+   port = (UInt16)tuple.getPort();
+}
+
+// pcap-ng block types and options, see
+// https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-02.html
+const UInt32 SectionHeaderBlock = 0x0A0D0D0A;
+const UInt32 InterfaceDescriptionBlock = 0x00000001;
+const UInt32 EnhancedPacketBlock = 0x00000006;
+const UInt32 ByteOrderMagic = 0x1A2B3C4D;
+const UInt16 LinkTypeRaw = 101;    // raw IPv4 or IPv6 packets
+const UInt16 OptionEnd = 0;
+const UInt16 OptionComment = 1;
+const UInt16 OptionShbUserAppl = 4;
+const UInt16 OptionEpbFlags = 2;
+
+// Largest SIP message that still fits in a made up UDP packet
+const unsigned long MaxPayload = 65535 - 40 - 8;
+
+}
+
+/**
+   Turns captured records into pcap-ng Enhanced Packet Blocks, and writes
+   them out.
+*/
+class SipCapture::BlockWriter
+{
+   public:
+      BlockWriter(SipCapture& capture) : mCapture(capture), mCount(0) {}
+
+      void operator()(int tag, const char* data, unsigned long size)
+      {
+         assert(size >= sizeof(CaptureHeader));
+         CaptureHeader header;
+         memcpy(&header, data, sizeof(header));
+         const char* payload = data + sizeof(header);
+         const unsigned long originalSize = size - sizeof(header);
+         const unsigned long payloadSize = originalSize > MaxPayload ? MaxPayload : originalSize;
+
+         const unsigned int ipHeaderSize = header.mIpVersion == 4 ? 20 : 40;
+         const UInt32 packetSize = UInt32(ipHeaderSize + 8 + payloadSize);
+
+         Data comment;
+         if (header.mTransport != UDP)
+         {
+            comment = Tuple::toData((TransportType)header.mTransport);
+         }
+         if (header.mRetransmit)
+         {
+            comment += comment.empty() ? "retransmission" : " retransmission";
+         }
+
+         const UInt32 paddedPacket = (packetSize + 3) & ~3U;
+         const UInt32 paddedComment = (UInt32(comment.size()) + 3) & ~3U;
+         const UInt32 optionsSize = 4 + 4                                  // epb_flags
+                                    + (comment.empty() ? 0 : 4 + paddedComment)
+                                    + 4;                                   // opt_endofopt
+         const UInt32 blockSize = 28 + paddedPacket + optionsSize + 4;
+
+         Data& block = mCapture.mBlock;
+         block.clear();
+         block.reserve(blockSize);
+         append32(block, EnhancedPacketBlock);
+         append32(block, blockSize);
+         append32(block, 0);                           // interface
+         append32(block, UInt32(header.mTime >> 32));
+         append32(block, UInt32(header.mTime));
+         append32(block, packetSize);
+         append32(block, UInt32(ipHeaderSize + 8 + originalSize));
+
+         // IP header
+         const UInt16 udpLength = UInt16(8 + payloadSize);
+         if (header.mIpVersion == 4)
+         {
+            unsigned char ip[20] = { 0x45, 0,
+                                     UInt8((udpLength + 20) >> 8), UInt8(udpLength + 20),
+                                     0, 0, 0x40, 0,      // id, don't fragment
+                                     64, 17, 0, 0 };     // ttl, UDP, checksum
+            memcpy(ip + 12, header.mSource, 4);
+            memcpy(ip + 16, header.mDestination, 4);
+            UInt32 sum = 0;
+            for (int i = 0; i < 20; i += 2)
+            {
+               sum += (ip[i] << 8) | ip[i+1];
+            }
+            sum = (sum & 0xffff) + (sum >> 16);
+            sum = ~((sum & 0xffff) + (sum >> 16));
+            ip[10] = UInt8(sum >> 8);
+            ip[11] = UInt8(sum);
+            block.append((const char*)ip, sizeof(ip));
+         }
+         else
+         {
+            unsigned char ip[40] = { 0x60, 0, 0, 0,
+                                     UInt8(udpLength >> 8), UInt8(udpLength),
+                                     17, 64 };           // UDP, hop limit
+            memcpy(ip + 8, header.mSource, 16);
+            memcpy(ip + 24, header.mDestination, 16);
+            block.append((const char*)ip, sizeof(ip));
+         }
+
+         // UDP header, without a checksum
+         const unsigned char udp[8] = { UInt8(header.mSourcePort >> 8), UInt8(header.mSourcePort),
+                                        UInt8(header.mDestinationPort >> 8), UInt8(header.mDestinationPort),
+                                        UInt8(udpLength >> 8), UInt8(udpLength), 0, 0 };
+         block.append((const char*)udp, sizeof(udp));
+         block.append(payload, payloadSize);
+         pad(block);
+
+         append16(block, OptionEpbFlags);
+         append16(block, 4);
+         append32(block, header.mDirection);   // inbound or outbound, in the low bits
+         if (!comment.empty())
+         {
+            append16(block, OptionComment);
+            append16(block, UInt16(comment.size()));
+            block += comment;
+            pad(block);
+         }
+         append16(block, OptionEnd);
+         append16(block, 0);
+         append32(block, blockSize);
+         assert(block.size() == blockSize);
+
+         mCapture.write(block.data(), block.size());
+         ++mCount;
+      }
+
+      static void append16(Data& block, UInt16 value)
+      {
+         block.append((const char*)&value, sizeof(value));
+      }
+
+      static void append32(Data& block, UInt32 value)
+      {
+         block.append((const char*)&value, sizeof(value));
+      }
+
+      static void pad(Data& block)
+      {
+         static const char zeros[4] = { 0, 0, 0, 0 };
+         if (block.size() % 4)
+         {
+            block.append(zeros, 4 - block.size() % 4);
+         }
+      }
+
+      unsigned long count() const { return mCount; }
+
+   private:
+      SipCapture& mCapture;
+      unsigned long mCount;
+};
+
+SipCapture::SipCapture(const Data& fileName,
+                       UInt64 maxFileBytes,
+                       unsigned int maxFiles,
+                       unsigned long bufferSize) :
+   mFileName(fileName),
+   mMaxFileBytes(maxFileBytes),
+   mMaxFiles(maxFiles ? maxFiles : 1),
+   mBuffers(0),
+   mFileBytes(0),
+   mDroppedReported(0),
+   mLastDropWarning(0),
+   mCaptured(0),
+   mDropped(0),
+   mWriter(*this)
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   mBuffers = new ThreadRecordRings(bufferSize);
+   openFile();
+   mWriter.run();
+#else
+   ErrLog(<< "SIP message capture needs atomic operations, which are not available on this platform");
+#endif
+}
+
+SipCapture::~SipCapture()
+{
+   mWriter.shutdown();
+   mWriter.join();
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   delete mBuffers;
+#endif
+}
+
+void
+SipCapture::outboundEncoded(const Tuple& source, const Tuple& destination, const SendData& data)
+{
+   capture(Outbound, false, source, destination, data.data.data(), data.data.size());
+}
+
+void
+SipCapture::outboundRetransmit(const Tuple& source, const Tuple& destination, const SendData& data)
+{
+   capture(Outbound, true, source, destination, data.data.data(), data.data.size());
+}
+
+void
+SipCapture::inboundRaw(const Tuple& source, const Tuple& destination, const char* data, size_t len)
+{
+   capture(Inbound, false, source, destination, data, len);
+}
+
+UInt64
+SipCapture::capturedMessages() const
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   return atomicLoad(mCaptured);
+#else
+   return 0;
+#endif
+}
+
+UInt64
+SipCapture::droppedMessages() const
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   return atomicLoad(mDropped);
+#else
+   return 0;
+#endif
+}
+
+void
+SipCapture::flush()
+{
+   drain();
+}
+
+void
+SipCapture::capture(Direction direction, bool retransmit,
+                    const Tuple& source, const Tuple& destination,
+                    const char* data, unsigned long size)
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   CaptureHeader header;
+   header.mTime = wallClockMicroSec();
+   copyAddress(source, header.mSource, header.mSourcePort);
+   copyAddress(destination, header.mDestination, header.mDestinationPort);
+   header.mIpVersion = destination.ipVersion() == V4 ? 4 : 6;
+   header.mTransport = UInt8(destination.getType());
+   header.mDirection = UInt8(direction);
+   header.mRetransmit = retransmit ? 1 : 0;
+
+   if (size > MaxPayload)
+   {
+      size = MaxPayload;
+   }
+   if (!mBuffers->ring().push(0, &header, sizeof(header), data, size))
+   {
+      atomicFetchAdd(mDropped, UInt64(1));
+   }
+#endif
+}
+
+void
+SipCapture::WriterThread::thread()
+{
+   while (!isShutdown())
+   {
+      mCapture.drain();
+      waitForShutdown(20);
+   }
+   mCapture.drain();
+}
+
+void
+SipCapture::drain()
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   Lock drainLock(mDrainMutex);
+
+   BlockWriter writer(*this);
+   mBuffers->consume(writer);
+   if (writer.count())
+   {
+      mFile.flush();
+      atomicFetchAdd(mCaptured, UInt64(writer.count()));
+   }
+
+   const UInt64 dropped = atomicLoad(mDropped);
+   const UInt64 now = Timer::getTimeMs();
+   if (dropped != mDroppedReported && now - mLastDropWarning >= 1000)
+   {
+      WarningLog(<< "SIP capture buffer full, dropped " << dropped - mDroppedReported
+                 << " messages (" << dropped << " in all)");
+      mDroppedReported = dropped;
+      mLastDropWarning = now;
+   }
+#endif
+}
+
+void
+SipCapture::openFile()
+{
+   mFile.open(mFileName.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+   if (!mFile)
+   {
+      ErrLog(<< "Could not open SIP capture file " << mFileName);
+      return;
+   }
+   mFileBytes = 0;
+
+   // Section Header Block
+   static const char application[] = "reSIProcate";
+   Data block;
+   const UInt32 applicationSize = sizeof(application) - 1;
+   const UInt32 shbSize = 24 + 4 + ((applicationSize + 3) & ~3U) + 4 + 4;
+   BlockWriter::append32(block, SectionHeaderBlock);
+   BlockWriter::append32(block, shbSize);
+   BlockWriter::append32(block, ByteOrderMagic);
+   BlockWriter::append16(block, 1);   // version 1.0
+   BlockWriter::append16(block, 0);
+   BlockWriter::append32(block, 0xffffffff);   // section length unknown
+   BlockWriter::append32(block, 0xffffffff);
+   BlockWriter::append16(block, OptionShbUserAppl);
+   BlockWriter::append16(block, UInt16(applicationSize));
+   block.append(application, applicationSize);
+   BlockWriter::pad(block);
+   BlockWriter::append16(block, OptionEnd);
+   BlockWriter::append16(block, 0);
+   BlockWriter::append32(block, shbSize);
+   assert(block.size() == shbSize);
+
+   // Interface Description Block, with no snapshot length limit
+   BlockWriter::append32(block, InterfaceDescriptionBlock);
+   BlockWriter::append32(block, 20);
+   BlockWriter::append16(block, LinkTypeRaw);
+   BlockWriter::append16(block, 0);
+   BlockWriter::append32(block, 0);
+   BlockWriter::append32(block, 20);
+
+   mFile.write(block.data(), block.size());
+   mFileBytes += block.size();
+}
+
+void
+SipCapture::rotate()
+{
+   mFile.close();
+   if (mMaxFiles > 1)
+   {
+      // fileName.(n-1) is dropped, fileName.i becomes fileName.(i+1), and
+      // fileName becomes fileName.1
+      Data oldest(mFileName + "." + Data(mMaxFiles - 1));
+      remove(oldest.c_str());
+      for (unsigned int i = mMaxFiles - 1; i > 1; --i)
+      {
+         Data from(mFileName + "." + Data(i - 1));
+         Data to(mFileName + "." + Data(i));
+         rename(from.c_str(), to.c_str());
+      }
+      Data first(mFileName + ".1");
+      rename(mFileName.c_str(), first.c_str());
+   }
+   openFile();
+}
+
+void
+SipCapture::write(const char* data, unsigned long size)
+{
+   if (mMaxFileBytes && mFileBytes + size > mMaxFileBytes)
+   {
+      rotate();
+   }
+   if (mFile)
+   {
+      mFile.write(data, size);
+      mFileBytes += size;
+   }
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
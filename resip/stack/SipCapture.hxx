@@ -0,0 +1,175 @@
+#if !defined(RESIP_SIPCAPTURE_HXX)
+#define RESIP_SIPCAPTURE_HXX
+
+#include <fstream>
+
+#include "resip/stack/Transport.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
+
+namespace resip
+{
+
+class ThreadRecordRings;
+
+/**
+   @brief Captures every SIP message sent and received by the stack to a
+   pcap-ng file, without slowing down the transport threads.
+
+   @details Install with SipStack::setTransportSipMessageLoggingHandler().
+   On the transport threads, a message is only copied, along with its
+   addresses and a timestamp, into a lock-free buffer belonging to that
+   thread. A background thread writes the buffers out, in batches, to
+   fileName; the file is rotated to fileName.1, fileName.2, ... when it
+   reaches maxFileBytes, keeping at most maxFiles files in all.
+
+   Each message is written as a single IPv4 or IPv6 UDP packet (a fake
+   header is made up from the message's addresses), so that Wireshark and
+   similar tools dissect it as SIP whatever transport actually carried it.
+   For other transports, the packet has a comment naming the transport, and
+   retransmissions are marked as such. Packets also carry the direction of
+   the message in their flags.
+
+   When a thread's buffer is full, its messages are dropped, and counted
+   (see droppedMessages()); the writer logs a warning when this happens.
+
+   Requires atomic operations (see rutil/AtomicOps.hxx); without them,
+   nothing is captured.
+*/
+class SipCapture : public Transport::SipMessageLoggingHandler
+{
+   public:
+      /**
+         @param maxFileBytes size at which the capture file is rotated, 0 for
+                             no limit.
+         @param maxFiles     number of capture files kept, including the
+                             current one.
+         @param bufferSize   size in bytes of each transport thread's buffer.
+      */
+      SipCapture(const Data& fileName,
+                 UInt64 maxFileBytes = 100*1024*1024,
+                 unsigned int maxFiles = 10,
+                 unsigned long bufferSize = 4*1024*1024);
+      virtual ~SipCapture();
+
+      // Outbound messages are captured by outboundEncoded(), once encoded
+      virtual void outboundMessage(const Tuple& source, const Tuple& destination, const SipMessage& msg) {}
+      virtual void outboundEncoded(const Tuple& source, const Tuple& destination, const SendData& data);
+      virtual void outboundRetransmit(const Tuple& source, const Tuple& destination, const SendData& data);
+      // Inbound messages are captured by inboundRaw(), before they are parsed
+      virtual void inboundRaw(const Tuple& source, const Tuple& destination, const char* data, size_t len);
+      virtual void inboundMessage(const Tuple& source, const Tuple& destination, const SipMessage& msg) {}
+
+      /// Messages written to the capture file so far
+      UInt64 capturedMessages() const;
+      /// Messages lost because a buffer was full
+      UInt64 droppedMessages() const;
+
+      /// Writes out everything captured so far
+      void flush();
+
+      enum Direction
+      {
+         Inbound = 1,
+         Outbound = 2
+      };
+
+   private:
+      SipCapture(const SipCapture&);
+      SipCapture& operator=(const SipCapture&);
+
+      class WriterThread : public ThreadIf
+      {
+         public:
+            WriterThread(SipCapture& capture) : mCapture(capture) {}
+            virtual void thread();
+         private:
+            SipCapture& mCapture;
+      };
+      friend class WriterThread;
+      class BlockWriter;
+      friend class BlockWriter;
+
+      void capture(Direction direction, bool retransmit,
+                   const Tuple& source, const Tuple& destination,
+                   const char* data, unsigned long size);
+      void drain();
+      void openFile();
+      void rotate();
+      void write(const char* data, unsigned long size);
+
+      const Data mFileName;
+      const UInt64 mMaxFileBytes;
+      const unsigned int mMaxFiles;
+
+      // one per transport thread
+      ThreadRecordRings* mBuffers;
+
+      // Only used by drain(), under mDrainMutex
+      Mutex mDrainMutex;
+      std::ofstream mFile;
+      UInt64 mFileBytes;
+      Data mBlock;
+      UInt64 mDroppedReported;
+      UInt64 mLastDropWarning;
+
+      volatile UInt64 mCaptured;
+      volatile UInt64 mDropped;
+
+      WriterThread mWriter;
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -2,6 +2,7 @@
 #include "config.h"
 #endif
 
+#include "resip/stack/BufferEncoder.hxx"
 #include "resip/stack/Contents.hxx"
 #include "resip/stack/Embedded.hxx"
 #include "resip/stack/OctetContents.hxx"
@@ -776,6 +777,54 @@ SipMessage::encode(EncodeStream& str, bool isSipFrag) const
    return str;
 }
 
+void
+SipMessage::encodeToBuffer(Data& buffer) const
+{
+   BufferEncoder encoder;
+
+   if (mStartLine != 0)
+   {
+      mStartLine->encode(encoder);
+      encoder.append("\r\n", 2);
+   }
+
+   Data contents;
+   if (mContents != 0)
+   {
+      oDataStream temp(contents);
+      mContents->encode(temp);
+   }
+   else if (mContentsHfv.getBuffer() != 0)
+   {
+      mContentsHfv.toShareData(contents);
+   }
+
+   for (UInt8 i = 0; i < Headers::MAX_HEADERS; i++)
+   {
+      if (i != Headers::ContentLength)
+      {
+         if (mHeaderIndices[i] > 0)
+         {
+            mHeaders[mHeaderIndices[i]]->encode(i, encoder);
+         }
+      }
+   }
+
+   for (UnknownHeaders::const_iterator i = mUnknownHeaders.begin(); 
+        i != mUnknownHeaders.end(); i++)
+   {
+      i->second->encode(i->first, encoder);
+   }
+
+   const Data length(contents.size());
+   encoder.append("Content-Length: ", 16);
+   encoder.append(length);
+   encoder.append("\r\n\r\n", 4);
+   encoder.append(contents);
+
+   encoder.writeTo(buffer);
+}
+
 EncodeStream&
 SipMessage::encodeSingleHeader(Headers::Type type, EncodeStream& str) const
 {
@@ -264,6 +264,15 @@ class SipMessage : public TransactionMessage
       @return string representation of a SIP message.
       */
       virtual EncodeStream& encode(EncodeStream& str) const;      
+
+      /** @brief Appends what encode() would write to buffer, without going
+          through a stream.
+
+          Headers and start line that have not been modified since they were
+          parsed are copied as received, and buffer grows at most once.
+          Subclasses that override encode() must override this too.
+      */
+      virtual void encodeToBuffer(Data& buffer) const;
       //sipfrags will not output Content Length if there is no body--introduce
       //friendship to hide this?
       virtual EncodeStream& encodeSipFrag(EncodeStream& str) const;
@@ -63,6 +63,7 @@ SipStack::SipStack(const SipStackOptions& options) :
    // WARNING - don't forget to add new member initialization to the init() method
    init(options);
    mTUFifo.setDescription("SipStack::mTUFifo");
+   mTUFifo.setLatencyRecorder(&mStatsManager.latencyRecorder(StatisticsMessage::TuFifoTime));
 }
 
 
@@ -122,6 +123,7 @@ SipStack::SipStack(Security* pSecurity,
    }
    
    mTUFifo.setDescription("SipStack::mTUFifo");
+   mTUFifo.setLatencyRecorder(&mStatsManager.latencyRecorder(StatisticsMessage::TuFifoTime));
    mTransactionController->transportSelector().setPollGrp(mPollGrp);
 
 #if 0
@@ -203,6 +205,14 @@ SipStack::init(const SipStackOptions& options)
    // grab the security, DnsStub, compression and statsManager
    mTransactionController = new TransactionController(*this, mAsyncProcessHandler);
    mTransactionController->transportSelector().setPollGrp(mPollGrp);
+   if(options.mLockFreeStateMacFifo)
+   {
+      mTransactionController->setLockFreeStateMacFifo(true);
+   }
+   if(options.mTransactionControllerShards > 1)
+   {
+      mTransactionController->setNumShards(options.mTransactionControllerShards);
+   }
    mTransactionControllerThread = 0;
    mTransportSelectorThread = 0;
 
@@ -550,6 +560,8 @@ SipStack::addTransport(std::auto_ptr<Transport> transport)
        transport->setCongestionManager(mCongestionManager);
    }
 
+   transport->setFifoLatencyRecorder(&mStatsManager.latencyRecorder(StatisticsMessage::TransportFifoTime));
+
    // Set Sip Message Logging Handler if one was provided
    if(mTransportSipMessageLoggingHandler.get())
    {
@@ -1149,6 +1161,7 @@ void
 SipStack::registerTransactionUser(TransactionUser& tu)
 {
    mTuSelector.registerTransactionUser(tu);
+   tu.setFifoLatencyRecorder(&mStatsManager.latencyRecorder(StatisticsMessage::TuFifoTime));
 }
 
 void
@@ -1162,6 +1175,7 @@ void
 SipStack::unregisterTransactionUser(TransactionUser& tu)
 {
    mTuSelector.unregisterTransactionUser(tu);
+   tu.setFifoLatencyRecorder(0);
    checkAsyncProcessHandler();
 }
 
@@ -96,6 +96,19 @@ class FdPollGrp;
           See EventStackThread. The SipStack does NOT take ownership;
           the application (or a helper such as EventStackSimpleMgr) must
           release this object after the SipStack is destructed.
+
+       mLockFreeStateMacFifo
+          If true, the fifo feeding the transaction state machine is run in
+          lock-free mode, so that transports, the TU and the DNS resolver
+          can post to it without contending for a mutex. Requires atomic
+          operations support (see rutil/AtomicOps.hxx); if that is absent, a
+          warning is logged and a regular fifo is used. Default false.
+
+       mTransactionControllerShards
+          If greater than 1, transaction processing is split across this
+          many TransactionControllers, each with its own thread, transaction
+          maps and timers. Messages are routed to a shard by hash of their
+          transaction id. Default 0 (no sharding).
 **/
 class SipStackOptions
 {
@@ -103,7 +116,9 @@ class SipStackOptions
       SipStackOptions()
          : mSecurity(0), mExtraNameserverList(0),
            mAsyncProcessHandler(0), mStateless(false),
-           mSocketFunc(0), mCompression(0), mPollGrp(0)
+           mSocketFunc(0), mCompression(0), mPollGrp(0),
+           mLockFreeStateMacFifo(false),
+           mTransactionControllerShards(0)
       {
       }
 
@@ -114,6 +129,8 @@ class SipStackOptions
       AfterSocketCreationFuncPtr mSocketFunc;
       Compression *mCompression;
       FdPollGrp* mPollGrp;
+      bool mLockFreeStateMacFifo;
+      unsigned int mTransactionControllerShards;
 };
 
 
@@ -2,30 +2,91 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <string.h>
+
+#include "rutil/AtomicOps.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "resip/stack/StatisticsManager.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/TransactionController.hxx"
 #include "resip/stack/SipStack.hxx"
+#ifdef USE_SSL
+#include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
+#endif
 
 using namespace resip;
 using std::vector;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSACTION
 
+StatisticsManager::Counters::Counters() : owner(0)
+{
+   memset(requests, 0, sizeof(requests));
+   memset(responses, 0, sizeof(responses));
+}
+
+void
+StatisticsManager::Counters::add(const Counters& rhs)
+{
+   for (int c = 0; c < RequestCounters; ++c)
+   {
+      for (int m = 0; m < MAX_METHODS; ++m)
+      {
+         requests[c][m] += singleWriterLoad(rhs.requests[c][m]);
+      }
+   }
+   for (int c = 0; c < ResponseCounters; ++c)
+   {
+      for (int m = 0; m < MAX_METHODS; ++m)
+      {
+         for (int code = 0; code < MaxCode; ++code)
+         {
+            responses[c][m][code] += singleWriterLoad(rhs.responses[c][m][code]);
+         }
+      }
+   }
+   for (int l = 0; l < StatisticsMessage::MaxLatency; ++l)
+   {
+      latency[l].merge(rhs.latency[l]);
+   }
+}
+
 StatisticsManager::StatisticsManager(SipStack& stack, unsigned long intervalSecs) 
-   : StatisticsMessage::Payload(),
-     mStack(stack),
+   : mStack(stack),
      mInterval(intervalSecs*1000),
      mNextPoll(Timer::getTimeMs() + mInterval),
      mExternalHandler(NULL),
-     mPublicPayload(NULL)
-{}
+     mPublicPayload(NULL),
+     mExited(new Counters),
+     mBaseline(new Counters)
+{
+   int err = ThreadIf::tlsKeyCreate(mCountersKey, threadExited);
+   (void)err;
+   assert(err == 0);
+
+   for (int l = 0; l < StatisticsMessage::MaxLatency; ++l)
+   {
+      mRecorders[l].init(this, (StatisticsMessage::Latency)l);
+   }
+}
 
 StatisticsManager::~StatisticsManager()
 {
    if ( mPublicPayload )
        delete mPublicPayload;
+
+   ThreadIf::tlsKeyDelete(mCountersKey);
+   for (vector<Counters*>::iterator i = mCounters.begin(); i != mCounters.end(); ++i)
+   {
+      delete *i;
+   }
+   delete mExited;
+   delete mBaseline;
 }
 
 void 
@@ -34,16 +95,157 @@ StatisticsManager::setInterval(unsigned long intervalSecs)
    mInterval = intervalSecs * 1000;
 }
 
+StatisticsManager::Counters&
+StatisticsManager::counters()
+{
+   Counters* counters = static_cast<Counters*>(ThreadIf::tlsGetValue(mCountersKey));
+   if (!counters)
+   {
+      counters = new Counters;
+      counters->owner = this;
+      {
+         Lock lock(mMutex);
+         mCounters.push_back(counters);
+      }
+      ThreadIf::tlsSetValue(mCountersKey, counters);
+   }
+   return *counters;
+}
+
+void
+StatisticsManager::threadExited(void* value)
+{
+   Counters* counters = static_cast<Counters*>(value);
+   StatisticsManager* manager = counters->owner;
+   {
+      Lock lock(manager->mMutex);
+      manager->mExited->add(*counters);
+      manager->mCounters.erase(std::find(manager->mCounters.begin(),
+                                         manager->mCounters.end(),
+                                         counters));
+   }
+   delete counters;
+}
+
+void
+StatisticsManager::addUp(Counters& total) const
+{
+   total.add(*mExited);
+   for (vector<Counters*>::const_iterator i = mCounters.begin(); i != mCounters.end(); ++i)
+   {
+      total.add(**i);
+   }
+}
+
+void
+StatisticsManager::count(StatisticsMessage::Snapshot::Counter counter,
+                         MethodTypes method,
+                         int code)
+{
+   const int c = (int)counter;
+   if (c < (int)Counters::FirstResponseCounter)
+   {
+      UInt32& value = counters().requests[c][method];
+      singleWriterStore(value, singleWriterLoad(value) + 1);
+   }
+   else
+   {
+      if (code < 0 || code >= Counters::MaxCode)
+      {
+         code = 0;
+      }
+      UInt32& value = counters().responses[c - (int)Counters::FirstResponseCounter][method][code];
+      singleWriterStore(value, singleWriterLoad(value) + 1);
+   }
+}
+
+void
+StatisticsManager::recordLatency(StatisticsMessage::Latency latency, UInt64 microSec)
+{
+   if (mStack.statisticsManagerEnabled())
+   {
+      counters().latency[latency].record(microSec);
+   }
+}
+
+void
+StatisticsManager::getSnapshot(StatisticsMessage::Snapshot& snapshot) const
+{
+   typedef StatisticsMessage::Snapshot Snapshot;
+
+   // Far too big for the stack.
+   std::auto_ptr<Counters> total(new Counters);
+   Lock lock(mMutex);
+   addUp(*total);
+
+   snapshot.counts.clear();
+   Snapshot::Count entry;
+   for (int c = 0; c < Counters::RequestCounters; ++c)
+   {
+      for (int m = 0; m < MAX_METHODS; ++m)
+      {
+         UInt32 value = total->requests[c][m] - mBaseline->requests[c][m];
+         if (value)
+         {
+            entry.counter = (UInt8)c;
+            entry.method = (UInt8)m;
+            entry.code = 0;
+            entry.value = value;
+            snapshot.counts.push_back(entry);
+         }
+      }
+   }
+   for (int c = 0; c < Counters::ResponseCounters; ++c)
+   {
+      for (int m = 0; m < MAX_METHODS; ++m)
+      {
+         for (int code = 0; code < Counters::MaxCode; ++code)
+         {
+            UInt32 value = total->responses[c][m][code] - mBaseline->responses[c][m][code];
+            if (value)
+            {
+               entry.counter = (UInt8)(c + Counters::FirstResponseCounter);
+               entry.method = (UInt8)m;
+               entry.code = (UInt16)code;
+               entry.value = value;
+               snapshot.counts.push_back(entry);
+            }
+         }
+      }
+   }
+
+   for (int l = 0; l < StatisticsMessage::MaxLatency; ++l)
+   {
+      snapshot.latency[l] = total->latency[l];
+      snapshot.latency[l].subtract(mBaseline->latency[l]);
+   }
+}
+
 void 
 StatisticsManager::poll()
 {
    // get snapshot data now..
-   tuFifoSize = mStack.mTransactionController->getTuFifoSize();
-   transportFifoSizeSum = mStack.mTransactionController->sumTransportFifoSizes();
-   transactionFifoSize = mStack.mTransactionController->getTransactionFifoSize();
-   activeTimers = mStack.mTransactionController->getTimerQueueSize();
-   activeClientTransactions = mStack.mTransactionController->getNumClientTransactions();
-   activeServerTransactions = mStack.mTransactionController->getNumServerTransactions();
+   mSnapshot.tuFifoSize = mStack.mTransactionController->getTuFifoSize();
+   mSnapshot.transportFifoSizeSum = mStack.mTransactionController->sumTransportFifoSizes();
+   mSnapshot.transactionFifoSize = mStack.mTransactionController->getTransactionFifoSize();
+   mSnapshot.activeTimers = mStack.mTransactionController->getTimerQueueSize();
+   mSnapshot.activeClientTransactions = mStack.mTransactionController->getNumClientTransactions();
+   mSnapshot.activeServerTransactions = mStack.mTransactionController->getNumServerTransactions();
+#ifdef USE_SSL
+   if(mStack.getSecurity())
+   {
+      TlsSessionCache::Stats tls = mStack.getSecurity()->getTlsSessionCache().getStats();
+      mSnapshot.tlsFullHandshakes = (unsigned int)(tls.serverFullHandshakes + tls.clientFullHandshakes);
+      mSnapshot.tlsResumedHandshakes = (unsigned int)(tls.serverResumedHandshakes + tls.clientResumedHandshakes);
+      for(int b = 0; b < StatisticsMessage::Gauges::TlsLatencyBuckets && b < TlsSessionCache::Stats::LatencyBuckets; ++b)
+      {
+         mSnapshot.tlsHandshakeLatency[b] = (unsigned int)tls.handshakeLatency[b];
+      }
+      TlsHandshakePool* pool = mStack.getSecurity()->getTlsHandshakePool();
+      mSnapshot.tlsHandshakesQueued = pool ? pool->queued() : 0;
+   }
+#endif
+   getSnapshot(mSnapshot);
 
    // .kw. At last check payload was > 146kB, which seems too large
    // to alloc on stack. Also, the post'd message has reference
@@ -54,7 +256,7 @@ StatisticsManager::poll()
        mPublicPayload = new StatisticsMessage::AtomicPayload;
        // re-used each time, free'd in destructor
    }
-   mPublicPayload->loadIn(*this);
+   mPublicPayload->loadIn(mSnapshot);
 
    bool postToStack = true;
    StatisticsMessage msg(*mPublicPayload);
@@ -80,6 +282,18 @@ StatisticsManager::poll()
    }
 }
 
+void
+StatisticsManager::zeroOut()
+{
+   // Counting carries on regardless; just remember where we were, and take
+   // that off from now on.
+   std::auto_ptr<Counters> total(new Counters);
+   Lock lock(mMutex);
+   addUp(*total);
+   delete mBaseline;
+   mBaseline = total.release();
+}
+
 void 
 StatisticsManager::process()
 {
@@ -97,20 +311,12 @@ StatisticsManager::sent(SipMessage* msg)
 
    if (msg->isRequest())
    {
-      ++requestsSent;
-      ++requestsSentByMethod[met];
+      count(StatisticsMessage::Snapshot::RequestsSent, met);
    }
    else if (msg->isResponse())
    {
-      int code = msg->const_header(h_StatusLine).statusCode();
-      if (code < 0 || code >= MaxCode)
-      {
-         code = 0;
-      }
-
-      ++responsesSent;
-      ++responsesSentByMethod[met];
-      ++responsesSentByMethodByCode[met][code];
+      count(StatisticsMessage::Snapshot::ResponsesSent, met,
+            msg->const_header(h_StatusLine).statusCode());
    }
    
    return false;
@@ -123,14 +329,11 @@ StatisticsManager::retransmitted(MethodTypes met,
 {
    if(request)
    {
-      ++requestsRetransmitted;
-      ++requestsRetransmittedByMethod[met];
+      count(StatisticsMessage::Snapshot::RequestsRetransmitted, met);
    }
    else
    {
-      ++responsesRetransmitted;
-      ++responsesRetransmittedByMethod[met];
-      ++responsesRetransmittedByMethodByCode[met][code];
+      count(StatisticsMessage::Snapshot::ResponsesRetransmitted, met, (int)code);
    }
    return false;
 }
@@ -142,19 +345,12 @@ StatisticsManager::received(SipMessage* msg)
 
    if (msg->isRequest())
    {
-      ++requestsReceived;
-      ++requestsReceivedByMethod[met];
+      count(StatisticsMessage::Snapshot::RequestsReceived, met);
    }
    else if (msg->isResponse())
    {
-      ++responsesReceived;
-      ++responsesReceivedByMethod[met];
-      int code = msg->const_header(h_StatusLine).statusCode();
-      if (code < 0 || code >= MaxCode)
-      {
-         code = 0;
-      }
-      ++responsesReceivedByMethodByCode[met][code];
+      count(StatisticsMessage::Snapshot::ResponsesReceived, met,
+            msg->const_header(h_StatusLine).statusCode());
    }
 
    return false;
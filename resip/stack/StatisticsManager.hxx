@@ -1,8 +1,13 @@
 #ifndef RESIP_StatisticsManager_hxx
 #define RESIP_StatisticsManager_hxx
 
+#include <vector>
+
 #include "rutil/Timer.hxx"
 #include "rutil/Data.hxx"
+#include "rutil/LatencyHistogram.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
 #include "resip/stack/StatisticsMessage.hxx"
 #include "resip/stack/StatisticsHandler.hxx"
 
@@ -16,8 +21,15 @@ class TransactionController;
    @brief Keeps track of various statistics on the stack's operation, and 
       periodically issues a StatisticsMessage to the TransactionUser (or, if the
       ExternalStatsHandler is set, it will be sent there).
+
+   @details Every thread that counts something (the TransactionController,
+      or each of its shards; whoever takes messages out of a TU fifo) gets
+      counters and latency histograms of its own, that only it writes to.
+      These are added up when the statistics are published, and zeroOut()
+      just remembers the totals at that point so that they can be taken
+      off later; so counting never takes a lock.
 */
-class StatisticsManager : public StatisticsMessage::Payload
+class StatisticsManager
 {
    public:
       // not implemented
@@ -50,6 +62,29 @@ class StatisticsManager : public StatisticsMessage::Payload
          mExternalHandler = handler;
       }
 
+      /**
+         @brief Adds up the counters and histograms of every thread, as they
+            are now. The gauges (fifo sizes and so on) are left alone; they
+            are only sampled when the statistics are published.
+      */
+      void getSnapshot(StatisticsMessage::Snapshot& snapshot) const;
+
+      /**
+         @brief Records a sample in one of the latency histograms, on behalf
+            of the calling thread.
+      */
+      void recordLatency(StatisticsMessage::Latency latency, UInt64 microSec);
+
+      /**
+         @brief Something to hand to a fifo (see 
+            TimeLimitFifo::setLatencyRecorder()) so that it records how long
+            things wait in it.
+      */
+      LatencyRecorder& latencyRecorder(StatisticsMessage::Latency latency)
+      {
+         return mRecorders[latency];
+      }
+
    private:
       friend class TransactionState;
       bool sent(SipMessage* msg);
@@ -57,6 +92,49 @@ class StatisticsManager : public StatisticsMessage::Payload
       bool received(SipMessage* msg);
 
       void poll(); // force an update
+      void zeroOut();
+
+      /// What one thread has counted
+      struct Counters
+      {
+            enum {MaxCode = StatisticsMessage::Payload::MaxCode};
+            enum {FirstResponseCounter = StatisticsMessage::Snapshot::ResponsesSent};
+            enum {RequestCounters = FirstResponseCounter};
+            enum {ResponseCounters = StatisticsMessage::Snapshot::MaxCounter - FirstResponseCounter};
+
+            Counters();
+            void add(const Counters& rhs);
+
+            StatisticsManager* owner;
+
+            UInt32 requests[RequestCounters][MAX_METHODS];
+            UInt32 responses[ResponseCounters][MAX_METHODS][MaxCode];
+            LatencyHistogram latency[StatisticsMessage::MaxLatency];
+      };
+      Counters& counters();
+      // TLS destructor: folds an exiting thread's Counters into mExited
+      static void threadExited(void* counters);
+      // Adds everything counted so far to total; mMutex must be held.
+      void addUp(Counters& total) const;
+      void count(StatisticsMessage::Snapshot::Counter counter, MethodTypes method, int code=0);
+
+      class Recorder : public LatencyRecorder
+      {
+         public:
+            Recorder() : mManager(0), mLatency(StatisticsMessage::MaxLatency) {}
+            void init(StatisticsManager* manager, StatisticsMessage::Latency latency)
+            {
+               mManager = manager;
+               mLatency = latency;
+            }
+            virtual void recordLatency(UInt64 microSec)
+            {
+               mManager->recordLatency(mLatency, microSec);
+            }
+         private:
+            StatisticsManager* mManager;
+            StatisticsMessage::Latency mLatency;
+      };
 
       SipStack& mStack;
       UInt64 mInterval;
@@ -69,6 +147,21 @@ class StatisticsManager : public StatisticsMessage::Payload
       // published thru both ExternalHandler and posted to stack as message.
       // This payload is mutex protected.
       StatisticsMessage::AtomicPayload *mPublicPayload;
+      // re-used each time, to keep the capacity of its vector of counts
+      StatisticsMessage::Snapshot mSnapshot;
+
+      // Each running thread's Counters, found through mCountersKey; they
+      // belong to us. When a thread exits, its Counters are added to
+      // mExited and deleted.
+      ThreadIf::TlsKey mCountersKey;
+      std::vector<Counters*> mCounters;
+      Counters* mExited;
+      // the totals when zeroOut() was last called
+      Counters* mBaseline;
+      // protects mCounters, mExited and mBaseline
+      mutable Mutex mMutex;
+
+      Recorder mRecorders[StatisticsMessage::MaxLatency];
 };
 
 }
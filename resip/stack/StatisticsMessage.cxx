@@ -1,4 +1,5 @@
 #include "resip/stack/StatisticsMessage.hxx"
+#include "rutil/DataStream.hxx"
 #include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/WinLeakCheck.hxx"
@@ -105,13 +106,33 @@ StatisticsMessage::clone() const
    return new StatisticsMessage(*this);
 }
 
-StatisticsMessage::Payload::Payload()
+const char*
+StatisticsMessage::latencyName(Latency latency)
+{
+   switch(latency)
+   {
+      case TransactionDuration:
+         return "TX";
+      case StateMachineFifoTime:
+         return "SMFIFO";
+      case TransportFifoTime:
+         return "TPFIFO";
+      case TuFifoTime:
+         return "TUFIFO";
+      case DnsResolutionTime:
+         return "DNS";
+      default:
+         return "?";
+   }
+}
+
+StatisticsMessage::Gauges::Gauges()
 {
    zeroOut();
 }
 
 void
-StatisticsMessage::Payload::zeroOut()
+StatisticsMessage::Gauges::zeroOut()
 {
    tuFifoSize = 0;
    transportFifoSizeSum = 0;
@@ -121,6 +142,21 @@ StatisticsMessage::Payload::zeroOut()
    activeClientTransactions = 0;
    activeServerTransactions = 0;
    pendingDnsQueries = 0;
+   tlsFullHandshakes = 0;
+   tlsResumedHandshakes = 0;
+   tlsHandshakesQueued = 0;
+   memset(tlsHandshakeLatency, 0, sizeof(tlsHandshakeLatency));
+}
+
+StatisticsMessage::Payload::Payload()
+{
+   zeroOut();
+}
+
+void
+StatisticsMessage::Payload::zeroOut()
+{
+   Gauges::zeroOut();
    requestsSent = 0;
    responsesSent = 0;
    requestsRetransmitted = 0;
@@ -137,6 +173,10 @@ StatisticsMessage::Payload::zeroOut()
    memset(responsesSentByMethodByCode, 0, sizeof(responsesSentByMethodByCode));
    memset(responsesRetransmittedByMethodByCode, 0, sizeof(responsesRetransmittedByMethodByCode));
    memset(responsesReceivedByMethodByCode, 0, sizeof(responsesReceivedByMethodByCode));
+   for (int l = 0; l < MaxLatency; ++l)
+   {
+      latency[l].clear();
+   }
 }
 
 StatisticsMessage::Payload&
@@ -144,15 +184,7 @@ StatisticsMessage::Payload::operator=(const StatisticsMessage::Payload& rhs)
 {
    if (&rhs != this)
    {
-      transportFifoSizeSum = rhs.transportFifoSizeSum;
-      tuFifoSize = rhs.tuFifoSize;
-      activeTimers = rhs.activeTimers;
-      transactionFifoSize = rhs.transactionFifoSize;
-
-      openTcpConnections = rhs.openTcpConnections;
-      activeClientTransactions = rhs.activeClientTransactions;
-      activeServerTransactions = rhs.activeServerTransactions;
-      pendingDnsQueries = rhs.pendingDnsQueries;
+      Gauges::operator=(rhs);
 
       requestsSent = rhs.requestsSent;
       responsesSent = rhs.responsesSent;
@@ -171,32 +203,142 @@ StatisticsMessage::Payload::operator=(const StatisticsMessage::Payload& rhs)
       memcpy(responsesSentByMethodByCode, rhs.responsesSentByMethodByCode, sizeof(responsesSentByMethodByCode));
       memcpy(responsesRetransmittedByMethodByCode, rhs.responsesRetransmittedByMethodByCode, sizeof(responsesRetransmittedByMethodByCode));
       memcpy(responsesReceivedByMethodByCode, rhs.responsesReceivedByMethodByCode, sizeof(responsesReceivedByMethodByCode));
+      for (int l = 0; l < MaxLatency; ++l)
+      {
+         latency[l] = rhs.latency[l];
+      }
+   }
+
+   return *this;
+}
+
+StatisticsMessage::Payload&
+StatisticsMessage::Payload::operator=(const StatisticsMessage::Snapshot& rhs)
+{
+   zeroOut();
+   Gauges::operator=(rhs);
+
+   for (Snapshot::Counts::const_iterator i = rhs.counts.begin(); i != rhs.counts.end(); ++i)
+   {
+      const unsigned int m = i->method;
+      const unsigned int code = i->code;
+      switch (i->counter)
+      {
+         case Snapshot::RequestsSent:
+            requestsSent += i->value;
+            requestsSentByMethod[m] += i->value;
+            break;
+         case Snapshot::RequestsRetransmitted:
+            requestsRetransmitted += i->value;
+            requestsRetransmittedByMethod[m] += i->value;
+            break;
+         case Snapshot::RequestsReceived:
+            requestsReceived += i->value;
+            requestsReceivedByMethod[m] += i->value;
+            break;
+         case Snapshot::ResponsesSent:
+            responsesSent += i->value;
+            responsesSentByMethod[m] += i->value;
+            responsesSentByMethodByCode[m][code] += i->value;
+            break;
+         case Snapshot::ResponsesRetransmitted:
+            responsesRetransmitted += i->value;
+            responsesRetransmittedByMethod[m] += i->value;
+            responsesRetransmittedByMethodByCode[m][code] += i->value;
+            break;
+         case Snapshot::ResponsesReceived:
+            responsesReceived += i->value;
+            responsesReceivedByMethod[m] += i->value;
+            responsesReceivedByMethodByCode[m][code] += i->value;
+            break;
+      }
    }
 
+   for (int l = 0; l < MaxLatency; ++l)
+   {
+      latency[l] = rhs.latency[l];
+   }
    return *this;
 }
 
+StatisticsMessage::Snapshot::Snapshot()
+{}
+
+unsigned int
+StatisticsMessage::Snapshot::count(Counter counter, MethodTypes method,
+                                   int lowCode, int highCode) const
+{
+   unsigned int ret = 0;
+   for (Counts::const_iterator i = counts.begin(); i != counts.end(); ++i)
+   {
+      if (i->counter == counter && i->method == method &&
+          i->code >= lowCode && i->code < highCode)
+      {
+         ret += i->value;
+      }
+   }
+   return ret;
+}
+
+unsigned int
+StatisticsMessage::Snapshot::total(Counter counter) const
+{
+   unsigned int ret = 0;
+   for (Counts::const_iterator i = counts.begin(); i != counts.end(); ++i)
+   {
+      if (i->counter == counter)
+      {
+         ret += i->value;
+      }
+   }
+   return ret;
+}
+
+void
+StatisticsMessage::Snapshot::zeroOut()
+{
+   Gauges::zeroOut();
+   counts.clear();
+   for (int l = 0; l < MaxLatency; ++l)
+   {
+      latency[l].clear();
+   }
+}
+
 void 
 StatisticsMessage::loadOut(Payload& payload) const
 {
    mPayload.loadOut(payload);
 }
 
+void 
+StatisticsMessage::loadOut(Snapshot& snapshot) const
+{
+   mPayload.loadOut(snapshot);
+}
+
 StatisticsMessage::AtomicPayload::AtomicPayload()
 {}
 
 void
-StatisticsMessage::AtomicPayload::loadIn(const Payload& payload)
+StatisticsMessage::AtomicPayload::loadIn(const Snapshot& snapshot)
 {
    Lock lock(mMutex);
-   Payload::operator=(payload);
+   mSnapshot = snapshot;
 }
 
 void
 StatisticsMessage::AtomicPayload::loadOut(Payload& payload) const
 {
    Lock lock(mMutex);
-   payload = (*this);
+   payload = mSnapshot;
+}
+
+void
+StatisticsMessage::AtomicPayload::loadOut(Snapshot& snapshot) const
+{
+   Lock lock(mMutex);
+   snapshot = mSnapshot;
 }
 
 EncodeStream& 
@@ -214,6 +356,41 @@ resip::operator<<(EncodeStream& strm, const StatisticsMessage::Payload& stats)
       retriesNonFinal += stats.responsesRetransmittedByMethodByCode[INVITE][c];
    }
 
+   Data tlsLatency;
+   {
+      DataStream ds(tlsLatency);
+      for (int b = 0; b < StatisticsMessage::Payload::TlsLatencyBuckets; ++b)
+      {
+         if (stats.tlsHandshakeLatency[b])
+         {
+            if (b == StatisticsMessage::Payload::TlsLatencyBuckets - 1)
+            {
+               ds << " >=" << (1U << (b - 1)) << "ms:";
+            }
+            else
+            {
+               ds << " <" << (1U << b) << "ms:";
+            }
+            ds << stats.tlsHandshakeLatency[b];
+         }
+      }
+   }
+
+   Data latencies;
+   {
+      DataStream ds(latencies);
+      for (int l = 0; l < StatisticsMessage::MaxLatency; ++l)
+      {
+         const LatencyHistogram& h = stats.latency[l];
+         ds << " " << StatisticsMessage::latencyName((StatisticsMessage::Latency)l)
+            << " n" << h.count()
+            << "/p50 " << h.valueAtPercentile(50)
+            << "/p90 " << h.valueAtPercentile(90)
+            << "/p99 " << h.valueAtPercentile(99)
+            << "/max " << h.max();
+      }
+   }
+
    strm << "TU summary: " << stats.tuFifoSize
         << " TRANSPORT " << stats.transportFifoSizeSum
         << " TRANSACTION " << stats.transactionFifoSize
@@ -226,6 +403,11 @@ resip::operator<<(EncodeStream& strm, const StatisticsMessage::Payload& stats)
         << " rspi " << stats.responsesReceived
         << " rspo " << stats.responsesSent
         << std::endl
+        << "TLS handshakes: full " << stats.tlsFullHandshakes
+        << " resumed " << stats.tlsResumedHandshakes
+        << " queued " << stats.tlsHandshakesQueued
+        << " latency" << tlsLatency
+        << std::endl
         << "Details: INVi " << stats.requestsReceivedByMethod[INVITE] << "/S" << stats.sum2xxOut(INVITE) << "/F" << stats.sumErrOut(INVITE)
         << " INVo " << stats.requestsSentByMethod[INVITE]-stats.requestsRetransmittedByMethod[INVITE] << "/S" << stats.sum2xxIn(INVITE) << "/F" << stats.sumErrIn(INVITE)
         << " ACKi " << stats.requestsReceivedByMethod[ACK]
@@ -272,7 +454,9 @@ resip::operator<<(EncodeStream& strm, const StatisticsMessage::Payload& stats)
         << " INFx " << stats.requestsRetransmittedByMethod[INFO]
         << " PRAx " << stats.requestsRetransmittedByMethod[PRACK]
         << " SERx " << stats.requestsRetransmittedByMethod[SERVICE]
-        << " UPDx " << stats.requestsRetransmittedByMethod[UPDATE];
+        << " UPDx " << stats.requestsRetransmittedByMethod[UPDATE]
+        << std::endl
+        << "Latency (us):" << latencies;
    strm.flush();
    return strm;
 }
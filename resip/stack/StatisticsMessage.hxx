@@ -2,8 +2,10 @@
 #define RESIP_StatisticsMessage_hxx
 
 #include <iostream>
+#include <vector>
 #include "resip/stack/ApplicationMessage.hxx"
 #include "resip/stack/MethodTypes.hxx"
+#include "rutil/LatencyHistogram.hxx"
 #include "rutil/Mutex.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
 
@@ -21,12 +23,24 @@ class StatisticsMessage : public ApplicationMessage
 
       virtual ~StatisticsMessage();
 
-      struct Payload
+      /// What the latency histograms measure; all are in microseconds.
+      typedef enum
       {
-            enum {MaxCode = 700};
+         TransactionDuration, // from creation to destruction of a transaction
+         StateMachineFifoTime, // from parsing a message off the wire to the state machine taking it
+         TransportFifoTime, // from the state machine sending a message to its transport taking it
+         TuFifoTime, // waiting in a TU's fifo (or the stack's own)
+         DnsResolutionTime, // from a transaction asking for DNS to its first result
+         MaxLatency
+      } Latency;
+
+      /// Values sampled when the statistics are published
+      struct Gauges
+      {
+            enum {TlsLatencyBuckets = 16};
+
+            Gauges();
 
-            Payload();
-            
             unsigned int tuFifoSize;
             unsigned int transportFifoSizeSum;
             unsigned int transactionFifoSize;
@@ -35,7 +49,24 @@ class StatisticsMessage : public ApplicationMessage
             unsigned int activeClientTransactions;
             unsigned int activeServerTransactions;
             unsigned int pendingDnsQueries; // .dlb. not implemented
+            unsigned int tlsFullHandshakes; // since startup, inbound and outbound
+            unsigned int tlsResumedHandshakes; // since startup, inbound and outbound
+            unsigned int tlsHandshakesQueued; // waiting for a handshake thread
+            // handshake latency since startup; bucket 0 is under 1ms, bucket i
+            // from 2^(i-1) to 2^i ms, the last one anything longer
+            unsigned int tlsHandshakeLatency[TlsLatencyBuckets];
 
+            void zeroOut();
+      };
+
+      class Snapshot;
+
+      struct Payload : public Gauges
+      {
+            enum {MaxCode = 700};
+
+            Payload();
+            
             unsigned int requestsSent; // includes retransmissions
             unsigned int responsesSent; // includes retransmissions
             unsigned int requestsRetransmitted; // counts each retransmission
@@ -56,6 +87,8 @@ class StatisticsMessage : public ApplicationMessage
             unsigned int responsesRetransmittedByMethodByCode[MAX_METHODS][MaxCode];
             unsigned int responsesReceivedByMethodByCode[MAX_METHODS][MaxCode];
 
+            LatencyHistogram latency[MaxLatency];
+
             unsigned int sum2xxIn(MethodTypes method) const;
             unsigned int sumErrIn(MethodTypes method) const;
             unsigned int sum2xxOut(MethodTypes method) const;
@@ -63,23 +96,74 @@ class StatisticsMessage : public ApplicationMessage
             void zeroOut();
 
             Payload& operator=(const Payload& payload);
+            /// spells out every count in snapshot
+            Payload& operator=(const Snapshot& snapshot);
+      };
+
+      /**
+         The statistics as the StatisticsManager publishes them: the gauges,
+         those request and response counts that are not zero, and the
+         latency histograms. This is a small fraction of the size of a
+         Payload, which has a slot for every method and response code; assign
+         a Snapshot to a Payload if that is the form you want.
+      */
+      class Snapshot : public Gauges
+      {
+         public:
+            typedef enum
+            {
+               RequestsSent, // includes retransmissions
+               RequestsRetransmitted,
+               RequestsReceived,
+               ResponsesSent, // includes retransmissions
+               ResponsesRetransmitted,
+               ResponsesReceived,
+               MaxCounter
+            } Counter;
+
+            struct Count
+            {
+               UInt8 counter;
+               UInt8 method;
+               UInt16 code; // 0 for requests
+               UInt32 value;
+            };
+            typedef std::vector<Count> Counts;
+
+            Snapshot();
+
+            /// Adds up the counts of counter for method, with a response code
+            /// from lowCode up to (but not including) highCode.
+            unsigned int count(Counter counter, MethodTypes method,
+                               int lowCode=0, int highCode=Payload::MaxCode) const;
+            /// Adds up the counts of counter for every method.
+            unsigned int total(Counter counter) const;
+            void zeroOut();
+
+            /// sorted by counter, then method, then code
+            Counts counts;
+            LatencyHistogram latency[MaxLatency];
       };
 
       void loadOut(Payload& payload) const;
+      void loadOut(Snapshot& snapshot) const;
       static void logStats(const Subsystem& subsystem, const Payload& stats);
+      static const char* latencyName(Latency latency);
 
       virtual EncodeStream& encode(EncodeStream& strm) const;
       virtual EncodeStream& encodeBrief(EncodeStream& str) const;
 
       Message* clone() const;
 
-      class AtomicPayload : private Payload
+      class AtomicPayload
       {
          public:
             AtomicPayload();
-            void loadIn(const Payload& payload);
+            void loadIn(const Snapshot& snapshot);
             void loadOut(Payload& payload) const;
+            void loadOut(Snapshot& snapshot) const;
          private:
+            Snapshot mSnapshot;
             mutable Mutex mMutex;
 
             // dis-allowed by not implemented
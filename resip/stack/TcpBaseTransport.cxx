@@ -305,6 +305,7 @@ TcpBaseTransport::processAllWriteRequests()
    while (mTxFifoOutBuffer.messageAvailable())
    {
       SendData* data = mTxFifoOutBuffer.getNext();
+      recordTxFifoLatency(*data);
       DebugLog (<< "Processing write for " << data->destination);
 
       // this will check by connectionId first, then by address
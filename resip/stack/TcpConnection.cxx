@@ -2,6 +2,10 @@
 #include "config.h"
 #endif
 
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
+
 #include "rutil/Logger.hxx"
 #include "rutil/Socket.hxx"
 #include "resip/stack/TcpConnection.hxx"
@@ -108,6 +112,38 @@ TcpConnection::write( const char* buf, const int count )
    return bytesWritten;
 }
 
+#ifndef WIN32
+int
+TcpConnection::writev( const char* first, const int firstCount,
+                       const char* second, const int secondCount )
+{
+   assert(first);
+   assert(firstCount > 0);
+
+   struct iovec iov[2];
+   iov[0].iov_base = const_cast<char*>(first);
+   iov[0].iov_len = firstCount;
+   iov[1].iov_base = const_cast<char*>(second);
+   iov[1].iov_len = secondCount;
+
+   int bytesWritten = ::writev(getSocket(), iov, secondCount > 0 ? 2 : 1);
+
+   if (bytesWritten == INVALID_SOCKET)
+   {
+      int e = getErrno();
+      if (e == EAGAIN || e == EWOULDBLOCK)
+      {
+          return 0;
+      }
+      InfoLog (<< "Failed write on " << getSocket() << " " << strerror(e));
+      Transport::error(e);
+      return -1;
+   }
+   
+   return bytesWritten;
+}
+#endif
+
 bool 
 TcpConnection::hasDataToRead()
 {
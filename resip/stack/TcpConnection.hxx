@@ -15,6 +15,11 @@ class TcpConnection : public Connection
       
       int read( char* buf, const int count );
       int write( const char* buf, const int count );
+#ifndef WIN32
+      int writev( const char* first, const int firstCount,
+                  const char* second, const int secondCount );
+      virtual bool canWritev() const { return true; }
+#endif
       virtual bool hasDataToRead(); // has data that can be read 
       virtual bool isGood(); // has valid connection
       virtual bool isWritable();
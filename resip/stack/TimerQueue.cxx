@@ -33,52 +33,49 @@ DtlsTimerQueue::DtlsTimerQueue( Fifo<DtlsMessage>& fifo )
 
 DtlsTimerQueue::~DtlsTimerQueue()
 {
-   while(!mTimers.empty())
+   const TimerWithPayload* timer;
+   while((timer = drain()) != 0)
    {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
+      delete timer->getMessage();
+      mTimers.popExpired();
    }
 }
 
 #endif
 
-UInt64
+TransactionTimerQueue::Id
 TransactionTimerQueue::add(Timer::Type type, const Data& transactionId, unsigned long msOffset)
 {
-   TransactionTimer t(msOffset, type, transactionId);
-   mTimers.push(t);
    DebugLog (<< "Adding timer: " << Timer::toData(type) << " tid=" << transactionId << " ms=" << msOffset);
-   return mTimers.top().getWhen();
+   return mTimers.add(TransactionTimer(msOffset, type, transactionId));
 }
 
 #ifdef USE_DTLS
 
-UInt64
+DtlsTimerQueue::Id
 DtlsTimerQueue::add( SSL *ssl, unsigned long msOffset )
 {
-   TimerWithPayload t( msOffset, new DtlsMessage( ssl ) ) ;
-   mTimers.push( t ) ;
-   return mTimers.top().getWhen();
+   return mTimers.add( TimerWithPayload( msOffset, new DtlsMessage( ssl ) ) ) ;
 }
 
 #endif
 
 BaseTimeLimitTimerQueue::~BaseTimeLimitTimerQueue()
 {
-   while(!mTimers.empty())
+   const TimerWithPayload* timer;
+   while((timer = drain()) != 0)
    {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
+      delete timer->getMessage();
+      mTimers.popExpired();
    }
 }
 
-UInt64
+BaseTimeLimitTimerQueue::Id
 BaseTimeLimitTimerQueue::add(unsigned int timeMs,Message* payload)
 {
    assert(payload);
    DebugLog(<< "Adding application timer: " << payload->brief() << " ms=" << timeMs);
-   mTimers.push(TimerWithPayload(timeMs,payload));
-   return mTimers.top().getWhen();
+   return mTimers.add(TimerWithPayload(timeMs,payload));
 }
 
 void
@@ -110,20 +107,20 @@ TuSelectorTimerQueue::TuSelectorTimerQueue(TuSelector& sel) : mFifoSelector(sel)
 
 TuSelectorTimerQueue::~TuSelectorTimerQueue()
 {
-   while(!mTimers.empty())
+   const TimerWithPayload* timer;
+   while((timer = drain()) != 0)
    {
-      delete mTimers.top().getMessage();
-      mTimers.pop();
+      delete timer->getMessage();
+      mTimers.popExpired();
    }
 }
 
-UInt64
+TuSelectorTimerQueue::Id
 TuSelectorTimerQueue::add(unsigned int timeMs,Message* payload)
 {
    assert(payload);
    DebugLog(<< "Adding application timer: " << payload->brief() << " ms=" << timeMs);
-   mTimers.push(TimerWithPayload(timeMs,payload));
-   return mTimers.top().getWhen();
+   return mTimers.add(TimerWithPayload(timeMs,payload));
 }
 
 void
@@ -5,19 +5,14 @@
   #include "config.h"
 #endif
 
-#include <functional>
-#include <queue>
-#include <set>
+#include <climits>
 #include <iosfwd>
 #include "resip/stack/TimerMessage.hxx"
 #include "resip/stack/DtlsMessage.hxx"
 #include "rutil/Fifo.hxx"
 #include "rutil/TimeLimitFifo.hxx"
 #include "rutil/Timer.hxx"
-
-// .dlb. 
-// to do: timer wheel for transaction-bound timers and a heap for
-// everything longer.
+#include "rutil/TimingWheel.hxx"
 
 namespace resip
 {
@@ -31,27 +26,27 @@ class TuSelector;
   * @brief This class takes a fifo as a place to where you can write your stuff.
   * When using this in the main loop, call process() on this.
   * During Transaction processing, TimerMessages and SIP messages are generated.
-  * 
-    @todo .dlb. timer wheel for transaction-bound timers and a heap for 
-      everything longer.
+  *
+  * Timers are kept in a TimingWheel, so adding and cancelling a timer are 
+  * O(1), regardless of how many timers are pending.
   */
 template <class T>
 class TimerQueue
 {
    public:
+      /// @brief identifies a pending timer, so that it can be cancelled
+      typedef typename TimingWheel<T>::Id Id;
+
+      TimerQueue() :
+         mTimers(Timer::getTimeMs())
+      {}
+
       // This is the logic that runs when a timer goes off. This is the only
       // thing subclasses must implement.
       virtual void processTimer(const T& timer)=0;
 
-      /// @brief deletes the message associated with the timer as well.
       virtual ~TimerQueue()
       {
-         //xkd-2004-11-4
-         // delete the message associated with the timer
-         while (!mTimers.empty())
-         {
-            mTimers.pop();
-         }
       }
 
       /// @brief provides the time in milliseconds before the next timer will fire
@@ -96,10 +91,11 @@ class TimerQueue
          if (!mTimers.empty())
          {
             UInt64 now=Timer::getTimeMs();
-            while (!mTimers.empty() && !(mTimers.top().getWhen() > now))
+            const T* timer;
+            while ((timer = mTimers.nextExpired(now)) != 0)
             {
-               processTimer(mTimers.top());
-               mTimers.pop();
+               processTimer(*timer);
+               mTimers.popExpired();
             }
 
             if(!mTimers.empty())
@@ -110,6 +106,19 @@ class TimerQueue
          return 0;
       }
 
+      /// @brief removes a pending timer
+      /// @return false if the timer has already fired or been cancelled
+      bool cancel(const Id& id)
+      {
+         return mTimers.cancel(id);
+      }
+
+      /// @return true iff the timer has neither fired nor been cancelled
+      bool pending(const Id& id) const
+      {
+         return mTimers.pending(id);
+      }
+
       int size() const
       {
          return (int)mTimers.size();
@@ -149,8 +158,13 @@ class TimerQueue
 #endif
 
    protected:
-      typedef std::vector<T, std::allocator<T> > TimerVector;
-      std::priority_queue<T, TimerVector, std::greater<T> > mTimers;
+      /// @brief expires every remaining timer; used to clean up payloads
+      const T* drain()
+      {
+         return mTimers.nextExpired(~UInt64(0));
+      }
+
+      TimingWheel<T> mTimers;
 };
 
 /**
@@ -160,7 +174,7 @@ class BaseTimeLimitTimerQueue : public TimerQueue<TimerWithPayload>
 {
    public:
       ~BaseTimeLimitTimerQueue();
-      UInt64 add(unsigned int timeMs,Message* payload);
+      Id add(unsigned int timeMs,Message* payload);
       virtual void processTimer(const TimerWithPayload& timer);
    protected:
       virtual void addToFifo(Message*, TimeLimitFifo<Message>::DepthUsage)=0;      
@@ -189,7 +203,7 @@ class TuSelectorTimerQueue : public TimerQueue<TimerWithPayload>
    public:
       TuSelectorTimerQueue(TuSelector& sel);
       ~TuSelectorTimerQueue();
-      UInt64 add(unsigned int timeMs,Message* payload);
+      Id add(unsigned int timeMs,Message* payload);
       virtual void processTimer(const TimerWithPayload& timer);
    private:
       TuSelector& mFifoSelector;
@@ -203,7 +217,7 @@ class TransactionTimerQueue : public TimerQueue<TransactionTimer>
 {
    public:
       TransactionTimerQueue(Fifo<TimerMessage>& fifo);
-      UInt64 add(Timer::Type type, const Data& transactionId, unsigned long msOffset);
+      Id add(Timer::Type type, const Data& transactionId, unsigned long msOffset);
       virtual void processTimer(const TransactionTimer& timer);
    private:
       Fifo<TimerMessage>& mFifo;
@@ -221,7 +235,7 @@ class DtlsTimerQueue : public TimerQueue<TimerWithPayload>
    public:
       DtlsTimerQueue(Fifo<DtlsMessage>& fifo);
       ~DtlsTimerQueue();
-      UInt64 add(SSL *, unsigned long msOffset);
+      Id add(SSL *, unsigned long msOffset);
       virtual void processTimer(const TimerWithPayload& timer) ;
       
    private:
@@ -6,6 +6,9 @@
 #include "resip/stack/ApplicationMessage.hxx"
 #include "resip/stack/CancelClientInviteTransaction.hxx"
 #include "resip/stack/Helper.hxx"
+#include "resip/stack/KeepAliveMessage.hxx"
+#include "resip/stack/KeepAlivePong.hxx"
+#include "resip/stack/ConnectionTerminated.hxx"
 #include "resip/stack/AddTransport.hxx"
 #include "resip/stack/RemoveTransport.hxx"
 #include "resip/stack/TerminateFlow.hxx"
@@ -15,12 +18,14 @@
 #include "resip/stack/ShutdownMessage.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/TransactionController.hxx"
+#include "resip/stack/TransactionControllerThread.hxx"
 #include "resip/stack/TransactionState.hxx"
 #ifdef USE_SSL
 #include "resip/stack/ssl/Security.hxx"
 #endif
 #include "rutil/CongestionManager.hxx"
 #include "rutil/DnsUtil.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "resip/stack/SipStack.hxx"
 #include "rutil/WinLeakCheck.hxx"
@@ -36,6 +41,30 @@ using namespace resip;
 unsigned int TransactionController::MaxTUFifoSize = 0;
 unsigned int TransactionController::MaxTUFifoTimeDepthSecs = 0;
 
+namespace
+{
+// Sent to each shard by TransactionController::pauseShards(); the shard waits
+// for resumeShards() when it gets to it.
+class ShardPause : public TransactionMessage
+{
+   public:
+      virtual const Data& getTransactionId() const {return Data::Empty;}
+      virtual bool isClientTransaction() const {return true;}
+      virtual EncodeStream& encode(EncodeStream& strm) const
+      {
+         return strm << "ShardPause";
+      }
+      virtual EncodeStream& encodeBrief(EncodeStream& strm) const
+      {
+         return strm << "ShardPause";
+      }
+      virtual Message* clone() const
+      {
+         return new ShardPause(*this);
+      }
+};
+}
+
 TransactionController::TransactionController(SipStack& stack, 
                                                 AsyncProcessHandler* handler) :
    mStack(stack),
@@ -46,24 +75,79 @@ TransactionController::TransactionController(SipStack& stack,
    mStateMacFifoOutBuffer(mStateMacFifo),
    mCongestionManager(0),
    mTuSelector(stack.mTuSelector),
-   mTransportSelector(mStateMacFifo,
-                      stack.getSecurity(),
-                      stack.getDnsStub(),
-                      stack.getCompression()),
+   mOwnedTransportSelector(new TransportSelector(mStateMacFifo,
+                                                 stack.getSecurity(),
+                                                 stack.getDnsStub(),
+                                                 stack.getCompression())),
+   mTransportSelector(*mOwnedTransportSelector),
    mTimers(mTimerFifo),
    mShuttingDown(false),
    mStatsManager(stack.mStatsManager),
-   mHostname(DnsUtil::getLocalHostName())
+   mHostname(DnsUtil::getLocalHostName()),
+   mIsShard(false),
+   mParent(0),
+   mShardIndex(0),
+   mShardsPausing(false),
+   mShardsPaused(0)
 {
    mStateMacFifo.setDescription("TransactionController::mStateMacFifo");
 }
 
+TransactionController::TransactionController(TransactionController& parent,
+                                             unsigned int index) :
+   mStack(parent.mStack),
+   mDiscardStrayResponses(parent.mDiscardStrayResponses),
+   mFixBadDialogIdentifiers(parent.mFixBadDialogIdentifiers),
+   mFixBadCSeqNumbers(parent.mFixBadCSeqNumbers),
+   mStateMacFifo(0),
+   mStateMacFifoOutBuffer(mStateMacFifo),
+   mCongestionManager(0),
+   mTuSelector(parent.mTuSelector),
+   mTransportSelector(parent.mTransportSelector),
+   mTimers(mTimerFifo),
+   mShuttingDown(false),
+   mStatsManager(parent.mStatsManager),
+   mHostname(parent.mHostname),
+   mIsShard(true),
+   mParent(&parent),
+   mShardIndex(index),
+   mShardsPausing(false),
+   mShardsPaused(0)
+{
+   mStateMacFifo.setDescription("TransactionController::mStateMacFifo[" + 
+                                Data(index) + "]");
+}
+
 #if defined(WIN32) && !defined(__GNUC__)
 #pragma warning( default : 4355 )
 #endif
 
 TransactionController::~TransactionController()
 {
+   for(std::vector<TransactionControllerThread*>::iterator i = mShardThreads.begin();
+       i != mShardThreads.end(); ++i)
+   {
+      (*i)->shutdown();
+   }
+   for(std::vector<TransactionControllerThread*>::iterator i = mShardThreads.begin();
+       i != mShardThreads.end(); ++i)
+   {
+      (*i)->join();
+      delete *i;
+   }
+   mShardThreads.clear();
+
+   for(std::vector<TransactionController*>::iterator i = mShards.begin();
+       i != mShards.end(); ++i)
+   {
+      if(mCongestionManager)
+      {
+         mCongestionManager->unregisterFifo(&(*i)->mStateMacFifo);
+      }
+      delete *i;
+   }
+   mShards.clear();
+
    if(mClientTransactionMap.size())
    {
       WarningLog(<< "On shutdown, there are Client TransactionStates remaining!");
@@ -76,6 +160,142 @@ TransactionController::~TransactionController()
 }
 
 
+bool
+TransactionController::setNumShards(unsigned int numShards)
+{
+   if(!mShards.empty() || mIsShard)
+   {
+      return false;
+   }
+
+   if(numShards < 2)
+   {
+      return true;
+   }
+
+   InfoLog(<< "Running transaction processing in " << numShards << " shards");
+   // The shards hand messages to the transports from their own threads, so
+   // whatever is processing the transports needs to be woken up when they do.
+   mTransportSelector.createSelectInterruptor();
+   for(unsigned int i = 0; i < numShards; ++i)
+   {
+      TransactionController* shard = new TransactionController(*this, i);
+      if(mStateMacFifo.isLockFree())
+      {
+         shard->setLockFreeStateMacFifo(true);
+      }
+      if(mCongestionManager)
+      {
+         shard->registerStateMacFifo(mCongestionManager);
+      }
+      mShards.push_back(shard);
+   }
+
+   for(unsigned int i = 0; i < numShards; ++i)
+   {
+      TransactionControllerThread* thread = new TransactionControllerThread(*mShards[i]);
+      mShardThreads.push_back(thread);
+      thread->run();
+   }
+   return true;
+}
+
+void
+TransactionController::dispatch(TransactionMessage* message)
+{
+   // Anything that is not tied to a transaction is handled right here. Note
+   // that KeepAliveMessage is a special SipMessage; check for it first.
+   if(dynamic_cast<KeepAliveMessage*>(message) ||
+      (!dynamic_cast<SipMessage*>(message) &&
+         (dynamic_cast<KeepAlivePong*>(message) ||
+          dynamic_cast<ConnectionTerminated*>(message) ||
+          dynamic_cast<TerminateFlow*>(message) ||
+          dynamic_cast<EnableFlowTimer*>(message) ||
+          dynamic_cast<ZeroOutStatistics*>(message) ||
+          dynamic_cast<PollStatistics*>(message))))
+   {
+      TransactionState::process(*this, message);
+      return;
+   }
+
+   if(!dynamic_cast<SipMessage*>(message) &&
+      (dynamic_cast<AddTransport*>(message) ||
+       dynamic_cast<RemoveTransport*>(message)))
+   {
+      // The shards look up transports from their own threads, so keep them
+      // out of the TransportSelector while its transports change.
+      pauseShards();
+      TransactionState::process(*this, message);
+      resumeShards();
+      return;
+   }
+
+   unsigned int shard;
+   try
+   {
+      // ACK and CANCEL share their tid with the INVITE they belong to, and
+      // so end up in the same shard.
+      shard = shardIndex(message->getTransactionId(), mShards.size());
+   }
+   catch(resip::BaseException&)
+   {
+      // Let the state machine log and discard it.
+      TransactionState::process(*this, message);
+      return;
+   }
+
+   mShards[shard]->mStateMacFifo.add(message);
+}
+
+unsigned int
+TransactionController::shardIndex(const Data& tid, size_t numShards)
+{
+   return (unsigned int)(tid.hash() % numShards);
+}
+
+bool
+TransactionController::ownsTransactionId(const Data& tid) const
+{
+   return !mParent || shardIndex(tid, mParent->mShards.size()) == mShardIndex;
+}
+
+void
+TransactionController::pauseShards()
+{
+   Lock lock(mShardPauseMutex); (void)lock;
+   mShardsPausing = true;
+   for(std::vector<TransactionController*>::iterator i = mShards.begin();
+       i != mShards.end(); ++i)
+   {
+      (*i)->mStateMacFifo.add(new ShardPause);
+   }
+   while(mShardsPaused < mShards.size())
+   {
+      mShardPauseCondition.wait(mShardPauseMutex);
+   }
+}
+
+void
+TransactionController::resumeShards()
+{
+   Lock lock(mShardPauseMutex); (void)lock;
+   mShardsPausing = false;
+   mShardPauseCondition.broadcast();
+}
+
+void
+TransactionController::waitWhileShardsPaused()
+{
+   Lock lock(mShardPauseMutex); (void)lock;
+   ++mShardsPaused;
+   mShardPauseCondition.broadcast();
+   while(mShardsPausing)
+   {
+      mShardPauseCondition.wait(mShardPauseMutex);
+   }
+   --mShardsPaused;
+}
+
 bool 
 TransactionController::isTUOverloaded() const
 {
@@ -95,6 +315,7 @@ TransactionController::process(int timeout)
    if (mShuttingDown && 
        //mTimers.empty() && 
        !mStateMacFifoOutBuffer.messageAvailable() && // !dcm! -- see below 
+       getTransactionFifoSize() == 0 &&
        !mStack.mTUFifo.messageAvailable() &&
        mTransportSelector.isFinished())
 // !dcm! -- why would one wait for the Tu's fifo to be empty before delivering a
@@ -115,7 +336,7 @@ TransactionController::process(int timeout)
 
       // Check if Statistics Manager needs to be polled - note:  all statistic manager polls should happen from the 
       // TransactionController thread / process loop
-      if(mStack.mStatisticsManagerEnabled)
+      if(mStack.mStatisticsManagerEnabled && !mIsShard)
       {
          mStatsManager.process();
       }
@@ -147,7 +368,19 @@ TransactionController::process(int timeout)
          int runs=16;
          while(message)
          {
-            TransactionState::process(*this, message);
+            if(!mShards.empty())
+            {
+               dispatch(message);
+            }
+            else if(mParent && dynamic_cast<ShardPause*>(message))
+            {
+               delete message;
+               mParent->waitWhileShardsPaused();
+            }
+            else
+            {
+               TransactionState::process(*this, message);
+            }
             if(--runs==0)
             {
                break;
@@ -206,25 +439,77 @@ TransactionController::getTransactionFifoSize() const
 {
    // Should we include the stuff in mStateMacFifoOutBuffer here too? This is
    // likely to be called from other threads...
-   return mStateMacFifo.size();
+   unsigned int size = mStateMacFifo.size();
+   for(std::vector<TransactionController*>::const_iterator i = mShards.begin();
+       i != mShards.end(); ++i)
+   {
+      size += (*i)->mStateMacFifo.size();
+   }
+   return size;
 }
 
+// When sharded, the counts below are read while the shards are running, so
+// they are only approximate.
 unsigned int 
 TransactionController::getNumClientTransactions() const
 {
-   return mClientTransactionMap.size();
+   unsigned int count = mClientTransactionMap.size();
+   for(std::vector<TransactionController*>::const_iterator i = mShards.begin();
+       i != mShards.end(); ++i)
+   {
+      count += (*i)->mClientTransactionMap.size();
+   }
+   return count;
 }
 
 unsigned int 
 TransactionController::getNumServerTransactions() const
 {
-   return mServerTransactionMap.size();
+   unsigned int count = mServerTransactionMap.size();
+   for(std::vector<TransactionController*>::const_iterator i = mShards.begin();
+       i != mShards.end(); ++i)
+   {
+      count += (*i)->mServerTransactionMap.size();
+   }
+   return count;
 }
 
 unsigned int 
 TransactionController::getTimerQueueSize() const
 {
-   return mTimers.size();
+   unsigned int count = mTimers.size();
+   for(std::vector<TransactionController*>::const_iterator i = mShards.begin();
+       i != mShards.end(); ++i)
+   {
+      count += (*i)->mTimers.size();
+   }
+   return count;
+}
+
+void
+TransactionController::setCongestionManager(CongestionManager* manager)
+{
+   mTransportSelector.setCongestionManager(manager);
+   registerStateMacFifo(manager);
+   for(std::vector<TransactionController*>::iterator i = mShards.begin();
+       i != mShards.end(); ++i)
+   {
+      (*i)->registerStateMacFifo(manager);
+   }
+}
+
+void
+TransactionController::registerStateMacFifo(CongestionManager* manager)
+{
+   if(mCongestionManager)
+   {
+      mCongestionManager->unregisterFifo(&mStateMacFifo);
+   }
+   mCongestionManager=manager;
+   if(mCongestionManager)
+   {
+      mCongestionManager->registerFifo(&mStateMacFifo);
+   }
 }
 
 void 
@@ -292,6 +577,23 @@ TransactionController::setInterruptor(AsyncProcessHandler* handler)
    mStateMacFifo.setInterruptor(handler);
 }
 
+bool 
+TransactionController::setLockFreeStateMacFifo(bool lockFree)
+{
+   if(!mStateMacFifo.setLockFree(lockFree))
+   {
+      WarningLog(<< "Could not set lock-free mode to " << lockFree 
+                  << " on mStateMacFifo");
+      return false;
+   }
+   for(std::vector<TransactionController*>::iterator i = mShards.begin();
+       i != mShards.end(); ++i)
+   {
+      (*i)->setLockFreeStateMacFifo(lockFree);
+   }
+   return true;
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
@@ -6,9 +6,14 @@
 #include "resip/stack/TransportSelector.hxx"
 #include "resip/stack/TimerQueue.hxx"
 #include "rutil/CongestionManager.hxx"
+#include "rutil/Condition.hxx"
+#include "rutil/Mutex.hxx"
 
 #include "rutil/ConsumerFifoBuffer.hxx"
 
+#include <memory>
+#include <vector>
+
 namespace resip
 {
 
@@ -19,6 +24,7 @@ class StatisticsManager;
 class SipStack;
 class Compression;
 class FdPollGrp;
+class TransactionControllerThread;
 
 class TransactionController
 {
@@ -37,6 +43,22 @@ class TransactionController
       // graceful shutdown (eventually)
       void shutdown();
 
+      /**
+         Splits transaction processing across numShards controllers, each
+         with its own state machine fifo, transaction maps and timer queue,
+         and each run by its own thread. This controller then only dispatches
+         incoming work to the shard that owns the transaction (chosen by hash
+         of the transaction id), and handles messages that do not belong to a
+         transaction (keepalives, flow control, statistics, transport
+         add/remove). The TransportSelector is shared by all shards; while
+         a transport is added or removed, every shard is paused.
+
+         Must be called before any processing starts. Returns false if the
+         controller is already sharded.
+      */
+      bool setNumShards(unsigned int numShards);
+      unsigned int getNumShards() const { return (unsigned int)mShards.size(); }
+
       TransportSelector& transportSelector() { return mTransportSelector; }
       const TransportSelector& transportSelector() const { return mTransportSelector; }
 
@@ -53,19 +75,7 @@ class TransactionController
       void zeroOutStatistics();
       void pollStatistics();
       
-      void setCongestionManager( CongestionManager *manager ) 
-      { 
-         mTransportSelector.setCongestionManager(manager);
-         if(mCongestionManager)
-         {
-            mCongestionManager->unregisterFifo(&mStateMacFifo);
-         }
-         mCongestionManager=manager;
-         if(mCongestionManager)
-         {
-            mCongestionManager->registerFifo(&mStateMacFifo);
-         }
-      }
+      void setCongestionManager( CongestionManager *manager );
 
       CongestionManager::RejectionBehavior getRejectionBehavior() const
       {
@@ -87,12 +97,22 @@ class TransactionController
       inline void setFixBadDialogIdentifiers(bool pFixBadDialogIdentifiers) 
       {
          mFixBadDialogIdentifiers = pFixBadDialogIdentifiers;
+         for(std::vector<TransactionController*>::iterator i = mShards.begin();
+             i != mShards.end(); ++i)
+         {
+            (*i)->setFixBadDialogIdentifiers(pFixBadDialogIdentifiers);
+         }
       }
 
       inline bool getFixBadCSeqNumbers() const { return mFixBadCSeqNumbers;} 
       inline void setFixBadCSeqNumbers(bool pFixBadCSeqNumbers)
       {
          mFixBadCSeqNumbers = pFixBadCSeqNumbers;
+         for(std::vector<TransactionController*>::iterator i = mShards.begin();
+             i != mShards.end(); ++i)
+         {
+            (*i)->setFixBadCSeqNumbers(pFixBadCSeqNumbers);
+         }
       }
 
       void abandonServerTransaction(const Data& tid);
@@ -103,9 +123,28 @@ class TransactionController
       void enableFlowTimer(const resip::Tuple& flow);
 
       void setInterruptor(AsyncProcessHandler* handler);
+
+      // Must be called before any processing starts; see 
+      // AbstractFifo::setLockFree()
+      bool setLockFreeStateMacFifo(bool lockFree);
    private:
       TransactionController(const TransactionController& rhs);
       TransactionController& operator=(const TransactionController& rhs);
+
+      // Creates a shard of parent; see setNumShards()
+      TransactionController(TransactionController& parent, unsigned int index);
+      void registerStateMacFifo(CongestionManager* manager);
+      void dispatch(TransactionMessage* message);
+      static unsigned int shardIndex(const Data& tid, size_t numShards);
+      // true if messages for tid are dispatched to this controller
+      bool ownsTransactionId(const Data& tid) const;
+      // Blocks until every shard has stopped where it does not touch the 
+      // TransportSelector; see resumeShards()
+      void pauseShards();
+      void resumeShards();
+      // Called by a shard when it reaches the pause pauseShards() asked for
+      void waitWhileShardsPaused();
+
       SipStack& mStack;
       
       // If true, indicate to the Transaction to ignore responses for which
@@ -137,22 +176,38 @@ class TransactionController
       // from the sipstack (for convenience)
       TuSelector& mTuSelector;
 
-      // Used to decide which transport to send a sip message on. 
-      TransportSelector mTransportSelector;
+      // Used to decide which transport to send a sip message on. Shards
+      // use their parent's TransportSelector, and do not own one.
+      std::auto_ptr<TransportSelector> mOwnedTransportSelector;
+      TransportSelector& mTransportSelector;
+
+      // timers associated with the transactions. When a timer fires, it is
+      // placed in the mStateMacFifo. Declared ahead of the transaction maps
+      // so that it outlives them; a TransactionState cancels its pending
+      // timers when it is destroyed.
+      TransactionTimerQueue  mTimers;
 
       // stores all of the transactions that are currently active in this stack 
       TransactionMap mClientTransactionMap;
       TransactionMap mServerTransactionMap;
 
-      // timers associated with the transactions. When a timer fires, it is
-      // placed in the mStateMacFifo
-      TransactionTimerQueue  mTimers;
-
       bool mShuttingDown;
       
       StatisticsManager& mStatsManager;
       
       Data mHostname;
+
+      // true for the shards themselves; mShards and mShardThreads are only
+      // populated on the controller that dispatches to them.
+      bool mIsShard;
+      TransactionController* mParent;  // for shards
+      unsigned int mShardIndex;
+      std::vector<TransactionController*> mShards;
+      std::vector<TransactionControllerThread*> mShardThreads;
+      Mutex mShardPauseMutex;
+      Condition mShardPauseCondition;
+      bool mShardsPausing;
+      size_t mShardsPaused;
       
       friend class SipStack; // for debug only
       friend class StatelessHandler;
@@ -39,13 +39,38 @@
 #include "rutil/MD5Stream.hxx"
 #include "rutil/Socket.hxx"
 #include "rutil/Random.hxx"
+#include "rutil/AtomicOps.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 using namespace resip;
 
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSACTION
 
-UInt32 TransactionState::StatelessIdCounter = 0;
+volatile UInt32 TransactionState::StatelessIdCounter = 0;
+
+UInt32
+TransactionState::nextStatelessId()
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   return atomicFetchAdd(StatelessIdCounter, (UInt32)1);
+#else
+   return StatelessIdCounter++;
+#endif
+}
+
+Data
+TransactionState::nextStatelessId(const TransactionController& controller)
+{
+   // With a sharded TransactionController, messages about this transaction
+   // (ie. a TransportFailure) are dispatched by hash of its id, so pick one
+   // that lands on the shard creating it.
+   Data id(nextStatelessId());
+   while(!controller.ownsTransactionId(id))
+   {
+      id = Data(nextStatelessId());
+   }
+   return id;
+}
 
 TransactionState::TransactionState(TransactionController& controller, Machine m, 
                                    State s, const Data& id, MethodTypes method, const Data& methodText, TransactionUser* tu) : 
@@ -56,6 +81,7 @@ TransactionState::TransactionState(TransactionController& controller, Machine m,
    mIsReliable(true), // !jf! 
    mNextTransmission(0),
    mDnsResult(0),
+   mDnsStartTime(0),
    mId(id),
    mMethod(method),
    mMethodText(method==UNKNOWN ? new Data(methodText) : 0),
@@ -65,7 +91,8 @@ TransactionState::TransactionState(TransactionController& controller, Machine m,
    mPendingOperation(None),
    mTransactionUser(tu),
    mFailureReason(TransportFailure::None),
-   mFailureSubCode(0)
+   mFailureSubCode(0),
+   mStartTime(Timer::getTimeMicroSec())
 {
    StackLog (<< "Creating new TransactionState: " << *this);
 }
@@ -104,7 +131,7 @@ TransactionState::handleInternalCancel(SipMessage* cancel,
    cancel->header(h_Vias).front().param(p_branch)=clientInvite.mNextTransmission->const_header(h_Vias).front().param(p_branch);
    state->processClientNonInvite(cancel);
    // for the INVITE in case we never get a 487
-   clientInvite.mController.mTimers.add(Timer::TimerCleanUp, clientInvite.mId, 128*Timer::T1);
+   clientInvite.startTimer(Timer::TimerCleanUp, 128*Timer::T1);
 }
 
 bool
@@ -147,6 +174,12 @@ TransactionState::~TransactionState()
 {
    assert(mState != Bogus);
 
+   if (mMachine != Stateless && mController.mStack.statisticsManagerEnabled())
+   {
+      mController.mStatsManager.recordLatency(StatisticsMessage::TransactionDuration,
+                                              Timer::getTimeMicroSec() - mStartTime);
+   }
+
    if (mDnsResult)
    {
       mDnsResult->destroy();
@@ -154,6 +187,14 @@ TransactionState::~TransactionState()
 
    //StackLog (<< "Deleting TransactionState " << mId << " : " << this);
    erase(mId);
+
+   // Any timers still pending for this transaction can never be matched
+   // to it again, so take them out of the timer queue now.
+   for(std::vector<TransactionTimerQueue::Id>::const_iterator i=mTimerIds.begin();
+       i!=mTimerIds.end(); ++i)
+   {
+      mController.mTimers.cancel(*i);
+   }
    
    delete mNextTransmission;
    delete mMethodText;
@@ -236,7 +277,7 @@ TransactionState::processSipMessageAsNew(SipMessage* sip, TransactionController&
             else
             {
                //StackLog(<<" adding T100 timer (INV)");
-               controller.mTimers.add(Timer::TimerTrying, tid, Timer::T100);
+               state->startTimer(Timer::TimerTrying, Timer::T100);
             }
             state->sendToTU(sip);
             return true;
@@ -316,7 +357,7 @@ TransactionState::processSipMessageAsNew(SipMessage* sip, TransactionController&
                                                             Data::Empty,
                                                             tu);
             state->add(state->mId);
-            state->mController.mTimers.add(Timer::TimerStateless, state->mId, Timer::TS );
+            state->startTimer(Timer::TimerStateless, Timer::TS );
             state->processStateless(sip);
          }
          else if (method == CANCEL)
@@ -377,12 +418,12 @@ TransactionState::processSipMessageAsNew(SipMessage* sip, TransactionController&
             new TransactionState(controller, 
                                  Stateless, 
                                  Calling, 
-                                 Data(StatelessIdCounter++), 
+                                 nextStatelessId(controller), 
                                  method,
                                  sip->methodStr(),
                                  tu);
          state->add(state->mId);
-         state->mController.mTimers.add(Timer::TimerStateless, state->mId, Timer::TS );
+         state->startTimer(Timer::TimerStateless, Timer::TS );
          state->processStateless(sip);
       }
    }
@@ -501,6 +542,8 @@ TransactionState::process(TransactionController& controller,
       if(controller.mStack.statisticsManagerEnabled() && sip->isExternal())
       {
          controller.mStatsManager.received(sip);
+         controller.mStatsManager.recordLatency(StatisticsMessage::StateMachineFifoTime,
+                                                Timer::getTimeMicroSec() - sip->getCreatedTimeMicroSec());
       }
       
       // .bwc. Check for error conditions we can respond to.
@@ -801,7 +844,11 @@ TransactionState::processTimer(TransactionController& controller,
 {
    Data tid = message->getTransactionId();
 
-   if(controller.getRejectionBehavior()==CongestionManager::REJECTING_NON_ESSENTIAL)
+   TransactionState* state = 0;
+   if (message->isClientTransaction()) state = controller.mClientTransactionMap.find(tid);
+   else state = controller.mServerTransactionMap.find(tid);
+
+   if(state && controller.getRejectionBehavior()==CongestionManager::REJECTING_NON_ESSENTIAL)
    {
       // .bwc. State machine fifo is backed up; we probably should not be 
       // retransmitting anything right now. If we have a retransmit timer, 
@@ -809,23 +856,18 @@ TransactionState::processTimer(TransactionController& controller,
       switch(message->getType())
       {
          case Timer::TimerA: // doubling
-            controller.mTimers.add(Timer::TimerA, 
-                                    tid, 
-                                    message->getDuration()*2);
+            state->startTimer(Timer::TimerA, message->getDuration()*2);
             delete message;
             return;
          case Timer::TimerE1:// doubling, until T2
          case Timer::TimerG: // doubling, until T2
-            controller.mTimers.add(message->getType(), 
-                                    tid, 
-                                    resipMin(message->getDuration()*2,
-                                             Timer::T2));
+            state->startTimer(message->getType(), 
+                              resipMin(message->getDuration()*2,
+                                       Timer::T2));
             delete message;
             return;
          case Timer::TimerE2:// just reset
-            controller.mTimers.add(Timer::TimerE2, 
-                                    tid, 
-                                    Timer::T2);
+            state->startTimer(Timer::TimerE2, Timer::T2);
             delete message;
             return;
          default:
@@ -833,10 +875,6 @@ TransactionState::processTimer(TransactionController& controller,
       }
    }
 
-   TransactionState* state = 0;
-   if (message->isClientTransaction()) state = controller.mClientTransactionMap.find(tid);
-   else state = controller.mServerTransactionMap.find(tid);
-   
    if (state) // found transaction for timer
    {
       StackLog (<< "Found matching transaction for " << message->brief() << " -> " << *state);
@@ -877,6 +915,27 @@ TransactionState::processTimer(TransactionController& controller,
 
 }
 
+void
+TransactionState::startTimer(Timer::Type type, unsigned long ms)
+{
+   // Most transactions only ever have a handful of timers outstanding;
+   // forget about the ones that have already fired before the list grows.
+   if(mTimerIds.size() >= 8)
+   {
+      std::vector<TransactionTimerQueue::Id>::iterator keep=mTimerIds.begin();
+      for(std::vector<TransactionTimerQueue::Id>::iterator i=mTimerIds.begin();
+          i!=mTimerIds.end(); ++i)
+      {
+         if(mController.mTimers.pending(*i))
+         {
+            *keep++ = *i;
+         }
+      }
+      mTimerIds.erase(keep, mTimerIds.end());
+   }
+   mTimerIds.push_back(mController.mTimers.add(type, mId, ms));
+}
+
 void
 TransactionState::startServerNonInviteTimerTrying(SipMessage& sip, const Data& tid)
 {
@@ -888,7 +947,7 @@ TransactionState::startServerNonInviteTimerTrying(SipMessage& sip, const Data& t
       while(duration*2<Timer::T2) duration = duration * 2;
    }
    resetNextTransmission(make100(&sip));  // Store for use when timer expires
-   mController.mTimers.add(Timer::TimerTrying, tid, duration );  // Start trying timer so that we can send 100 to NITs as recommened in RFC4320
+   startTimer(Timer::TimerTrying, duration );  // Start trying timer so that we can send 100 to NITs as recommened in RFC4320
 }
 
 void
@@ -985,7 +1044,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
       SipMessage* sip = dynamic_cast<SipMessage*>(msg);
       resetNextTransmission(sip);
       saveOriginalContactAndVia(*sip);
-      mController.mTimers.add(Timer::TimerF, mId, Timer::TF);
+      startTimer(Timer::TimerF, Timer::TF);
       sendCurrentToWire();
    }
    else if (isResponse(msg) && isFromWire(msg)) // from the wire
@@ -1002,7 +1061,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
             // Should we restart the E2 timer though?  If so, we need to use somekind of timer sequence number so that previous E2 timers get discarded.
             if (!mIsReliable && mState == Trying)
             {
-               mController.mTimers.add(Timer::TimerE2, mId, Timer::T2 );
+               startTimer(Timer::TimerE2, Timer::T2 );
             }
             mState = Proceeding;
             sendToTU(msg); // don't delete            
@@ -1038,7 +1097,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
          else if (mState != Completed) // prevent TimerK reproduced
          {
             mState = Completed;
-            mController.mTimers.add(Timer::TimerK, mId, Timer::T4 );
+            startTimer(Timer::TimerK, Timer::T4 );
             // !bwc! Got final response in NIT. We don't need to do anything
             // except quietly absorb retransmissions. Dump all state.
             if(mDnsResult)
@@ -1068,7 +1127,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
             {
                unsigned long d = timer->getDuration();
                if (d < Timer::T2) d *= 2;
-               mController.mTimers.add(Timer::TimerE1, mId, d);
+               startTimer(Timer::TimerE1, d);
                StackLog (<< "Transmitting current message");
                sendCurrentToWire();
                delete timer;
@@ -1083,7 +1142,7 @@ TransactionState::processClientNonInvite(TransactionMessage* msg)
          case Timer::TimerE2:
             if (mState == Proceeding)
             {
-               mController.mTimers.add(Timer::TimerE2, mId, Timer::T2);
+               startTimer(Timer::TimerE2, Timer::T2);
                StackLog (<< "Transmitting current message");
                sendCurrentToWire();
                delete timer;
@@ -1169,7 +1228,7 @@ TransactionState::processClientInvite(TransactionMessage* msg)
             {
                resetNextTransmission(sip);
                saveOriginalContactAndVia(*sip);
-               mController.mTimers.add(Timer::TimerB, mId, Timer::TB );
+               startTimer(Timer::TimerB, Timer::TB );
                sendCurrentToWire();
             }
             else
@@ -1256,7 +1315,7 @@ TransactionState::processClientInvite(TransactionMessage* msg)
                }
                StackLog (<< "Received 2xx on client invite transaction");
                StackLog (<< *this);
-               mController.mTimers.add(Timer::TimerStaleClient, mId, Timer::TS );
+               startTimer(Timer::TimerStaleClient, Timer::TS );
             }
             else if (code >= 300)
             {
@@ -1294,7 +1353,7 @@ TransactionState::processClientInvite(TransactionMessage* msg)
                      // reliable, if transport is Unreliable then Fire the Timer D which 
                      // take care of re-Transmission of ACK 
                      mState = Completed;
-                     mController.mTimers.add(Timer::TimerD, mId, Timer::TD );
+                     startTimer(Timer::TimerD, Timer::TD );
                      SipMessage* ack = Helper::makeFailureAck(*mNextTransmission, *sip);
                      mNextTransmission->copyOutboundDecoratorsToStackFailureAck(*ack);
                      resetNextTransmission(ack);
@@ -1361,7 +1420,7 @@ TransactionState::processClientInvite(TransactionMessage* msg)
                unsigned long d = timer->getDuration()*2;
                // TimerA is supposed to double with each retransmit RFC3261 17.1.1          
 
-               mController.mTimers.add(Timer::TimerA, mId, d);
+               startTimer(Timer::TimerA, d);
                DebugLog (<< "Retransmitting INVITE ");
                sendCurrentToWire();
             }
@@ -1543,7 +1602,7 @@ TransactionState::processServerNonInvite(TransactionMessage* msg)
             if (mState == Trying || mState == Proceeding)
             {
                mState = Completed;
-               mController.mTimers.add(Timer::TimerJ, mId, 64*Timer::T1 );
+               startTimer(Timer::TimerJ, 64*Timer::T1 );
                resetNextTransmission(sip);
                sendCurrentToWire();
             }
@@ -1633,7 +1692,7 @@ TransactionState::processServerNonInvite(TransactionMessage* msg)
             // retransmission comes in. In the meantime, set up timers for
             // transaction termination.
             mState = Completed;
-            mController.mTimers.add(Timer::TimerJ, mId, 64*Timer::T1 );
+            startTimer(Timer::TimerJ, 64*Timer::T1 );
          }
       }
       delete msg;
@@ -1668,10 +1727,10 @@ TransactionState::processServerInvite(TransactionMessage* msg)
                mAckIsValid=true;
                resetNextTransmission(Helper::makeResponse(*sip, 500));
                mState = Completed;
-               mController.mTimers.add(Timer::TimerH, mId, Timer::TH );
+               startTimer(Timer::TimerH, Timer::TH );
                if (!mIsReliable)
                {
-                  mController.mTimers.add(Timer::TimerG, mId, Timer::T1 );
+                  startTimer(Timer::TimerG, Timer::T1 );
                }
                sendCurrentToWire();
                delete msg;
@@ -1722,7 +1781,7 @@ TransactionState::processServerInvite(TransactionMessage* msg)
                {
                   //StackLog (<< "Received ACK in Completed (unreliable) - confirmed, start Timer I");
                   mState = Confirmed;
-                  mController.mTimers.add(Timer::TimerI, mId, Timer::T4 );
+                  startTimer(Timer::TimerI, Timer::T4 );
                   // !bwc! Got an ACK/failure; we can stop retransmitting
                   // our failure response now.
                   resetNextTransmission(0);
@@ -1797,7 +1856,7 @@ TransactionState::processServerInvite(TransactionMessage* msg)
                   // source Tuple that the request was received on. 
                   //terminateServerTransaction(mId);
                   mMachine = ServerStale;
-                  mController.mTimers.add(Timer::TimerStaleServer, mId, Timer::TS );
+                  startTimer(Timer::TimerStaleServer, Timer::TS );
                }
                else
                {
@@ -1823,10 +1882,10 @@ TransactionState::processServerInvite(TransactionMessage* msg)
                   StackLog (<< "Received failed response in Trying or Proceeding. Start Timer H, move to completed." << *this);
                   resetNextTransmission(sip);
                   mState = Completed;
-                  mController.mTimers.add(Timer::TimerH, mId, Timer::TH );
+                  startTimer(Timer::TimerH, Timer::TH );
                   if (!mIsReliable)
                   {
-                     mController.mTimers.add(Timer::TimerG, mId, Timer::T1 );
+                     startTimer(Timer::TimerG, Timer::T1 );
                   }
                   sendCurrentToWire(); // don't delete msg
                }
@@ -1864,7 +1923,7 @@ TransactionState::processServerInvite(TransactionMessage* msg)
             {
                StackLog (<< "TimerG fired. retransmit, and re-add TimerG");
                sendCurrentToWire();
-               mController.mTimers.add(Timer::TimerG, mId, resipMin(Timer::T2, timer->getDuration()*2) );  //  TimerG is supposed to double - up until a max of T2 RFC3261 17.2.1
+               startTimer(Timer::TimerG, resipMin(Timer::T2, timer->getDuration()*2) );  //  TimerG is supposed to double - up until a max of T2 RFC3261 17.2.1
             }
             break;
 
@@ -1933,10 +1992,10 @@ TransactionState::processServerInvite(TransactionMessage* msg)
             mAckIsValid=true;
             StackLog (<< "Received failed response in Trying or Proceeding. Start Timer H, move to completed." << *this);
             mState = Completed;
-            mController.mTimers.add(Timer::TimerH, mId, Timer::TH );
+            startTimer(Timer::TimerH, Timer::TH );
             if (!mIsReliable)
             {
-               mController.mTimers.add(Timer::TimerG, mId, Timer::T1 );
+               startTimer(Timer::TimerG, Timer::T1 );
             }
          }
          else
@@ -2369,7 +2428,18 @@ TransactionState::handleSync(DnsResult* result)  // !slg! it is strange that we
    if (mPendingOperation == Dns)
    {
       assert(mDnsResult);
-      switch (mDnsResult->available())
+      DnsResult::Type available = mDnsResult->available();
+      if (mDnsStartTime && available != DnsResult::Pending)
+      {
+         if (mController.mStack.statisticsManagerEnabled())
+         {
+            mController.mStatsManager.recordLatency(StatisticsMessage::DnsResolutionTime,
+                                                    Timer::getTimeMicroSec() - mDnsStartTime);
+         }
+         mDnsStartTime = 0;
+      }
+
+      switch (available)
       {
          case DnsResult::Available:
             mPendingOperation=None;
@@ -2411,11 +2481,11 @@ TransactionState::processReliability(TransportType type)
             switch (mMachine)
             {
                case ClientNonInvite:
-                  mController.mTimers.add(Timer::TimerE1, mId, Timer::T1 );
+                  startTimer(Timer::TimerE1, Timer::T1 );
                   break;
                   
                case ClientInvite:
-                  mController.mTimers.add(Timer::TimerA, mId, Timer::T1 );
+                  startTimer(Timer::TimerA, Timer::T1 );
                   break;
 
                default:
@@ -2527,6 +2597,7 @@ TransactionState::sendCurrentToWire()
                   assert(sip->isRequest());
                   assert(mMethod!=CANCEL); // .bwc. mTarget should be set in this case.
                   mDnsResult = mController.mTransportSelector.createDnsResult(this);
+                  mDnsStartTime = Timer::getTimeMicroSec();
                   mPendingOperation=Dns;
                   mController.mTransportSelector.dnsResolve(mDnsResult, sip);
                }
@@ -3,10 +3,12 @@
 
 #include <iosfwd>
 #include <memory>
+#include <vector>
 #include "rutil/dns/DnsHandler.hxx"
 #include "resip/stack/MethodTypes.hxx"
 #include "resip/stack/SipMessage.hxx"
 #include "resip/stack/Transport.hxx"
+#include "resip/stack/TimerQueue.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
 
 namespace resip
@@ -117,6 +119,13 @@ class TransactionState : public DnsHandler
 
       void startServerNonInviteTimerTrying(SipMessage& sip, const Data& tid);
 
+      /**
+         Schedules a timer of the given type for this transaction, and
+         remembers its id so that it can be cancelled if this transaction is
+         destroyed before the timer fires.
+      */
+      void startTimer(Timer::Type type, unsigned long ms);
+
       static TransactionState* makeCancelTransaction(TransactionState* tran, Machine machine, const Data& tid);
       static void handleInternalCancel(SipMessage* cancel,
                                        TransactionState& clientInvite);
@@ -161,6 +170,8 @@ class TransactionState : public DnsHandler
 
       // Handle to the dns results queried by the TransportSelector
       DnsResult* mDnsResult;
+      // when we asked mDnsResult for a target, if we haven't heard back yet
+      UInt64 mDnsStartTime;
 
       // current selection from the DnsResult. e.g. it is important to send the
       // CANCEL to exactly the same tuple as the original INVITE went to. 
@@ -186,7 +197,17 @@ class TransactionState : public DnsHandler
       TransportFailure::FailureReason mFailureReason;      
       int mFailureSubCode;
 
-      static UInt32 StatelessIdCounter;
+      // Ids of the timers started by startTimer(); some of these may have
+      // fired already.
+      std::vector<TransactionTimerQueue::Id> mTimerIds;
+
+      // for the StatisticsManager
+      UInt64 mStartTime;
+
+      // Shared by all TransactionController shards
+      static volatile UInt32 StatelessIdCounter;
+      static UInt32 nextStatelessId();
+      static Data nextStatelessId(const TransactionController& controller);
       
       friend EncodeStream& operator<<(EncodeStream& strm, const TransactionState& state);
       friend class TransactionController;
@@ -138,6 +138,16 @@ class TransactionUser
       }
 
       const TimeLimitFifo<Message>* getFifo() { return(&mFifo); } const
+
+      /**
+         @internal
+         @brief Has our fifo report how long messages wait in it; the stack
+            points this at its StatisticsManager while we are registered.
+      */
+      void setFifoLatencyRecorder(LatencyRecorder* recorder)
+      {
+         mFifo.setLatencyRecorder(recorder);
+      }
       
       virtual UInt16 getExpectedWait() const
       {
@@ -442,6 +442,16 @@ Transport::pushRxMsgUp(SipMessage* message)
    mStateMachineFifo.add(message);
 }
 
+void
+Transport::logRxBytes(const Tuple& source, const char* data, size_t len)
+{
+   SipMessageLoggingHandler* handler = getSipMessageLoggingHandler();
+   if(handler)
+   {
+       handler->inboundRaw(source, mTuple, data, len);
+   }
+}
+
 bool
 Transport::operator==(const Transport& rhs) const
 {
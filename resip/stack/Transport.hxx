@@ -19,6 +19,7 @@ class SipMessage;
 class Connection;
 class Compression;
 class FdPollGrp;
+class LatencyRecorder;
 
 /**
  * TransportFlags is bit-mask that can be set when creating a transport.
@@ -51,6 +52,22 @@ class FdPollGrp;
  *    Specifies whether this Transport object has its own thread (ie; if
  *    set, the TransportSelector should not run the select/poll loop for
  *    this transport, since that is another thread's job)
+ * LOCKFREE_TXFIFO:
+ *    Use a lock-free fifo for messages waiting to be transmitted, so that
+ *    threads posting messages never contend with the thread servicing this
+ *    Transport (or with one another). Most useful in combination with
+ *    OWNTHREAD. See AbstractFifo::setLockFree().
+ * MMSG:
+ *    On UDP transports, receive and transmit datagrams in batches using
+ *    recvmmsg() and sendmmsg(), where the platform has them (otherwise
+ *    ignored). Combine with RXALL and TXALL to keep going until the
+ *    socket or the transmit queue is drained.
+ * REUSEPORT:
+ *    On UDP transports, bind with SO_REUSEPORT and open additional sockets
+ *    on the same address and port (one per core by default, see
+ *    UdpTransport::setNumReceiveSockets()), each served by its own thread,
+ *    so that the kernel spreads inbound datagrams, and the work of parsing
+ *    them, across cores. Ignored where SO_REUSEPORT is not available.
  */
 #define RESIP_TRANSPORT_FLAG_NOBIND      (1<<0)
 #define RESIP_TRANSPORT_FLAG_RXALL       (1<<1)
@@ -58,6 +75,9 @@ class FdPollGrp;
 #define RESIP_TRANSPORT_FLAG_KEEP_BUFFER (1<<3)
 #define RESIP_TRANSPORT_FLAG_TXNOW       (1<<4)
 #define RESIP_TRANSPORT_FLAG_OWNTHREAD   (1<<5)
+#define RESIP_TRANSPORT_FLAG_LOCKFREE_TXFIFO (1<<6)
+#define RESIP_TRANSPORT_FLAG_MMSG        (1<<7)
+#define RESIP_TRANSPORT_FLAG_REUSEPORT   (1<<8)
 
 /**
    @brief The base class for Transport classes.
@@ -77,10 +97,16 @@ class Transport : public FdSetIOObserver
       public:
           virtual ~SipMessageLoggingHandler(){}
           virtual void outboundMessage(const Tuple &source, const Tuple &destination, const SipMessage &msg) = 0;
+          // Called after outboundMessage, with the message as encoded for sending
+          virtual void outboundEncoded(const Tuple &source, const Tuple &destination, const SendData &data) {}
           // Note:  retranmissions store already encoded messages, so callback doesn't send SipMessage it sends
           //        the encoded version of the SipMessage instead.  If you need a SipMessage you will need to
           //        re-parse back into a SipMessage in the callback handler.
           virtual void outboundRetransmit(const Tuple &source, const Tuple &destination, const SendData &data) {}
+          // Called with the bytes of a received message as they came off the wire (after
+          // SigComp decompression or WebSocket deframing), before they are parsed.  Not every
+          // message passed here makes it to inboundMessage.
+          virtual void inboundRaw(const Tuple &source, const Tuple &destination, const char* data, size_t len) {}
           virtual void inboundMessage(const Tuple& source, const Tuple& destination, const SipMessage &msg) = 0;
       };
 
@@ -344,6 +370,10 @@ class Transport : public FdSetIOObserver
          mCongestionManager=manager;
       }
 
+      /// Tells the transport whom to tell how long outgoing messages waited in
+      /// its tx fifo; 0 to stop. Transports without a tx fifo ignore this.
+      virtual void setFifoLatencyRecorder(LatencyRecorder* recorder) {}
+
       CongestionManager::RejectionBehavior getRejectionBehaviorForIncoming() const
       {
          if(mCongestionManager)
@@ -360,6 +390,9 @@ class Transport : public FdSetIOObserver
 
       // called by Connection to deliver a received message
       virtual void pushRxMsgUp(SipMessage* msg);
+      // called by Connection with the bytes of a received message, before
+      // they are parsed; see SipMessageLoggingHandler::inboundRaw
+      void logRxBytes(const Tuple& source, const char* data, size_t len);
 
       // set the receive buffer length (SO_RCVBUF)
       virtual void setRcvBufLen(int buflen) { };	// make pure?
@@ -33,6 +33,7 @@
 #include "rutil/DnsUtil.hxx"
 #include "rutil/Inserter.hxx"
 #include "rutil/Logger.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Socket.hxx"
 #include "rutil/FdPoll.hxx"
 #include "rutil/WinLeakCheck.hxx"
@@ -73,7 +74,6 @@ TransportSelector::TransportSelector(Fifo<TransactionMessage>& fifo, Security* s
    mCompression(compression),
    mSigcompStack (0),
    mPollGrp(0),
-   mAvgBufferSize(1024),
    mInterruptorHandle(0)
 {
    memset(&mUnspecified.v4Address, 0, sizeof(sockaddr_in));
@@ -740,6 +740,7 @@ TransportSelector::determineSourceInterface(SipMessage* msg, const Tuple& target
 
       // this process will determine which interface the kernel would use to
       // send a packet to the target by making a connect call on a udp socket.
+      Lock lock(mSocketMutex);
       Socket tmp = INVALID_SOCKET;
       Data netNs = target.getNetNs();
       // One IPV4 and IPV6 socket per namespace.  Even if we do not support netns,
@@ -1269,16 +1270,13 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
                                                    msg->getTransactionId(),
                                                    remoteSigcompId));
 
-         send->data.reserve(mAvgBufferSize + mAvgBufferSize/4);
+         // Works out the size first, so the buffer is allocated just once.
+         msg->encodeToBuffer(send->data);
 
-         DataStream str(send->data);
-         msg->encode(str);
-         str.flush();
-
-         // !bwc! Moving average of message size. (Used to intelligently
-         // predict how much space to reserve in the buffer, to minimize
-         // dynamic resizing.)
-         mAvgBufferSize = (255*mAvgBufferSize + send->data.size()+128)/256;
+         if(handler)
+         {
+            handler->outboundEncoded(source, target, *send);
+         }
 
          assert(!send->data.empty());
          DebugLog (<< "Transmitting to " << target
@@ -1289,6 +1287,8 @@ TransportSelector::transmit(SipMessage* msg, Tuple& target, SendData* sendData)
 
          if(sendData)
          {
+            // Retransmissions go out of the same buffer.
+            send->share();
             *sendData = *send;
          }
 
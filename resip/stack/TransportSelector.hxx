@@ -11,6 +11,7 @@
 
 #include "rutil/Data.hxx"
 #include "rutil/Fifo.hxx"
+#include "rutil/Mutex.hxx"
 #include "rutil/GenericIPAddress.hxx"
 #include "resip/stack/Transport.hxx"
 #include "resip/stack/DnsInterface.hxx"
@@ -237,6 +238,10 @@ class TransportSelector
       // fake socket(s) one for each netns, for connect() and route table lookups
       mutable HashMap<Data, Socket> mSockets;
       mutable HashMap<Data, Socket> mSocket6s;
+      // determineSourceInterface() may be called from several
+      // TransactionController shards at once; see 
+      // TransactionController::setNumShards()
+      mutable Mutex mSocketMutex;
 
       // An AF_UNSPEC addr_in for rapid unconnect
       GenericIPAddress mUnspecified;
@@ -249,7 +254,6 @@ class TransportSelector
       // epoll support, for sharedprocess transports
       FdPollGrp* mPollGrp;
 
-      int mAvgBufferSize;
       Fifo<Transport> mTransportsToAddRemove;
       std::auto_ptr<SelectInterruptor> mSelectInterruptor;
       FdPollItemHandle mInterruptorHandle;
@@ -7,6 +7,7 @@
 #include "resip/stack/Helper.hxx"
 #include "resip/stack/SendData.hxx"
 #include "resip/stack/SipMessage.hxx"
+#include "resip/stack/TransportThread.hxx"
 #include "resip/stack/UdpTransport.hxx"
 #include "rutil/Data.hxx"
 #include "rutil/DnsUtil.hxx"
@@ -22,6 +23,10 @@
 #include <osc/SigcompMessage.h>
 #endif
 
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define RESIP_UDP_USE_MMSG
+#endif
+
 #define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
 
 using namespace std;
@@ -39,14 +44,44 @@ UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
      mSigcompStack(0),
      mRxBuffer(0),
      mExternalUnknownDatagramHandler(0),
-     mInWritable(false)
+     mInWritable(false),
+     mNumReceiveSockets(0),
+     mReceiversStarted(false),
+     mReceiveFor(0),
+     mRcvBufLen(0)
 {
    mPollEventCnt = 0;
    mTxTryCnt = mTxMsgCnt = mTxFailCnt = 0;
    mRxTryCnt = mRxMsgCnt = mRxKeepaliveCnt = mRxTransactionCnt = 0;
+   mRxBatchCnt = mRxBatchMax = mTxBatchCnt = mTxBatchMax = 0;
+#ifndef RESIP_UDP_USE_MMSG
+   if (mTransportFlags & RESIP_TRANSPORT_FLAG_MMSG)
+   {
+      WarningLog(<< "recvmmsg/sendmmsg not available on this platform, "
+                    "ignoring RESIP_TRANSPORT_FLAG_MMSG");
+      mTransportFlags &= ~RESIP_TRANSPORT_FLAG_MMSG;
+   }
+#endif
    mTuple.setType(UDP);
    mFd = InternalTransport::socket(transport(), version);
    mTuple.mFlowKey=(FlowKey)mFd;
+   if (mTransportFlags & RESIP_TRANSPORT_FLAG_REUSEPORT)
+   {
+#ifdef SO_REUSEPORT
+      int on = 1;
+      if ( ::setsockopt(mFd, SOL_SOCKET, SO_REUSEPORT, (char*)&on, sizeof(on)) )
+      {
+         int e = getErrno();
+         WarningLog(<< "Couldn't set SO_REUSEPORT, ignoring RESIP_TRANSPORT_FLAG_REUSEPORT: "
+                    << strerror(e));
+         mTransportFlags &= ~RESIP_TRANSPORT_FLAG_REUSEPORT;
+      }
+#else
+      WarningLog(<< "SO_REUSEPORT not available on this platform, "
+                    "ignoring RESIP_TRANSPORT_FLAG_REUSEPORT");
+      mTransportFlags &= ~RESIP_TRANSPORT_FLAG_REUSEPORT;
+#endif
+   }
    bind();      // also makes it non-blocking
 
    InfoLog (<< "Creating UDP transport host=" << pinterface
@@ -72,6 +107,7 @@ UdpTransport::UdpTransport(Fifo<TransactionMessage>& fifo,
 
 UdpTransport::~UdpTransport()
 {
+   stopReceivers();
    InfoLog(<< "Shutting down " << mTuple
            <<" tf="<<mTransportFlags<<" evt="<<(mPollGrp?1:0)
            <<" stats:"
@@ -83,6 +119,10 @@ UdpTransport::~UdpTransport()
            <<" rxmsg="<<mRxMsgCnt
            <<" rxka="<<mRxKeepaliveCnt
            <<" rxtr="<<mRxTransactionCnt
+           <<" rxbatch="<<mRxBatchCnt
+           <<" rxbatchmax="<<mRxBatchMax
+           <<" txbatch="<<mTxBatchCnt
+           <<" txbatchmax="<<mTxBatchMax
            );
 #ifdef USE_SIGCOMP
    delete mSigcompStack;
@@ -91,6 +131,11 @@ UdpTransport::~UdpTransport()
    {
       delete[] mRxBuffer;
    }
+   for (std::vector<char*>::iterator i = mRxBatchBuffers.begin();
+        i != mRxBatchBuffers.end(); ++i)
+   {
+      delete[] *i;
+   }
    setPollGrp(0);
 }
 
@@ -115,6 +160,104 @@ UdpTransport::setPollGrp(FdPollGrp *grp)
    InternalTransport::setPollGrp(grp);
 }
 
+/**
+ * With REUSEPORT, opens the extra sockets on our address (each one is a
+ * UdpTransport in its own right), and starts a thread for each of them.
+ * Called from the first process() call, so that none of this happens
+ * until the stack is actually running this transport.
+ * Their receive paths stamp incoming messages with our Tuple, so that the
+ * TransactionController treats them as having arrived on this transport;
+ * anything they need to send themselves (eg; 503s while congested, STUN
+ * responses) goes out on their own socket, which has the same address.
+ */
+void
+UdpTransport::startReceivers()
+{
+   mReceiversStarted = true;
+   if ( (mTransportFlags & RESIP_TRANSPORT_FLAG_REUSEPORT) == 0 || mReceiveFor )
+   {
+      return;
+   }
+
+   unsigned num = mNumReceiveSockets;
+   if (num == 0)
+   {
+#ifndef WIN32
+      long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      num = cpus > 0 ? (unsigned)cpus : 1;
+#else
+      num = 1;
+#endif
+   }
+
+   InfoLog(<< "Starting " << num-1 << " additional receive sockets for " << mTuple);
+   for (unsigned i = 1; i < num; ++i)
+   {
+      UdpTransport* receiver = 0;
+      try
+      {
+         receiver = new UdpTransport(mStateMachineFifo.getFifo(),
+                                     mTuple.getPort(),
+                                     ipVersion(),
+                                     StunDisabled,
+                                     interfaceName(),
+                                     mSocketFunc,
+                                     mCompression,
+                                     (mTransportFlags | RESIP_TRANSPORT_FLAG_OWNTHREAD));
+      }
+      catch (BaseException& e)
+      {
+         ErrLog(<< "Failed to open additional receive socket for " << mTuple << ": " << e);
+         break;
+      }
+      receiver->mReceiveFor = this;
+      receiver->mExternalUnknownDatagramHandler = mExternalUnknownDatagramHandler;
+      receiver->setCongestionManager(mCongestionManager);
+      if (mRcvBufLen)
+      {
+         receiver->setRcvBufLen(mRcvBufLen);
+      }
+      mReceivers.push_back(receiver);
+      mReceiverThreads.push_back(new TransportThread(*receiver));
+      mReceiverThreads.back()->run();
+   }
+}
+
+void
+UdpTransport::stopReceivers()
+{
+   for (std::vector<TransportThread*>::iterator t = mReceiverThreads.begin();
+        t != mReceiverThreads.end(); ++t)
+   {
+      (*t)->shutdown();
+   }
+   for (std::vector<TransportThread*>::iterator t = mReceiverThreads.begin();
+        t != mReceiverThreads.end(); ++t)
+   {
+      (*t)->join();
+      delete *t;
+   }
+   mReceiverThreads.clear();
+
+   for (std::vector<UdpTransport*>::iterator r = mReceivers.begin();
+        r != mReceivers.end(); ++r)
+   {
+      delete *r;
+   }
+   mReceivers.clear();
+}
+
+void
+UdpTransport::shutdown()
+{
+   InternalTransport::shutdown();
+   for (std::vector<UdpTransport*>::iterator r = mReceivers.begin();
+        r != mReceivers.end(); ++r)
+   {
+      (*r)->shutdown();
+   }
+}
+
 
 /**
  * Called after a message is added. Could try writing it now.
@@ -122,6 +265,10 @@ UdpTransport::setPollGrp(FdPollGrp *grp)
 void
 UdpTransport::process() 
 {
+   if ( !mReceiversStarted )
+   {
+      startReceivers();
+   }
    mStateMachineFifo.flush();
    if ( (mTransportFlags & RESIP_TRANSPORT_FLAG_TXNOW)!= 0 )
    {
@@ -203,6 +350,11 @@ UdpTransport::process(FdSet& fdset)
    // receive datagrams from fd
    // preparse and stuff into RxFifo
 
+   if ( !mReceiversStarted )
+   {
+      startReceivers();
+   }
+
    if (fdset.readyToWrite(mFd))
    {
       processTxAll();
@@ -223,10 +375,18 @@ UdpTransport::process(FdSet& fdset)
 void
 UdpTransport::processTxAll()
 {
+#ifdef RESIP_UDP_USE_MMSG
+   if ( (mTransportFlags & RESIP_TRANSPORT_FLAG_MMSG) != 0 )
+   {
+      processTxBatch();
+      return;
+   }
+#endif
    SendData *msg;
    ++mTxTryCnt;
    while ( (msg=mTxFifoOutBuffer.getNext(RESIP_FIFO_NOWAIT)) != NULL )
    {
+      recordTxFifoLatency(*msg);
       processTxOne(msg);
       // With UDP we don't need to worry about write blocking (I hope)
       if ( (mTransportFlags & RESIP_TRANSPORT_FLAG_TXALL)==0 )
@@ -318,13 +478,20 @@ UdpTransport::processTxOne(SendData *data)
 void
 UdpTransport::processRxAll()
 {
+#ifdef RESIP_UDP_USE_MMSG
+   if ( (mTransportFlags & RESIP_TRANSPORT_FLAG_MMSG) != 0 )
+   {
+      processRxBatch();
+      return;
+   }
+#endif
    char *buffer = mRxBuffer;
    mRxBuffer = NULL;
    ++mRxTryCnt;
    for (;;)
    {
       // TBD: check StateMac capacity
-      Tuple sender(mTuple);
+      Tuple sender(ownerTuple());
       int len = processRxRecv(buffer, sender);
       if ( len <= 0 )
       {
@@ -352,6 +519,186 @@ UdpTransport::processRxAll()
    }
 }
 
+#ifdef RESIP_UDP_USE_MMSG
+/**
+ * Batched version of processTxAll(), used with the MMSG flag. Pulls up to
+ * MaxBatchSize messages off the TxFifo and hands them to a single
+ * sendmmsg() call. Messages that need SigComp compression are sent one at
+ * a time by processTxOne(). With TXALL this keeps going until the TxFifo
+ * is empty; otherwise a single batch is sent.
+ */
+void
+UdpTransport::processTxBatch()
+{
+   SendData* batch[MaxBatchSize];
+   struct mmsghdr msgs[MaxBatchSize];
+   struct iovec iovs[MaxBatchSize];
+
+   ++mTxTryCnt;
+   for (;;)
+   {
+      int n = 0;
+      SendData* data;
+      while ( n < MaxBatchSize &&
+              (data=mTxFifoOutBuffer.getNext(RESIP_FIFO_NOWAIT)) != NULL )
+      {
+         recordTxFifoLatency(*data);
+         if ( data->command != SendData::NoCommand
+#ifdef USE_SIGCOMP
+              || (mSigcompStack && data->sigcompId.size() > 0 &&
+                  !data->isAlreadyCompressed)
+#endif
+            )
+         {
+            processTxOne(data);
+            continue;
+         }
+         assert( data->destination.getPort() != 0 );
+         ++mTxMsgCnt;
+         iovs[n].iov_base = const_cast<char*>(data->data.data());
+         iovs[n].iov_len = data->data.size();
+         memset(&msgs[n], 0, sizeof(msgs[n]));
+         msgs[n].msg_hdr.msg_name = const_cast<sockaddr*>(&data->destination.getSockaddr());
+         msgs[n].msg_hdr.msg_namelen = data->destination.length();
+         msgs[n].msg_hdr.msg_iov = &iovs[n];
+         msgs[n].msg_hdr.msg_iovlen = 1;
+         batch[n++] = data;
+      }
+
+      int sent = 0;
+      while ( sent < n )
+      {
+         int count = sendmmsg(mFd, &msgs[sent], n - sent, 0);
+         if ( count == SOCKET_ERROR )
+         {
+            // The first message in the remainder could not be sent; skip
+            // it, and try again with the rest.
+            int e = getErrno();
+            error(e);
+            InfoLog (<< "Failed (" << e << ") sending to " << batch[sent]->destination);
+            fail(batch[sent]->transactionId);
+            ++mTxFailCnt;
+            ++sent;
+            continue;
+         }
+
+         ++mTxBatchCnt;
+         if ( (unsigned)count > mTxBatchMax )
+         {
+            mTxBatchMax = count;
+         }
+         for (int i = sent; i < sent + count; ++i)
+         {
+            if ( msgs[i].msg_len != iovs[i].iov_len )
+            {
+               ErrLog (<< "UDPTransport - send buffer full" );
+               fail(batch[i]->transactionId);
+            }
+         }
+         sent += count;
+      }
+
+      for (int i = 0; i < n; ++i)
+      {
+         delete batch[i];
+      }
+
+      if ( n < MaxBatchSize || (mTransportFlags & RESIP_TRANSPORT_FLAG_TXALL) == 0 )
+      {
+         break;
+      }
+   }
+}
+
+/**
+ * Batched version of processRxAll(), used with the MMSG flag. Receives up
+ * to MaxBatchSize datagrams with a single recvmmsg() call into a set of
+ * buffers that persists between calls; only buffers that were absorbed into
+ * a SipMessage need to be replaced. With RXALL this keeps going until the
+ * socket is drained; otherwise a single batch is read.
+ */
+void
+UdpTransport::processRxBatch()
+{
+   struct mmsghdr msgs[MaxBatchSize];
+   struct iovec iovs[MaxBatchSize];
+   struct sockaddr_storage addrs[MaxBatchSize];
+
+   if ( mRxBatchBuffers.empty() )
+   {
+      mRxBatchBuffers.resize(MaxBatchSize, (char*)0);
+   }
+
+   ++mRxTryCnt;
+   for (;;)
+   {
+      for (int i = 0; i < MaxBatchSize; ++i)
+      {
+         if ( mRxBatchBuffers[i] == NULL )
+         {
+            mRxBatchBuffers[i] = MsgHeaderScanner::allocateBuffer(MaxBufferSize);
+         }
+         iovs[i].iov_base = mRxBatchBuffers[i];
+         iovs[i].iov_len = MaxBufferSize;
+         memset(&msgs[i], 0, sizeof(msgs[i]));
+         msgs[i].msg_hdr.msg_name = &addrs[i];
+         msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+         msgs[i].msg_hdr.msg_iov = &iovs[i];
+         msgs[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      int n = recvmmsg(mFd, msgs, MaxBatchSize, 0, NULL);
+      if ( n == SOCKET_ERROR )
+      {
+         int err = getErrno();
+         if ( err != EAGAIN && err != EWOULDBLOCK )
+         {
+            error( err );
+         }
+         break;
+      }
+      if ( n <= 0 )
+      {
+         break;
+      }
+
+      ++mRxBatchCnt;
+      if ( (unsigned)n > mRxBatchMax )
+      {
+         mRxBatchMax = n;
+      }
+
+      for (int i = 0; i < n; ++i)
+      {
+         int len = (int)msgs[i].msg_len;
+         if ( len <= 0 )
+         {
+            // nothing to parse; the buffer still holds an earlier datagram
+            continue;
+         }
+         if ( len+1 >= MaxBufferSize )
+         {
+            InfoLog(<<"Datagram exceeded max length "<<MaxBufferSize);
+            continue;
+         }
+         Tuple sender(ownerTuple());
+         memcpy(&sender.getMutableSockaddr(), &addrs[i],
+                resipMin((socklen_t)msgs[i].msg_hdr.msg_namelen, sender.length()));
+         ++mRxMsgCnt;
+         if ( processRxParse(mRxBatchBuffers[i], len, sender) )
+         {
+            mRxBatchBuffers[i] = NULL;
+         }
+      }
+
+      if ( n < MaxBatchSize || (mTransportFlags & RESIP_TRANSPORT_FLAG_RXALL) == 0 )
+      {
+         break;
+      }
+   }
+}
+#endif
+
 /*
  * Receive from socket and store results into {buffer}. Updates
  * {buffer} with actual buffer (in case allocation required),
@@ -417,6 +764,8 @@ bool
 UdpTransport::processRxParse(char *buffer, int len, Tuple& sender)
 {
    bool origBufferConsumed = true;
+   // the transport that datagrams received on this socket belong to
+   UdpTransport& owner = mReceiveFor ? *mReceiveFor : *this;
 
    //handle incoming CRLFCRLF keep-alive packets
    if (len == 4 &&
@@ -430,7 +779,7 @@ UdpTransport::processRxParse(char *buffer, int len, Tuple& sender)
    // this must be a STUN response (or garbage)
    if (buffer[0] == 1 && buffer[1] == 1 && ipVersion() == V4)
    {
-      resip::Lock lock(myMutex);
+      resip::Lock lock(owner.myMutex);
       StunMessage resp;
       memset(&resp, 0, sizeof(StunMessage));
 
@@ -454,8 +803,8 @@ UdpTransport::processRxParse(char *buffer, int len, Tuple& sender)
 #else
             sin_addr.s_addr = htonl(resp.xorMappedAddress.ipv4.addr);
 #endif
-            mStunMappedAddress = Tuple(sin_addr,resp.xorMappedAddress.ipv4.port, UDP);
-            mStunSuccess = true;
+            owner.mStunMappedAddress = Tuple(sin_addr,resp.xorMappedAddress.ipv4.port, UDP);
+            owner.mStunSuccess = true;
          }
          else if(resp.hasMappedAddress)
          {
@@ -464,8 +813,8 @@ UdpTransport::processRxParse(char *buffer, int len, Tuple& sender)
 #else
             sin_addr.s_addr = htonl(resp.mappedAddress.ipv4.addr);
 #endif
-            mStunMappedAddress = Tuple(sin_addr,resp.mappedAddress.ipv4.port, UDP);
-            mStunSuccess = true;
+            owner.mStunMappedAddress = Tuple(sin_addr,resp.mappedAddress.ipv4.port, UDP);
+            owner.mStunSuccess = true;
          }
       }
       return false;
@@ -568,7 +917,9 @@ UdpTransport::processRxParse(char *buffer, int len, Tuple& sender)
    //DebugLog ( << "UDP Rcv : " << len << " b" );
    //DebugLog ( << Data(buffer, len).escaped().c_str());
 
-   SipMessage* message = new SipMessage(&mTuple);
+   owner.logRxBytes(sender, buffer, len);
+
+   SipMessage* message = new SipMessage(&owner.mTuple);
 
    // set the received from information into the received= parameter in the
    // via
@@ -597,7 +948,7 @@ UdpTransport::processRxParse(char *buffer, int len, Tuple& sender)
       if(mExternalUnknownDatagramHandler)
       {
          auto_ptr<Data> datagram(new Data(buffer,len));
-         (*mExternalUnknownDatagramHandler)(this,sender,datagram);
+         (*mExternalUnknownDatagramHandler)(&owner,sender,datagram);
       }
 
       // Idea: consider backing buffer out of message and letting caller reuse it
@@ -753,12 +1104,23 @@ void
 UdpTransport::setExternalUnknownDatagramHandler(ExternalUnknownDatagramHandler *handler)
 {
    mExternalUnknownDatagramHandler = handler;
+   for (std::vector<UdpTransport*>::iterator r = mReceivers.begin();
+        r != mReceivers.end(); ++r)
+   {
+      (*r)->setExternalUnknownDatagramHandler(handler);
+   }
 }
 
 void
 UdpTransport::setRcvBufLen(int buflen)
 {
    setSocketRcvBufLen(mFd, buflen);
+   mRcvBufLen = buflen;
+   for (std::vector<UdpTransport*>::iterator r = mReceivers.begin();
+        r != mReceivers.end(); ++r)
+   {
+      (*r)->setRcvBufLen(buflen);
+   }
 }
 
 /* ====================================================================
@@ -2,6 +2,7 @@
 #define RESIP_UDPTRANSPORT_HXX
 
 #include <memory>
+#include <vector>
 #include "resip/stack/InternalTransport.hxx"
 #include "resip/stack/MsgHeaderScanner.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
@@ -11,6 +12,7 @@ namespace osc { class Stack; }
 
 namespace resip
 {
+class TransportThread;
 class UdpTransport;
 
 /** Interface functor for external unrecognized datagram handling.
@@ -75,6 +77,7 @@ public:
    virtual void buildFdSet( FdSet& fdset);
    virtual void setPollGrp(FdPollGrp *grp);
    virtual void setRcvBufLen(int buflen);
+   virtual void shutdown();
 
    // FdPollItemIf
    // virtual Socket getPollSocket() const;
@@ -82,6 +85,10 @@ public:
 
    static const int MaxBufferSize = 8192;
 
+   /// Most datagrams moved by one recvmmsg()/sendmmsg() call, when
+   /// RESIP_TRANSPORT_FLAG_MMSG is set.
+   static const int MaxBatchSize = 16;
+
    // STUN client functionality
    bool stunSendTest(const Tuple& dest);
    bool stunResult(Tuple& mappedAddress);
@@ -89,6 +96,32 @@ public:
    /// Installs a handler for the unknown datagrams arriving on the udp transport.
    void setExternalUnknownDatagramHandler(ExternalUnknownDatagramHandler *handler);
 
+   /**
+      Sets the total number of sockets (this transport's own socket
+      included) that receive on this transport's address when
+      RESIP_TRANSPORT_FLAG_REUSEPORT is set. Each additional socket is
+      served by its own thread, which receives and preparses datagrams, and
+      posts them to the TransactionController as if they had arrived on
+      this transport. 0 (the default) means one socket per online CPU.
+
+      The additional sockets are opened the first time this transport is
+      processed, so this must be called before the stack starts running.
+   */
+   void setNumReceiveSockets(unsigned num) { mNumReceiveSockets = num; }
+
+   /// Datagrams received and sent so far.
+   unsigned getRxMsgCount() const { return mRxMsgCnt; }
+   unsigned getTxMsgCount() const { return mTxMsgCnt; }
+   /**
+      With RESIP_TRANSPORT_FLAG_MMSG, the number of recvmmsg()/sendmmsg()
+      calls that moved any datagrams, and the most datagrams one call moved;
+      all 0 otherwise. Only meaningful on the thread processing the transport.
+   */
+   unsigned getRxBatchCount() const { return mRxBatchCnt; }
+   unsigned getRxBatchMax() const { return mRxBatchMax; }
+   unsigned getTxBatchCount() const { return mTxBatchCnt; }
+   unsigned getTxBatchMax() const { return mTxBatchMax; }
+
 protected:
 
    void processRxAll();
@@ -96,7 +129,13 @@ protected:
    bool processRxParse(char *buffer, int len, Tuple& sender);
    void processTxAll();
    void processTxOne(SendData *data);
+   void processRxBatch();
+   void processTxBatch();
    void updateEvents();
+   void startReceivers();
+   void stopReceivers();
+   /// The Tuple of the transport that datagrams received here belong to
+   const Tuple& ownerTuple() const { return mReceiveFor ? mReceiveFor->mTuple : mTuple; }
 
    osc::Stack *mSigcompStack;
 
@@ -109,8 +148,26 @@ protected:
    unsigned mRxMsgCnt;
    unsigned mRxKeepaliveCnt;
    unsigned mRxTransactionCnt;
+   // batched I/O statistics (RESIP_TRANSPORT_FLAG_MMSG); the average batch
+   // size is mRxMsgCnt/mRxBatchCnt and mTxMsgCnt/mTxBatchCnt
+   unsigned mRxBatchCnt;
+   unsigned mRxBatchMax;
+   unsigned mTxBatchCnt;
+   unsigned mTxBatchMax;
 private:
    char* mRxBuffer;
+   // receive buffers for processRxBatch(), one per datagram in a batch
+   std::vector<char*> mRxBatchBuffers;
+
+   // RESIP_TRANSPORT_FLAG_REUSEPORT: the extra transports receiving on our
+   // address, and the threads serving them. For one of those extra
+   // transports, mReceiveFor points back at the transport it receives for.
+   unsigned mNumReceiveSockets;
+   bool mReceiversStarted;
+   std::vector<UdpTransport*> mReceivers;
+   std::vector<TransportThread*> mReceiverThreads;
+   UdpTransport* mReceiveFor;
+   int mRcvBufLen;
    MsgHeaderScanner mMsgHeaderScanner;
    mutable resip::Mutex  myMutex;
    Tuple mStunMappedAddress;
@@ -342,6 +342,8 @@ DtlsTransport::_read( FdSet& fdset )
 #endif
    }
 
+   logRxBytes(tuple, (const char *)pt, len);
+
    SipMessage* message = new SipMessage(&mTuple);
 
    // set the received from information into the received= parameter in the
@@ -448,7 +450,10 @@ void DtlsTransport::_write( FdSet& fdset )
    if ( mSendData != NULL )
        sendData = mSendData ;
    else
+   {
        sendData = mTxFifo.getNext() ;
+       recordTxFifoLatency(*sendData) ;
+   }
 
    //DebugLog (<< "Sent: " <<  sendData->data);
    //DebugLog (<< "Sending message on udp.");
@@ -5,6 +5,7 @@
 #ifdef USE_SSL
 
 #include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
 
 #include <ostream>
 #include <fstream>
@@ -376,6 +377,7 @@ Security::createDomainCtx(const SSL_METHOD* method, const Data& domain, const Da
    SSL_CTX_set_cipher_list(ctx, mCipherList.cipherList().c_str());
    SSL_CTX_set_options(ctx, BaseSecurity::OpenSSLCTXSetOptions);
    SSL_CTX_clear_options(ctx, BaseSecurity::OpenSSLCTXClearOptions);
+   mTlsSessionCache.configure(ctx, domain);
 
    return ctx;
 }
@@ -1057,6 +1059,7 @@ Security::Exception::Exception(const Data& msg, const Data& file, const int line
 BaseSecurity::BaseSecurity (const CipherList& cipherSuite, const Data& defaultPrivateKeyPassPhrase) :
    mTlsCtx(0),
    mSslCtx(0),
+   mTlsHandshakePool(0),
    mCipherList(cipherSuite),
    mDefaultPrivateKeyPassPhrase(defaultPrivateKeyPassPhrase),
    mRootTlsCerts(0),
@@ -1128,6 +1131,8 @@ BaseSecurity::~BaseSecurity ()
 {
    DebugLog(<< "BaseSecurity::~BaseSecurity");
 
+   delete mTlsHandshakePool;
+
    // cleanup certificates
    clearList(mRootCerts, X509_free);
    clearMap(mDomainCerts, X509_free);
@@ -1149,6 +1154,37 @@ BaseSecurity::~BaseSecurity ()
 
 }
 
+void
+BaseSecurity::setTlsSessionCache(unsigned long maxSessions, unsigned long timeoutSecs)
+{
+   mTlsSessionCache.setServerCache(maxSessions, timeoutSecs);
+   mTlsSessionCache.configure(mTlsCtx, Data::Empty);
+   mTlsSessionCache.configure(mSslCtx, Data::Empty);
+}
+
+void
+BaseSecurity::setTlsSessionTickets(bool enable, unsigned long keyLifetimeSecs)
+{
+   mTlsSessionCache.setTickets(enable, keyLifetimeSecs);
+   mTlsSessionCache.configure(mTlsCtx, Data::Empty);
+   mTlsSessionCache.configure(mSslCtx, Data::Empty);
+}
+
+void
+BaseSecurity::setTlsClientSessionReuse(unsigned long maxSessions)
+{
+   mTlsSessionCache.setClientReuse(maxSessions);
+   mTlsSessionCache.configure(mTlsCtx, Data::Empty);
+   mTlsSessionCache.configure(mSslCtx, Data::Empty);
+}
+
+void
+BaseSecurity::setTlsHandshakeThreads(unsigned int threads, unsigned int maxQueued)
+{
+   delete mTlsHandshakePool;
+   mTlsHandshakePool = threads ? new TlsHandshakePool(threads, maxQueued) : 0;
+}
+
 void
 BaseSecurity::initialize ()
 {
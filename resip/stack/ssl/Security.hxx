@@ -14,6 +14,7 @@
 #include "rutil/BaseException.hxx"
 #include "resip/stack/SecurityTypes.hxx"
 #include "resip/stack/SecurityAttributes.hxx"
+#include "resip/stack/ssl/TlsSessionCache.hxx"
 
 // If USE_SSL is not defined, Security will not be built, and this header will 
 // not be installed. If you are including this file from a source tree, and are 
@@ -39,6 +40,7 @@ class Pkcs7Contents;
 class Security;
 class MultipartSignedContents;
 class SipMessage;
+class TlsHandshakePool;
 
 
 class BaseSecurity
@@ -195,6 +197,24 @@ class BaseSecurity
       static SecurityTypes::SSLType parseSSLType(const Data& typeName);
       static long parseOpenSSLCTXOption(const Data& optionName);
 
+      /**
+         TLS session resumption; see TlsSessionCache. These affect the
+         contexts created afterwards, so call them before adding TLS
+         transports.
+      */
+      void setTlsSessionCache(unsigned long maxSessions, unsigned long timeoutSecs = 3600);
+      void setTlsSessionTickets(bool enable, unsigned long keyLifetimeSecs = 3600);
+      void setTlsClientSessionReuse(unsigned long maxSessions);
+      TlsSessionCache& getTlsSessionCache() { return mTlsSessionCache; }
+
+      /**
+         Runs TLS handshakes on a pool of threads instead of the transport
+         threads; see TlsHandshakePool. With 0 threads (the default) they
+         run inline. Must be called before TLS transports are added.
+      */
+      void setTlsHandshakeThreads(unsigned int threads, unsigned int maxQueued = 1000);
+      TlsHandshakePool* getTlsHandshakePool() const { return mTlsHandshakePool; }
+
    public:
       SSL_CTX*       getTlsCtx ();
       SSL_CTX*       getSslCtx ();
@@ -223,6 +243,8 @@ class BaseSecurity
        */
       SSL_CTX*       mTlsCtx;
       SSL_CTX*       mSslCtx;
+      TlsSessionCache mTlsSessionCache;
+      TlsHandshakePool* mTlsHandshakePool;
       static void dumpAsn(char*, Data);
 
       CipherList mCipherList;
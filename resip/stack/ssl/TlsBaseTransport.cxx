@@ -4,15 +4,18 @@
 
 #ifdef USE_SSL
 
+#include <algorithm>
 #include <memory>
 #include <stdexcept>
 
 #include "rutil/compat.hxx"
 #include "rutil/Data.hxx"
 #include "rutil/Socket.hxx"
+#include "rutil/Lock.hxx"
 #include "rutil/Logger.hxx"
 #include "resip/stack/ssl/TlsBaseTransport.hxx"
 #include "resip/stack/ssl/TlsConnection.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
 #include "resip/stack/ssl/Security.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
@@ -42,7 +45,8 @@ TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo,
    mSslType(sslType),
    mDomainCtx(0),
    mClientVerificationMode(cvm),
-   mUseEmailAsSIP(useEmailAsSIP)
+   mUseEmailAsSIP(useEmailAsSIP),
+   mHandshakeInterruptorHandle(0)
 {
    setTlsDomain(sipDomain);   
    mTuple.setType(transportType);
@@ -72,6 +76,18 @@ TlsBaseTransport::TlsBaseTransport(Fifo<TransactionMessage>& fifo,
 
 TlsBaseTransport::~TlsBaseTransport()
 {
+   // Our connections outlive this part of the transport; make sure none of
+   // them is still with the pool, or will call back into us.
+   for(std::set<TlsConnection*>::iterator i = mQueuedHandshakes.begin(); i != mQueuedHandshakes.end(); ++i)
+   {
+      mSecurity->getTlsHandshakePool()->cancel(*i);
+      (*i)->mHandshakeQueued = false;
+   }
+   if(mPollGrp && mHandshakeInterruptorHandle)
+   {
+      mPollGrp->delPollItem(mHandshakeInterruptorHandle);
+      mHandshakeInterruptorHandle=0;
+   }
    if (mDomainCtx)
    {
       SSL_CTX_free(mDomainCtx);mDomainCtx=0;
@@ -114,6 +130,88 @@ TlsBaseTransport::setPeerCertificateVerificationCallback(
    return true;
 }
 
+void
+TlsBaseTransport::setPollGrp(FdPollGrp *grp)
+{
+   if(mPollGrp && mHandshakeInterruptorHandle)
+   {
+      mPollGrp->delPollItem(mHandshakeInterruptorHandle);
+      mHandshakeInterruptorHandle=0;
+   }
+   if(grp)
+   {
+      // Wakes whichever thread polls grp when a TlsHandshakePool hands a
+      // connection back.
+      mHandshakeInterruptorHandle = grp->addPollItem(mHandshakeInterruptor.getReadSocket(), FPEM_Read, &mHandshakeInterruptor);
+   }
+   TcpBaseTransport::setPollGrp(grp);
+}
+
+void
+TlsBaseTransport::process()
+{
+   TcpBaseTransport::process();
+   processHandedBackHandshakes();
+}
+
+bool
+TlsBaseTransport::queueHandshake(TlsConnection* conn)
+{
+   TlsHandshakePool* pool = mSecurity->getTlsHandshakePool();
+   if(!pool || !mHandshakeInterruptorHandle)
+   {
+      return false;
+   }
+   // The pool may hand conn back before post() even returns, but that is
+   // only noticed by process(), on this thread.
+   if(!pool->post(conn))
+   {
+      return false;
+   }
+   mQueuedHandshakes.insert(conn);
+   return true;
+}
+
+void
+TlsBaseTransport::handBackHandshake(TlsConnection* conn)
+{
+   {
+      Lock lock(mHandshakeMutex);
+      mHandedBackHandshakes.push_back(conn);
+   }
+   mHandshakeInterruptor.handleProcessNotification();
+}
+
+void
+TlsBaseTransport::forgetHandshake(TlsConnection* conn)
+{
+   mSecurity->getTlsHandshakePool()->cancel(conn);
+   mQueuedHandshakes.erase(conn);
+   Lock lock(mHandshakeMutex);
+   mHandedBackHandshakes.erase(std::remove(mHandedBackHandshakes.begin(), mHandedBackHandshakes.end(), conn),
+                               mHandedBackHandshakes.end());
+}
+
+void
+TlsBaseTransport::processHandedBackHandshakes()
+{
+   std::vector<TlsConnection*> ready;
+   {
+      Lock lock(mHandshakeMutex);
+      if(mHandedBackHandshakes.empty())
+      {
+         return;
+      }
+      ready.swap(mHandedBackHandshakes);
+   }
+   for(std::vector<TlsConnection*>::iterator i = ready.begin(); i != ready.end(); ++i)
+   {
+      // May delete the connection; each appears here only once.
+      mQueuedHandshakes.erase(*i);
+      (*i)->queuedHandshakeDone();
+   }
+}
+
 Connection* 
 TlsBaseTransport::createConnection(const Tuple& who, Socket fd, bool server)
 {
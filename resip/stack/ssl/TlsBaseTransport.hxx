@@ -10,6 +10,11 @@
 #include "resip/stack/SecurityTypes.hxx"
 #include "rutil/HeapInstanceCounter.hxx"
 #include "resip/stack/Compression.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/SelectInterruptor.hxx"
+
+#include <set>
+#include <vector>
 
 #include <openssl/ssl.h>
 
@@ -19,6 +24,7 @@ namespace resip
 class Connection;
 class Message;
 class Security;
+class TlsConnection;
 
 class TlsBaseTransport : public TcpBaseTransport
 {
@@ -74,8 +80,22 @@ class TlsBaseTransport : public TcpBaseTransport
          void *func,
          void *arg);
 
+      virtual void setPollGrp(FdPollGrp *grp);
+      virtual void process();
+
+      /// Passes the next handshake step of conn, which has stopped polling,
+      /// to the TlsHandshakePool of mSecurity. Returns false if there is no
+      /// pool, it is full, or this transport has no FdPollGrp.
+      bool queueHandshake(TlsConnection* conn);
+      /// Called from a TlsHandshakePool thread once a handshake step has
+      /// run; conn is picked up again by the next process().
+      void handBackHandshake(TlsConnection* conn);
+      /// Called when a connection with a queued handshake is deleted.
+      void forgetHandshake(TlsConnection* conn);
+
    protected:
       Connection* createConnection(const Tuple& who, Socket fd, bool server=false);
+      void processHandedBackHandshakes();
 
       Security* mSecurity;
       SecurityTypes::SSLType mSslType;
@@ -85,6 +105,13 @@ class TlsBaseTransport : public TcpBaseTransport
          as if it were a SIP URI.  This is convenient because many commercial
          CAs offer email certificates but not sip: certificates */
       bool mUseEmailAsSIP;
+
+      // Connections whose handshake is with the pool; transport thread only.
+      std::set<TlsConnection*> mQueuedHandshakes;
+      Mutex mHandshakeMutex;
+      std::vector<TlsConnection*> mHandedBackHandshakes;
+      SelectInterruptor mHandshakeInterruptor;
+      FdPollItemHandle mHandshakeInterruptorHandle;
 };
 
 }
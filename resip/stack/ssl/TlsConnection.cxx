@@ -8,6 +8,7 @@
 #include "resip/stack/ssl/TlsTransport.hxx"
 #include "resip/stack/ssl/Security.hxx"
 #include "rutil/Logger.hxx"
+#include "rutil/Timer.hxx"
 #include "resip/stack/Uri.hxx"
 #include "rutil/Socket.hxx"
 
@@ -122,6 +123,10 @@ TlsConnection::TlsConnection( Transport* transport, const Tuple& tuple,
       }
       SSL_set_verify(mSsl, verify_mode, 0);
    }
+   else
+   {
+      mSecurity->getTlsSessionCache().prepareClient(mSsl, tuple);
+   }
 
    mBio = BIO_new_socket((int)fd,0/*close flag*/);
    if( !mBio )
@@ -134,6 +139,9 @@ TlsConnection::TlsConnection( Transport* transport, const Tuple& tuple,
 
    mTlsState = Initial;
    mHandShakeWantsRead = false;
+   mHandShakeWantsWrite = false;
+   mHandshakeQueued = false;
+   mHandshakeStart = 0;
 
 #endif // USE_SSL   
 }
@@ -141,6 +149,10 @@ TlsConnection::TlsConnection( Transport* transport, const Tuple& tuple,
 TlsConnection::~TlsConnection()
 {
 #if defined(USE_SSL)
+   if (mHandshakeQueued)
+   {
+      static_cast<TlsBaseTransport*>(transport())->forgetHandshake(this);
+   }
    ERR_clear_error();
    int ret = SSL_shutdown(mSsl);
    if(ret < 0)
@@ -186,17 +198,21 @@ TlsConnection::checkState()
 #if defined(USE_SSL)
    //DebugLog(<<"state is " << fromTlsState(mTlsState));
 
+   if (mHandshakeQueued)
+   {
+      // A TlsHandshakePool thread has mSsl, and is updating mTlsState,
+      // until it hands us back.
+      return Handshaking;
+   }
+
    if (mTlsState == Up || mTlsState == Broken)
    {
       return mTlsState;
    }
    
-   int ok=0;
-   
-   ERR_clear_error();
-   
    if (mTlsState != Handshaking)
    {
+      mHandshakeStart = Timer::getTimeMs();
       if (mServer)
       {
          InfoLog( << "TLS handshake starting (Server mode)" );
@@ -214,8 +230,79 @@ TlsConnection::checkState()
       mTlsState = Handshaking;
    }
 
+   if (queueHandshake())
+   {
+      return Handshaking;
+   }
+
+   handshake();
+   if (mHandShakeWantsWrite || (mTlsState == Up && !mOutstandingSends.empty()))
+   {
+      ensureWritable();
+   }
+#endif // USE_SSL   
+   return mTlsState;
+}
+
+bool
+TlsConnection::queueHandshake()
+{
+#if defined(USE_SSL)
+   if (!mSecurity->getTlsHandshakePool() || !suspendPolling())
+   {
+      return false;
+   }
+   mHandshakeQueued = true;
+   TlsBaseTransport *t = static_cast<TlsBaseTransport*>(transport());
+   if (!t->queueHandshake(this))
+   {
+      StackLog( << "Can not queue TLS handshake, handshaking on transport thread");
+      mHandshakeQueued = false;
+      resumePolling();
+      return false;
+   }
+   StackLog( << "Queued TLS handshake");
+   return true;
+#else
+   return false;
+#endif
+}
+
+void
+TlsConnection::runQueuedHandshake()
+{
+   handshake();
+   static_cast<TlsBaseTransport*>(transport())->handBackHandshake(this);
+}
+
+void
+TlsConnection::queuedHandshakeDone()
+{
+   assert(mHandshakeQueued);
+   mHandshakeQueued = false;
+   resumePolling();
+   if (mHandShakeWantsWrite || (mTlsState == Up && !mOutstandingSends.empty()))
+   {
+      ensureWritable();
+   }
+   if (mTlsState == Up || mTlsState == Broken)
+   {
+      // Pick up anything the peer sent right behind the handshake, or close
+      // a connection whose handshake failed. May delete this.
+      performReads();
+   }
+}
+
+// Runs one step of the handshake. This may be on a TlsHandshakePool thread,
+// so it must not touch anything the transport thread could be using.
+void
+TlsConnection::handshake()
+{
+#if defined(USE_SSL)
+   ERR_clear_error();
    mHandShakeWantsRead = false;
-   ok = SSL_do_handshake(mSsl);
+   mHandShakeWantsWrite = false;
+   int ok = SSL_do_handshake(mSsl);
       
    if ( ok <= 0 )
    {
@@ -226,30 +313,30 @@ TlsConnection::checkState()
          case SSL_ERROR_WANT_READ:
             StackLog( << "TLS handshake want read" );
             mHandShakeWantsRead = true;
-            return mTlsState;
+            return;
 
          case SSL_ERROR_WANT_WRITE:
             StackLog( << "TLS handshake want write" );
-            ensureWritable();
-            return mTlsState;
+            mHandShakeWantsWrite = true;
+            return;
 
          case SSL_ERROR_ZERO_RETURN:
             StackLog( << "TLS connection closed cleanly");
-            return mTlsState;
+            return;
 
          case SSL_ERROR_WANT_CONNECT:
             StackLog( << "BIO not connected, try later");
-            return mTlsState;
+            return;
 
 #if  ( OPENSSL_VERSION_NUMBER >= 0x0090702fL )
          case SSL_ERROR_WANT_ACCEPT:
             StackLog( << "TLS connection want accept" );
-            return mTlsState;
+            return;
 #endif
 
          case SSL_ERROR_WANT_X509_LOOKUP:
             DebugLog( << "Try later / SSL_ERROR_WANT_X509_LOOKUP");
-            return mTlsState;
+            return;
 
          default:
             if(err == SSL_ERROR_SYSCALL)
@@ -263,7 +350,7 @@ TlsConnection::checkState()
                   case EWOULDBLOCK:  // Treat EGAIN and EWOULDBLOCK as the same: http://stackoverflow.com/questions/7003234/which-systems-define-eagain-and-ewouldblock-as-different-values
 #endif
                      StackLog( << "try later");
-                     return mTlsState;
+                     return;
                }
                ErrLog( << "socket error " << e);
                Transport::error(e);
@@ -322,7 +409,7 @@ TlsConnection::checkState()
             handleOpenSSLErrorQueue(ok, err, "SSL_do_handshake");
             mBio = NULL;
             mTlsState = Broken;
-            return mTlsState;
+            return;
       }
    }
    else // ok > 1
@@ -354,18 +441,14 @@ TlsConnection::checkState()
                  << "> remote cert domain(s) are <" 
                  << getPeerNamesData() << ">" );
          mFailureReason = TransportFailure::CertNameMismatch;         
-         return mTlsState;
+         return;
       }
    }
 
    InfoLog( << "TLS handshake done for peer " << getPeerNamesData()); 
+   mSecurity->getTlsSessionCache().handshakeCompleted(mSsl, mServer, Timer::getTimeMs() - mHandshakeStart);
    mTlsState = Up;
-   if (!mOutstandingSends.empty())
-   {
-      ensureWritable();
-   }
 #endif // USE_SSL   
-   return mTlsState;
 }
 
       
@@ -479,11 +562,23 @@ TlsConnection::read(char* buf, int count )
 bool
 TlsConnection::transportWrite()
 {
+   if (mHandshakeQueued)
+   {
+      // Leave the write set alone; polling is suspended until the
+      // handshake comes back from the pool.
+      DebugLog(<< "Transportwrite--Handshake queued");
+      return false;
+   }
    switch(mTlsState)
    {
       case Handshaking:
       case Initial:
          checkState();
+         if (mHandshakeQueued)
+         {
+            DebugLog(<< "Transportwrite--Handshake queued");
+            return false;
+         }
          if (mTlsState == Handshaking)
          {
             DebugLog(<< "Transportwrite--Handshaking--remove from write: " << mHandShakeWantsRead);
@@ -621,6 +716,11 @@ bool
 TlsConnection::isWritable() 
 {
 #if defined(USE_SSL)
+   if (mHandshakeQueued)
+   {
+      // polling resumes, writable or not, once the handshake is handed back
+      return false;
+   }
    switch(mTlsState)
    {
       case Handshaking:
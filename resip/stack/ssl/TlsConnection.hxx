@@ -10,6 +10,7 @@
 #include "rutil/HeapInstanceCounter.hxx"
 #include "resip/stack/SecurityTypes.hxx"
 #include "resip/stack/ssl/Security.hxx"
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
 
 // If USE_SSL is not defined, this will not be built, and this header will 
 // not be installed. If you are including this file from a source tree, and are 
@@ -29,7 +30,7 @@ namespace resip
 class Tuple;
 class Security;
 
-class TlsConnection : public Connection
+class TlsConnection : public Connection, public TlsHandshakePool::Handshake
 {
    public:
       RESIP_HeapCount(TlsConnection);
@@ -55,11 +56,21 @@ class TlsConnection : public Connection
       static const char * fromState(TlsState);
    
    private:
+      friend class TlsBaseTransport;
+
       /// No default c'tor
       TlsConnection();
       void computePeerName();
       Data getPeerNamesData() const;
       TlsState checkState();
+      void handshake();
+
+      // Handshaking on a TlsHandshakePool: queueHandshake() hands the
+      // connection to the pool, which calls runQueuedHandshake(); the
+      // transport thread then picks it up in queuedHandshakeDone().
+      bool queueHandshake();
+      virtual void runQueuedHandshake();
+      void queuedHandshakeDone();
 
       bool mServer;
       Security* mSecurity;
@@ -68,6 +79,9 @@ class TlsConnection : public Connection
       
       TlsState mTlsState;
       bool mHandShakeWantsRead;
+      bool mHandShakeWantsWrite;
+      bool mHandshakeQueued;
+      UInt64 mHandshakeStart;
 
       SSL* mSsl;
       BIO* mBio;
@@ -0,0 +1,180 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#if defined(USE_SSL)
+
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+using namespace resip;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
+
+TlsHandshakePool::TlsHandshakePool(unsigned int threads, unsigned int maxQueued) :
+   mMaxQueued(maxQueued),
+   mShutdown(false)
+{
+   if(threads == 0)
+   {
+      threads = 1;
+   }
+   InfoLog(<< "Starting " << threads << " TLS handshake threads");
+   for(unsigned int i = 0; i < threads; ++i)
+   {
+      mWorkers.push_back(new Worker(*this));
+      mWorkers.back()->run();
+   }
+}
+
+TlsHandshakePool::~TlsHandshakePool()
+{
+   {
+      Lock lock(mMutex);
+      mShutdown = true;
+      mWork.broadcast();
+   }
+   for(std::vector<Worker*>::iterator i = mWorkers.begin(); i != mWorkers.end(); ++i)
+   {
+      (*i)->shutdown();
+      (*i)->join();
+      delete *i;
+   }
+   if(!mQueue.empty())
+   {
+      WarningLog(<< "Abandoning " << mQueue.size() << " queued TLS handshakes");
+   }
+}
+
+bool
+TlsHandshakePool::post(Handshake* conn)
+{
+   Lock lock(mMutex);
+   if(mShutdown || mQueue.size() >= mMaxQueued)
+   {
+      return false;
+   }
+   mQueue.push_back(conn);
+   mWork.signal();
+   return true;
+}
+
+void
+TlsHandshakePool::cancel(Handshake* conn)
+{
+   Lock lock(mMutex);
+   for(std::deque<Handshake*>::iterator i = mQueue.begin(); i != mQueue.end(); ++i)
+   {
+      if(*i == conn)
+      {
+         mQueue.erase(i);
+         return;
+      }
+   }
+   while(mRunning.count(conn))
+   {
+      mDone.wait(mMutex);
+   }
+}
+
+unsigned int
+TlsHandshakePool::queued() const
+{
+   Lock lock(mMutex);
+   return (unsigned int)mQueue.size();
+}
+
+void
+TlsHandshakePool::Worker::thread()
+{
+   for(;;)
+   {
+      Handshake* conn = 0;
+      {
+         Lock lock(mPool.mMutex);
+         while(mPool.mQueue.empty() && !mPool.mShutdown)
+         {
+            mPool.mWork.wait(mPool.mMutex);
+         }
+         if(mPool.mShutdown)
+         {
+            break;
+         }
+         conn = mPool.mQueue.front();
+         mPool.mQueue.pop_front();
+         mPool.mRunning.insert(conn);
+      }
+
+      // conn belongs to this thread until it has been handed back; after
+      // that the transport may delete it at any moment.
+      conn->runQueuedHandshake();
+
+      {
+         Lock lock(mPool.mMutex);
+         mPool.mRunning.erase(conn);
+         mPool.mDone.broadcast();
+      }
+   }
+}
+
+void
+TlsHandshakePool::Worker::shutdown()
+{
+   ThreadIf::shutdown();
+   Lock lock(mPool.mMutex);
+   mPool.mWork.broadcast();
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
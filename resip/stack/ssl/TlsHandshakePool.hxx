@@ -0,0 +1,137 @@
+#if !defined(RESIP_TLSHANDSHAKEPOOL_HXX)
+#define RESIP_TLSHANDSHAKEPOOL_HXX
+
+#if defined(HAVE_CONFIG_H)
+  #include "config.h"
+#endif
+
+#include <deque>
+#include <set>
+#include <vector>
+
+#include "rutil/Condition.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
+
+namespace resip
+{
+
+/**
+   @brief A bounded set of threads that run TLS handshakes on behalf of the
+   transports.
+
+   A handshake step can cost milliseconds of CPU (the private key operation
+   of a full handshake, mostly), and when it runs on the transport thread
+   every other connection of the transport waits for it. When a pool is
+   installed (see BaseSecurity::setTlsHandshakeThreads()), a TlsConnection
+   whose transport is driven by an FdPollGrp stops polling its socket and
+   queues its handshake here; the worker that runs it hands the connection
+   back to the transport, which resumes polling.
+
+   If more than maxQueued handshakes are waiting, further handshakes run
+   on the transport thread as before.
+*/
+class TlsHandshakePool
+{
+   public:
+      /// A handshake step to run on a worker (a TlsConnection)
+      class Handshake
+      {
+         public:
+            virtual ~Handshake() {}
+            /// Runs the step, then hands it back to its transport; after
+            /// that the worker no longer touches it.
+            virtual void runQueuedHandshake() = 0;
+      };
+
+      TlsHandshakePool(unsigned int threads, unsigned int maxQueued);
+      /// Stops the workers; connections still queued are not handed back.
+      ~TlsHandshakePool();
+
+      /// Queues a handshake step for conn. Returns false if the queue is full.
+      bool post(Handshake* conn);
+      /// Makes sure no worker is, or will be, using conn. Blocks while a
+      /// worker is running a handshake step for it.
+      void cancel(Handshake* conn);
+
+      unsigned int queued() const;
+      unsigned int threads() const { return (unsigned int)mWorkers.size(); }
+
+   private:
+      TlsHandshakePool(const TlsHandshakePool&);
+      TlsHandshakePool& operator=(const TlsHandshakePool&);
+
+      class Worker : public ThreadIf
+      {
+         public:
+            explicit Worker(TlsHandshakePool& pool) : mPool(pool) {}
+            virtual void thread();
+            virtual void shutdown();
+         private:
+            TlsHandshakePool& mPool;
+      };
+      friend class Worker;
+
+      const unsigned int mMaxQueued;
+      mutable Mutex mMutex;
+      Condition mWork;
+      Condition mDone;
+      std::deque<Handshake*> mQueue;
+      std::set<Handshake*> mRunning;
+      bool mShutdown;
+      std::vector<Worker*> mWorkers;
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,576 @@
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#if defined(USE_SSL)
+
+#include <string.h>
+#include <time.h>
+
+#include "resip/stack/ssl/TlsSessionCache.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Logger.hxx"
+#include "rutil/WinLeakCheck.hxx"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+using namespace resip;
+
+#define RESIPROCATE_SUBSYSTEM Subsystem::TRANSPORT
+
+namespace
+{
+Mutex indexMutex;
+int ctxIndex = -1;
+int targetIndex = -1;
+
+void
+freeTarget(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp)
+{
+   delete static_cast<Data*>(ptr);
+}
+
+Data
+sessionIdOf(SSL_SESSION* session)
+{
+   unsigned int len = 0;
+   const unsigned char* id = SSL_SESSION_get_id(session, &len);
+   return Data(reinterpret_cast<const char*>(id), len);
+}
+
+bool
+hasExpired(SSL_SESSION* session, UInt64 now)
+{
+   return (UInt64)SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) < now;
+}
+}
+
+TlsSessionCache::Stats::Stats() :
+   serverFullHandshakes(0),
+   serverResumedHandshakes(0),
+   clientFullHandshakes(0),
+   clientResumedHandshakes(0),
+   serverSessions(0),
+   clientSessions(0)
+{
+   memset(handshakeLatency, 0, sizeof(handshakeLatency));
+}
+
+unsigned int
+TlsSessionCache::Stats::latencyBucket(UInt64 latencyMs)
+{
+   unsigned int bucket = 0;
+   while(latencyMs > 0 && bucket < LatencyBuckets - 1)
+   {
+      latencyMs >>= 1;
+      ++bucket;
+   }
+   return bucket;
+}
+
+TlsSessionCache::TlsSessionCache() :
+   mServerMaxSessions(0),
+   mServerTimeoutSecs(3600),
+   mTickets(false),
+   mTicketKeyLifetimeSecs(3600),
+   mTicketKeyCount(0),
+   mClientMaxSessions(0)
+{
+   Lock lock(indexMutex);
+   if(ctxIndex < 0)
+   {
+      ctxIndex = SSL_CTX_get_ex_new_index(0, 0, 0, 0, 0);
+      targetIndex = SSL_get_ex_new_index(0, 0, 0, 0, freeTarget);
+   }
+}
+
+TlsSessionCache::~TlsSessionCache()
+{
+   for(SessionMap::iterator i = mServerSessions.begin(); i != mServerSessions.end(); ++i)
+   {
+      SSL_SESSION_free(i->second);
+   }
+   for(SessionMap::iterator i = mClientSessions.begin(); i != mClientSessions.end(); ++i)
+   {
+      SSL_SESSION_free(i->second);
+   }
+   OPENSSL_cleanse(mTicketKeys, sizeof(mTicketKeys));
+}
+
+void
+TlsSessionCache::setServerCache(unsigned long maxSessions, unsigned long timeoutSecs)
+{
+   Lock lock(mMutex);
+   mServerMaxSessions = maxSessions;
+   mServerTimeoutSecs = timeoutSecs;
+}
+
+void
+TlsSessionCache::setTickets(bool enable, unsigned long keyLifetimeSecs)
+{
+   Lock lock(mMutex);
+   mTickets = enable;
+   mTicketKeyLifetimeSecs = keyLifetimeSecs ? keyLifetimeSecs : 1;
+}
+
+void
+TlsSessionCache::setClientReuse(unsigned long maxSessions)
+{
+   Lock lock(mMutex);
+   mClientMaxSessions = maxSessions;
+}
+
+bool
+TlsSessionCache::enabled() const
+{
+   Lock lock(mMutex);
+   return mServerMaxSessions > 0 || mTickets || mClientMaxSessions > 0;
+}
+
+void
+TlsSessionCache::configure(SSL_CTX* ctx, const Data& sessionContext)
+{
+   if(!enabled())
+   {
+      return;
+   }
+
+   Lock lock(mMutex);
+   SSL_CTX_set_ex_data(ctx, ctxIndex, this);
+
+   // Resumption is refused outright when peer verification is on and no
+   // session id context is set.
+   Data sid(sessionContext.empty() ? Data("resip") : sessionContext);
+   SSL_CTX_set_session_id_context(ctx, reinterpret_cast<const unsigned char*>(sid.data()),
+                                  resipMin((unsigned int)sid.size(), (unsigned int)SSL_MAX_SID_CTX_LENGTH));
+
+   long mode = SSL_SESS_CACHE_SERVER;
+   if(mServerMaxSessions > 0)
+   {
+      mode |= SSL_SESS_CACHE_NO_INTERNAL;
+      SSL_CTX_set_timeout(ctx, mServerTimeoutSecs);
+   }
+   if(mClientMaxSessions > 0)
+   {
+      mode |= SSL_SESS_CACHE_CLIENT;
+   }
+   SSL_CTX_set_session_cache_mode(ctx, mode);
+   SSL_CTX_sess_set_new_cb(ctx, &TlsSessionCache::newSessionCb);
+   if(mServerMaxSessions > 0)
+   {
+      SSL_CTX_sess_set_get_cb(ctx, &TlsSessionCache::getSessionCb);
+      SSL_CTX_sess_set_remove_cb(ctx, &TlsSessionCache::removeSessionCb);
+   }
+
+   if(mTickets)
+   {
+      SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+      SSL_CTX_set_tlsext_ticket_key_cb(ctx, &TlsSessionCache::ticketKeyCb);
+   }
+   else
+   {
+      SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+   }
+}
+
+void
+TlsSessionCache::prepareClient(SSL* ssl, const Tuple& target)
+{
+   Data* key = new Data(Tuple::inet_ntop(target));
+   *key += ":";
+   *key += Data(target.getPort());
+   *key += " ";
+   *key += target.getTargetDomain();
+   SSL_set_ex_data(ssl, targetIndex, key);
+
+   Lock lock(mMutex);
+   if(mClientMaxSessions == 0)
+   {
+      return;
+   }
+   SessionMap::iterator i = mClientSessions.find(*key);
+   if(i != mClientSessions.end())
+   {
+      if(hasExpired(i->second, time(0)))
+      {
+         SSL_SESSION_free(i->second);
+         mClientSessions.erase(i);
+      }
+      else
+      {
+         DebugLog(<< "Offering cached TLS session to " << *key);
+         SSL_set_session(ssl, i->second);
+      }
+   }
+}
+
+void
+TlsSessionCache::handshakeCompleted(SSL* ssl, bool server, UInt64 latencyMs)
+{
+   bool resumed = SSL_session_reused(ssl) != 0;
+   DebugLog(<< (server ? "Server" : "Client") << " TLS handshake "
+            << (resumed ? "resumed a session" : "was a full handshake")
+            << " in " << latencyMs << "ms");
+   Lock lock(mMutex);
+   ++mStats.handshakeLatency[Stats::latencyBucket(latencyMs)];
+   if(server)
+   {
+      ++(resumed ? mStats.serverResumedHandshakes : mStats.serverFullHandshakes);
+   }
+   else
+   {
+      ++(resumed ? mStats.clientResumedHandshakes : mStats.clientFullHandshakes);
+   }
+}
+
+TlsSessionCache::Stats
+TlsSessionCache::getStats() const
+{
+   Lock lock(mMutex);
+   Stats stats(mStats);
+   stats.serverSessions = (unsigned long)mServerSessions.size();
+   stats.clientSessions = (unsigned long)mClientSessions.size();
+   return stats;
+}
+
+TlsSessionCache*
+TlsSessionCache::fromSsl(SSL* ssl)
+{
+   return static_cast<TlsSessionCache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ctxIndex));
+}
+
+int
+TlsSessionCache::newSessionCb(SSL* ssl, SSL_SESSION* session)
+{
+   TlsSessionCache* cache = fromSsl(ssl);
+   if(!cache)
+   {
+      return 0;
+   }
+   // Only outbound connections are tagged with a target.
+   Data* target = static_cast<Data*>(SSL_get_ex_data(ssl, targetIndex));
+   if(target)
+   {
+      return cache->storeClientSession(*target, session) ? 1 : 0;
+   }
+   return cache->storeServerSession(session) ? 1 : 0;
+}
+
+SSL_SESSION*
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+TlsSessionCache::getSessionCb(SSL* ssl, const unsigned char* id, int idLen, int* copy)
+#else
+TlsSessionCache::getSessionCb(SSL* ssl, unsigned char* id, int idLen, int* copy)
+#endif
+{
+   *copy = 0;
+   TlsSessionCache* cache = fromSsl(ssl);
+   if(!cache)
+   {
+      return 0;
+   }
+   // findServerSession() has already taken the reference handed to OpenSSL,
+   // so it must not take another.
+   return cache->findServerSession(Data(reinterpret_cast<const char*>(id), idLen));
+}
+
+void
+TlsSessionCache::removeSessionCb(SSL_CTX* ctx, SSL_SESSION* session)
+{
+   TlsSessionCache* cache = static_cast<TlsSessionCache*>(SSL_CTX_get_ex_data(ctx, ctxIndex));
+   if(cache)
+   {
+      cache->removeServerSession(sessionIdOf(session));
+   }
+}
+
+int
+TlsSessionCache::ticketKeyCb(SSL* ssl, unsigned char* keyName, unsigned char* iv,
+                             EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx, int enc)
+{
+   TlsSessionCache* cache = fromSsl(ssl);
+   if(!cache)
+   {
+      return -1;
+   }
+
+   TicketKey key;
+   bool current = true;
+   {
+      Lock lock(cache->mMutex);
+      cache->rotateTicketKeys(time(0));
+      if(enc)
+      {
+         key = cache->mTicketKeys[0];
+      }
+      else
+      {
+         const TicketKey* found = cache->findTicketKey(keyName);
+         if(!found)
+         {
+            // Unknown or retired key; fall back to a full handshake.
+            return 0;
+         }
+         key = *found;
+         current = (found == &cache->mTicketKeys[0]);
+      }
+   }
+
+   int ret = 1;
+   if(enc)
+   {
+      memcpy(keyName, key.name, sizeof(key.name));
+      if(RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1 ||
+         !EVP_EncryptInit_ex(cipherCtx, EVP_aes_256_cbc(), 0, key.aesKey, iv))
+      {
+         ret = -1;
+      }
+   }
+   else
+   {
+      if(!EVP_DecryptInit_ex(cipherCtx, EVP_aes_256_cbc(), 0, key.aesKey, iv))
+      {
+         ret = -1;
+      }
+      else if(!current)
+      {
+         // Accept, but have the client replace the ticket with one under
+         // the current key.
+         ret = 2;
+      }
+#ifdef TLS1_3_VERSION
+      else if(SSL_version(ssl) >= TLS1_3_VERSION)
+      {
+         // TLS 1.3 clients use a ticket only once, so unless we ask for
+         // renewal they are left without one for the next connection.
+         ret = 2;
+      }
+#endif
+   }
+   if(ret > 0 && !HMAC_Init_ex(hmacCtx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), 0))
+   {
+      ret = -1;
+   }
+   OPENSSL_cleanse(&key, sizeof(key));
+   return ret;
+}
+
+bool
+TlsSessionCache::storeServerSession(SSL_SESSION* session)
+{
+   Lock lock(mMutex);
+   if(mServerMaxSessions == 0)
+   {
+      return false;
+   }
+
+   expireServerSessions(time(0));
+   while(mServerSessions.size() >= mServerMaxSessions && !mServerOrder.empty())
+   {
+      SessionMap::iterator i = mServerSessions.find(mServerOrder.front());
+      mServerOrder.pop_front();
+      if(i != mServerSessions.end())
+      {
+         SSL_SESSION_free(i->second);
+         mServerSessions.erase(i);
+      }
+   }
+
+   Data id(sessionIdOf(session));
+   std::pair<SessionMap::iterator, bool> res = mServerSessions.insert(std::make_pair(id, session));
+   if(!res.second)
+   {
+      SSL_SESSION_free(res.first->second);
+      res.first->second = session;
+   }
+   mServerOrder.push_back(id);
+   return true;
+}
+
+SSL_SESSION*
+TlsSessionCache::findServerSession(const Data& id)
+{
+   Lock lock(mMutex);
+   SessionMap::iterator i = mServerSessions.find(id);
+   if(i == mServerSessions.end())
+   {
+      return 0;
+   }
+   if(hasExpired(i->second, time(0)))
+   {
+      SSL_SESSION_free(i->second);
+      mServerSessions.erase(i);
+      return 0;
+   }
+   // Taken under the lock, since another thread may evict the session as
+   // soon as it is released.
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+   SSL_SESSION_up_ref(i->second);
+#else
+   CRYPTO_add(&i->second->references, 1, CRYPTO_LOCK_SSL_SESSION);
+#endif
+   return i->second;
+}
+
+void
+TlsSessionCache::removeServerSession(const Data& id)
+{
+   Lock lock(mMutex);
+   SessionMap::iterator i = mServerSessions.find(id);
+   if(i != mServerSessions.end())
+   {
+      SSL_SESSION_free(i->second);
+      mServerSessions.erase(i);
+   }
+}
+
+void
+TlsSessionCache::expireServerSessions(UInt64 now)
+{
+   // Sessions all get the same timeout, so the oldest are at the front.
+   while(!mServerOrder.empty())
+   {
+      SessionMap::iterator i = mServerSessions.find(mServerOrder.front());
+      if(i != mServerSessions.end())
+      {
+         if(!hasExpired(i->second, now))
+         {
+            break;
+         }
+         SSL_SESSION_free(i->second);
+         mServerSessions.erase(i);
+      }
+      mServerOrder.pop_front();
+   }
+}
+
+bool
+TlsSessionCache::storeClientSession(const Data& target, SSL_SESSION* session)
+{
+   Lock lock(mMutex);
+   if(mClientMaxSessions == 0)
+   {
+      return false;
+   }
+
+   SessionMap::iterator i = mClientSessions.find(target);
+   if(i != mClientSessions.end())
+   {
+      // Only the newest session for a target is worth offering.
+      SSL_SESSION_free(i->second);
+      i->second = session;
+      return true;
+   }
+
+   while(mClientSessions.size() >= mClientMaxSessions && !mClientOrder.empty())
+   {
+      SessionMap::iterator old = mClientSessions.find(mClientOrder.front());
+      mClientOrder.pop_front();
+      if(old != mClientSessions.end())
+      {
+         SSL_SESSION_free(old->second);
+         mClientSessions.erase(old);
+      }
+   }
+   mClientSessions[target] = session;
+   mClientOrder.push_back(target);
+   return true;
+}
+
+void
+TlsSessionCache::rotateTicketKeys(UInt64 now)
+{
+   if(mTicketKeyCount > 0 && mTicketKeys[0].created + mTicketKeyLifetimeSecs > now)
+   {
+      return;
+   }
+
+   if(mTicketKeyCount > 0)
+   {
+      mTicketKeys[1] = mTicketKeys[0];
+      // The previous key stays usable for one lifetime after it is replaced,
+      // unless it was replaced late (nothing needed a ticket for a while).
+      mTicketKeyCount = (mTicketKeys[1].created + 2 * mTicketKeyLifetimeSecs > now) ? 2 : 1;
+   }
+   else
+   {
+      mTicketKeyCount = 1;
+   }
+
+   TicketKey& key = mTicketKeys[0];
+   if(RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+      RAND_bytes(key.aesKey, sizeof(key.aesKey)) != 1 ||
+      RAND_bytes(key.hmacKey, sizeof(key.hmacKey)) != 1)
+   {
+      ErrLog(<< "Unable to generate a TLS session ticket key");
+   }
+   key.created = now;
+   InfoLog(<< "Generated new TLS session ticket key");
+}
+
+const TlsSessionCache::TicketKey*
+TlsSessionCache::findTicketKey(const unsigned char* name) const
+{
+   for(unsigned int i = 0; i < mTicketKeyCount; ++i)
+   {
+      if(memcmp(mTicketKeys[i].name, name, sizeof(mTicketKeys[i].name)) == 0)
+      {
+         return &mTicketKeys[i];
+      }
+   }
+   return 0;
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
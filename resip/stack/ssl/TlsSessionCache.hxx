@@ -0,0 +1,201 @@
+#if !defined(RESIP_TLSSESSIONCACHE_HXX)
+#define RESIP_TLSSESSIONCACHE_HXX
+
+#if defined(HAVE_CONFIG_H)
+  #include "config.h"
+#endif
+
+#include <deque>
+#include <map>
+
+#include "rutil/Data.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/compat.hxx"
+
+#include <openssl/hmac.h>
+#include <openssl/ssl.h>
+
+namespace resip
+{
+
+class Tuple;
+
+/**
+   @brief Lets TLS peers skip the full handshake when they reconnect, and
+   keeps the handshake statistics of a BaseSecurity.
+
+   One TlsSessionCache is owned by each BaseSecurity, and every SSL_CTX that
+   BaseSecurity creates (including the per-domain contexts of the
+   TlsTransports) is hooked up to it with configure(). Three independent
+   features are provided, all off by default:
+
+   - A server-side session cache that is shared by all contexts, so a client
+     can resume a session on any TLS transport of the stack.
+   - Session tickets (RFC 5077), encrypted with keys that are regenerated
+     every few minutes. Tickets issued under the previous key are still
+     accepted (and renewed) for one more rotation period.
+   - Client-side session reuse: the session established with a target is
+     remembered, and offered again on the next outbound connection to the
+     same address and domain.
+
+   Settings are picked up by contexts when they are configured, so they
+   should be made before any TLS transports are added to the stack.
+*/
+class TlsSessionCache
+{
+   public:
+      TlsSessionCache();
+      ~TlsSessionCache();
+
+      /// Caches up to maxSessions server sessions, for timeoutSecs each.
+      /// A maxSessions of 0 disables the cache.
+      void setServerCache(unsigned long maxSessions, unsigned long timeoutSecs);
+      /// Enables or disables session tickets, with keys replaced every
+      /// keyLifetimeSecs.
+      void setTickets(bool enable, unsigned long keyLifetimeSecs);
+      /// Remembers the sessions of up to maxSessions outbound targets.
+      /// A maxSessions of 0 disables client-side reuse.
+      void setClientReuse(unsigned long maxSessions);
+
+      bool enabled() const;
+
+      /// Installs the cache callbacks on ctx. sessionContext distinguishes
+      /// sessions established for different domains; a session is only
+      /// resumed by a context with the same sessionContext.
+      void configure(SSL_CTX* ctx, const Data& sessionContext);
+
+      /// Called for an outbound connection before the handshake starts;
+      /// offers a session previously established with target, if there is one.
+      void prepareClient(SSL* ssl, const Tuple& target);
+      /// Called once a handshake has completed, to count it. latencyMs is
+      /// the time from the start of the handshake.
+      void handshakeCompleted(SSL* ssl, bool server, UInt64 latencyMs);
+
+      struct Stats
+      {
+         Stats();
+         UInt64 serverFullHandshakes;
+         UInt64 serverResumedHandshakes;
+         UInt64 clientFullHandshakes;
+         UInt64 clientResumedHandshakes;
+         unsigned long serverSessions;
+         unsigned long clientSessions;
+
+         /// Handshake latency histogram: bucket 0 counts handshakes under
+         /// 1ms, bucket i those from 2^(i-1) up to 2^i ms, and the last
+         /// bucket everything longer.
+         enum { LatencyBuckets = 16 };
+         UInt64 handshakeLatency[LatencyBuckets];
+         static unsigned int latencyBucket(UInt64 latencyMs);
+      };
+      Stats getStats() const;
+
+   private:
+      TlsSessionCache(const TlsSessionCache&);
+      TlsSessionCache& operator=(const TlsSessionCache&);
+
+      static TlsSessionCache* fromSsl(SSL* ssl);
+      static int newSessionCb(SSL* ssl, SSL_SESSION* session);
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+      static SSL_SESSION* getSessionCb(SSL* ssl, const unsigned char* id, int idLen, int* copy);
+#else
+      static SSL_SESSION* getSessionCb(SSL* ssl, unsigned char* id, int idLen, int* copy);
+#endif
+      static void removeSessionCb(SSL_CTX* ctx, SSL_SESSION* session);
+      static int ticketKeyCb(SSL* ssl, unsigned char* keyName, unsigned char* iv,
+                             EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx, int enc);
+
+      bool storeServerSession(SSL_SESSION* session);
+      // Returns a new reference, which the caller must free
+      SSL_SESSION* findServerSession(const Data& id);
+      void removeServerSession(const Data& id);
+      bool storeClientSession(const Data& target, SSL_SESSION* session);
+      void expireServerSessions(UInt64 now);
+
+      struct TicketKey
+      {
+         unsigned char name[16];
+         unsigned char aesKey[32];
+         unsigned char hmacKey[32];
+         UInt64 created;
+      };
+      void rotateTicketKeys(UInt64 now);
+      const TicketKey* findTicketKey(const unsigned char* name) const;
+
+      mutable Mutex mMutex;
+
+      unsigned long mServerMaxSessions;
+      unsigned long mServerTimeoutSecs;
+      typedef std::map<Data, SSL_SESSION*> SessionMap;
+      SessionMap mServerSessions;
+      // Session ids in the order they were added, for eviction. May hold ids
+      // that have since been removed.
+      std::deque<Data> mServerOrder;
+
+      bool mTickets;
+      unsigned long mTicketKeyLifetimeSecs;
+      TicketKey mTicketKeys[2];   // current, previous
+      unsigned int mTicketKeyCount;
+
+      unsigned long mClientMaxSessions;
+      SessionMap mClientSessions;
+      std::deque<Data> mClientOrder;
+
+      Stats mStats;
+
+      friend class TestTlsSessionCache;
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
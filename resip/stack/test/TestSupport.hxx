@@ -32,6 +32,11 @@ class SipRawMessage : public SipMessage
          return str;
       }
 
+      virtual void encodeToBuffer(Data& buffer) const
+      {
+         buffer += mRawMessage;
+      }
+
    private:
       mutable Data mRawMessage;
 };
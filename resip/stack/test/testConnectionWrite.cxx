@@ -0,0 +1,210 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <iostream>
+
+#include "resip/stack/Connection.hxx"
+#include "resip/stack/SendData.hxx"
+#include "resip/stack/TcpTransport.hxx"
+#include "resip/stack/TransactionMessage.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/Fifo.hxx"
+
+using namespace resip;
+using namespace std;
+
+// Refuses every other write, as a socket with full buffers would, and
+// otherwise takes only a few bytes. Like OpenSSL after SSL_ERROR_WANT_WRITE,
+// it insists that a refused write is retried with the same buffer.
+class ChokingConnection : public Connection
+{
+   public:
+      ChokingConnection(Transport* transport, const Tuple& who, bool vector) :
+         Connection(transport, who, 0, Compression::Disabled),
+         mVector(vector),
+         mRetryBuf(0),
+         mRetryCount(0)
+      {}
+
+      void sendWebSocketFrames()
+      {
+         mSendingTransmissionFormat = WebSocketData;
+      }
+
+      Data mWritten;
+
+   protected:
+      virtual int write(const char* buf, const int count)
+      {
+         // Written straight out of the SendData, not out of a copy made for
+         // this one call
+         const Data& data = mOutstandingSends.front()->data;
+         assert(buf >= data.data() && buf + count <= data.data() + data.size());
+         return take(buf, count);
+      }
+
+      virtual int writev(const char* first, const int firstCount,
+                         const char* second, const int secondCount)
+      {
+         assert(mVector);
+         const Data& header = mOutstandingSends.front()->header;
+         const Data& data = mOutstandingSends.front()->data;
+         assert(first >= header.data() && first + firstCount == header.data() + header.size());
+         assert(second == data.data() && secondCount == (int)data.size());
+         return take(first, firstCount);
+      }
+
+      virtual bool canWritev() const
+      {
+         return mVector;
+      }
+
+   private:
+      int take(const char* buf, int count)
+      {
+         if(!mRetryBuf)
+         {
+            mRetryBuf = buf;
+            mRetryCount = count;
+            return 0;
+         }
+         assert(buf == mRetryBuf && count == mRetryCount);
+         mRetryBuf = 0;
+         int n = count < 7 ? count : 7;
+         mWritten.append(buf, n);
+         return n;
+      }
+
+      const bool mVector;
+      const char* mRetryBuf;
+      int mRetryCount;
+};
+
+static void
+testWrites(bool vector)
+{
+   cerr << "!! Test writes " << (vector ? "with" : "without") << " writev" << endl;
+   Fifo<TransactionMessage> fifo;
+   TcpTransport transport(fifo, vector ? 25100 : 25102, V4, "127.0.0.1");
+   Tuple who("127.0.0.1", 5060, V4, TCP);
+   ChokingConnection conn(&transport, who, vector);
+
+   const Data header("FRAME");
+   const Data body("OPTIONS sip:bob@127.0.0.1 SIP/2.0\r\n"
+                   "Via: SIP/2.0/TCP 127.0.0.1:5060;branch=z9hG4bKchoke\r\n"
+                   "Content-Length: 0\r\n"
+                   "\r\n");
+   // A copy kept for retransmission shares the body
+   SendData* first = new SendData(who, body, "choke", Data::Empty);
+   first->share();
+   SendData retransmission(*first);
+   first->header = header;
+   conn.requestWrite(first);
+   SendData* second = new SendData(who, body, "choke", Data::Empty);
+   second->header = header;
+   conn.requestWrite(second);
+
+   const Data expected = header + body + header + body;
+   for(int i = 0; i < 1000 && conn.mWritten.size() < expected.size(); ++i)
+   {
+      assert(conn.performWrite() >= 0);
+   }
+   assert(conn.mWritten == expected);
+   assert(retransmission.header.empty());
+   assert(retransmission.data == body);
+}
+
+static void
+testWebSocketWrites()
+{
+   cerr << "!! Test WebSocket writes without writev" << endl;
+   Fifo<TransactionMessage> fifo;
+   TcpTransport transport(fifo, 25104, V4, "127.0.0.1");
+   Tuple who("127.0.0.1", 5060, V4, TCP);
+   ChokingConnection conn(&transport, who, false);
+   conn.sendWebSocketFrames();
+
+   const Data body("OPTIONS sip:bob@127.0.0.1 SIP/2.0\r\n"
+                   "Via: SIP/2.0/WSS 127.0.0.1:5060;branch=z9hG4bKchoke\r\n"
+                   "Content-Length: 0\r\n"
+                   "\r\n");
+   for (int i = 0; i < 2; ++i)
+   {
+      SendData* sd = new SendData(who, body, "choke", Data::Empty);
+      sd->share();
+      conn.requestWrite(sd);
+   }
+
+   // Framed once each, even though every first write is refused
+   const char frame[] = { (char)0x82, (char)body.size() };
+   const Data framed = Data(frame, sizeof(frame)) + body;
+   const Data expected = framed + framed;
+   for(int i = 0; i < 1000 && conn.mWritten.size() < expected.size(); ++i)
+   {
+      assert(conn.performWrite() >= 0);
+   }
+   assert(conn.mWritten == expected);
+}
+
+int
+main(int argc, char* argv[])
+{
+   testWrites(false);
+   testWrites(true);
+   testWebSocketWrites();
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
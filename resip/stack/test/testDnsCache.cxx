@@ -2,263 +2,145 @@
 #include "config.h"
 #endif
 
-#if defined (HAVE_POPT_H) 
-#include <popt.h>
-#else
-#ifndef WIN32
-#warning "will not work very well without libpopt"
-#endif
-#endif
-
-#include <sys/types.h>
+#include <cassert>
 #include <iostream>
-#include <memory>
+#include <vector>
 
-#include <fstream>
+#ifndef WIN32
+#include <arpa/inet.h>
+#endif
 
-#include "rutil/socket.hxx"
 #include "rutil/Data.hxx"
-#include "rutil/DnsUtil.hxx"
-#include "resip/stack/DnsInterface.hxx"
+#include "rutil/Timer.hxx"
 #include "rutil/dns/QueryTypes.hxx"
-#include "rutil/dns/RROverlay.hxx"
-#include "rutil/dns/RRList.hxx"
+#include "rutil/dns/DnsHostRecord.hxx"
 #include "rutil/dns/RRCache.hxx"
-#include "rutil/dns/DnsStub.hxx"
 
 using namespace resip;
 using namespace std;
 
-class MyDnsSink : public DnsResultSink
-{
-   void onDnsResult(const DNSResult<DnsHostRecord>&);
-#ifdef USE_IPV6
-   void onDnsResult(const DNSResult<DnsAAAARecord>&); 
-#endif
-   void onDnsResult(const DNSResult<DnsSrvRecord>&);
-   void onDnsResult(const DNSResult<DnsNaptrRecord>&) {}
-   void onDnsResult(const DNSResult<DnsCnameRecord>&);
-};
-
-void MyDnsSink::onDnsResult(const DNSResult<DnsHostRecord>& result)
+static DnsHostRecord
+host(const Data& name, UInt32 addr)
 {
-   cout << "A records" << endl;
-   cout << "Status: " << result.status << endl;
-   cout << "Domain: " << result.domain << endl;
-   if (result.status == 0)
-   {
-      for (vector<DnsHostRecord>::const_iterator it = result.records.begin(); it != result.records.end(); ++it)
-      {
-         cout << (*it).host() << endl;
-      }
-   }
-   cout << endl;
+   in_addr a;
+   a.s_addr = htonl(addr);
+   return DnsHostRecord(name, a);
 }
 
-void MyDnsSink::onDnsResult(const DNSResult<DnsCnameRecord>& result)
+static Data
+trunk(int i)
 {
-   cout << "CNAME records" << endl;
-   cout << "Status: " << result.status << endl;
-   cout << "Domain: " << result.domain << endl;
-   if (result.status == 0)
-   {
-      for (vector<DnsCnameRecord>::const_iterator it = result.records.begin(); it != result.records.end(); ++it)
-      {
-         cout << (*it).cname() << endl;
-      }
-   }
-   cout << endl;
+   return "trunk" + Data(i) + ".customer" + Data(i % 97) + ".example.com";
 }
 
-void MyDnsSink::onDnsResult(const DNSResult<DnsSrvRecord>& result)
+static void
+testCaseInsensitive()
 {
-   cout << "SRV records" << endl;
-   cout << "Status: " << result.status << endl;
-   cout << "Domain: " << result.domain << endl;
-   if (result.status == 0)
-   {
-      for (vector<DnsSrvRecord>::const_iterator it = result.records.begin(); it != result.records.end(); ++it)
-      {
-         cout << "Name: " << (*it).name() << endl;
-         cout << "Priority: " << (*it).priority() << endl;
-         cout << "Weight: " << (*it).weight() << endl;
-         cout << "Port: " << (*it).port() << endl;
-         cout << "Target: " << (*it).target() << endl;
-      }
-   }
-   cout << endl;
+   cerr << "!! Test case insensitive lookup" << endl;
+   RRCache cache;
+   cache.updateCacheFromHostFile(host("Trunk.Example.COM", 0xc0000207));
+
+   RRCache::Result records;
+   int status = -1;
+   assert(cache.lookup("trunk.example.com", RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   assert(status == 0);
+   assert(records.size() == 1);
+   assert(cache.lookup("TRUNK.EXAMPLE.COM", RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   assert(!cache.lookup("trunk.example.com", RR_SRV::getRRType(), RRCache::Protocol::Sip, records, status));
+   assert(!cache.lookup("trunk.example.org", RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+
+   // Updating it under another spelling replaces what's there.
+   cache.updateCacheFromHostFile(host("trunk.example.com", 0xc0000208));
+   assert(cache.size() == 1);
 }
 
-
-// adopted from DnsUtil.
-const int NS_INT16SZ = 2;
-const int NS_INADDRSZ = 4;
-const int NS_IN6ADDRSZ = 16;
-
-static const char*
-MyInet_ntop4(const u_char *src, char *dst, size_t size)
+static void
+testMaxBytes()
 {
-   static const char fmt[] = "%u.%u.%u.%u";
-#ifdef WIN32
-   if ( _snprintf(dst, size, fmt, src[0], src[1], src[2], src[3]) < 0)
-#else
-   if ( snprintf(dst, size, fmt, src[0], src[1], src[2], src[3]) < 0)
-#endif
+   cerr << "!! Test memory limit" << endl;
+   RRCache cache;
+   cache.setSize(100000);
+   cache.updateCacheFromHostFile(host(trunk(0), 1));
+   size_t each = cache.bytes();
+   assert(each > 0);
+
+   // Room for about ten of them.
+   cache.setMaxBytes(each * 10);
+   for (int i = 1; i < 1000; ++i)
    {
-      errno = ENOSPC;
-      dst[size-1] = 0;
-      return NULL;
+      cache.updateCacheFromHostFile(host(trunk(i), i));
+      assert(cache.bytes() <= each * 10 + 100);
    }
-   return (dst);
+   assert(cache.size() >= 8 && cache.size() <= 10);
+
+   // The least recently used go first.
+   RRCache::Result records;
+   int status;
+   assert(cache.lookup(trunk(999), RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+   assert(!cache.lookup(trunk(1), RR_A::getRRType(), RRCache::Protocol::Sip, records, status));
+
+   // Shrinking the limit evicts straight away.
+   cache.setMaxBytes(each * 3);
+   assert(cache.size() <= 3);
+   assert(cache.bytes() <= each * 3 + 100);
+
+   cache.clearCache();
+   assert(cache.size() == 0);
+   assert(cache.bytes() == 0);
 }
 
-static const char *
-MyInet_ntop6(const u_char *src, char *dst, size_t size)
+static void
+benchmark(int entries, int lookups)
 {
-   /*
-    * Note that int32_t and int16_t need only be "at least" large enough
-    * to contain a value of the specified size.  On some systems, like
-    * Crays, there is no such thing as an integer variable with 16 bits.
-    * Keep this in mind if you think this function should have been coded
-    * to use pointer overlays.  All the world's not a VAX.
-    */
-   char tmp[sizeof "ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255"], *tp;
-   struct { int base, len; } best, cur;
-   u_int words[NS_IN6ADDRSZ / NS_INT16SZ];
-   int i;
-
-   /*
-    * Preprocess:
-    *	Copy the input (bytewise) array into a wordwise array.
-    *	Find the longest run of 0x00's in src[] for :: shorthanding.
-    */
-   memset(words, '\0', sizeof words);
-   for (i = 0; i < NS_IN6ADDRSZ; i++)
-      words[i / 2] |= (src[i] << ((1 - (i % 2)) << 3));
-   best.base = -1;
-   cur.base = -1;
-   for (i = 0; i < (NS_IN6ADDRSZ / NS_INT16SZ); i++) {
-      if (words[i] == 0) {
-         if (cur.base == -1)
-            cur.base = i, cur.len = 1;
-         else
-            cur.len++;
-      } else {
-         if (cur.base != -1) {
-            if (best.base == -1 || cur.len > best.len)
-               best = cur;
-            cur.base = -1;
-         }
-      }
-   }
-   if (cur.base != -1) {
-      if (best.base == -1 || cur.len > best.len)
-         best = cur;
-   }
-   if (best.base != -1 && best.len < 2)
-      best.base = -1;
-
-   /*
-    * Format the result.
-    */
-   tp = tmp;
-   for (i = 0; i < (NS_IN6ADDRSZ / NS_INT16SZ); i++) {
-      /* Are we inside the best run of 0x00's? */
-      if (best.base != -1 && i >= best.base &&
-          i < (best.base + best.len)) {
-         if (i == best.base)
-            *tp++ = ':';
-         continue;
-      }
-      /* Are we following an initial run of 0x00s or any real hex? */
-      if (i != 0)
-         *tp++ = ':';
-      /* Is this address an encapsulated IPv4? */
-      if (i == 6 && best.base == 0 &&
-          (best.len == 6 || (best.len == 5 && words[5] == 0xffff))) {
-         if (!MyInet_ntop4(src+12, tp, sizeof tmp - (tp - tmp)))
-            return (NULL);
-         tp += strlen(tp);
-         break;
-      }
-      tp += sprintf(tp, "%x", words[i]);
+   RRCache cache;
+   cache.setSize(entries + 1);
+   vector<Data> names;
+   for (int i = 0; i < entries; ++i)
+   {
+      names.push_back(trunk(i));
+      cache.updateCacheFromHostFile(host(names.back(), i));
    }
-   /* Was it a trailing run of 0x00's? */
-   if (best.base != -1 && (best.base + best.len) ==
-       (NS_IN6ADDRSZ / NS_INT16SZ))
-      *tp++ = ':';
-   *tp++ = '\0';
 
-   /*
-    * Check for overflow, copy, and we're done.
-    */
-   if ((size_t)(tp - tmp) > size) {
-      errno = ENOSPC;
-      return (NULL);
-   }
-   strcpy(dst, tmp);
-   return (dst);
-}
-
-#ifdef USE_IPV6
-void MyDnsSink::onDnsResult(const DNSResult<DnsAAAARecord>& result)
-{
-   cout << "AAAA records" << endl;
-   cout << "Status: " << result.status << endl;
-   cout << "Domain: " << result.domain << endl;
-   if (result.status == 0)
+   RRCache::Result records;
+   int status;
+   int found = 0;
+   UInt64 start = Timer::getTimeMicroSec();
+   for (int n = 0; n < lookups; ++n)
    {
-      for (vector<DnsAAAARecord>::const_iterator it = result.records.begin(); it != result.records.end(); ++it)
+      // Mostly hits, spread over the whole cache; one in eight misses.
+      int i = (int)(((UInt64)n * 7919) % entries);
+      if (n % 8 == 0)
+      {
+         found += cache.lookup(names[i], RR_SRV::getRRType(), RRCache::Protocol::Sip, records, status);
+      }
+      else
       {
-         char str[256];
-         cout << MyInet_ntop6((const u_char*)&(*it).v6Address(), str, sizeof(str)) << endl;
+         found += cache.lookup(names[i], RR_A::getRRType(), RRCache::Protocol::Sip, records, status);
       }
    }
-   cout << endl;
-}
-#endif
+   UInt64 elapsed = Timer::getTimeMicroSec() - start;
+   assert(found == lookups - (lookups + 7) / 8);
 
+   cerr << entries << " entries, " << lookups << " lookups: "
+        << elapsed / 1000 << " ms, "
+        << (elapsed * 1000) / lookups << " ns/lookup" << endl;
+}
 
-// NOTE: In order to run this test, you need to uncomment out the USE_LOCAL_DNS define in
-// ExternalDnsFactory.cxx.
+int
 main(int argc, char* argv[])
 {
-   {
-      const char* const key = "yahoo.com";
-      MyDnsSink sink;
-      DnsStub stub;
-      DnsInterface dns(stub);
-      stub.lookup<RR_A>(key, Protocol::Sip, &sink);
-   }
+   testCaseInsensitive();
+   testMaxBytes();
 
-   {
-      const char* const key = "_ldap._tcp.openldap.org";
-      MyDnsSink sink;
-      DnsStub stub;
-      DnsInterface dns(stub);
-      stub.lookup<RR_SRV>(key, Protocol::Sip, &sink);
-   }
-
-   {
-#ifdef USE_IPV6
-      const char* const key = "quartz";
-      MyDnsSink sink;
-      DnsStub stub;
-      DnsInterface dns(stub);
-      stub.lookup<RR_AAAA>(key, Protocol::Sip, &sink);
-#endif
-   }
-
-   {
-      const char* const key = "www.google.com";
-      MyDnsSink sink;
-      DnsStub stub;
-      DnsInterface dns(stub);
-      stub.lookup<RR_CNAME>(key, Protocol::Sip, &sink);
-   }
+   cerr << "!! Benchmark" << endl;
+   benchmark(100, 1000000);
+   benchmark(10000, 1000000);
+   benchmark(100000, 1000000);
 
+   cerr << "All OK" << endl;
    return 0;
 }
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
@@ -0,0 +1,400 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "resip/stack/MsgHeaderScanner.hxx"
+#include "resip/stack/SipMessage.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DataStream.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+// Scans the message headers in every fast scan mode this CPU supports, checks
+// that they all agree with the plain state machine (with the text split into
+// chunks at every possible place, for the short messages), then times them.
+//
+// usage: testMsgHeaderScanner [-r runs] [file.dat ...]
+//
+// With no files, the RFC 4475 torture messages are read from $srcdir (or the
+// current directory); any that can't be found are skipped.
+
+static const char* tortureFiles[] =
+{
+   "wsinv.dat", "intmeth.dat", "esc01.dat", "escnull.dat", "esc02.dat",
+   "lwsdisp.dat", "longreq.dat", "dblreq.dat", "semiuri.dat",
+   "transports.dat", "mpart01.dat", "unreason.dat", "noreason.dat",
+   "ncl.dat", "novelsc.dat", "mismatch01.dat", "mismatch02.dat",
+   "regaut01.dat", "regescrt.dat", "sdp01.dat", "inv2543.dat",
+   "lwsstart.dat", "trws.dat", "quotbal.dat", "ltgtruri.dat",
+   "scalar02.dat", "scalarlg.dat", "badaspec.dat", "baddn.dat",
+   "badvers.dat", "bcast.dat", "bext01.dat", "bigcode.dat",
+   "clerr.dat", "cparam01.dat", "cparam02.dat", "escruri.dat",
+   "insuf.dat", "invut.dat", "mcl01.dat", "multi01.dat", "regbadct.dat",
+   "unkscm.dat", "unksm2.dat", "zeromf.dat",
+   0
+};
+
+static const char* invite =
+   "INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/TLS client.atlanta.example.com:5061;branch=z9hG4bK74bf9;rport\r\n"
+   "Max-Forwards: 70\r\n"
+   "From: \"Alice Liddell\" <sip:alice@atlanta.example.com>;tag=9fxced76sl\r\n"
+   "To: \"Bob\" <sip:bob@biloxi.example.com>\r\n"
+   "Call-ID: 3848276298220188511@atlanta.example.com\r\n"
+   "CSeq: 1 INVITE\r\n"
+   "Contact: <sip:alice@client.atlanta.example.com;transport=tls;ob>;+sip.instance=\"<urn:uuid:00000000-0000-1000-8000-AABBCCDDEEFF>\"\r\n"
+   "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO, UPDATE\r\n"
+   "Supported: replaces, outbound, gruu, timer\r\n"
+   "Session-Expires: 1800;refresher=uac\r\n"
+   "User-Agent: Example SIP Phone 4.2.1 (build 20140307)\r\n"
+   "P-Asserted-Identity: \"Alice Liddell\" <sip:alice@atlanta.example.com>, <tel:+15551234567>\r\n"
+   "Content-Type: application/sdp\r\n"
+   "Content-Length: 151\r\n"
+   "\r\n"
+   "v=0\r\n"
+   "o=alice 2890844526 2890844526 IN IP4 client.atlanta.example.com\r\n"
+   "s=-\r\n"
+   "c=IN IP4 192.0.2.101\r\n"
+   "t=0 0\r\n"
+   "m=audio 49172 RTP/AVP 0\r\n"
+   "a=rtpmap:0 PCMU/8000\r\n";
+
+static const char* registerRequest =
+   "REGISTER sip:registrar.biloxi.example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 192.0.2.4:5060;branch=z9hG4bKnashds7;received=192.0.2.4\r\n"
+   "Max-Forwards: 70\r\n"
+   "From: Bob <sip:bob@biloxi.example.com>;tag=a73kszlfl\r\n"
+   "To: Bob <sip:bob@biloxi.example.com>\r\n"
+   "Call-ID: 1j9FpLxk3uxtm8tn@biloxi.example.com\r\n"
+   "CSeq: 2 REGISTER\r\n"
+   "Contact: <sip:bob@192.0.2.4;line=a8f3k2>;expires=3600;reg-id=1;+sip.instance=\"<urn:uuid:f81d4fae-7dec-11d0-a765-00a0c91e6bf6>\"\r\n"
+   "Authorization: Digest username=\"bob\", realm=\"biloxi.example.com\", "
+   "nonce=\"ea9c8e88df84f1cec4341ae6cbe5a359\", opaque=\"\", "
+   "uri=\"sip:registrar.biloxi.example.com\", "
+   "response=\"dfe56131d1958046689d83306477ecc\", algorithm=MD5, qop=auth, "
+   "nc=00000001, cnonce=\"0a4f113b\"\r\n"
+   "Supported: path, outbound, gruu\r\n"
+   "User-Agent: Example SIP Phone 4.2.1 (build 20140307)\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+static const char* okResponse =
+   "SIP/2.0 200 OK\r\n"
+   "Via: SIP/2.0/UDP proxy2.example.com:5060;branch=z9hG4bK721e4.1;received=192.0.2.3\r\n"
+   "Via: SIP/2.0/UDP proxy1.example.com:5060;branch=z9hG4bKnashds8.1;received=192.0.2.2\r\n"
+   "Via: SIP/2.0/TLS client.atlanta.example.com:5061;branch=z9hG4bK74bf9;rport=5061\r\n"
+   "Record-Route: <sip:proxy2.example.com;lr>, <sip:proxy1.example.com;lr;transport=tcp>\r\n"
+   "Record-Route: <sip:edge.example.com;lr;ftag=9fxced76sl>\r\n"
+   "From: \"Alice Liddell\" <sip:alice@atlanta.example.com>;tag=9fxced76sl\r\n"
+   "To: \"Bob\" <sip:bob@biloxi.example.com>;tag=314159\r\n"
+   "Call-ID: 3848276298220188511@atlanta.example.com\r\n"
+   "CSeq: 1 INVITE\r\n"
+   "Contact: <sip:bob@client.biloxi.example.com;transport=tcp>\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+struct Sample
+{
+   Data name;
+   Data text;
+};
+
+// What a scan ended up with; the same whichever way the text was scanned.
+struct Outcome
+{
+   int result;
+   int unprocessed;
+   unsigned int headers;
+   Data encoded;
+
+   bool operator==(const Outcome& rhs) const
+   {
+      return result == rhs.result && unprocessed == rhs.unprocessed &&
+         headers == rhs.headers && encoded == rhs.encoded;
+   }
+};
+
+// Scans "text" in two chunks, the first "split" characters long (or in one
+// if "split" is 0).
+static Outcome
+scan(const Data& text, unsigned int split)
+{
+   char* buffer = MsgHeaderScanner::allocateBuffer((int)text.size());
+   memcpy(buffer, text.data(), text.size());
+
+   Outcome outcome;
+   outcome.unprocessed = -1;
+   SipMessage* msg = new SipMessage;
+   MsgHeaderScanner scanner;
+   scanner.prepareForMessage(msg);
+   char* unprocessed = buffer;
+   try
+   {
+      MsgHeaderScanner::ScanChunkResult result;
+      if (split)
+      {
+         result = scanner.scanChunk(buffer, split, &unprocessed);
+         if (result == MsgHeaderScanner::scrNextChunk)
+         {
+            result = scanner.scanChunk(unprocessed,
+                                       (unsigned int)(buffer + text.size() - unprocessed),
+                                       &unprocessed);
+         }
+      }
+      else
+      {
+         result = scanner.scanChunk(buffer, (unsigned int)text.size(), &unprocessed);
+      }
+      outcome.result = result;
+      outcome.unprocessed = (int)(unprocessed - buffer);
+      outcome.headers = scanner.getHeaderCount();
+      if (result == MsgHeaderScanner::scrEnd)
+      {
+         DataStream str(outcome.encoded);
+         msg->encode(str);
+      }
+   }
+   catch (BaseException& e)
+   {
+      // Not the scanner's business, but it must happen the same every time.
+      outcome.result = -1;
+      outcome.headers = scanner.getHeaderCount();
+      outcome.encoded = e.getMessage();
+   }
+   delete msg;
+   delete [] buffer;
+   return outcome;
+}
+
+static vector<MsgHeaderScanner::FastScanEnum>
+supportedFastScans()
+{
+   vector<MsgHeaderScanner::FastScanEnum> supported;
+   MsgHeaderScanner::FastScanEnum best = MsgHeaderScanner::getFastScan();
+   MsgHeaderScanner::FastScanEnum all[] = { MsgHeaderScanner::fsNone,
+                                            MsgHeaderScanner::fsScalar,
+                                            MsgHeaderScanner::fsSse2,
+                                            MsgHeaderScanner::fsAvx2 };
+   for (unsigned int i = 0; i < sizeof(all) / sizeof(*all); ++i)
+   {
+      if (MsgHeaderScanner::setFastScan(all[i]))
+      {
+         supported.push_back(all[i]);
+      }
+   }
+   MsgHeaderScanner::setFastScan(best);
+   return supported;
+}
+
+static void
+testAgree(const vector<Sample>& samples,
+          const vector<MsgHeaderScanner::FastScanEnum>& fastScans)
+{
+   cerr << "!! Test fast scans agree with the state machine" << endl;
+   for (vector<Sample>::const_iterator s = samples.begin(); s != samples.end(); ++s)
+   {
+      MsgHeaderScanner::setFastScan(MsgHeaderScanner::fsNone);
+      Outcome expected = scan(s->text, 0);
+      // Every split of the shorter messages, so fast scans start and stop in
+      // every possible place relative to a chunk's end.
+      unsigned int step = s->text.size() < 2000 ? 1 : 97;
+      for (unsigned int i = 0; i < fastScans.size(); ++i)
+      {
+         MsgHeaderScanner::setFastScan(fastScans[i]);
+         for (unsigned int split = 0; split < s->text.size(); split += step)
+         {
+            Outcome outcome = scan(s->text, split);
+            if (!(outcome == expected))
+            {
+               cerr << s->name << ": " << MsgHeaderScanner::getFastScanName(fastScans[i])
+                    << " split at " << split << " gave " << outcome.result << "@"
+                    << outcome.unprocessed << " (" << outcome.headers << " headers), expected "
+                    << expected.result << "@" << expected.unprocessed << " ("
+                    << expected.headers << " headers)" << endl;
+               assert(0);
+            }
+         }
+      }
+   }
+}
+
+// Scanning includes adding the headers to the message, and every run makes a
+// new message, so these are a good deal slower than the scanner alone.
+static UInt64
+timeScan(const vector<Sample>& samples, int runs)
+{
+   UInt64 bytes = 0;
+   UInt64 elapsed = 0;
+   MsgHeaderScanner scanner;
+   for (vector<Sample>::const_iterator s = samples.begin(); s != samples.end(); ++s)
+   {
+      char* buffer = MsgHeaderScanner::allocateBuffer((int)s->text.size());
+      memcpy(buffer, s->text.data(), s->text.size());
+      UInt64 start = Timer::getTimeMicroSec();
+      for (int r = 0; r < runs; ++r)
+      {
+         SipMessage msg;
+         scanner.prepareForMessage(&msg);
+         char* unprocessed = buffer;
+         try
+         {
+            scanner.scanChunk(buffer, (unsigned int)s->text.size(), &unprocessed);
+         }
+         catch (BaseException&)
+         {
+         }
+         bytes += unprocessed - buffer;
+      }
+      elapsed += Timer::getTimeMicroSec() - start;
+      delete [] buffer;
+   }
+   // bytes per microsecond
+   return elapsed ? bytes / elapsed : 0;
+}
+
+static void
+timeScans(const vector<Sample>& samples,
+          const vector<MsgHeaderScanner::FastScanEnum>& fastScans,
+          int runs)
+{
+   cerr << "!! Time scans, " << runs << " runs, MB/s" << endl;
+   vector<Sample> torture(samples.begin() + 3, samples.end());
+   cerr << "              INVITE  REGISTER  200/INVITE  RFC 4475 (" << torture.size() << ")" << endl;
+   for (unsigned int i = 0; i < fastScans.size(); ++i)
+   {
+      MsgHeaderScanner::setFastScan(fastScans[i]);
+      cerr.width(12);
+      cerr << MsgHeaderScanner::getFastScanName(fastScans[i]);
+      for (unsigned int j = 0; j < 3; ++j)
+      {
+         cerr.width(j ? 10 : 8);
+         cerr << timeScan(vector<Sample>(1, samples[j]), runs);
+      }
+      cerr.width(12);
+      cerr << (torture.empty() ? 0 : timeScan(torture, runs / 10 + 1)) << endl;
+   }
+}
+
+int
+main(int argc, char* argv[])
+{
+   int runs = 20000;
+   vector<Data> files;
+   for (int i = 1; i < argc; ++i)
+   {
+      if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      {
+         runs = atoi(argv[++i]);
+      }
+      else
+      {
+         files.push_back(argv[i]);
+      }
+   }
+   if (files.empty())
+   {
+      Data dir(getenv("srcdir") ? getenv("srcdir") : ".");
+      for (const char** f = tortureFiles; *f; ++f)
+      {
+         files.push_back(dir + "/" + *f);
+      }
+   }
+
+   vector<Sample> samples;
+   const char* builtIn[][2] = { { "INVITE", invite },
+                                { "REGISTER", registerRequest },
+                                { "200/INVITE", okResponse } };
+   for (unsigned int i = 0; i < sizeof(builtIn) / sizeof(*builtIn); ++i)
+   {
+      Sample sample;
+      sample.name = builtIn[i][0];
+      sample.text = builtIn[i][1];
+      samples.push_back(sample);
+   }
+   int found = 0;
+   for (vector<Data>::const_iterator f = files.begin(); f != files.end(); ++f)
+   {
+      ifstream in(f->c_str(), ios::in | ios::binary);
+      if (!in)
+      {
+         continue;
+      }
+      Sample sample;
+      sample.name = *f;
+      char buf[4096];
+      while (in.read(buf, sizeof(buf)) || in.gcount())
+      {
+         sample.text.append(buf, (Data::size_type)in.gcount());
+      }
+      samples.push_back(sample);
+      ++found;
+   }
+   cerr << "Read " << found << " of " << files.size() << " message files" << endl;
+
+   vector<MsgHeaderScanner::FastScanEnum> fastScans = supportedFastScans();
+   cerr << "Default fast scan: "
+        << MsgHeaderScanner::getFastScanName(MsgHeaderScanner::getFastScan()) << endl;
+
+   testAgree(samples, fastScans);
+
+   timeScans(samples, fastScans, runs);
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ *
+ */
@@ -0,0 +1,410 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "resip/stack/SendData.hxx"
+#include "resip/stack/SipCapture.hxx"
+#include "resip/stack/TcpTransport.hxx"
+#include "resip/stack/TransactionMessage.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "resip/stack/UdpTransport.hxx"
+#include "rutil/AtomicOps.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DnsUtil.hxx"
+#include "rutil/Fifo.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+static const Data invite("INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+                         "Via: SIP/2.0/UDP 192.0.2.1:5060;branch=z9hG4bKnashds8\r\n"
+                         "Max-Forwards: 70\r\n"
+                         "To: Bob <sip:bob@biloxi.example.com>\r\n"
+                         "From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+                         "Call-ID: a84b4c76e66710\r\n"
+                         "CSeq: 314159 INVITE\r\n"
+                         "Contact: <sip:alice@192.0.2.1>\r\n"
+                         "Content-Length: 0\r\n"
+                         "\r\n");
+
+struct Packet
+{
+   UInt32 mFlags;
+   Data mComment;
+   Data mIpHeader;
+   Data mPayload;
+};
+
+static UInt32
+read32(const Data& file, size_t pos)
+{
+   UInt32 value;
+   memcpy(&value, file.data() + pos, 4);
+   return value;
+}
+
+static UInt16
+read16(const Data& file, size_t pos)
+{
+   UInt16 value;
+   memcpy(&value, file.data() + pos, 2);
+   return value;
+}
+
+// Checks the structure of a pcap-ng file, and returns its packets
+static vector<Packet>
+readCapture(const char* fileName)
+{
+   ifstream in(fileName, ios_base::in | ios_base::binary);
+   assert(in);
+   Data file;
+   char buffer[4096];
+   while (in.read(buffer, sizeof(buffer)) || in.gcount())
+   {
+      file.append(buffer, (Data::size_type)in.gcount());
+   }
+
+   vector<Packet> packets;
+   size_t pos = 0;
+   assert(read32(file, 0) == 0x0A0D0D0A);
+   assert(read32(file, 8) == 0x1A2B3C4D);
+   bool haveInterface = false;
+   while (pos < file.size())
+   {
+      const UInt32 type = read32(file, pos);
+      const UInt32 length = read32(file, pos + 4);
+      assert(length % 4 == 0 && pos + length <= file.size());
+      assert(read32(file, pos + length - 4) == length);
+      if (type == 1)
+      {
+         assert(read16(file, pos + 8) == 101);
+         haveInterface = true;
+      }
+      else if (type == 6)
+      {
+         assert(haveInterface);
+         Packet packet;
+         packet.mFlags = 0;
+         const UInt32 captured = read32(file, pos + 20);
+         const char* data = file.data() + pos + 28;
+         const unsigned int ipHeader = (data[0] & 0xf0) == 0x40 ? 20 : 40;
+         packet.mIpHeader = Data(data, ipHeader);
+         packet.mPayload = Data(data + ipHeader + 8, captured - ipHeader - 8);
+         size_t opt = pos + 28 + ((captured + 3) & ~3U);
+         for (;;)
+         {
+            const UInt16 code = read16(file, opt);
+            const UInt16 size = read16(file, opt + 2);
+            if (code == 0)
+            {
+               break;
+            }
+            if (code == 1)
+            {
+               packet.mComment = Data(file.data() + opt + 4, size);
+            }
+            else if (code == 2)
+            {
+               packet.mFlags = read32(file, opt + 4);
+            }
+            opt += 4 + ((size + 3) & ~3U);
+         }
+         assert(opt + 8 == pos + length);
+         packets.push_back(packet);
+      }
+      pos += length;
+   }
+   return packets;
+}
+
+static bool
+fileExists(const Data& fileName)
+{
+   ifstream in(fileName.c_str());
+   return (bool)in;
+}
+
+static void
+testBasics()
+{
+   cerr << "!! Test basics" << endl;
+   const char* fileName = "testSipCapture.pcapng";
+   Tuple remote("192.0.2.1", 5060, V4, UDP);
+   Tuple local("192.0.2.2", 5080, V4, UDP);
+   Tuple tcpRemote("192.0.2.3", 5061, V4, TCP);
+   {
+      SipCapture capture(fileName);
+      capture.inboundRaw(remote, local, invite.data(), invite.size());
+      SendData send(tcpRemote, invite, Data::Empty, Data::Empty);
+      capture.outboundEncoded(local, tcpRemote, send);
+      capture.outboundRetransmit(local, tcpRemote, send);
+      capture.flush();
+      assert(capture.capturedMessages() == 3);
+      assert(capture.droppedMessages() == 0);
+   }
+
+   vector<Packet> packets = readCapture(fileName);
+   assert(packets.size() == 3);
+
+   // inbound, as received over UDP
+   assert(packets[0].mFlags == 1);
+   assert(packets[0].mComment.empty());
+   assert(packets[0].mPayload == invite);
+   const unsigned char source[4] = { 192, 0, 2, 1 };
+   assert(memcmp(packets[0].mIpHeader.data() + 12, source, 4) == 0);
+
+   assert(packets[1].mFlags == 2);
+   assert(packets[1].mComment == "TCP");
+   assert(packets[1].mPayload == invite);
+   assert(packets[2].mFlags == 2);
+   assert(packets[2].mComment == "TCP retransmission");
+   remove(fileName);
+}
+
+class CaptureThread : public ThreadIf
+{
+   public:
+      CaptureThread(SipCapture& capture, int count) :
+         mCapture(capture),
+         mCount(count),
+         mElapsed(0)
+      {}
+
+      virtual void thread()
+      {
+         Tuple remote("192.0.2.1", 5060, V4, UDP);
+         Tuple local("192.0.2.2", 5060, V4, UDP);
+         SendData send(remote, invite, Data::Empty, Data::Empty);
+         UInt64 start = Timer::getTimeMicroSec();
+         for (int i = 0; i < mCount; ++i)
+         {
+            mCapture.outboundEncoded(local, remote, send);
+         }
+         mElapsed = Timer::getTimeMicroSec() - start;
+      }
+
+      SipCapture& mCapture;
+      const int mCount;
+      UInt64 mElapsed;
+};
+
+static UInt64
+runThreads(SipCapture& capture, int threads, int count)
+{
+   vector<CaptureThread*> captureThreads;
+   for (int i = 0; i < threads; ++i)
+   {
+      captureThreads.push_back(new CaptureThread(capture, count));
+      captureThreads.back()->run();
+   }
+   UInt64 elapsed = 0;
+   for (int i = 0; i < threads; ++i)
+   {
+      captureThreads[i]->join();
+      elapsed += captureThreads[i]->mElapsed;
+      delete captureThreads[i];
+   }
+   return elapsed;
+}
+
+static void
+testThreads()
+{
+   cerr << "!! Test threads" << endl;
+   const char* fileName = "testSipCapture-threads.pcapng";
+   const int threads = 4;
+   const int count = 20000;
+   UInt64 captured = 0;
+   UInt64 dropped = 0;
+   {
+      SipCapture capture(fileName, 0, 1, 64*1024);
+      UInt64 elapsed = runThreads(capture, threads, count);
+      capture.flush();
+      captured = capture.capturedMessages();
+      dropped = capture.droppedMessages();
+      cerr << "Captured " << captured << " messages, dropped " << dropped << ", "
+           << double(elapsed*1000)/(threads*count) << "ns per message" << endl;
+      assert(captured + dropped == UInt64(threads*count));
+   }
+   assert(readCapture(fileName).size() == captured);
+   remove(fileName);
+}
+
+static void
+testRotation()
+{
+   cerr << "!! Test rotation" << endl;
+   const Data fileName("testSipCapture-rotate.pcapng");
+   Tuple remote("192.0.2.1", 5060, V4, UDP);
+   Tuple local("192.0.2.2", 5060, V4, UDP);
+   SendData send(remote, invite, Data::Empty, Data::Empty);
+   {
+      SipCapture capture(fileName, 8192, 3);
+      for (int i = 0; i < 200; ++i)
+      {
+         capture.outboundEncoded(local, remote, send);
+      }
+      capture.flush();
+      assert(capture.capturedMessages() == 200);
+   }
+   assert(fileExists(fileName));
+   assert(fileExists(fileName + ".1"));
+   assert(fileExists(fileName + ".2"));
+   assert(!fileExists(fileName + ".3"));
+   // Every file is complete in itself
+   size_t packets = readCapture(fileName.c_str()).size();
+   assert(packets > 0);
+   assert(readCapture((fileName + ".1").c_str()).size() >= packets);
+   remove(fileName.c_str());
+   remove((fileName + ".1").c_str());
+   remove((fileName + ".2").c_str());
+}
+
+// Sends a request to a transport with a capture installed, and returns once
+// it has been captured.
+static void
+receive(Transport& sender, Transport& receiver, Fifo<TransactionMessage>& rxFifo,
+        const Tuple& dest, const Data& request, SipCapture& capture)
+{
+   UInt64 captured = capture.capturedMessages();
+   sender.send(sender.makeSendData(dest, request, "capture"));
+   UInt64 deadline = Timer::getTimeMs() + 5000;
+   while(capture.capturedMessages() == captured && Timer::getTimeMs() < deadline)
+   {
+      FdSet fdset;
+      sender.buildFdSet(fdset);
+      receiver.buildFdSet(fdset);
+      fdset.selectMilliSeconds(100);
+      sender.process(fdset);
+      receiver.process(fdset);
+      capture.flush();
+   }
+   assert(capture.capturedMessages() == captured + 1);
+   while(rxFifo.messageAvailable())
+   {
+      delete rxFifo.getNext();
+   }
+}
+
+// Received messages are captured as they came off the wire: compact headers
+// are not expanded, and the Via has no received= parameter.
+static void
+testReceived()
+{
+   cerr << "!! Test received" << endl;
+   const char* fileName = "testSipCapture-received.pcapng";
+   const Data request("OPTIONS sip:bob@127.0.0.1 SIP/2.0\r\n"
+                      "v: SIP/2.0/UDP 192.0.2.1:5060;branch=z9hG4bKcapture;rport\r\n"
+                      "Max-Forwards: 70\r\n"
+                      "t: <sip:bob@127.0.0.1>\r\n"
+                      "f: <sip:alice@127.0.0.1>;tag=1928301774\r\n"
+                      "i: capture\r\n"
+                      "CSeq: 1 OPTIONS\r\n"
+                      "c: text/plain\r\n"
+                      "l: 5\r\n"
+                      "\r\n"
+                      "hello");
+   in_addr in;
+   DnsUtil::inet_pton("127.0.0.1", in);
+   {
+      SharedPtr<SipCapture> capture(new SipCapture(fileName));
+
+      Fifo<TransactionMessage> txFifo;
+      Fifo<TransactionMessage> rxFifo;
+      UdpTransport udpSender(txFifo, 25090, V4, StunDisabled, "127.0.0.1");
+      UdpTransport udpReceiver(rxFifo, 25092, V4, StunDisabled, "127.0.0.1");
+      udpReceiver.setSipMessageLoggingHandler(capture);
+      receive(udpSender, udpReceiver, rxFifo, Tuple(in, 25092, UDP), request, *capture);
+
+      TcpTransport tcpSender(txFifo, 25094, V4, "127.0.0.1");
+      TcpTransport tcpReceiver(rxFifo, 25096, V4, "127.0.0.1");
+      tcpReceiver.setSipMessageLoggingHandler(capture);
+      receive(tcpSender, tcpReceiver, rxFifo, Tuple(in, 25096, TCP), request, *capture);
+      while(txFifo.messageAvailable())
+      {
+         delete txFifo.getNext();
+      }
+   }
+
+   vector<Packet> packets = readCapture(fileName);
+   assert(packets.size() == 2);
+   assert(packets[0].mFlags == 1);
+   assert(packets[0].mComment.empty());
+   assert(packets[0].mPayload == request);
+   assert(packets[1].mFlags == 1);
+   assert(packets[1].mComment == "TCP");
+   assert(packets[1].mPayload == request);
+   remove(fileName);
+}
+
+int
+main(int argc, char* argv[])
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   testBasics();
+   testThreads();
+   testRotation();
+   testReceived();
+#endif
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
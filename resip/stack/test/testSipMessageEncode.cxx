@@ -14,16 +14,66 @@ class Args
 {
 public:
 
-	Args(void):runs(100000),runFs(false),runDs(true)
+	Args(void):runs(100000),runFs(false),runDs(true),runBuf(true)
 	{}
 
 	int runs;
 	bool runFs;
 	bool runDs;
+	bool runBuf;
 };
 
 void processArgs(int argc, char* argv[],Args &args);
 
+static double
+timeDataStream(const SipMessage& msg, int runs)
+{
+	UInt64 startTime = Timer::getTimeMs();
+	for(int i=0; i<runs; i++)
+	{
+		// A fresh buffer each time, reserved the way TransportSelector::transmit()
+		// used to (from a running average of message sizes)
+		Data data;
+		data.reserve(1280);
+		DataStream resipStr(data);
+		msg.encode(resipStr);
+		resipStr.flush();
+	}
+	return (double)(Timer::getTimeMs() - startTime) / 1000.0;
+}
+
+static double
+timeBuffer(const SipMessage& msg, int runs)
+{
+	UInt64 startTime = Timer::getTimeMs();
+	for(int i=0; i<runs; i++)
+	{
+		// A fresh buffer each time, as TransportSelector::transmit() uses
+		Data data;
+		msg.encodeToBuffer(data);
+	}
+	return (double)(Timer::getTimeMs() - startTime) / 1000.0;
+}
+
+static bool
+encodersAgree(const SipMessage& msg)
+{
+	Data streamed;
+	{
+		DataStream str(streamed);
+		msg.encode(str);
+	}
+	Data buffered;
+	msg.encodeToBuffer(buffered);
+	if( streamed != buffered )
+	{
+		cout << "\r\nError: encoders disagree\r\n--- stream:\r\n" << streamed
+		     << "\r\n--- buffer:\r\n" << buffered << "\r\n";
+		return false;
+	}
+	return true;
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -31,7 +81,7 @@ main(int argc, char* argv[])
 
 	cout << "\r\n------------------------------------------------------\r\n";
 	cout << "Resiprocate resip::SipMessage encoder speed test rev 1.0\r\n";
-	cout << "Args: [-r <number of runs>] [-runfs=(yes|no)] [-runds=(yes|no)]\r\n";
+	cout << "Args: [-r <number of runs>] [-runfs=(yes|no)] [-runds=(yes|no)] [-runbuf=(yes|no)]\r\n";
 	cout << "Example: -r 100000 -runfs=yes -runds=no\r\n";
 	cout << "------------------------------------------------------------\r\n";
 
@@ -108,23 +158,41 @@ main(int argc, char* argv[])
 
 	}
 
-	if( args.runDs )
-	{
-		Data data;
-		DataStream resipStr(data);
+	// What a proxy sends on: the same message, with a Via added, one less
+	// Max-Forwards, and everything else as received.
+	SipMessage forwarded(*msg);
+	Via via;
+	via.sentHost() = "10.0.0.1";
+	via.sentPort() = 5060;
+	forwarded.header(h_Vias).push_front(via);
+	forwarded.header(h_MaxForwards).value()--;
 
-		cout << "\r\nOutput to resip::DataStream, runs = " << args.runs << ", ...\r\n";
+	// Parsed but untouched headers must still come out as received.
+	const SipMessage& constMsg = *msg;
+	constMsg.header(h_To).uri();
+	constMsg.header(h_CSeq).sequence();
 
-		startTime = Timer::getTimeMs();
-		for(int i=0; i<args.runs; i++)
-		{
-			msg->encode(resipStr);
-			data.clear();
-		}
-		elapsed = Timer::getTimeMs() - startTime;
-		secs = ((double) elapsed / 1000.0);
+	if( !encodersAgree(*msg) || !encodersAgree(forwarded) )
+	{
+		return -1;
+	}
 
+	if( args.runDs )
+	{
+		cout << "\r\nOutput to resip::DataStream, runs = " << args.runs << ", ...\r\n";
+		secs = timeDataStream(*msg, args.runs);
 		cout << "\r\nOutput to resip::DataStream completed, elapsed time= " << secs << " seconds.\r\n";
+		secs = timeDataStream(forwarded, args.runs);
+		cout << "Forwarded message, elapsed time= " << secs << " seconds.\r\n";
+	}
+
+	if( args.runBuf )
+	{
+		cout << "\r\nOutput to resip::Data with encodeToBuffer(), runs = " << args.runs << ", ...\r\n";
+		secs = timeBuffer(*msg, args.runs);
+		cout << "\r\nOutput with encodeToBuffer() completed, elapsed time= " << secs << " seconds.\r\n";
+		secs = timeBuffer(forwarded, args.runs);
+		cout << "Forwarded message, elapsed time= " << secs << " seconds.\r\n";
 	}
 
 	cout << "Test complete.\r\n";
@@ -181,5 +249,16 @@ void processArgs(int argc, char* argv[],Args &args)
 				args.runDs = false;
 			}
 		}
+		else if( arg.substr(0,8) == "-runbuf=" )
+		{
+			if( arg.substr(8) == "yes" )
+			{
+				args.runBuf = true;
+			}
+			else
+			{
+				args.runBuf = false;
+			}
+		}
 	}
 }
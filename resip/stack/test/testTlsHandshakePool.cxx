@@ -0,0 +1,269 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+#ifdef USE_SSL
+#include "resip/stack/ssl/TlsHandshakePool.hxx"
+#endif
+#include "rutil/Condition.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Time.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+#ifdef USE_SSL
+// Stands in for the transport: handshakes are held at the gate until it is
+// opened, and are handed back here once they have run.
+class FakeTransport
+{
+   public:
+      FakeTransport() : mOpen(false), mStarted(0) {}
+
+      void open()
+      {
+         Lock lock(mMutex);
+         mOpen = true;
+         mCondition.broadcast();
+      }
+
+      void pass()
+      {
+         Lock lock(mMutex);
+         ++mStarted;
+         mCondition.broadcast();
+         while(!mOpen)
+         {
+            mCondition.wait(mMutex);
+         }
+      }
+
+      void handBack(TlsHandshakePool::Handshake* handshake)
+      {
+         Lock lock(mMutex);
+         mHandedBack.push_back(handshake);
+         mCondition.broadcast();
+      }
+
+      // Waits up to 5s for count handshakes to have started
+      bool waitStarted(unsigned int count)
+      {
+         Lock lock(mMutex);
+         UInt64 deadline = Timer::getTimeMs() + 5000;
+         while(mStarted < count && Timer::getTimeMs() < deadline)
+         {
+            mCondition.wait(mMutex, 100);
+         }
+         return mStarted >= count;
+      }
+
+      // Waits up to 5s for count handshakes to have been handed back
+      vector<TlsHandshakePool::Handshake*> waitHandedBack(size_t count)
+      {
+         Lock lock(mMutex);
+         UInt64 deadline = Timer::getTimeMs() + 5000;
+         while(mHandedBack.size() < count && Timer::getTimeMs() < deadline)
+         {
+            mCondition.wait(mMutex, 100);
+         }
+         return mHandedBack;
+      }
+
+   private:
+      Mutex mMutex;
+      Condition mCondition;
+      bool mOpen;
+      unsigned int mStarted;
+      vector<TlsHandshakePool::Handshake*> mHandedBack;
+};
+
+class TestHandshake : public TlsHandshakePool::Handshake
+{
+   public:
+      explicit TestHandshake(FakeTransport& transport) : mTransport(transport), mRuns(0) {}
+
+      virtual void runQueuedHandshake()
+      {
+         mTransport.pass();
+         ++mRuns;
+         mTransport.handBack(this);
+      }
+
+      FakeTransport& mTransport;
+      int mRuns;
+};
+
+class Opener : public ThreadIf
+{
+   public:
+      Opener(FakeTransport& transport, unsigned int delayMs) : mTransport(transport), mDelayMs(delayMs) {}
+      virtual void thread()
+      {
+         sleepMs(mDelayMs);
+         mTransport.open();
+      }
+   private:
+      FakeTransport& mTransport;
+      unsigned int mDelayMs;
+};
+
+// Beyond maxQueued, post() refuses; everything accepted is run once and
+// handed back, in order.
+static void
+testBounded()
+{
+   cerr << "!! Test bounded" << endl;
+   FakeTransport transport;
+   TestHandshake h0(transport), h1(transport), h2(transport), h3(transport);
+   TlsHandshakePool pool(1, 2);
+   assert(pool.threads() == 1);
+
+   assert(pool.post(&h0));
+   assert(transport.waitStarted(1));
+   // h0 is running, so it no longer counts against the queue
+   assert(pool.queued() == 0);
+   assert(pool.post(&h1));
+   assert(pool.post(&h2));
+   assert(pool.queued() == 2);
+   assert(!pool.post(&h3));
+   assert(pool.queued() == 2);
+
+   transport.open();
+   vector<TlsHandshakePool::Handshake*> handedBack = transport.waitHandedBack(3);
+   assert(handedBack.size() == 3);
+   assert(handedBack[0] == &h0);
+   assert(handedBack[1] == &h1);
+   assert(handedBack[2] == &h2);
+   assert(pool.queued() == 0);
+   assert(h0.mRuns == 1 && h1.mRuns == 1 && h2.mRuns == 1);
+   assert(h3.mRuns == 0);
+
+   // Room again once drained
+   assert(pool.post(&h3));
+   assert(transport.waitHandedBack(4).size() == 4);
+   assert(h3.mRuns == 1);
+}
+
+// A queued handshake is dropped; a running one is waited for.
+static void
+testCancel()
+{
+   cerr << "!! Test cancel" << endl;
+   FakeTransport transport;
+   TestHandshake h0(transport), h1(transport);
+   TlsHandshakePool pool(1, 4);
+
+   assert(pool.post(&h0));
+   assert(transport.waitStarted(1));
+   assert(pool.post(&h1));
+   pool.cancel(&h1);
+   assert(pool.queued() == 0);
+
+   Opener opener(transport, 100);
+   opener.run();
+   pool.cancel(&h0);
+   // cancel() only returns once the worker is done with h0
+   assert(h0.mRuns == 1);
+   opener.join();
+
+   sleepMs(100);
+   assert(transport.waitHandedBack(1).size() == 1);
+   assert(h1.mRuns == 0);
+}
+
+// Several workers drain the queue between them.
+static void
+testThreads()
+{
+   cerr << "!! Test threads" << endl;
+   const int count = 50;
+   FakeTransport transport;
+   transport.open();
+   vector<TestHandshake*> handshakes;
+   {
+      TlsHandshakePool pool(4, count);
+      assert(pool.threads() == 4);
+      for(int i = 0; i < count; ++i)
+      {
+         handshakes.push_back(new TestHandshake(transport));
+         assert(pool.post(handshakes.back()));
+      }
+      assert(transport.waitHandedBack(count).size() == (size_t)count);
+      assert(pool.queued() == 0);
+   }
+   for(int i = 0; i < count; ++i)
+   {
+      assert(handshakes[i]->mRuns == 1);
+      delete handshakes[i];
+   }
+}
+#endif
+
+int
+main(int argc, char* argv[])
+{
+#ifdef USE_SSL
+   testBounded();
+   testCancel();
+   testThreads();
+#endif
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,212 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <iostream>
+#include <time.h>
+
+#include "rutil/Data.hxx"
+
+#ifdef USE_SSL
+#include "resip/stack/ssl/TlsSessionCache.hxx"
+#include <openssl/ssl.h>
+#endif
+
+using namespace resip;
+using namespace std;
+
+#if defined(USE_SSL) && (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+namespace resip
+{
+
+class TestTlsSessionCache
+{
+   public:
+      static SSL_SESSION* makeSession(const Data& id, long age, long timeout)
+      {
+         SSL_SESSION* session = SSL_SESSION_new();
+         SSL_SESSION_set1_id(session, reinterpret_cast<const unsigned char*>(id.data()), (unsigned int)id.size());
+         SSL_SESSION_set_time(session, (long)time(0) - age);
+         SSL_SESSION_set_timeout(session, timeout);
+         return session;
+      }
+
+      static Data sessionId(SSL_SESSION* session)
+      {
+         unsigned int len = 0;
+         const unsigned char* id = SSL_SESSION_get_id(session, &len);
+         return Data(reinterpret_cast<const char*>(id), len);
+      }
+
+      // Finds id, checks it, and drops the reference returned
+      static bool has(TlsSessionCache& cache, const Data& id)
+      {
+         SSL_SESSION* session = cache.findServerSession(id);
+         if(!session)
+         {
+            return false;
+         }
+         assert(sessionId(session) == id);
+         SSL_SESSION_free(session);
+         return true;
+      }
+
+      static void testStoreFind()
+      {
+         cerr << "!! Test store and find" << endl;
+         TlsSessionCache cache;
+         SSL_SESSION* session = makeSession("one", 0, 3600);
+         assert(!cache.storeServerSession(session));
+         SSL_SESSION_free(session);
+
+         cache.setServerCache(10, 3600);
+         assert(cache.storeServerSession(makeSession("one", 0, 3600)));
+         assert(cache.storeServerSession(makeSession("two", 0, 3600)));
+         // stored again under the same id: replaces the old one
+         assert(cache.storeServerSession(makeSession("two", 0, 3600)));
+         assert(cache.getStats().serverSessions == 2);
+         assert(has(cache, "one"));
+         assert(has(cache, "two"));
+         assert(!has(cache, "three"));
+
+         // The session found is the caller's to free, even once the cache
+         // has let go of it.
+         SSL_SESSION* found = cache.findServerSession("one");
+         assert(found);
+         cache.removeServerSession("one");
+         assert(cache.getStats().serverSessions == 1);
+         assert(!has(cache, "one"));
+         assert(sessionId(found) == "one");
+         SSL_SESSION_free(found);
+      }
+
+      static void testExpire()
+      {
+         cerr << "!! Test expire" << endl;
+         TlsSessionCache cache;
+         cache.setServerCache(10, 3600);
+
+         // Expired sessions are not found, and are dropped when looked up
+         assert(cache.storeServerSession(makeSession("old", 100, 10)));
+         assert(cache.getStats().serverSessions == 1);
+         assert(!has(cache, "old"));
+         assert(cache.getStats().serverSessions == 0);
+
+         // ... or when another session is stored
+         assert(cache.storeServerSession(makeSession("old", 100, 10)));
+         assert(cache.storeServerSession(makeSession("new", 0, 3600)));
+         assert(cache.getStats().serverSessions == 1);
+         assert(has(cache, "new"));
+      }
+
+      static void testEvict()
+      {
+         cerr << "!! Test evict" << endl;
+         TlsSessionCache cache;
+         cache.setServerCache(3, 3600);
+         assert(cache.storeServerSession(makeSession("a", 0, 3600)));
+         assert(cache.storeServerSession(makeSession("b", 0, 3600)));
+         assert(cache.storeServerSession(makeSession("c", 0, 3600)));
+         assert(cache.storeServerSession(makeSession("d", 0, 3600)));
+         assert(cache.getStats().serverSessions == 3);
+         // the oldest goes first
+         assert(!has(cache, "a"));
+         assert(has(cache, "b"));
+         assert(has(cache, "c"));
+         assert(has(cache, "d"));
+      }
+
+      // OpenSSL is handed a reference of its own, and told not to take another
+      static void testGetSessionCallback()
+      {
+         cerr << "!! Test get session callback" << endl;
+         TlsSessionCache cache;
+         cache.setServerCache(10, 3600);
+         SSL_CTX* ctx = SSL_CTX_new(TLS_method());
+         cache.configure(ctx, "test");
+         SSL* ssl = SSL_new(ctx);
+
+         assert(cache.storeServerSession(makeSession("one", 0, 3600)));
+         int copy = 1;
+         SSL_SESSION* session = TlsSessionCache::getSessionCb(ssl, reinterpret_cast<const unsigned char*>("one"), 3, &copy);
+         assert(session);
+         assert(copy == 0);
+         cache.removeServerSession("one");
+         assert(sessionId(session) == "one");
+         SSL_SESSION_free(session);
+
+         copy = 1;
+         assert(TlsSessionCache::getSessionCb(ssl, reinterpret_cast<const unsigned char*>("two"), 3, &copy) == 0);
+         assert(copy == 0);
+
+         SSL_free(ssl);
+         SSL_CTX_free(ctx);
+      }
+};
+
+}
+#endif
+
+int
+main(int argc, char* argv[])
+{
+#if defined(USE_SSL) && (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+   TestTlsSessionCache::testStoreFind();
+   TestTlsSessionCache::testExpire();
+   TestTlsSessionCache::testEvict();
+   TestTlsSessionCache::testGetSessionCallback();
+#endif
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,224 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <iostream>
+#include <memory>
+
+#include "resip/stack/SipMessage.hxx"
+#include "resip/stack/TransactionMessage.hxx"
+#include "resip/stack/Tuple.hxx"
+#include "resip/stack/UdpTransport.hxx"
+#include "rutil/Data.hxx"
+#include "rutil/DnsUtil.hxx"
+#include "rutil/Fifo.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+static Data
+makeRequest(int n)
+{
+   return Data("OPTIONS sip:bob@127.0.0.1 SIP/2.0\r\n"
+               "Via: SIP/2.0/UDP 127.0.0.1:25070;branch=z9hG4bK") + Data(n) + Data("\r\n"
+               "Max-Forwards: 70\r\n"
+               "To: <sip:bob@127.0.0.1>\r\n"
+               "From: <sip:alice@127.0.0.1>;tag=1928301774\r\n"
+               "Call-ID: batch") + Data(n) + Data("\r\n"
+               "CSeq: 1 OPTIONS\r\n"
+               "Content-Length: 0\r\n"
+               "\r\n");
+}
+
+// Queues count requests on the sender before either transport is processed,
+// so that they should all go out in one sendmmsg() and be picked up by one
+// recvmmsg().
+static void
+testBatches()
+{
+   cerr << "!! Test batches" << endl;
+   const int count = 8;
+   const unsigned flags = RESIP_TRANSPORT_FLAG_MMSG | RESIP_TRANSPORT_FLAG_RXALL | RESIP_TRANSPORT_FLAG_TXALL;
+
+   Fifo<TransactionMessage> txFifo;
+   UdpTransport sender(txFifo, 25070, V4, StunDisabled, "127.0.0.1", 0, Compression::Disabled, flags);
+   Fifo<TransactionMessage> rxFifo;
+   UdpTransport receiver(rxFifo, 25080, V4, StunDisabled, "127.0.0.1", 0, Compression::Disabled, flags);
+
+   in_addr in;
+   DnsUtil::inet_pton("127.0.0.1", in);
+   Tuple dest(in, 25080, UDP);
+   for(int i = 0; i < count; ++i)
+   {
+      sender.send(sender.makeSendData(dest, makeRequest(i), Data(i)));
+   }
+
+   UInt64 deadline = Timer::getTimeMs() + 5000;
+   while(sender.getTxMsgCount() < (unsigned)count && Timer::getTimeMs() < deadline)
+   {
+      FdSet fdset;
+      sender.buildFdSet(fdset);
+      fdset.selectMilliSeconds(100);
+      sender.process(fdset);
+   }
+   assert(sender.getTxMsgCount() == (unsigned)count);
+   assert(sender.getTxBatchCount() >= 1);
+   assert(sender.getTxBatchMax() > 1);
+   assert(sender.getRxBatchCount() == 0);
+
+   int received = 0;
+   while(received < count && Timer::getTimeMs() < deadline)
+   {
+      FdSet fdset;
+      receiver.buildFdSet(fdset);
+      fdset.selectMilliSeconds(100);
+      receiver.process(fdset);
+      while(rxFifo.messageAvailable())
+      {
+         delete rxFifo.getNext();
+         ++received;
+      }
+   }
+   assert(received == count);
+   assert(receiver.getRxMsgCount() == (unsigned)count);
+   assert(receiver.getRxBatchMax() > 1);
+   assert(receiver.getRxBatchCount() < (unsigned)count);
+   cerr << "sent " << count << " in " << sender.getTxBatchCount() << " sendmmsg calls, received in "
+        << receiver.getRxBatchCount() << " recvmmsg calls" << endl;
+}
+
+// An empty datagram in a batch is dropped, not parsed out of whatever the
+// buffer held before.
+static void
+testEmptyDatagram()
+{
+   cerr << "!! Test empty datagram" << endl;
+   const unsigned flags = RESIP_TRANSPORT_FLAG_MMSG | RESIP_TRANSPORT_FLAG_RXALL;
+   Fifo<TransactionMessage> rxFifo;
+   UdpTransport receiver(rxFifo, 25084, V4, StunDisabled, "127.0.0.1", 0, Compression::Disabled, flags);
+
+   Socket fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+   assert(fd != INVALID_SOCKET);
+   in_addr in;
+   DnsUtil::inet_pton("127.0.0.1", in);
+   Tuple dest(in, 25084, UDP);
+   const Data request = makeRequest(0);
+   for(int i = 0; i < 2; ++i)
+   {
+      // the request first, so that the buffers have something in them
+      assert(sendto(fd, request.data(), request.size(), 0, &dest.getSockaddr(), dest.length()) == (int)request.size());
+      assert(sendto(fd, request.data(), 0, 0, &dest.getSockaddr(), dest.length()) == 0);
+   }
+
+   int received = 0;
+   UInt64 deadline = Timer::getTimeMs() + 5000;
+   while(received < 2 && Timer::getTimeMs() < deadline)
+   {
+      FdSet fdset;
+      receiver.buildFdSet(fdset);
+      fdset.selectMilliSeconds(100);
+      receiver.process(fdset);
+      while(rxFifo.messageAvailable())
+      {
+         delete rxFifo.getNext();
+         ++received;
+      }
+   }
+   closeSocket(fd);
+   assert(received == 2);
+   assert(receiver.getRxMsgCount() == 2);
+}
+
+// Without the flag, nothing is batched.
+static void
+testNoBatches()
+{
+   cerr << "!! Test no batches" << endl;
+   Fifo<TransactionMessage> txFifo;
+   UdpTransport sender(txFifo, 25072, V4, StunDisabled, "127.0.0.1");
+   Fifo<TransactionMessage> rxFifo;
+   UdpTransport receiver(rxFifo, 25082, V4, StunDisabled, "127.0.0.1");
+
+   in_addr in;
+   DnsUtil::inet_pton("127.0.0.1", in);
+   sender.send(sender.makeSendData(Tuple(in, 25082, UDP), makeRequest(0), Data(0)));
+
+   UInt64 deadline = Timer::getTimeMs() + 5000;
+   while(!rxFifo.messageAvailable() && Timer::getTimeMs() < deadline)
+   {
+      FdSet fdset;
+      sender.buildFdSet(fdset);
+      receiver.buildFdSet(fdset);
+      fdset.selectMilliSeconds(100);
+      sender.process(fdset);
+      receiver.process(fdset);
+   }
+   assert(rxFifo.messageAvailable());
+   delete rxFifo.getNext();
+   assert(sender.getTxMsgCount() == 1 && receiver.getRxMsgCount() == 1);
+   assert(sender.getTxBatchCount() == 0 && receiver.getRxBatchCount() == 0);
+}
+
+int
+main(int argc, char* argv[])
+{
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+   testBatches();
+   testEmptyDatagram();
+#endif
+   testNoBatches();
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -11,6 +11,7 @@
 
 #include "rutil/compat.hxx"
 #include "rutil/Timer.hxx"
+#include "rutil/MpscQueue.hxx"
 
 namespace resip
 {
@@ -110,12 +111,19 @@ class FifoStatsInterface
 #define RESIP_FIFO_NOWAIT	-1
 #define RESIP_FIFO_FOREVER	0
 
+template<typename T> class MpscQueue;
+
 /**
    @brief The base class from which various templated Fifo classes are derived.
 
    (aka template hoist) 
    AbstractFifo's get operations are all threadsafe; AbstractFifo does not 
    define any put operations (these are defined in subclasses).
+
+   An AbstractFifo can optionally be switched into a lock-free mode (see
+   setLockFree()), in which puts from any number of threads, and the
+   empty()/size()/messageAvailable() queries, never take the mutex. In this
+   mode, only a single thread may consume from the fifo.
    @note Users of the resip stack will not need to interact with this class 
       directly in most cases. Look at Fifo and TimeLimitFifo instead.
 
@@ -134,11 +142,16 @@ class AbstractFifo : public FifoStatsInterface
             mLastSampleTakenMicroSec(0),
             mCounter(0),
             mAverageServiceTimeMicroSec(0),
-            mSize(0)
+            mSize(0),
+            mLockFreeFifo(0),
+            mConsumerWaiting(0)
       {}
 
       virtual ~AbstractFifo()
       {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         delete mLockFreeFifo;
+#endif
       }
 
       /** 
@@ -147,6 +160,12 @@ class AbstractFifo : public FifoStatsInterface
        **/
       bool empty() const
       {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            return atomicLoad(mSize) == 0;
+         }
+#endif
          Lock lock(mMutex); (void)lock;
          return mFifo.empty();
       }
@@ -160,6 +179,12 @@ class AbstractFifo : public FifoStatsInterface
        */
       virtual unsigned int size() const
       {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            return atomicLoad(mSize);
+         }
+#endif
          Lock lock(mMutex); (void)lock;
          return (unsigned int)mFifo.size();
       }
@@ -171,10 +196,62 @@ class AbstractFifo : public FifoStatsInterface
        
       bool messageAvailable() const
       {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            return atomicLoad(mSize) != 0;
+         }
+#endif
          Lock lock(mMutex); (void)lock;
          return !mFifo.empty();
       }
 
+      /**
+         @brief Switches this fifo into (or out of) lock-free mode.
+         @details In lock-free mode, elements are kept in an MpscQueue instead
+         of a mutex-protected deque; producers and the size queries never
+         block one another, and the mutex is only used to put the consumer to
+         sleep when there is nothing to do. The statistics used by the
+         CongestionManager continue to be maintained.
+         @note This must be called before the fifo is shared between threads,
+         and it is only safe if a single thread consumes from the fifo.
+         @return true iff the fifo is now in the requested mode. This will 
+            fail if the fifo is not empty, or if lock-free mode is requested 
+            and this platform lacks atomic operations (see AtomicOps.hxx).
+      */
+      bool setLockFree(bool lockFree)
+      {
+         Lock lock(mMutex); (void)lock;
+         if(lockFree == isLockFree())
+         {
+            return true;
+         }
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(!mFifo.empty() || mSize != 0)
+         {
+            return false;
+         }
+
+         if(lockFree)
+         {
+            mLockFreeFifo = new MpscQueue<T>;
+         }
+         else
+         {
+            delete mLockFreeFifo;
+            mLockFreeFifo = 0;
+         }
+         return true;
+#else
+         return false;
+#endif
+      }
+
+      bool isLockFree() const
+      {
+         return mLockFreeFifo != 0;
+      }
+
       /**
       @brief computes the time delta between the oldest and newest queue members
       @note defaults to zero, overridden by TimeLimitFifo<T>
@@ -215,6 +292,16 @@ class AbstractFifo : public FifoStatsInterface
        */
       T getNext()
       {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            T firstMessage = T();
+            onFifoPolled();
+            waitForLockFree(0);
+            popLockFree(firstMessage);
+            return firstMessage;
+         }
+#endif
          Lock lock(mMutex); (void)lock;
          onFifoPolled();
 
@@ -250,6 +337,18 @@ class AbstractFifo : public FifoStatsInterface
             return true;
          }
 
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            onFifoPolled();
+            if(ms > 0 && !waitForLockFree(Timer::getTimeMs() + (unsigned int)ms))
+            {
+               return false;
+            }
+            return popLockFree(toReturn);
+         }
+#endif
+
          if(ms < 0)
          {
             Lock lock(mMutex); (void)lock;
@@ -301,6 +400,16 @@ class AbstractFifo : public FifoStatsInterface
 
       void getMultiple(Messages& other, unsigned int max)
       {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            assert(other.empty());
+            onFifoPolled();
+            waitForLockFree(0);
+            popMultipleLockFree(other, max);
+            return;
+         }
+#endif
          Lock lock(mMutex); (void)lock;
          onFifoPolled();
          assert(other.empty());
@@ -337,6 +446,19 @@ class AbstractFifo : public FifoStatsInterface
          assert(other.empty());
          const UInt64 begin(Timer::getTimeMs());
          const UInt64 end(begin + (unsigned int)(ms)); // !kh! ms should've been unsigned :(
+
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            onFifoPolled();
+            if(ms > 0 && !waitForLockFree(end))
+            {
+               return false;
+            }
+            return popMultipleLockFree(other, max) != 0;
+         }
+#endif
+
          Lock lock(mMutex); (void)lock;
          onFifoPolled();
 
@@ -383,6 +505,17 @@ class AbstractFifo : public FifoStatsInterface
 
       size_t add(const T& item)
       {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            // Count first, so that the consumer never sees more elements than
+            // mSize accounts for.
+            size_t size = onMessagePushedLockFree(1);
+            mLockFreeFifo->push(item);
+            wakeLockFreeConsumer();
+            return size;
+         }
+#endif
          Lock lock(mMutex); (void)lock;
          mFifo.push_back(item);
          mCondition.signal();
@@ -392,6 +525,20 @@ class AbstractFifo : public FifoStatsInterface
 
       size_t addMultiple(Messages& items)
       {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            if(items.empty())
+            {
+               return atomicLoad(mSize);
+            }
+            size_t size = onMessagePushedLockFree((UInt32)items.size());
+            mLockFreeFifo->pushMultiple(items.begin(), items.end());
+            items.clear();
+            wakeLockFreeConsumer();
+            return size;
+         }
+#endif
          Lock lock(mMutex); (void)lock;
          size_t size=items.size();
          if(mFifo.empty())
@@ -413,6 +560,90 @@ class AbstractFifo : public FifoStatsInterface
          return mFifo.size();
       }
 
+#ifdef RESIP_HAVE_ATOMIC_OPS
+      /**
+         Waits until the lock-free fifo has an element ready to be popped, or
+         until the time (in ms) end passes. If end is 0, waits forever.
+         @return true iff there is an element ready to be popped.
+      */
+      bool waitForLockFree(UInt64 end)
+      {
+         if(mLockFreeFifo->hasNext())
+         {
+            return true;
+         }
+
+         Lock lock(mMutex); (void)lock;
+         atomicStore(mConsumerWaiting, (UInt32)1);
+         // Pairs with the fence in wakeLockFreeConsumer(); either the producer
+         // sees mConsumerWaiting, or we see its element.
+         atomicFence();
+         while(!mLockFreeFifo->hasNext())
+         {
+            if(end == 0)
+            {
+               mCondition.wait(mMutex);
+               continue;
+            }
+
+            const UInt64 now(Timer::getTimeMs());
+            if(now >= end || !mCondition.wait(mMutex, (unsigned int)(end - now)))
+            {
+               break;
+            }
+         }
+         atomicStore(mConsumerWaiting, (UInt32)0);
+         return mLockFreeFifo->hasNext();
+      }
+
+      void wakeLockFreeConsumer()
+      {
+         atomicFence();
+         if(atomicLoad(mConsumerWaiting))
+         {
+            Lock lock(mMutex); (void)lock;
+            mCondition.signal();
+         }
+      }
+
+      bool popLockFree(T& toReturn)
+      {
+         if(mLockFreeFifo->pop(toReturn))
+         {
+            onMessagePopped();
+            return true;
+         }
+         return false;
+      }
+
+      unsigned int popMultipleLockFree(Messages& other, unsigned int max)
+      {
+         unsigned int num=0;
+         T item;
+         while(num < max && mLockFreeFifo->pop(item))
+         {
+            other.push_back(item);
+            ++num;
+         }
+         if(num)
+         {
+            onMessagePopped(num);
+         }
+         return num;
+      }
+
+      /// @return The size of the fifo after the push.
+      size_t onMessagePushedLockFree(UInt32 num)
+      {
+         UInt32 oldSize = atomicFetchAdd(mSize, num);
+         if(oldSize == 0)
+         {
+            atomicStore(mLastSampleTakenMicroSec, Timer::getTimeMicroSec());
+         }
+         return oldSize + num;
+      }
+#endif
+
       /** @brief container for FIFO items */
       Messages mFifo;
       /** @brief access serialization lock */
@@ -425,18 +656,33 @@ class AbstractFifo : public FifoStatsInterface
       mutable UInt32 mAverageServiceTimeMicroSec;
       // std::deque has to perform some amount of traversal to calculate its 
       // size; we maintain this count so that it can be queried without locking, 
-      // in situations where it being off by a small amount is ok.
+      // in situations where it being off by a small amount is ok. In 
+      // lock-free mode, this is the authoritative count, and is only ever
+      // modified atomically.
       UInt32 mSize;
 
+      /** @brief element storage in lock-free mode, or 0 */
+      MpscQueue<T>* mLockFreeFifo;
+      /** @brief set while the lock-free consumer is asleep on mCondition */
+      UInt32 mConsumerWaiting;
+
       virtual void onFifoPolled()
       {
          // !bwc! TODO allow this sampling frequency to be tweaked
-         if(mLastSampleTakenMicroSec &&
+         bool fifoEmpty = mFifo.empty();
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            fifoEmpty = (atomicLoad(mSize) == 0);
+         }
+#endif
+         UInt64 lastSampleTaken = loadLastSampleTaken();
+         if(lastSampleTaken &&
             mCounter &&
-            (mCounter >= 64 || mFifo.empty()))
+            (mCounter >= 64 || fifoEmpty))
          {
             UInt64 now(Timer::getTimeMicroSec());
-            UInt64 diff = now-mLastSampleTakenMicroSec;
+            UInt64 diff = now-lastSampleTaken;
 
             if(mCounter >= 4096)
             {
@@ -451,14 +697,9 @@ class AbstractFifo : public FifoStatsInterface
                      4096U);
             }
             mCounter=0;
-            if(mFifo.empty())
-            {
-               mLastSampleTakenMicroSec=0;
-            }
-            else
-            {
-               mLastSampleTakenMicroSec=now;
-            }
+            // In lock-free mode, a producer may have found the fifo empty and
+            // started a new sample since we looked; if so, that one stands.
+            replaceLastSampleTaken(lastSampleTaken, fifoEmpty ? 0 : now);
          }
       }
 
@@ -469,6 +710,13 @@ class AbstractFifo : public FifoStatsInterface
       virtual void onMessagePopped(unsigned int num=1)
       {
          mCounter+=num;
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         if(mLockFreeFifo)
+         {
+            atomicFetchSub(mSize, (UInt32)num);
+            return;
+         }
+#endif
          mSize-=num;
       }
 
@@ -478,10 +726,30 @@ class AbstractFifo : public FifoStatsInterface
          {
             // Fifo went from empty to non-empty. Take a timestamp, and record
             // how long it takes to process some messages.
-            mLastSampleTakenMicroSec=Timer::getTimeMicroSec();
+            replaceLastSampleTaken(loadLastSampleTaken(), Timer::getTimeMicroSec());
          }
          mSize+=num;
       }
+
+      // mLastSampleTakenMicroSec is written by producers in lock-free mode,
+      // so it is only ever accessed atomically when we can.
+      UInt64 loadLastSampleTaken() const
+      {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         return atomicLoad(mLastSampleTakenMicroSec);
+#else
+         return mLastSampleTakenMicroSec;
+#endif
+      }
+
+      void replaceLastSampleTaken(UInt64 expected, UInt64 value) const
+      {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         atomicCompareAndSwap(mLastSampleTakenMicroSec, expected, value);
+#else
+         mLastSampleTakenMicroSec = value;
+#endif
+      }
    private:
       // no value semantics
       AbstractFifo(const AbstractFifo&);
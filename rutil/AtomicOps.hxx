@@ -0,0 +1,250 @@
+#if !defined(RESIP_ATOMICOPS_HXX)
+#define RESIP_ATOMICOPS_HXX
+
+#include "rutil/compat.hxx"
+
+/**
+   @file
+   @brief A minimal set of atomic operations on word-sized integers and
+   pointers, used to build the lock-free structures in rutil.
+
+   @details Loads have acquire semantics, stores have release semantics, and
+   the read-modify-write operations (exchange, fetch-add, compare-and-swap)
+   are full barriers. Only types whose size is 4 or 8 bytes are supported.
+
+   If the compiler provides no usable atomic primitives,
+   RESIP_HAVE_ATOMIC_OPS is left undefined, and code that relies on this file
+   must fall back to locking (see AbstractFifo::setLockFree() for an example).
+*/
+
+#if defined(__GNUC__) && (defined(__clang__) || (__GNUC__ > 4) || \
+                          (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#  define RESIP_HAVE_ATOMIC_OPS
+#  define RESIP_ATOMIC_OPS_GCC
+#elif defined(_MSC_VER)
+#  include <intrin.h>
+#  define RESIP_HAVE_ATOMIC_OPS
+#  define RESIP_ATOMIC_OPS_MSVC
+#endif
+
+#ifdef RESIP_HAVE_ATOMIC_OPS
+
+namespace resip
+{
+
+#ifdef RESIP_ATOMIC_OPS_MSVC
+// MSVC only gives us compare-and-swap on long and __int64, so everything
+// else is built on top of that. volatile reads/writes already have
+// acquire/release semantics with this compiler.
+template<int size> struct AtomicWord;
+
+template<> struct AtomicWord<4>
+{
+   typedef long type;
+   static type cas(volatile void* p, type desired, type expected)
+   {
+      return _InterlockedCompareExchange((volatile long*)p, desired, expected);
+   }
+};
+
+template<> struct AtomicWord<8>
+{
+   typedef __int64 type;
+   static type cas(volatile void* p, type desired, type expected)
+   {
+      return _InterlockedCompareExchange64((volatile __int64*)p, desired, expected);
+   }
+};
+
+template<typename T>
+union AtomicPun
+{
+   T value;
+   typename AtomicWord<sizeof(T)>::type word;
+};
+#endif
+
+/** Loads the value of v, with acquire semantics. */
+template<typename T>
+inline T
+atomicLoad(const volatile T& v)
+{
+#ifdef RESIP_ATOMIC_OPS_GCC
+   return __atomic_load_n(&v, __ATOMIC_ACQUIRE);
+#else
+   return v;
+#endif
+}
+
+/** Stores val into v, with release semantics. */
+template<typename T>
+inline void
+atomicStore(volatile T& v, T val)
+{
+#ifdef RESIP_ATOMIC_OPS_GCC
+   __atomic_store_n(&v, val, __ATOMIC_RELEASE);
+#else
+   v = val;
+#endif
+}
+
+/**
+   Sets v to desired iff v is equal to expected.
+   @return true iff the swap took place.
+*/
+template<typename T>
+inline bool
+atomicCompareAndSwap(volatile T& v, T expected, T desired)
+{
+#ifdef RESIP_ATOMIC_OPS_GCC
+   return __atomic_compare_exchange_n(&v, &expected, desired, false,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#else
+   AtomicPun<T> e, d;
+   e.value = expected;
+   d.value = desired;
+   return AtomicWord<sizeof(T)>::cas(&v, d.word, e.word) == e.word;
+#endif
+}
+
+/** Stores val into v, and returns the previous value of v. */
+template<typename T>
+inline T
+atomicExchange(volatile T& v, T val)
+{
+#ifdef RESIP_ATOMIC_OPS_GCC
+   return __atomic_exchange_n(&v, val, __ATOMIC_SEQ_CST);
+#else
+   T old(atomicLoad(v));
+   while(!atomicCompareAndSwap(v, old, val))
+   {
+      old = atomicLoad(v);
+   }
+   return old;
+#endif
+}
+
+/** Adds delta to v, and returns the previous value of v. */
+template<typename T>
+inline T
+atomicFetchAdd(volatile T& v, T delta)
+{
+#ifdef RESIP_ATOMIC_OPS_GCC
+   return __atomic_fetch_add(&v, delta, __ATOMIC_SEQ_CST);
+#else
+   T old(atomicLoad(v));
+   while(!atomicCompareAndSwap(v, old, (T)(old + delta)))
+   {
+      old = atomicLoad(v);
+   }
+   return old;
+#endif
+}
+
+/** Subtracts delta from v, and returns the previous value of v. */
+template<typename T>
+inline T
+atomicFetchSub(volatile T& v, T delta)
+{
+   return atomicFetchAdd(v, (T)(0 - delta));
+}
+
+/** Full memory barrier. */
+inline void
+atomicFence()
+{
+#ifdef RESIP_ATOMIC_OPS_GCC
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#else
+   MemoryBarrier();
+#endif
+}
+
+}
+
+#endif // RESIP_HAVE_ATOMIC_OPS
+
+namespace resip
+{
+
+/**
+   Loads and stores for a value that only one thread ever writes, while other
+   threads may read it (a per-thread counter, say). The writer needs no atomic
+   read-modify-write; these only keep readers from seeing a torn value.
+   Unlike the operations above, they are always available.
+*/
+template<typename T>
+inline T
+singleWriterLoad(const T& v)
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   return atomicLoad(v);
+#else
+   return *(const volatile T*)&v;
+#endif
+}
+
+template<typename T>
+inline void
+singleWriterStore(T& v, T val)
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   atomicStore(v, val);
+#else
+   *(volatile T*)&v = val;
+#endif
+}
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
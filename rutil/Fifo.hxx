@@ -23,6 +23,8 @@ class Fifo : public AbstractFifo<Msg*>
       using AbstractFifo<Msg*>::mCondition;
       using AbstractFifo<Msg*>::empty;
       using AbstractFifo<Msg*>::size;
+      using AbstractFifo<Msg*>::setLockFree;
+      using AbstractFifo<Msg*>::isLockFree;
 
       /// Add a message to the fifo.
       size_t add(Msg* msg);
@@ -51,7 +53,8 @@ class Fifo : public AbstractFifo<Msg*>
       void getMultiple(Messages& other, unsigned int max);
       bool getMultiple(int ms, Messages& other, unsigned int max);
 
-      /// delete all elements in the queue
+      /// delete all elements in the queue; in lock-free mode, this may only 
+      /// be called by the consumer thread
       virtual void clear();
       void setInterruptor(AsyncProcessHandler* interruptor);
 
@@ -88,6 +91,17 @@ template <class Msg>
 void
 Fifo<Msg>::clear()
 {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   if(isLockFree())
+   {
+      Msg* msg(0);
+      while(AbstractFifo<Msg*>::popLockFree(msg))
+      {
+         delete msg;
+      }
+      return;
+   }
+#endif
    Lock lock(mMutex); (void)lock;
    while ( ! mFifo.empty() )
    {
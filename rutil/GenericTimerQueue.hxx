@@ -2,12 +2,23 @@
 #define RUTIL_GENERICTIMERQUEUE_HXX
 
 #include "rutil/Timer.hxx"
-#include <set>
+#include "rutil/TimingWheel.hxx"
+#include <cassert>
+#include <climits>
 #include <vector>
 
 namespace resip {
 
 // !dcm! -- hoist?
+/**
+   @brief A queue of timers that carry heap-allocated events of type T.
+
+   @details Timers are held in a TimingWheel, so add() and cancel() are O(1),
+   expiry is amortized O(1), and no allocation takes place once the queue
+   has reached its working size. The queue owns the events it holds; an
+   event is handed to processTimer() when its timer fires, and is deleted if
+   its timer is cancelled or still pending when the queue is destroyed.
+*/
 template<class T>
 class GenericTimerQueue
 {
@@ -28,6 +39,11 @@ class GenericTimerQueue
             {
                return mEvent;
             }
+
+            UInt64 getWhen() const
+            {
+               return mWhen;
+            }
             
             bool operator<(const TimerEntry<E>& rhs) const
             {
@@ -36,62 +52,80 @@ class GenericTimerQueue
             UInt64 mWhen;
             E* mEvent;
       };
+
+      typedef typename TimingWheel<TimerEntry<T> >::Id Id;
+
+      GenericTimerQueue() :
+         mTimers(Timer::getTimeMs())
+      {
+      }
            
       /// deletes the message associated with the timer as well.
       virtual ~GenericTimerQueue()
       {
-         for (typename std::multiset<TimerEntry<T> >::iterator i = mTimers.begin(); i !=  mTimers.end(); ++i)
+         const TimerEntry<T>* timer;
+         while ((timer = mTimers.nextExpired(~UInt64(0))) != 0)
          {
-            delete i->mEvent;            
+            delete timer->mEvent;
+            mTimers.popExpired();
          }
       }
       
       virtual void process()
       {
-         if (!mTimers.empty() && msTillNextTimer() == 0)
+         // Everything that is due is taken off the wheel before any of it is
+         // processed, so that timers added from processTimer() wait for the
+         // next pass. mFired is reused from one pass to the next.
+         UInt64 now = Timer::getTimeMs();
+         const TimerEntry<T>* timer;
+         while ((timer = mTimers.nextExpired(now)) != 0)
          {
-            TimerEntry<T> now(0, 0);
-
-            // hacky solution, needs work, insertion from processTimer
-            // caused bizarre infinite loop issues in previous revision;
-            // this code is in desperate need of help
-            typedef typename std::multiset<TimerEntry<T> > TimerSet;
-            typedef std::vector<typename TimerSet::iterator> ItVector;
-            ItVector iterators;
+            assert(timer->getEvent());
+            mFired.push_back(timer->getEvent());
+            mTimers.popExpired();
+         }
 
-            typename TimerSet::iterator end = mTimers.upper_bound(now);
-            typename TimerSet::iterator begin = mTimers.begin();
+         for (typename std::vector<T*>::iterator i = mFired.begin(); i != mFired.end(); ++i)
+         {
+            processTimer(*i);
+         }
+         mFired.clear();
+      }
 
-            for (typename TimerSet::iterator i = begin; i != end; ++i)
-            {
-               iterators.push_back(i);
-            }
+      virtual void processTimer(T*)=0;      
 
-            for (typename ItVector::iterator i = iterators.begin(); i != iterators.end(); ++i)
-            {
-               assert((*i)->getEvent());
-               processTimer((*i)->getEvent());               
-            }
+      /**
+         Schedules event to be passed to processTimer() in msOffset ms.
+         @return An id that can be used to cancel the timer.
+      */
+      Id add(T* event, unsigned long msOffset)
+      {
+         return mTimers.add(TimerEntry<T>(msOffset, event));
+      }
 
-            //!dcm! -- erasing the range didn't work...upper bound was prob. end()
-            for (typename ItVector::iterator i = iterators.begin(); i != iterators.end(); ++i)
-            {
-               mTimers.erase(*i);
-            }
+      /**
+         Cancels a pending timer, and deletes its event.
+         @return false if the timer has already fired or been cancelled.
+      */
+      bool cancel(const Id& id)
+      {
+         if (!mTimers.pending(id))
+         {
+            return false;
          }
+         delete mTimers.get(id).mEvent;
+         return mTimers.cancel(id);
       }
 
-      virtual void processTimer(T*)=0;      
-
-	  void add(T* event, unsigned long msOffset)
-	  {
-   	      TimerEntry<T> t(msOffset, event);
-		  mTimers.insert(t);
-	  }
+      /// @return true iff the timer has neither fired nor been cancelled
+      bool pending(const Id& id) const
+      {
+         return mTimers.pending(id);
+      }
 
       int size() const
       {
-         return mTimers.size();
+         return (int)mTimers.size();
       }
       
       bool empty() const
@@ -103,7 +137,7 @@ class GenericTimerQueue
       {
          if (!mTimers.empty())
          {
-            UInt64 next = mTimers.begin()->mWhen;
+            UInt64 next = mTimers.top().mWhen;
             UInt64 now = Timer::getTimeMs();
             if (now > next) 
             {
@@ -132,7 +166,8 @@ class GenericTimerQueue
       
    protected:
 //      friend std::ostream& operator<<(std::ostream&, const GenericTimerQueue&);
-      std::multiset<TimerEntry<T> > mTimers;
+      TimingWheel<TimerEntry<T> > mTimers;
+      std::vector<T*> mFired;
 };
 
 }
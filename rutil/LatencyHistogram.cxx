@@ -0,0 +1,196 @@
+#include <cstring>
+
+#include "rutil/LatencyHistogram.hxx"
+
+using namespace resip;
+
+LatencyHistogram::LatencyHistogram() :
+   mSum(0)
+{
+   memset(mCounts, 0, sizeof(mCounts));
+}
+
+void
+LatencyHistogram::merge(const LatencyHistogram& rhs)
+{
+   for(unsigned int i = 0; i < BucketCount; ++i)
+   {
+      mCounts[i] += rhs.bucketCount(i);
+   }
+   mSum += rhs.sum();
+}
+
+void
+LatencyHistogram::subtract(const LatencyHistogram& rhs)
+{
+   for(unsigned int i = 0; i < BucketCount; ++i)
+   {
+      mCounts[i] -= rhs.bucketCount(i);
+   }
+   mSum -= rhs.sum();
+}
+
+void
+LatencyHistogram::clear()
+{
+   memset(mCounts, 0, sizeof(mCounts));
+   mSum = 0;
+}
+
+UInt64
+LatencyHistogram::count() const
+{
+   UInt64 total = 0;
+   for(unsigned int i = 0; i < BucketCount; ++i)
+   {
+      total += bucketCount(i);
+   }
+   return total;
+}
+
+UInt64
+LatencyHistogram::mean() const
+{
+   UInt64 samples = count();
+   return samples ? sum() / samples : 0;
+}
+
+UInt64
+LatencyHistogram::max() const
+{
+   for(unsigned int i = BucketCount; i > 0; --i)
+   {
+      if(bucketCount(i - 1))
+      {
+         return highestValue(i - 1);
+      }
+   }
+   return 0;
+}
+
+UInt64
+LatencyHistogram::valueAtPercentile(double percentile) const
+{
+   UInt64 samples = count();
+   if(samples == 0)
+   {
+      return 0;
+   }
+
+   UInt64 wanted = (UInt64)(percentile * samples / 100.0 + 0.5);
+   if(wanted == 0)
+   {
+      wanted = 1;
+   }
+
+   UInt64 seen = 0;
+   for(unsigned int i = 0; i < BucketCount; ++i)
+   {
+      seen += bucketCount(i);
+      if(seen >= wanted)
+      {
+         return highestValue(i);
+      }
+   }
+   return max();
+}
+
+unsigned int
+LatencyHistogram::bucketIndex(UInt64 value)
+{
+   if(value < SubBuckets)
+   {
+      return (unsigned int)value;
+   }
+
+   const UInt64 limit = UInt64(1) << MaxValueBits;
+   if(value >= limit)
+   {
+      value = limit - 1;
+   }
+
+   unsigned int topBit = SubBucketBits;
+   while((value >> (topBit + 1)) != 0)
+   {
+      ++topBit;
+   }
+
+   // value >> shift is in [HalfBuckets, SubBuckets)
+   unsigned int shift = topBit - SubBucketBits + 1;
+   return SubBuckets + (shift - 1) * HalfBuckets
+      + (unsigned int)(value >> shift) - HalfBuckets;
+}
+
+UInt64
+LatencyHistogram::lowestValue(unsigned int i)
+{
+   if(i < SubBuckets)
+   {
+      return i;
+   }
+   unsigned int shift = (i - SubBuckets) / HalfBuckets + 1;
+   UInt64 top = HalfBuckets + (i - SubBuckets) % HalfBuckets;
+   return top << shift;
+}
+
+UInt64
+LatencyHistogram::highestValue(unsigned int i)
+{
+   if(i < SubBuckets)
+   {
+      return i;
+   }
+   unsigned int shift = (i - SubBuckets) / HalfBuckets + 1;
+   UInt64 top = HalfBuckets + (i - SubBuckets) % HalfBuckets;
+   return ((top + 1) << shift) - 1;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
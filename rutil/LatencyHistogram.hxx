@@ -0,0 +1,143 @@
+#if !defined(RESIP_LATENCYHISTOGRAM_HXX)
+#define RESIP_LATENCYHISTOGRAM_HXX
+
+#include "rutil/AtomicOps.hxx"
+#include "rutil/compat.hxx"
+
+namespace resip
+{
+
+/**
+   @brief Something that wants to be told how long things took; for instance
+   a fifo reporting how long each element waited in it (see
+   TimeLimitFifo::setLatencyRecorder()).
+*/
+class LatencyRecorder
+{
+   public:
+      virtual ~LatencyRecorder() {}
+      virtual void recordLatency(UInt64 microSec) = 0;
+};
+
+/**
+   @brief A histogram of non-negative integer samples (typically latencies in
+   microseconds) whose buckets grow with the value, in the style of
+   HdrHistogram.
+
+   @details Values below 2^SubBucketBits each get a bucket of their own.
+   Above that, every power of two is split into 2^(SubBucketBits-1) equally
+   sized buckets, so any recorded value is known to within about 3%, at a
+   fixed cost of about 2kB whatever the range. Values of 2^MaxValueBits or
+   more (19 hours, for microseconds) are counted in the last bucket.
+
+   One thread at a time may record() into a histogram, while others read it
+   (merge() it into theirs, ask for percentiles); every count is read and
+   written whole, so readers see a histogram that is at most a few samples
+   behind. This is what lets the StatisticsManager keep one histogram per
+   thread and add them up when asked.
+*/
+class LatencyHistogram
+{
+   public:
+      enum
+      {
+         SubBucketBits = 5,
+         SubBuckets = 1 << SubBucketBits,
+         HalfBuckets = SubBuckets / 2,
+         MaxValueBits = 36,
+         BucketCount = SubBuckets + (MaxValueBits - SubBucketBits) * HalfBuckets
+      };
+
+      LatencyHistogram();
+
+      void record(UInt64 value)
+      {
+         UInt32& bucket = mCounts[bucketIndex(value)];
+         singleWriterStore(bucket, singleWriterLoad(bucket) + 1);
+         singleWriterStore(mSum, singleWriterLoad(mSum) + value);
+      }
+
+      /// Adds the samples in rhs to this histogram.
+      void merge(const LatencyHistogram& rhs);
+      /// Removes the samples in rhs (an earlier copy of this histogram, say).
+      void subtract(const LatencyHistogram& rhs);
+      void clear();
+
+      UInt64 count() const;
+      UInt64 sum() const { return singleWriterLoad(mSum); }
+      UInt64 mean() const;
+      /// The largest value recorded (to within the bucket size), or 0.
+      UInt64 max() const;
+      /**
+         The value that percentile percent of the samples are less than or
+         equal to (to within the bucket size), or 0 if there are no samples.
+      */
+      UInt64 valueAtPercentile(double percentile) const;
+
+      /// Number of samples in bucket i
+      UInt32 bucketCount(unsigned int i) const { return singleWriterLoad(mCounts[i]); }
+
+      static unsigned int bucketIndex(UInt64 value);
+      /// Smallest value that is counted in bucket i
+      static UInt64 lowestValue(unsigned int i);
+      /// Largest value that is counted in bucket i
+      static UInt64 highestValue(unsigned int i);
+
+   private:
+      UInt32 mCounts[BucketCount];
+      UInt64 mSum;
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -1,9 +1,12 @@
 #include "rutil/Socket.hxx"
 
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <stdio.h>
+#include <vector>
 #include "rutil/Data.hxx"
 
 #ifndef WIN32
@@ -13,12 +16,17 @@
 #include <sys/types.h>
 #include <time.h>
 
+#include "rutil/AtomicOps.hxx"
+#include "rutil/Condition.hxx"
+#include "rutil/DataStream.hxx"
 #include "rutil/Log.hxx"
 #include "rutil/Logger.hxx"
 #include "rutil/ParseBuffer.hxx"
 #include "rutil/ThreadIf.hxx"
+#include "rutil/ThreadRecordRings.hxx"
 #include "rutil/Subsystem.hxx"
 #include "rutil/SysLogStream.hxx"
+#include "rutil/Time.hxx"
 #include "rutil/WinLeakCheck.hxx"
 
 using namespace resip;
@@ -55,6 +63,10 @@ HashMap<int, Log::Level> Log::mServiceToLevel;
 Log::LocalLoggerMap Log::mLocalLoggerMap;
 ThreadIf::TlsKey* Log::mLocalLoggerKey;
 
+Log::AsyncWriter* Log::mAsyncWriter = 0;
+volatile bool Log::mAsync = false;
+static Mutex asyncMutex;
+
 const char
 Log::mDescriptions[][32] = {"NONE", "EMERG", "ALERT", "CRIT", "ERR", "WARNING", "NOTICE", "INFO", "DEBUG", "STACK", "CERR", ""}; 
 
@@ -76,8 +88,223 @@ extern "C"
          Log::mLocalLoggerMap.decreaseUseCount((static_cast<Log::ThreadData*>(pThreadData))->id());
       }
    }
+
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   static void stopAsyncAtExit()
+   {
+      Log::setAsync(false);
+   }
+#endif
 }
 
+#ifdef RESIP_HAVE_ATOMIC_OPS
+class Log::AsyncWriter
+{
+   public:
+      AsyncWriter() :
+         mThread(0),
+         mRunning(false),
+         mBlockWhenFull(false),
+         mBuffers(4096),
+         mDropped(0),
+         mDroppedReported(0)
+      {}
+
+      ~AsyncWriter()
+      {
+         stop();
+      }
+
+      void configure(AsyncOverflow overflow, unsigned int bufferSize)
+      {
+         unsigned int size = 4096;
+         while (size < bufferSize && size < 0x80000000U)
+         {
+            size <<= 1;
+         }
+         // Only affects buffers created from now on
+         mBuffers.setRingSize(size);
+         mBlockWhenFull = (overflow == BlockWhenFull);
+      }
+
+      bool post(Level level, const Data& line)
+      {
+         RecordRing* buffer = &mBuffers.ring();
+         if (line.size() > buffer->maxRecordSize())
+         {
+            return false;
+         }
+
+         const unsigned long used = buffer->used();
+         while (!buffer->push(level, line.data(), line.size()))
+         {
+            wake();
+            if (!mBlockWhenFull)
+            {
+               atomicFetchAdd(mDropped, 1UL);
+               return true;
+            }
+            if (!atomicLoad(Log::mAsync) || !atomicLoad(mRunning))
+            {
+               // Nothing will make room; write this one synchronously
+               return false;
+            }
+            sleepMs(1);
+         }
+         if (used < buffer->capacity()/2 && buffer->used() >= buffer->capacity()/2)
+         {
+            // Don't wait for the writer's next pass
+            wake();
+         }
+         return true;
+      }
+
+      unsigned long dropped() const
+      {
+         return atomicLoad(mDropped);
+      }
+
+      void wake()
+      {
+         Lock lock(mWakeMutex);
+         mWakeCondition.signal();
+      }
+
+      void start()
+      {
+         if (mThread == 0)
+         {
+            mThread = new WriterThread(*this);
+            mThread->run();
+            atomicStore(mRunning, true);
+         }
+      }
+
+      // Stops the writer thread, once it has written out what is queued
+      void stop()
+      {
+         if (mThread)
+         {
+            atomicStore(mRunning, false);
+            mThread->shutdown();
+            wake();
+            mThread->join();
+            delete mThread;
+            mThread = 0;
+         }
+      }
+
+      // Writes out everything queued so far, in one batch per buffer.
+      void drain()
+      {
+         Lock drainLock(mDrainMutex);
+
+         LineWriter writer;
+         mBuffers.consume(writer);
+
+         const unsigned long dropped = atomicLoad(mDropped);
+         if (dropped != mDroppedReported)
+         {
+            Data line;
+            {
+               DataStream strm(line);
+               Log::tags(Log::Warning, Subsystem::NONE, __FILE__, __LINE__, strm);
+               strm << Log::delim << "Asynchronous log buffer full, dropped "
+                    << dropped - mDroppedReported << " lines";
+            }
+            mDroppedReported = dropped;
+            writer(Log::Warning, line.data(), line.size());
+         }
+      }
+
+   private:
+      class WriterThread : public ThreadIf
+      {
+         public:
+            WriterThread(AsyncWriter& writer) : mWriter(writer) {}
+
+            virtual void thread()
+            {
+               while (!isShutdown())
+               {
+                  mWriter.drain();
+                  Lock lock(mWriter.mWakeMutex);
+                  if (!isShutdown())
+                  {
+                     mWriter.mWakeCondition.wait(mWriter.mWakeMutex, 20);
+                  }
+               }
+               mWriter.drain();
+            }
+
+         private:
+            AsyncWriter& mWriter;
+      };
+
+      // Writes records to the default logger, holding Log::_mutex from the
+      // first record to the end of the batch.
+      class LineWriter
+      {
+         public:
+            LineWriter() : mLock(0), mStream(0) {}
+            ~LineWriter()
+            {
+               if (mStream)
+               {
+                  mStream->flush();
+               }
+               delete mLock;
+            }
+
+            void operator()(int level, const char* data, unsigned long size)
+            {
+               if (!mLock)
+               {
+                  mLock = new Lock(Log::_mutex);
+               }
+               std::ostream& strm = Log::mDefaultLoggerData.Instance((unsigned int)size + 2);
+               if (Log::mDefaultLoggerData.type() == Log::Syslog)
+               {
+                  // endl is magic in syslog -- every line must have one
+                  strm << (Level)level;
+                  strm.write(data, size);
+                  strm << std::endl;
+                  mStream = 0;
+               }
+               else
+               {
+                  if (mStream && mStream != &strm)
+                  {
+                     // the log file was rotated
+                     mStream = 0;
+                  }
+                  strm.write(data, size);
+                  strm << '\n';
+                  mStream = &strm;
+               }
+            }
+
+         private:
+            Lock* mLock;
+            std::ostream* mStream;
+      };
+
+      WriterThread* mThread;
+      volatile bool mRunning;
+      volatile bool mBlockWhenFull;
+      ThreadRecordRings mBuffers;
+      volatile unsigned long mDropped;
+      unsigned long mDroppedReported;
+      Mutex mDrainMutex;
+      Mutex mWakeMutex;
+      Condition mWakeCondition;
+};
+#else
+class Log::AsyncWriter
+{
+};
+#endif
+
 unsigned int LogStaticInitializer::mInstanceCounter=0;
 LogStaticInitializer::LogStaticInitializer()
 {
@@ -103,6 +330,10 @@ LogStaticInitializer::~LogStaticInitializer()
 
       ThreadIf::tlsKeyDelete(*Log::mLocalLoggerKey);
       delete Log::mLocalLoggerKey;
+
+      // The writer thread was stopped at exit, see Log::setAsync()
+      delete Log::mAsyncWriter;
+      Log::mAsyncWriter = 0;
    }
 }
 
@@ -117,16 +348,30 @@ Log::initialize(const Data& typed, const Data& leveld, const Data& appName,
                 const char *logFileName, ExternalLogger* externalLogger,
                 const Data& syslogFacilityName)
 {
+   static const Data asyncSuffix("-async");
+   Data typeName(typed);
+   bool async = false;
+   if (typeName.size() > asyncSuffix.size() &&
+       isEqualNoCase(typeName.substr(typeName.size() - asyncSuffix.size()), asyncSuffix))
+   {
+      typeName = typeName.substr(0, typeName.size() - asyncSuffix.size());
+      async = true;
+   }
+
    Type type = Log::Cout;
-   if (isEqualNoCase(typed, "cout")) type = Log::Cout;
-   else if (isEqualNoCase(typed, "cerr")) type = Log::Cerr;
-   else if (isEqualNoCase(typed, "file")) type = Log::File;
+   if (isEqualNoCase(typeName, "cout")) type = Log::Cout;
+   else if (isEqualNoCase(typeName, "cerr")) type = Log::Cerr;
+   else if (isEqualNoCase(typeName, "file")) type = Log::File;
    else type = Log::Syslog;
    
    Level level = Log::Info;
    level = toLevel(leveld);
 
    Log::initialize(type, level, appName, logFileName, externalLogger, syslogFacilityName);
+   if (async != isAsync())
+   {
+      setAsync(async);
+   }
 }
 
 int
@@ -836,6 +1081,81 @@ void Log::LocalLoggerMap::decreaseUseCount(Log::LocalLoggerId loggerId)
 }
 
 
+void
+Log::setAsync(bool enable, AsyncOverflow overflow, unsigned int bufferSize)
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   Lock lock(asyncMutex);
+   if (enable)
+   {
+      if (mAsyncWriter == 0)
+      {
+         mAsyncWriter = new AsyncWriter;
+         // Stop the writer, and write out what is left, before the default
+         // logger is destroyed.
+         atexit(stopAsyncAtExit);
+      }
+      mAsyncWriter->configure(overflow, bufferSize);
+      mAsyncWriter->start();
+      atomicStore(mAsync, true);
+   }
+   else if (atomicLoad(mAsync))
+   {
+      // The writer is kept, since threads may still be holding buffers; lines
+      // that race with this are written out by flushAsync(), or when
+      // asynchronous mode is enabled again.
+      atomicStore(mAsync, false);
+      mAsyncWriter->stop();
+   }
+#else
+   if (enable)
+   {
+      std::cerr << "Asynchronous logging is not supported on this platform" << std::endl;
+   }
+#endif
+}
+
+bool
+Log::isAsync()
+{
+   return mAsync;
+}
+
+unsigned long
+Log::asyncDroppedLines()
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   return mAsyncWriter ? mAsyncWriter->dropped() : 0;
+#else
+   return 0;
+#endif
+}
+
+void
+Log::flushAsync()
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   if (mAsyncWriter)
+   {
+      mAsyncWriter->drain();
+   }
+#endif
+}
+
+bool
+Log::postAsync(Level level, const Data& line)
+{
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   if (!atomicLoad(mAsync) || &getLoggerData() != &mDefaultLoggerData)
+   {
+      return false;
+   }
+   return mAsyncWriter->post(level, line);
+#else
+   return false;
+#endif
+}
+
 Log::Guard::Guard(resip::Log::Level level,
                   const resip::Subsystem& subsystem,
                   const char* file,
@@ -891,6 +1211,11 @@ Log::Guard::~Guard()
       return;
    }
 
+   if (logType != resip::Log::VSDebugWindow && resip::Log::postAsync(mLevel, mData))
+   {
+      return;
+   }
+
    resip::Lock lock(resip::Log::_mutex);
    // !dlb! implement VSDebugWindow as an external logger
    if (logType == resip::Log::VSDebugWindow)
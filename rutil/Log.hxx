@@ -189,6 +189,43 @@ class Log
                              ExternalLogger& logger,
                              const Data& syslogFacility = "LOG_DAEMON");
 
+      /// What asynchronous logging does when a thread's buffer is full
+      enum AsyncOverflow
+      {
+         DropWhenFull,   ///< discard the line, and count it (see asyncDroppedLines())
+         BlockWhenFull   ///< wait for the writer thread to make room; if
+                         ///< asynchronous mode is disabled meanwhile, write
+                         ///< the line synchronously
+      };
+
+      /**
+         @brief Moves writing of log output off the logging threads.
+
+         @details In asynchronous mode, a thread still formats its log lines
+         itself, but then copies them into a lock-free buffer of its own rather
+         than writing them out while holding the global log mutex. A background
+         thread drains all of the buffers, in batches, to the default logger.
+         Lines logged by threads with a local logger, and lines that do not fit
+         in half a buffer, are still written synchronously.
+
+         Log::initialize(const Data& type, ...) enables this when the type has
+         an "-async" suffix (e.g. "file-async"), and disables it otherwise.
+
+         Requires atomic operations (see rutil/AtomicOps.hxx); without them
+         this has no effect.
+
+         @param bufferSize size in bytes of each thread's buffer, rounded up to
+         a power of two.
+      */
+      static void setAsync(bool enable,
+                           AsyncOverflow overflow = DropWhenFull,
+                           unsigned int bufferSize = 1024*1024);
+      static bool isAsync();
+      /// Number of lines discarded because a buffer was full
+      static unsigned long asyncDroppedLines();
+      /// Writes out everything that has been logged asynchronously so far
+      static void flushAsync();
+
       /** @brief Set logging level for current thread.
       * If thread has no local logger attached, then set global logging level.
       */
@@ -403,6 +440,13 @@ class Log
       static LocalLoggerMap mLocalLoggerMap;
       static ThreadIf::TlsKey* mLocalLoggerKey;
 
+      /// Background writer for asynchronous logging, see setAsync()
+      class AsyncWriter;
+      static AsyncWriter* mAsyncWriter;
+      static volatile bool mAsync;
+      /// Queues a line for the AsyncWriter, returns false if it must be written synchronously
+      static bool postAsync(Level level, const Data& line);
+
 
       /// DEPRECATED! Left for backward compatibility - use localLoggers instead
 #ifdef LOG_ENABLE_THREAD_SETTING
@@ -0,0 +1,204 @@
+#if !defined(RESIP_MPSCQUEUE_HXX)
+#define RESIP_MPSCQUEUE_HXX
+
+#include <cassert>
+#include "rutil/AtomicOps.hxx"
+
+#ifdef RESIP_HAVE_ATOMIC_OPS
+
+namespace resip
+{
+
+/**
+   @brief An unbounded, lock-free, multiple-producer/single-consumer queue.
+
+   @details This is a linked list with a dummy node (see Dmitry Vyukov's
+   "Intrusive MPSC node-based queue"). Producers never contend on anything
+   but a single atomic exchange of the head pointer, and the consumer never
+   executes an atomic read-modify-write at all.
+
+   push() and pushMultiple() may be called from any number of threads. pop()
+   and hasNext() must only ever be called from a single thread at a time.
+
+   There is a short window between a producer swinging the head pointer and
+   linking the previous node, during which the consumer will not see the new
+   element (or any element pushed after it). The element becomes visible as
+   soon as the producer finishes push(), so callers that need to block must
+   wait for a notification from the producer, and not spin on pop().
+
+   @note This does no blocking, and keeps no count; see AbstractFifo for that.
+   @ingroup message_passing
+*/
+template<typename T>
+class MpscQueue
+{
+   public:
+      MpscQueue() :
+         mHead(&mStub),
+         mTail(&mStub)
+      {
+         mStub.mNext = 0;
+      }
+
+      ~MpscQueue()
+      {
+         T discard;
+         while(pop(discard))
+         {}
+
+         if(mTail != &mStub)
+         {
+            delete mTail;
+         }
+      }
+
+      /// Appends a single element.
+      void push(const T& item)
+      {
+         Node* node = new Node(item);
+         link(node, node);
+      }
+
+      /**
+         Appends a sequence of elements with a single atomic operation; the
+         elements will be adjacent in the queue.
+         @param begin An iterator to the first element to append.
+         @param end An iterator one past the last element to append.
+         @return The number of elements appended.
+      */
+      template<typename InputIterator>
+      size_t pushMultiple(InputIterator begin, InputIterator end)
+      {
+         if(begin == end)
+         {
+            return 0;
+         }
+
+         size_t count = 1;
+         Node* first = new Node(*begin);
+         Node* last = first;
+         for(++begin; begin != end; ++begin, ++count)
+         {
+            last->mNext = new Node(*begin);
+            last = last->mNext;
+         }
+         link(first, last);
+         return count;
+      }
+
+      /**
+         Removes the element at the front of the queue.
+         @param item Set to the removed element, if there is one.
+         @return false iff there was no element visible.
+      */
+      bool pop(T& item)
+      {
+         Node* tail = mTail;
+         Node* next = atomicLoad(tail->mNext);
+         if(!next)
+         {
+            return false;
+         }
+
+         // next becomes the new dummy node; we steal its value.
+         item = next->mValue;
+         next->mValue = T();
+         mTail = next;
+         if(tail != &mStub)
+         {
+            delete tail;
+         }
+         return true;
+      }
+
+      /// @return true iff pop() would succeed.
+      bool hasNext() const
+      {
+         return atomicLoad(mTail->mNext) != 0;
+      }
+
+   private:
+      class Node
+      {
+         public:
+            Node() : mNext(0), mValue() {}
+            explicit Node(const T& value) : mNext(0), mValue(value) {}
+
+            Node* volatile mNext;
+            T mValue;
+      };
+
+      void link(Node* first, Node* last)
+      {
+         Node* prev = atomicExchange(mHead, last);
+         atomicStore(prev->mNext, first);
+      }
+
+      // Written by producers only. Keep the two ends on separate cache lines
+      // so producers and the consumer do not bounce the same line around.
+      Node* volatile mHead;
+      char mPad[64 - sizeof(Node*)];
+      // Owned by the consumer.
+      Node* mTail;
+      Node mStub;
+
+      // no value semantics
+      MpscQueue(const MpscQueue&);
+      MpscQueue& operator=(const MpscQueue&);
+};
+
+}
+
+#endif // RESIP_HAVE_ATOMIC_OPS
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -4,6 +4,7 @@
 
 #include <cassert>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef WIN32
 #include "rutil/Socket.hxx"
@@ -63,6 +64,28 @@ struct random_data* Random::sRandomState = 0;
 ThreadIf::TlsKey Random::sRandomStateKey = 0;
 #endif
 
+#ifdef RESIP_RANDOM_THREAD_FAST
+ThreadIf::TlsKey Random::sThreadStateKey = 0;
+UInt64 Random::sSeed = 0;
+UInt64 Random::sThreadCount = 0;
+
+static inline UInt64
+rotl(UInt64 x, int k)
+{
+   return (x << k) | (x >> (64 - k));
+}
+
+// splitmix64; used to spread one seed over a generator's state
+static inline UInt64
+splitmix(UInt64& x)
+{
+   UInt64 z = (x += 0x9E3779B97F4A7C15ULL);
+   z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+   return z ^ (z >> 31);
+}
+#endif
+
 #define RANDOM_STATE_SIZE 128
 
 const char*
@@ -75,7 +98,9 @@ Random::getImplName()
    return "win32_rand";
 #endif
 #else // WIN32
-#if defined(RESIP_RANDOM_THREAD_LOCAL)
+#if defined(RESIP_RANDOM_THREAD_FAST)
+   return "posix_thread_fast";
+#elif defined(RESIP_RANDOM_THREAD_LOCAL)
    return "posix_thread_local";
 #elif defined(RESIP_RANDOM_THREAD_MUTEX)
    return "posix_thread_mutex";
@@ -179,7 +204,10 @@ Random::initialize()
 
          unsigned seed = getSimpleSeed();
 
-#if defined(RESIP_RANDOM_THREAD_LOCAL)
+#if defined(RESIP_RANDOM_THREAD_FAST)
+         ThreadIf::tlsKeyCreate(sThreadStateKey, ::free);
+         sSeed = ((UInt64)seed << 32) ^ ResipClock::getTimeMicroSec();
+#elif defined(RESIP_RANDOM_THREAD_LOCAL)
          ThreadIf::tlsKeyCreate(sRandomStateKey, ::free);
 #elif defined(RESIP_RANDOM_THREAD_MUTEX)
          struct random_data *buf;
@@ -203,6 +231,13 @@ Random::initialize()
             {
                ErrLog( << "System is short of randomness" ); // !ah! never prints
             }
+#if defined(RESIP_RANDOM_THREAD_FAST)
+            UInt64 devSeed;
+            if ( read( fd,&devSeed,sizeof(devSeed) ) == sizeof(devSeed) )
+            {
+               sSeed ^= devSeed;
+            }
+#endif
          }
          else
          {
@@ -278,7 +313,9 @@ Random::getRandom()
    return ret;
 #else	// WIN32
 
-#if defined(RESIP_RANDOM_THREAD_LOCAL)
+#if defined(RESIP_RANDOM_THREAD_FAST)
+   return (int)(next(getThreadState()) >> 33);
+#elif defined(RESIP_RANDOM_THREAD_LOCAL)
    struct random_data *buf = (struct random_data*) ThreadIf::tlsGetValue(sRandomStateKey);
    if ( buf==NULL ) {
       size_t sz = sizeof(*buf)+RANDOM_STATE_SIZE;
@@ -332,23 +369,86 @@ Random::getCryptoRandom()
 #endif
 }
 
-Data 
-Random::getRandom(unsigned int len)
+#ifdef RESIP_RANDOM_THREAD_FAST
+UInt64
+Random::next(UInt64* state)
+{
+   // xoroshiro128**
+   const UInt64 s0 = state[0];
+   UInt64 s1 = state[1];
+   const UInt64 result = rotl(s0 * 5, 7) * 9;
+   s1 ^= s0;
+   state[0] = rotl(s0, 24) ^ s1 ^ (s1 << 16);
+   state[1] = rotl(s1, 37);
+   return result;
+}
+
+UInt64*
+Random::getThreadState()
+{
+   UInt64* state = (UInt64*) ThreadIf::tlsGetValue(sThreadStateKey);
+   if ( state==NULL )
+   {
+      // Every thread starts from a different point of the process seed;
+      // the count keeps two threads from ever being handed the same one.
+      UInt64 x;
+      {
+         Lock lock(mMutex);
+         x = sSeed ^ (++sThreadCount << 32) ^ getSimpleSeed();
+      }
+      // a cache line's worth, so that threads never write to the same one
+      state = (UInt64*) ::malloc(64);
+      state[0] = splitmix(x);
+      state[1] = splitmix(x);
+      ThreadIf::tlsSetValue(sThreadStateKey, state);
+   }
+   return state;
+}
+#endif
+
+void
+Random::getRandom(unsigned char* buf, unsigned int numBytes)
 {
    initialize();
-   assert(len < Random::maxLength+1);
-   
-   union 
+
+#if defined(RESIP_RANDOM_THREAD_FAST)
+   UInt64* state = getThreadState();
+   while (numBytes >= sizeof(UInt64))
    {
-         char cbuf[Random::maxLength+1];
-         unsigned int  ibuf[(Random::maxLength+1)/sizeof(int)];
-   };
-   
-   for (unsigned int count=0; count<(len+sizeof(int)-1)/sizeof(int); ++count)
+      UInt64 r = next(state);
+      memcpy(buf, &r, sizeof(r));
+      buf += sizeof(r);
+      numBytes -= sizeof(r);
+   }
+   if (numBytes)
+   {
+      UInt64 r = next(state);
+      memcpy(buf, &r, numBytes);
+   }
+#else
+   while (numBytes >= sizeof(int))
    {
-      ibuf[count] = Random::getRandom();
+      int r = Random::getRandom();
+      memcpy(buf, &r, sizeof(r));
+      buf += sizeof(r);
+      numBytes -= sizeof(r);
    }
-   return Data(cbuf, len);
+   if (numBytes)
+   {
+      int r = Random::getRandom();
+      memcpy(buf, &r, numBytes);
+   }
+#endif
+}
+
+Data 
+Random::getRandom(unsigned int len)
+{
+   assert(len < Random::maxLength+1);
+   
+   char buf[Random::maxLength];
+   getRandom((unsigned char*)buf, len);
+   return Data(buf, len);
 }
 
 Data 
@@ -359,16 +459,24 @@ Random::getCryptoRandom(unsigned int len)
    return Data(Data::Take, (char*)buf, len);
 }
 
+// The raw bytes never need to be a Data of their own; encode them straight
+// out of a stack buffer.
 Data 
 Random::getRandomHex(unsigned int numBytes)
 {
-   return Random::getRandom(numBytes).hex();
+   assert(numBytes < Random::maxLength+1);
+   char buf[Random::maxLength];
+   getRandom((unsigned char*)buf, numBytes);
+   return Data(Data::Share, buf, numBytes).hex();
 }
 
 Data 
 Random::getRandomBase64(unsigned int numBytes)
 {
-   return Random::getRandom(numBytes).base64encode();
+   assert(numBytes < Random::maxLength+1);
+   char buf[Random::maxLength];
+   getRandom((unsigned char*)buf, numBytes);
+   return Data(Data::Share, buf, numBytes).base64encode();
 }
 
 Data 
@@ -460,9 +568,7 @@ Random::getCryptoRandom(unsigned char* buf, unsigned int numBytes)
       assert(0);
    }
 #else
-   // !bwc! Should optimize this.
-   Data temp=Random::getRandom(numBytes);
-   memcpy(buf, temp.data(), numBytes);
+   Random::getRandom(buf, numBytes);
 #endif
 }
 
@@ -28,14 +28,27 @@ struct random_data;
 // #define RESIP_RANDOM_THREAD_LOCAL 1
 
 /**
- * By default, on POSIX, the standard srandom() and random()
- * functions will be used. This shares the generator state with
- * others libraries running in the same application. Under Linux
- * random() obtains a mutex so is threadsafe.
+ * Define below to use the standard srandom() and random() functions.
+ * This shares the generator state with others libraries running in the
+ * same application. Under Linux random() obtains a mutex so is threadsafe,
+ * but every thread that wants a random number queues up behind it.
  * NOTE: See http://evanjones.ca/random-thread-safe.html for some good info.
  * WATCHOUT: Some other library can call srandom() in a stupid way,
  * causing duplicate callids and such.
  */
+// #define RESIP_RANDOM_POSIX_RANDOM 1
+
+/**
+ * By default, on POSIX, each thread gets its own xoroshiro128** generator,
+ * kept in ThreadIf thread-local-storage. The generators are seeded once per
+ * thread from a process-wide seed read from /dev/urandom, so no locks are
+ * taken after a thread's first call, and no two threads share a sequence.
+ * This is not a cryptographic generator; use getCryptoRandom() for that.
+ */
+#if !defined(WIN32) && !defined(RESIP_RANDOM_THREAD_LOCAL) && \
+    !defined(RESIP_RANDOM_THREAD_MUTEX) && !defined(RESIP_RANDOM_POSIX_RANDOM)
+#define RESIP_RANDOM_THREAD_FAST 1
+#endif
 
 
 namespace resip
@@ -63,6 +76,8 @@ class Random
       static Data getCryptoRandomBase64(unsigned int numBytes); // actual length is 1.5*numBytes
 
       static void getCryptoRandom(unsigned char* buf, unsigned int numBytes);
+      /// Fills buf with numBytes of (non-cryptographic) randomness.
+      static void getRandom(unsigned char* buf, unsigned int numBytes);
 
       /**
         Returns a version 4 (random) UUID as defined in RFC 4122
@@ -117,6 +132,13 @@ class Random
       static struct random_data* sRandomState;
       // we re-use the initialization mutex
 #endif
+#ifdef RESIP_RANDOM_THREAD_FAST
+      static UInt64 next(UInt64* state);
+      static UInt64* getThreadState();
+      static ThreadIf::TlsKey sThreadStateKey;
+      static UInt64 sSeed;
+      static UInt64 sThreadCount; // protected by mMutex
+#endif
 };
  
 }
@@ -0,0 +1,230 @@
+#if !defined(RESIP_RECORDRING_HXX)
+#define RESIP_RECORDRING_HXX
+
+#include <cassert>
+#include <cstring>
+
+#include "rutil/AtomicOps.hxx"
+#include "rutil/compat.hxx"
+
+#ifdef RESIP_HAVE_ATOMIC_OPS
+
+namespace resip
+{
+
+/**
+   @brief A lock-free, single producer, single consumer ring of variable
+   sized records.
+
+   @details Each record is a small header (its size and an integer tag chosen
+   by the caller) followed by the record's bytes, padded to a multiple of 8
+   bytes. A record never wraps around the end of the ring. One thread may
+   push() while another thread calls consume(); neither ever blocks, and
+   push() simply fails when there is no room, leaving it to the caller to
+   decide whether to drop the record or retry.
+
+   Used to hand data from busy threads to a background writer, one ring per
+   producing thread (see ThreadRecordRings).
+
+   @code
+      RecordRing ring(65536);
+      ...
+      // producer
+      if (!ring.push(tag, data.data(), data.size())) { ++dropped; }
+      ...
+      // consumer
+      struct Writer { void operator()(int tag, const char* data, unsigned long size) {...} } w;
+      ring.consume(w);
+   @endcode
+*/
+class RecordRing
+{
+   public:
+      /// size must be a power of two, of at least 64 bytes
+      explicit RecordRing(unsigned long size) :
+         mBuffer(new char[size]),
+         mSize(size),
+         mHead(0),
+         mTail(0)
+      {
+         assert(size >= 64 && (size & (size - 1)) == 0);
+      }
+
+      ~RecordRing()
+      {
+         delete [] mBuffer;
+      }
+
+      /// Largest record that can be pushed
+      unsigned long maxRecordSize() const
+      {
+         return mSize/2 - sizeof(Header);
+      }
+
+      unsigned long capacity() const
+      {
+         return mSize;
+      }
+
+      /// Bytes in use; only approximate while the other thread is active
+      unsigned long used() const
+      {
+         return atomicLoad(mHead) - atomicLoad(mTail);
+      }
+
+      bool empty() const
+      {
+         return atomicLoad(mHead) == atomicLoad(mTail);
+      }
+
+      /**
+         Producer only. Appends a record made of the bytes at first followed
+         by the bytes at second. Returns false if there is no room.
+      */
+      bool push(int tag,
+                const void* first, unsigned long firstSize,
+                const void* second = 0, unsigned long secondSize = 0)
+      {
+         const unsigned long recordSize = firstSize + secondSize;
+         if (recordSize > maxRecordSize())
+         {
+            return false;
+         }
+         const unsigned long need = paddedSize(recordSize);
+         const unsigned long head = mHead;
+         const unsigned long pos = head & (mSize - 1);
+         const unsigned long contiguous = mSize - pos;
+         const unsigned long total = need + (contiguous < need ? contiguous : 0);
+         if (mSize - (head - atomicLoad(mTail)) < total)
+         {
+            return false;
+         }
+
+         unsigned long start = head;
+         if (contiguous < need)
+         {
+            header(pos)->mSize = WrapMarker;
+            start += contiguous;
+         }
+         Header* h = header(start & (mSize - 1));
+         h->mSize = (UInt32)recordSize;
+         h->mTag = (Int32)tag;
+         char* data = reinterpret_cast<char*>(h + 1);
+         memcpy(data, first, firstSize);
+         if (secondSize)
+         {
+            memcpy(data + firstSize, second, secondSize);
+         }
+         atomicStore(mHead, start + need);
+         return true;
+      }
+
+      /**
+         Consumer only. Calls consumer(tag, data, size) for every record
+         pushed so far, oldest first, and returns how many there were.
+      */
+      template<class Consumer>
+      unsigned long consume(Consumer& consumer)
+      {
+         unsigned long count = 0;
+         const unsigned long head = atomicLoad(mHead);
+         unsigned long tail = mTail;
+         while (tail != head)
+         {
+            const unsigned long pos = tail & (mSize - 1);
+            const Header* h = header(pos);
+            if (h->mSize == WrapMarker)
+            {
+               tail += mSize - pos;
+               continue;
+            }
+            consumer((int)h->mTag, reinterpret_cast<const char*>(h + 1), (unsigned long)h->mSize);
+            tail += paddedSize(h->mSize);
+            ++count;
+         }
+         atomicStore(mTail, tail);
+         return count;
+      }
+
+   private:
+      RecordRing(const RecordRing&);
+      RecordRing& operator=(const RecordRing&);
+
+      struct Header
+      {
+         UInt32 mSize;
+         Int32 mTag;
+      };
+      static const UInt32 WrapMarker = 0xffffffff;
+
+      static unsigned long paddedSize(unsigned long recordSize)
+      {
+         return (sizeof(Header) + recordSize + 7) & ~7UL;
+      }
+
+      Header* header(unsigned long pos) const
+      {
+         return reinterpret_cast<Header*>(mBuffer + pos);
+      }
+
+      char* const mBuffer;
+      const unsigned long mSize;
+      volatile unsigned long mHead;  // total bytes pushed
+      volatile unsigned long mTail;  // total bytes consumed
+};
+
+}
+
+#endif // RESIP_HAVE_ATOMIC_OPS
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,203 @@
+#if !defined(RESIP_SNAPSHOTPTR_HXX)
+#define RESIP_SNAPSHOTPTR_HXX
+
+#include "rutil/AtomicOps.hxx"
+#include "rutil/Lock.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/RWMutex.hxx"
+#include "rutil/Time.hxx"
+
+namespace resip
+{
+
+/**
+   @brief Holds a read-mostly object that is replaced wholesale rather than
+   modified in place.
+
+   @details Readers take a SnapshotPtr::Reader, which pins the current value
+   for as long as the Reader lives. Writers build a complete new value and
+   publish it with reset(); reset() then waits until no Reader can still be
+   looking at the previous value, and deletes it. This suits tables that are
+   consulted for every request but only change on configuration updates.
+
+   When atomic operations are available (see rutil/AtomicOps.hxx), taking a
+   Reader costs a couple of atomic increments and never blocks, no matter what
+   writers are doing. Otherwise, Readers fall back to taking a read lock.
+
+   @code
+      SnapshotPtr<Table> table(new Table);
+      ...
+      {
+         SnapshotPtr<Table>::Reader current(table);
+         current->lookup(key);
+      }
+      ...
+      table.reset(buildNewTable());
+   @endcode
+
+   A Reader must not outlive its SnapshotPtr, and a thread must not call
+   reset() while it holds a Reader on the same SnapshotPtr (it would wait on
+   itself forever).
+*/
+template<class T>
+class SnapshotPtr
+{
+   public:
+      explicit SnapshotPtr(T* value=0) :
+         mCurrent(value),
+         mEpoch(0)
+      {
+         mReaders[0] = 0;
+         mReaders[1] = 0;
+      }
+
+      ~SnapshotPtr()
+      {
+         delete mCurrent;
+      }
+
+      /**
+         Makes value the current value, and deletes the previous one once no
+         Reader is using it. Concurrent calls are serialized.
+      */
+      void reset(T* value)
+      {
+         Lock lock(mWriteMutex);
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         T* old = atomicExchange(mCurrent, value);
+
+         // Every Reader that could have seen old is counted in the slot for
+         // the current epoch. Send new Readers to the other slot, and wait
+         // for this one to drain.
+         const unsigned long slot = atomicFetchAdd(mEpoch, 1UL) & 1;
+         while(atomicLoad(mReaders[slot]) != 0)
+         {
+            sleepMs(1);
+         }
+#else
+         T* old = 0;
+         {
+            WriteLock readersLock(mReadMutex);
+            old = mCurrent;
+            mCurrent = value;
+         }
+#endif
+         delete old;
+      }
+
+      class Reader
+      {
+         public:
+            explicit Reader(const SnapshotPtr& ptr) :
+               mPtr(ptr)
+            {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+               for(;;)
+               {
+                  const unsigned long epoch = atomicLoad(mPtr.mEpoch);
+                  mSlot = epoch & 1;
+                  atomicFetchAdd(mPtr.mReaders[mSlot], 1L);
+                  if(atomicLoad(mPtr.mEpoch) == epoch)
+                  {
+                     break;
+                  }
+                  // A writer moved on while we registered; we may not have
+                  // been seen. Try again in the new slot.
+                  atomicFetchSub(mPtr.mReaders[mSlot], 1L);
+               }
+               mValue = atomicLoad(mPtr.mCurrent);
+#else
+               mPtr.mReadMutex.readlock();
+               mValue = mPtr.mCurrent;
+#endif
+            }
+
+            ~Reader()
+            {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+               atomicFetchSub(mPtr.mReaders[mSlot], 1L);
+#else
+               mPtr.mReadMutex.unlock();
+#endif
+            }
+
+            const T* get() const { return mValue; }
+            const T* operator->() const { return mValue; }
+            const T& operator*() const { return *mValue; }
+
+         private:
+            Reader(const Reader&);
+            Reader& operator=(const Reader&);
+
+            const SnapshotPtr& mPtr;
+            const T* mValue;
+            unsigned long mSlot;
+      };
+
+   private:
+      SnapshotPtr(const SnapshotPtr&);
+      SnapshotPtr& operator=(const SnapshotPtr&);
+
+      T* volatile mCurrent;
+      volatile unsigned long mEpoch;
+      // Number of Readers registered in each epoch parity
+      mutable volatile long mReaders[2];
+      Mutex mWriteMutex;
+#ifndef RESIP_HAVE_ATOMIC_OPS
+      mutable RWMutex mReadMutex;
+#endif
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
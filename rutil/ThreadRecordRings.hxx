@@ -0,0 +1,137 @@
+#if !defined(RESIP_THREADRECORDRINGS_HXX)
+#define RESIP_THREADRECORDRINGS_HXX
+
+#include <vector>
+
+#include "rutil/Lock.hxx"
+#include "rutil/Mutex.hxx"
+#include "rutil/RecordRing.hxx"
+#include "rutil/ThreadIf.hxx"
+
+#ifdef RESIP_HAVE_ATOMIC_OPS
+
+namespace resip
+{
+
+/**
+   @brief A RecordRing for every thread that produces records, and one
+   consumer that empties them all.
+
+   @details A thread's ring is made the first time it calls ring(). When the
+   thread exits, its ring is kept until consume() has emptied it, and then
+   deleted. Used by asynchronous logging (see Log::setAsync()) and by
+   SipCapture.
+*/
+class ThreadRecordRings
+{
+   public:
+      /// ringSize must be a power of two, of at least 64 bytes
+      explicit ThreadRecordRings(unsigned long ringSize);
+      ~ThreadRecordRings();
+
+      /// Only affects rings made from now on
+      void setRingSize(unsigned long ringSize);
+
+      /// The calling thread's ring
+      RecordRing& ring();
+
+      /**
+         Consumer only. Calls consumer(tag, data, size) for every record
+         pushed so far, one ring at a time, and returns how many there were.
+      */
+      template<class Consumer>
+      unsigned long consume(Consumer& consumer)
+      {
+         unsigned long count = 0;
+         Lock lock(mRingsMutex);
+         for (std::vector<Ring*>::iterator i = mRings.begin(); i != mRings.end(); )
+         {
+            Ring* ring = *i;
+            count += ring->consume(consumer);
+            if (atomicLoad(ring->mOrphaned) && ring->empty())
+            {
+               delete ring;
+               i = mRings.erase(i);
+            }
+            else
+            {
+               ++i;
+            }
+         }
+         return count;
+      }
+
+   private:
+      ThreadRecordRings(const ThreadRecordRings&);
+      ThreadRecordRings& operator=(const ThreadRecordRings&);
+
+      class Ring : public RecordRing
+      {
+         public:
+            explicit Ring(unsigned long size) : RecordRing(size), mOrphaned(false) {}
+            // Set when the owning thread exits
+            volatile bool mOrphaned;
+      };
+      static void orphan(void* ring);
+
+      ThreadIf::TlsKey mKey;
+      volatile unsigned long mRingSize;
+      Mutex mRingsMutex;
+      std::vector<Ring*> mRings;
+};
+
+}
+
+#endif // RESIP_HAVE_ATOMIC_OPS
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -4,6 +4,7 @@
 #include <cassert>
 #include <memory>
 #include "rutil/AbstractFifo.hxx"
+#include "rutil/LatencyHistogram.hxx"
 #include <iostream>
 #if defined( WIN32 )
 #include <time.h>
@@ -24,18 +25,28 @@ template<typename Payload>
 class Timestamped
 {
    public:
-      Timestamped(const Payload& msg, time_t n)
+      Timestamped()
+         : mMsg(),
+           mTime(0),
+           mTimeMicroSec(0)
+      {}
+
+      Timestamped(const Payload& msg, time_t n, UInt64 us=0)
          : mMsg(msg),
-           mTime(n)
+           mTime(n),
+           mTimeMicroSec(us)
       {}
 
       inline const Payload& getMsg() const { return mMsg;} 
       inline void setMsg(const Payload& pMsg) { mMsg = pMsg;}
       inline const time_t& getTime() const { return mTime;} 
+      /// finer grained than getTime(), but only taken if someone asks for it
+      inline UInt64 getTimeMicroSec() const { return mTimeMicroSec;} 
 
    private:
       Payload mMsg;
       time_t mTime;
+      UInt64 mTimeMicroSec;
 };
 
 /**
@@ -206,8 +217,17 @@ class TimeLimitFifo : public AbstractFifo< Timestamped<Msg*> >
       */
       virtual void setTimeDepthTolerance(unsigned int maxSecs);
 
+      /**
+      @brief reports how long each message waited in the FIFO
+      @param recorder told, from the thread calling getNext(), how long
+      (in microseconds) each message it returns was queued for; 0 to stop
+      @note set this before the FIFO is in use
+      */
+      void setLatencyRecorder(LatencyRecorder* recorder);
+
    private:
       time_t timeDepthInternal() const;
+      void recordLatency(const Timestamped<Msg*>& tm) const;
       inline bool wouldAcceptInteral(DepthUsage usage) const;
       TimeLimitFifo(const TimeLimitFifo& rhs);
       TimeLimitFifo& operator=(const TimeLimitFifo& rhs);
@@ -215,6 +235,7 @@ class TimeLimitFifo : public AbstractFifo< Timestamped<Msg*> >
       time_t mMaxDurationSecs;
       unsigned int mMaxSize;
       unsigned int mUnreservedMaxSize;
+      LatencyRecorder* mLatencyRecorder;
 };
 
 template <class Msg>
@@ -223,7 +244,8 @@ TimeLimitFifo<Msg>::TimeLimitFifo(unsigned int maxDurationSecs,
    : AbstractFifo< Timestamped<Msg*> >(),
      mMaxDurationSecs(maxDurationSecs),
      mMaxSize(maxSize),
-     mUnreservedMaxSize((int)((maxSize*8)/10)) // !dlb! random guess
+     mUnreservedMaxSize((int)((maxSize*8)/10)), // !dlb! random guess
+     mLatencyRecorder(0)
 {}
 
 template <class Msg>
@@ -243,7 +265,7 @@ TimeLimitFifo<Msg>::add(Msg* msg,
    if (wouldAcceptInteral(usage))
    {
       time_t n = time(0);
-      mFifo.push_back(Timestamped<Msg*>(msg, n));
+      mFifo.push_back(Timestamped<Msg*>(msg, n, mLatencyRecorder ? Timer::getTimeMicroSec() : 0));
       onMessagePushed(1);
       mCondition.signal();
       return true;
@@ -268,6 +290,7 @@ Msg*
 TimeLimitFifo<Msg>::getNext()
 {
    Timestamped<Msg*> tm(AbstractFifo< Timestamped<Msg*> >::getNext());
+   recordLatency(tm);
    return tm.getMsg();
 }
 
@@ -278,11 +301,22 @@ TimeLimitFifo<Msg>::getNext(int ms)
    Timestamped<Msg*> tm(0,0);
    if(AbstractFifo< Timestamped<Msg*> >::getNext(ms, tm))
    {
+      recordLatency(tm);
       return tm.getMsg();
    }
    return 0;
 }
 
+template <class Msg>
+void
+TimeLimitFifo<Msg>::recordLatency(const Timestamped<Msg*>& tm) const
+{
+   if(mLatencyRecorder && tm.getTimeMicroSec())
+   {
+      mLatencyRecorder->recordLatency(Timer::getTimeMicroSec() - tm.getTimeMicroSec());
+   }
+}
+
 template <class Msg>
 time_t
 TimeLimitFifo<Msg>::timeDepthInternal() const
@@ -399,6 +433,14 @@ TimeLimitFifo<Msg>::setTimeDepthTolerance(unsigned int maxSecs)
    mMaxDurationSecs=maxSecs;
 }
 
+template <class Msg>
+void
+TimeLimitFifo<Msg>::setLatencyRecorder(LatencyRecorder* recorder)
+{
+   Lock lock(mMutex); (void)lock;
+   mLatencyRecorder=recorder;
+}
+
 
 } // namespace resip
 
@@ -0,0 +1,491 @@
+#if !defined(RESIP_TIMINGWHEEL_HXX)
+#define RESIP_TIMINGWHEEL_HXX
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+
+#include "rutil/compat.hxx"
+
+namespace resip
+{
+
+/**
+   @brief A hierarchical timing wheel, with millisecond resolution.
+
+   @details Holds timers of type T, which must be copy-constructible, and
+   must have a UInt64 getWhen() const member that returns the absolute time
+   (in ms) at which the timer expires.
+
+   There are 11 levels of 64 slots; level n has a granularity of 64^n ms, 
+   which is enough to cover the full range of a UInt64. A timer is placed on
+   the lowest level on which its expiry and the current time of the wheel
+   share all higher-order digits, so add() and cancel() are O(1). As time 
+   advances, each timer is cascaded down at most once per level before it
+   expires, so expiry is amortized O(1) as well. Occupancy bitmaps allow
+   empty stretches of time to be skipped in a single step.
+
+   Storage for timers is recycled internally, so a wheel that has reached its
+   working size does no further heap allocation.
+
+   top() returns the earliest timer exactly; this is O(1) unless the earliest
+   timer lives on one of the coarser levels, in which case that one slot is 
+   scanned (and the result cached until the wheel changes).
+
+   @note This class is not threadsafe.
+   @ingroup data_structures
+*/
+template<class T>
+class TimingWheel
+{
+   private:
+      class Link
+      {
+         public:
+            Link() : mPrev(this), mNext(this) {}
+            Link* mPrev;
+            Link* mNext;
+      };
+
+      class Node : public Link
+      {
+         public:
+            Node() : mSeq(0), mSlot(FreeSlot) {}
+
+            T& timer() { return *reinterpret_cast<T*>(mStorage.mBuf); }
+            const T& timer() const { return *reinterpret_cast<const T*>(mStorage.mBuf); }
+            UInt64 when() const { return timer().getWhen(); }
+
+            UInt32 mSeq;
+            int mSlot;
+            union
+            {
+               char mBuf[sizeof(T)];
+               UInt64 mAlignInt;
+               double mAlignDouble;
+               void* mAlignPtr;
+            } mStorage;
+      };
+
+   public:
+      /**
+         Identifies a timer in the wheel, so that it can be cancelled. Ids
+         remain safe to use after the timer has fired or been cancelled; they
+         simply stop matching anything.
+      */
+      class Id
+      {
+         public:
+            Id() : mNode(0), mSeq(0) {}
+
+            bool operator==(const Id& rhs) const
+            {
+               return mNode == rhs.mNode && mSeq == rhs.mSeq;
+            }
+            bool operator!=(const Id& rhs) const { return !(*this == rhs); }
+
+         private:
+            friend class TimingWheel<T>;
+            Id(Node* node, UInt32 seq) : mNode(node), mSeq(seq) {}
+
+            Node* mNode;
+            UInt32 mSeq;
+      };
+
+      /**
+         @param now The time (in ms) to start the wheel at. Timers that 
+            expire at or before this are due immediately.
+      */
+      explicit TimingWheel(UInt64 now) :
+         mCurrent(now),
+         mSize(0),
+         mFreeNodes(0),
+         mEarliest(0),
+         mExpiring(0)
+      {
+         for(int level = 0; level < NumLevels; ++level)
+         {
+            mOccupied[level] = 0;
+         }
+      }
+
+      ~TimingWheel()
+      {
+         destroyList(mReady);
+         for(int i = 0; i < NumLevels*SlotsPerLevel; ++i)
+         {
+            destroyList(mSlots[i]);
+         }
+         while(mFreeNodes)
+         {
+            Node* node = mFreeNodes;
+            mFreeNodes = static_cast<Node*>(node->mNext);
+            delete node;
+         }
+      }
+
+      /// Adds a timer; it will expire at timer.getWhen()
+      Id add(const T& timer)
+      {
+         Node* node = allocateNode();
+         new (node->mStorage.mBuf) T(timer);
+         place(node);
+         ++mSize;
+         if(mEarliest && node->when() < mEarliest->when())
+         {
+            mEarliest = node;
+         }
+         return Id(node, node->mSeq);
+      }
+
+      /**
+         Removes a timer from the wheel.
+         @return false iff the timer had already fired, been cancelled, or is
+            the timer currently returned by nextExpired().
+      */
+      bool cancel(const Id& id)
+      {
+         Node* node = id.mNode;
+         if(!node || node->mSeq != id.mSeq || node->mSlot == FreeSlot || 
+            node == mExpiring)
+         {
+            return false;
+         }
+         remove(node);
+         return true;
+      }
+
+      /// @return true iff the timer identified by id has yet to fire
+      bool pending(const Id& id) const
+      {
+         return id.mNode && id.mNode->mSeq == id.mSeq && 
+                  id.mNode->mSlot != FreeSlot;
+      }
+
+      /// @return The timer identified by id, which must be pending()
+      const T& get(const Id& id) const
+      {
+         assert(pending(id));
+         return id.mNode->timer();
+      }
+
+      bool empty() const { return mSize == 0; }
+      size_t size() const { return mSize; }
+
+      /// @return The earliest timer in the wheel. Must not be empty().
+      const T& top() const
+      {
+         assert(mSize);
+         if(!mEarliest)
+         {
+            mEarliest = findEarliest();
+         }
+         return mEarliest->timer();
+      }
+
+      /**
+         Advances the wheel to now, and returns the earliest timer that has
+         expired by then, or 0 if there is none. The timer remains in the
+         wheel until popExpired() is called; it is fine to add() new timers in
+         between. Expired timers are returned in expiry order.
+      */
+      const T* nextExpired(UInt64 now)
+      {
+         assert(!mExpiring);
+         while(mReady.mNext == &mReady)
+         {
+            if(!advance(now))
+            {
+               return 0;
+            }
+         }
+         mExpiring = static_cast<Node*>(mReady.mNext);
+         return &mExpiring->timer();
+      }
+
+      /// Removes the timer most recently returned by nextExpired()
+      void popExpired()
+      {
+         assert(mExpiring);
+         Node* node = mExpiring;
+         mExpiring = 0;
+         remove(node);
+      }
+
+   private:
+      enum
+      {
+         BitsPerLevel = 6,
+         SlotsPerLevel = 1 << BitsPerLevel,
+         NumLevels = (64 + BitsPerLevel - 1) / BitsPerLevel,
+         ReadySlot = -1,
+         FreeSlot = -2
+      };
+
+      static int lowestBit(UInt64 x)
+      {
+#ifdef __GNUC__
+         return __builtin_ctzll(x);
+#else
+         int n = 0;
+         while(!(x & 1))
+         {
+            x >>= 1;
+            ++n;
+         }
+         return n;
+#endif
+      }
+
+      static int highestBit(UInt64 x)
+      {
+#ifdef __GNUC__
+         return 63 - __builtin_clzll(x);
+#else
+         int n = 0;
+         while(x >>= 1)
+         {
+            ++n;
+         }
+         return n;
+#endif
+      }
+
+      static void append(Link& list, Link* link)
+      {
+         link->mPrev = list.mPrev;
+         link->mNext = &list;
+         list.mPrev->mNext = link;
+         list.mPrev = link;
+      }
+
+      static void unlink(Link* link)
+      {
+         link->mPrev->mNext = link->mNext;
+         link->mNext->mPrev = link->mPrev;
+         link->mPrev = link->mNext = link;
+      }
+
+      Node* allocateNode()
+      {
+         if(mFreeNodes)
+         {
+            Node* node = mFreeNodes;
+            mFreeNodes = static_cast<Node*>(node->mNext);
+            return node;
+         }
+         return new Node;
+      }
+
+      void place(Node* node)
+      {
+         const UInt64 when = node->when();
+         if(when <= mCurrent)
+         {
+            node->mSlot = ReadySlot;
+            append(mReady, node);
+            return;
+         }
+
+         const int level = highestBit(when ^ mCurrent) / BitsPerLevel;
+         const int slot = (int)((when >> (level*BitsPerLevel)) & (SlotsPerLevel-1));
+         node->mSlot = level*SlotsPerLevel + slot;
+         append(mSlots[node->mSlot], node);
+         mOccupied[level] |= (UInt64(1) << slot);
+      }
+
+      void remove(Node* node)
+      {
+         if(node == mEarliest)
+         {
+            mEarliest = 0;
+         }
+
+         if(node->mSlot >= 0)
+         {
+            Link& list = mSlots[node->mSlot];
+            unlink(node);
+            if(list.mNext == &list)
+            {
+               mOccupied[node->mSlot / SlotsPerLevel] &= 
+                  ~(UInt64(1) << (node->mSlot % SlotsPerLevel));
+            }
+         }
+         else
+         {
+            unlink(node);
+         }
+
+         node->timer().~T();
+         node->mSlot = FreeSlot;
+         ++node->mSeq;
+         node->mNext = mFreeNodes;
+         mFreeNodes = node;
+         --mSize;
+      }
+
+      /**
+         Moves the earliest non-empty slot onto the ready list (or cascades
+         it onto lower levels), if that slot starts at or before now.
+         @return false if there was nothing to do.
+      */
+      bool advance(UInt64 now)
+      {
+         int level = 0;
+         while(level < NumLevels && !mOccupied[level])
+         {
+            ++level;
+         }
+
+         if(level == NumLevels)
+         {
+            if(now > mCurrent)
+            {
+               mCurrent = now;
+            }
+            return false;
+         }
+
+         const int slot = lowestBit(mOccupied[level]);
+         const int shift = level*BitsPerLevel;
+         const UInt64 upper = (shift + BitsPerLevel >= 64) ? 0 :
+                              (mCurrent & ~((UInt64(1) << (shift + BitsPerLevel)) - 1));
+         const UInt64 start = upper | (UInt64(slot) << shift);
+         if(start > now)
+         {
+            // Nothing is due. Every timer lies at or beyond start, so moving
+            // up to now does not disturb their placement.
+            if(now > mCurrent)
+            {
+               mCurrent = now;
+            }
+            return false;
+         }
+
+         Link& list = mSlots[level*SlotsPerLevel + slot];
+         mOccupied[level] &= ~(UInt64(1) << slot);
+         mCurrent = start;
+         mEarliest = 0;
+
+         Link* link = list.mNext;
+         list.mPrev = list.mNext = &list;
+         while(link != &list)
+         {
+            Node* node = static_cast<Node*>(link);
+            link = link->mNext;
+            // On level 0 everything in the slot expires at start, and lands
+            // on the ready list; otherwise this cascades to lower levels.
+            place(node);
+         }
+         return true;
+      }
+
+      Node* findEarliest() const
+      {
+         if(mReady.mNext != &mReady)
+         {
+            return static_cast<Node*>(mReady.mNext);
+         }
+
+         int level = 0;
+         while(!mOccupied[level])
+         {
+            ++level;
+         }
+
+         const Link& list = mSlots[level*SlotsPerLevel + lowestBit(mOccupied[level])];
+         Node* earliest = static_cast<Node*>(list.mNext);
+         if(level > 0)
+         {
+            for(Link* link = earliest->mNext; link != &list; link = link->mNext)
+            {
+               Node* node = static_cast<Node*>(link);
+               if(node->when() < earliest->when())
+               {
+                  earliest = node;
+               }
+            }
+         }
+         return earliest;
+      }
+
+      void destroyList(Link& list)
+      {
+         Link* link = list.mNext;
+         while(link != &list)
+         {
+            Node* node = static_cast<Node*>(link);
+            link = link->mNext;
+            node->timer().~T();
+            delete node;
+         }
+         list.mPrev = list.mNext = &list;
+      }
+
+      UInt64 mCurrent;
+      size_t mSize;
+      UInt64 mOccupied[NumLevels];
+      Link mSlots[NumLevels*SlotsPerLevel];
+      Link mReady;
+      Node* mFreeNodes;
+      mutable Node* mEarliest;
+      Node* mExpiring;
+
+      // no value semantics
+      TimingWheel(const TimingWheel&);
+      TimingWheel& operator=(const TimingWheel&);
+};
+
+}
+
+#endif
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0 
+ * 
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ * 
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ * 
+ * ====================================================================
+ * 
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
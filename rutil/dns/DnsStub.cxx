@@ -8,7 +8,11 @@
 //	release version messes time_t definition again
 #include <set>
 #include <vector>
+#include <fstream>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 
 #include "AresCompat.hxx"
 
@@ -25,6 +29,7 @@
 #include "rutil/BaseException.hxx"
 #include "rutil/Data.hxx"
 #include "rutil/Inserter.hxx"
+#include "rutil/Timer.hxx"
 #include "rutil/dns/DnsStub.hxx"
 #include "rutil/dns/ExternalDns.hxx"
 #include "rutil/dns/ExternalDnsFactory.hxx"
@@ -88,6 +93,10 @@ DnsStub::DnsStub(const NameserverList& additional,
    mTransform(0),
    mDnsProvider(ExternalDnsFactory::createExternalDns()),
    mPollGrp(0),
+   mIssuedQueries(0),
+   mCoalescedQueries(0),
+   mSnapshotInterval(0),
+   mNextSnapshot(0),
    mAsyncProcessHandler(asyncProcessHandler)
 {
    setPollGrp(pollGrp);
@@ -111,10 +120,23 @@ DnsStub::DnsStub(const NameserverList& additional,
 
 DnsStub::~DnsStub()
 {
+   if (!mSnapshotFile.empty())
+   {
+      doSaveDnsCache(mSnapshotFile);
+   }
+
    for (set<Query*>::iterator it = mQueries.begin(); it != mQueries.end(); ++it)
    {
       delete *it;
    }
+   for (PendingLookupMap::iterator it = mPendingLookups.begin(); it != mPendingLookups.end(); ++it)
+   {
+      delete it->second;
+   }
+   for (set<RefreshQuery*>::iterator it = mRefreshQueries.begin(); it != mRefreshQueries.end(); ++it)
+   {
+      delete *it;
+   }
 
    setPollGrp(0);
    delete mDnsProvider;
@@ -159,6 +181,12 @@ DnsStub::processTimers()
    // the fifo is captures as a timer within getTimeTill... above
    processFifo();
    mDnsProvider->processTimers();
+
+   if (mSnapshotInterval > 0 && Timer::getTimeSecs() >= mNextSnapshot)
+   {
+      doSaveDnsCache(mSnapshotFile);
+      mNextSnapshot = Timer::getTimeSecs() + mSnapshotInterval;
+   }
 }
 
 void 
@@ -219,6 +247,11 @@ DnsStub::cache(const Data& key,
       aptr = createOverlay(abuf, alen, aptr, overlays);
    }
 
+   if (overlays.empty())
+   {
+      return;
+   }
+
    // sort overlays by type.
    sort(overlays.begin(), overlays.end());
 
@@ -460,6 +493,24 @@ typeToData(int rr)
    }
 }
 
+void
+DnsStub::refreshCacheEntry(const Data& target, int rrType)
+{
+   DebugLog(<< "Refreshing cached " << typeToData(rrType) << " records for " << target);
+   RefreshQuery* query = new RefreshQuery(*this, target, rrType);
+   mRefreshQueries.insert(query);
+   lookupRecords(target, (unsigned short)rrType, query);
+}
+
+void
+DnsStub::refreshCacheEntries(const std::vector<Data>& targets, int rrType)
+{
+   for (std::vector<Data>::const_iterator it = targets.begin(); it != targets.end(); ++it)
+   {
+      refreshCacheEntry(*it, rrType);
+   }
+}
+
 void
 DnsStub::Query::go()
 {
@@ -468,8 +519,10 @@ DnsStub::Query::go()
    DnsResourceRecordsByPtr records;
    int status = 0;
    bool cached = false;
+   bool refresh = false;
+   std::vector<Data> staleCnames;
    Data targetToQuery = mTarget;
-   cached = mStub.mRRCache.lookup(mTarget, mRRType, mProto, records, status);
+   cached = mStub.mRRCache.lookup(mTarget, mRRType, mProto, records, status, refresh);
 
    if (!cached)
    {
@@ -478,7 +531,12 @@ DnsStub::Query::go()
          do
          {
             DnsResourceRecordsByPtr cnames;
-            cached = mStub.mRRCache.lookup(targetToQuery, T_CNAME, mProto, cnames, status);
+            bool refreshCname = false;
+            cached = mStub.mRRCache.lookup(targetToQuery, T_CNAME, mProto, cnames, status, refreshCname);
+            if (refreshCname)
+            {
+               staleCnames.push_back(targetToQuery);
+            }
             if (cached)
             {
                targetToQuery = (dynamic_cast<DnsCnameRecord*>(cnames[0]))->cname();
@@ -486,11 +544,14 @@ DnsStub::Query::go()
          } while(cached);
       }
    }
+   // These only replace the CNAMEs, which nobody is handed, so they can
+   // start now.
+   mStub.refreshCacheEntries(staleCnames, T_CNAME);
 
    if (targetToQuery != mTarget)
    {
       StackLog(<< mTarget << " mapped to CNAME " << targetToQuery);
-      cached = mStub.mRRCache.lookup(targetToQuery, mRRType, mProto, records, status);
+      cached = mStub.mRRCache.lookup(targetToQuery, mRRType, mProto, records, status, refresh);
    }
 
    if (!cached)
@@ -537,6 +598,13 @@ DnsStub::Query::go()
       }
       mResultConverter->notifyUser(mTarget, status, mStub.errorMessage(status), records, mSink);
 
+      // Only now: the answer might come back at once, replacing the records
+      // the user was just given.
+      if (refresh)
+      {
+         mStub.refreshCacheEntry(targetToQuery, mRRType);
+      }
+
       mStub.removeQuery(this);
       delete this;
    }
@@ -733,11 +801,17 @@ DnsStub::Query::followCname(const unsigned char* aptr, const unsigned char*abuf,
             ++mReQuery;
             int status = 0;
             bool cached = false;
+            std::vector<Data> staleCnames;
 
             do
             {
                DnsResourceRecordsByPtr cnames;
-               cached = mStub.mRRCache.lookup(targetToQuery, T_CNAME, mProto, cnames, status);
+               bool refreshCname = false;
+               cached = mStub.mRRCache.lookup(targetToQuery, T_CNAME, mProto, cnames, status, refreshCname);
+               if (refreshCname)
+               {
+                  staleCnames.push_back(targetToQuery);
+               }
                if (cached)
                {
                   ++mReQuery;
@@ -752,6 +826,7 @@ DnsStub::Query::followCname(const unsigned char* aptr, const unsigned char*abuf,
                bDeleteThis = false;
                bGotAnswers = false;
             }
+            mStub.refreshCacheEntries(staleCnames, T_CNAME);
          }
          else
          {
@@ -774,7 +849,55 @@ DnsStub::errorMessage(int status)
 void
 DnsStub::lookupRecords(const Data& target, unsigned short type, DnsRawSink* sink)
 {
-   mDnsProvider->lookup(target.c_str(), type, this, sink);
+   Data name(target);
+   name.lowercase();
+   PendingLookupKey key(name, type);
+
+   PendingLookupMap::iterator it = mPendingLookups.find(key);
+   if (it != mPendingLookups.end())
+   {
+      StackLog(<< "Waiting for lookup already in flight for " << target << " " << typeToData(type));
+      it->second->addWaiter(sink);
+      ++mCoalescedQueries;
+      return;
+   }
+
+   // In the map before the provider sees it, since it may answer at once.
+   PendingLookup* lookup = new PendingLookup(*this, key);
+   lookup->addWaiter(sink);
+   mPendingLookups[key] = lookup;
+   ++mIssuedQueries;
+   mDnsProvider->lookup(target.c_str(), type, this, lookup);
+}
+
+DnsStub::PendingLookup::PendingLookup(DnsStub& stub, const PendingLookupKey& key)
+   : mStub(stub),
+     mKey(key)
+{
+}
+
+void
+DnsStub::PendingLookup::addWaiter(DnsRawSink* sink)
+{
+   mWaiters.push_back(sink);
+}
+
+void
+DnsStub::PendingLookup::onDnsRaw(int status, const unsigned char* abuf, int alen)
+{
+   // Out of the map first: a waiter may start new lookups (following a CNAME,
+   // say) while it handles the answer, and those must go out afresh.
+   mStub.mPendingLookups.erase(mKey);
+
+   if (mWaiters.size() > 1)
+   {
+      StackLog(<< "Answer for " << mKey.first << " goes to " << mWaiters.size() << " waiting queries");
+   }
+   for (vector<DnsRawSink*>::iterator it = mWaiters.begin(); it != mWaiters.end(); ++it)
+   {
+      (*it)->onDnsRaw(status, abuf, alen);
+   }
+   delete this;
 }
 
 void
@@ -846,6 +969,9 @@ void
 DnsStub::doLogDnsCache()
 {
    mRRCache.logCache();
+   InfoLog(<< "DNS cache entries: " << mRRCache.size() << ", bytes: " << mRRCache.bytes());
+   InfoLog(<< "DNS lookups issued: " << mIssuedQueries << ", coalesced: " << mCoalescedQueries
+           << ", in flight: " << mPendingLookups.size());
 }
 
 void 
@@ -876,6 +1002,241 @@ DnsStub::setDnsCacheSize(int size)
    mRRCache.setSize(size);
 }
 
+void
+DnsStub::setDnsCacheMaxBytes(size_t maxBytes)
+{
+   mRRCache.setMaxBytes(maxBytes);
+}
+
+void
+DnsStub::setDnsCacheRefreshAhead(int secsBeforeExpiry, unsigned int minHits)
+{
+   mRRCache.setRefreshAhead(secsBeforeExpiry, minHits);
+}
+
+void
+DnsStub::setDnsCacheServeStale(int maxStaleSecs)
+{
+   mRRCache.setServeStale(maxStaleSecs);
+}
+
+void
+DnsStub::setDnsCacheSnapshot(const Data& filename, int saveIntervalSecs)
+{
+   SetDnsCacheSnapshotCommand* command = new SetDnsCacheSnapshotCommand(*this, filename, saveIntervalSecs);
+   queueCommand(command);
+}
+
+void
+DnsStub::doSetDnsCacheSnapshot(const Data& filename, int saveIntervalSecs)
+{
+   mSnapshotFile = filename;
+   mSnapshotInterval = filename.empty() ? 0 : saveIntervalSecs;
+   mNextSnapshot = Timer::getTimeSecs() + mSnapshotInterval;
+   if (!filename.empty())
+   {
+      loadDnsCache(filename);
+   }
+}
+
+void
+DnsStub::saveDnsCache(const Data& filename)
+{
+   SaveDnsCacheCommand* command = new SaveDnsCacheCommand(*this, filename);
+   queueCommand(command);
+}
+
+// A snapshot is this line, then when it was written (seconds since the
+// epoch), then each saved response preceded by its length.  Numbers are in
+// network order; the time takes 4 bytes, the lengths 2.
+static const char SnapshotMagic[] = "resip DNS cache 1\n";
+
+void
+DnsStub::doSaveDnsCache(const Data& filename)
+{
+   vector<Data> responses;
+   mRRCache.getSnapshot(responses);
+
+   Data snapshot;
+   snapshot.append(SnapshotMagic, sizeof(SnapshotMagic) - 1);
+   UInt32 now = (UInt32)time(0);
+   snapshot += (char)(now >> 24);
+   snapshot += (char)(now >> 16);
+   snapshot += (char)(now >> 8);
+   snapshot += (char)now;
+   for (vector<Data>::const_iterator it = responses.begin(); it != responses.end(); ++it)
+   {
+      if (it->size() > 0xffff)
+      {
+         continue;
+      }
+      snapshot += (char)(it->size() >> 8);
+      snapshot += (char)it->size();
+      snapshot += *it;
+   }
+
+   // Swap it in whole, so a crash part way through can't leave half a file.
+   Data tmp(filename + ".tmp");
+   ofstream os(tmp.c_str(), ios::binary | ios::trunc);
+   os.write(snapshot.data(), snapshot.size());
+   os.close();
+   if (!os)
+   {
+      ErrLog(<< "Couldn't write DNS cache snapshot to " << tmp);
+      return;
+   }
+#ifdef WIN32
+   remove(filename.c_str());
+#endif
+   if (rename(tmp.c_str(), filename.c_str()) != 0)
+   {
+      ErrLog(<< "Couldn't move DNS cache snapshot from " << tmp << " to " << filename);
+      return;
+   }
+   DebugLog(<< "Saved " << responses.size() << " DNS cache entries to " << filename);
+}
+
+void
+DnsStub::loadDnsCache(const Data& filename)
+{
+   Data snapshot;
+   try
+   {
+      snapshot = Data::fromFile(filename);
+   }
+   catch (BaseException&)
+   {
+      InfoLog(<< "No DNS cache snapshot to load from " << filename);
+      return;
+   }
+
+   const size_t magicLen = sizeof(SnapshotMagic) - 1;
+   if (snapshot.size() < magicLen + 4 ||
+       memcmp(snapshot.data(), SnapshotMagic, magicLen) != 0)
+   {
+      WarningLog(<< filename << " isn't a DNS cache snapshot; ignoring it");
+      return;
+   }
+
+   unsigned char* pos = (unsigned char*)snapshot.data() + magicLen;
+   unsigned char* end = (unsigned char*)snapshot.data() + snapshot.size();
+   UInt32 saved = DNS__32BIT(pos);
+   UInt32 now = (UInt32)time(0);
+   UInt32 elapsed = now > saved ? now - saved : 0;
+   pos += 4;
+
+   int loaded = 0;
+   int expired = 0;
+   while (pos + 2 <= end)
+   {
+      int len = DNS__16BIT(pos);
+      pos += 2;
+      if (len < HFIXEDSZ || pos + len > end)
+      {
+         WarningLog(<< "DNS cache snapshot " << filename << " is truncated");
+         break;
+      }
+      try
+      {
+         if (ageSavedResponse(pos, len, elapsed))
+         {
+            cache(Data::Empty, pos, len);
+            ++loaded;
+         }
+         else
+         {
+            ++expired;
+         }
+      }
+      catch (BaseException& e)
+      {
+         WarningLog(<< "Skipping bad entry in DNS cache snapshot " << filename << ": " << e.getMessage());
+      }
+      pos += len;
+   }
+   InfoLog(<< "Loaded " << loaded << " DNS cache entries from " << filename
+           << " (" << expired << " had expired)");
+}
+
+bool
+DnsStub::ageSavedResponse(unsigned char* abuf, int alen, UInt32 elapsed)
+{
+   const unsigned char* aptr = abuf + HFIXEDSZ;
+   int qdcount = DNS_HEADER_QDCOUNT(abuf);
+   for (int i = 0; i < qdcount; ++i)
+   {
+      aptr = skipDNSQuestion(aptr, abuf, alen);
+   }
+
+   int ancount = DNS_HEADER_ANCOUNT(abuf);
+   for (int i = 0; i < ancount; ++i)
+   {
+      char* name = 0;
+      long len = 0;
+      if (ares_expand_name(aptr, abuf, alen, &name, &len) != ARES_SUCCESS)
+      {
+         throw DnsStubException("Failed to parse saved record", __FILE__, __LINE__);
+      }
+      free(name);
+      aptr += len;
+      if (aptr + RRFIXEDSZ > abuf + alen ||
+          aptr + RRFIXEDSZ + DNS_RR_LEN(aptr) > abuf + alen)
+      {
+         throw DnsStubException("Saved record is truncated", __FILE__, __LINE__);
+      }
+      UInt32 ttl = DNS_RR_TTL(aptr);
+      if (ttl <= elapsed)
+      {
+         return false;
+      }
+      unsigned char* rr = abuf + (aptr - abuf);
+      DNS_RR_SET_TTL(rr, ttl - elapsed);
+      aptr += RRFIXEDSZ + DNS_RR_LEN(aptr);
+   }
+   return ancount > 0;
+}
+
+DnsStub::RefreshQuery::RefreshQuery(DnsStub& stub, const Data& target, int rrType)
+   : mStub(stub),
+     mTarget(target),
+     mRRType(rrType)
+{
+}
+
+void
+DnsStub::RefreshQuery::onDnsRaw(int status, const unsigned char* abuf, int alen)
+{
+   try
+   {
+      if (status == 0)
+      {
+         if (DNS_HEADER_ANCOUNT(abuf) > 0)
+         {
+            mStub.cache(mTarget, abuf, alen);
+         }
+      }
+      else if (status == ARES_ENODATA || status == ARES_ENOTFOUND)
+      {
+         // The records are really gone; don't go on serving them.
+         mStub.cacheTTL(mTarget, mRRType, status, abuf, alen);
+      }
+      else
+      {
+         // Whatever we have is still better than nothing.
+         InfoLog(<< "Couldn't refresh " << typeToData(mRRType) << " records for " << mTarget
+                 << ": " << mStub.errorMessage(status));
+      }
+   }
+   catch (BaseException& e)
+   {
+      ErrLog(<< "Couldn't parse refreshed records for " << mTarget << ": " << e.getMessage());
+   }
+
+   mStub.mRRCache.endRefresh(mTarget, mRRType);
+   mStub.mRefreshQueries.erase(this);
+   delete this;
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
@@ -175,9 +175,35 @@ class DnsStub : public ExternalDnsHandler
       void getDnsCacheDump(std::pair<unsigned long, unsigned long> key, GetDnsCacheDumpHandler* handler);
       void setDnsCacheTTL(int ttl);
       void setDnsCacheSize(int size);
+      // Evict the least recently used entries once the cache takes up more
+      // than about "maxBytes".  0 means no limit (the default).
+      void setDnsCacheMaxBytes(size_t maxBytes);
+      // Re-query cached records that have been used at least "minHits" times
+      // when they come within "secsBeforeExpiry" of expiring, so that busy
+      // targets are never missing from the cache.  0 turns this off (the
+      // default).
+      void setDnsCacheRefreshAhead(int secsBeforeExpiry, unsigned int minHits = 2);
+      // Keep answering from expired records for up to "maxStaleSecs" while
+      // they are re-queried, and for as long as the DNS servers can't be
+      // reached within that time.  0 turns this off (the default).
+      void setDnsCacheServeStale(int maxStaleSecs);
+      // Keep a copy of the cache in "filename", so that a restart doesn't
+      // begin with an empty cache.  Whatever the file holds is loaded right
+      // away, and the cache is written back every "saveIntervalSecs" (0 for
+      // never) and when the stub is destroyed.  Only answers that haven't
+      // expired are kept, and they still expire when their TTLs say.
+      void setDnsCacheSnapshot(const Data& filename, int saveIntervalSecs = 0);
+      // Write the cache to "filename" now.
+      void saveDnsCache(const Data& filename);
       bool checkDnsChange();
       bool supportedType(int);
 
+      // Number of lookups sent to the DNS provider, and number that found an
+      // identical lookup (same target and type) already in flight and waited
+      // for its answer instead.  Only the DNS thread updates these.
+      UInt64 getIssuedQueryCount() const { return mIssuedQueries; }
+      UInt64 getCoalescedQueryCount() const { return mCoalescedQueries; }
+
       template<class QueryType> void lookup(const Data& target, DnsResultSink* sink)
       {
          lookup<QueryType>(target, Protocol::Reserved, sink);
@@ -277,6 +303,42 @@ class DnsStub : public ExternalDnsHandler
             bool mFollowCname;
       };
 
+      // (lowercased target, type)
+      typedef std::pair<Data, unsigned short> PendingLookupKey;
+
+      // A lookup sent to the DNS provider.  Anyone else who wants the same
+      // records while it is in flight waits for its answer rather than
+      // sending a lookup of their own.
+      class PendingLookup : public DnsRawSink
+      {
+         public:
+            PendingLookup(DnsStub& stub, const PendingLookupKey& key);
+
+            void addWaiter(DnsRawSink* sink);
+            void onDnsRaw(int status, const unsigned char* abuf, int alen);
+
+         private:
+            DnsStub& mStub;
+            PendingLookupKey mKey;
+            std::vector<DnsRawSink*> mWaiters;
+      };
+      typedef std::map<PendingLookupKey, PendingLookup*> PendingLookupMap;
+
+      // Re-queries cached records in the background (see
+      // setDnsCacheRefreshAhead() and setDnsCacheServeStale()).
+      class RefreshQuery : public DnsRawSink
+      {
+         public:
+            RefreshQuery(DnsStub& stub, const Data& target, int rrType);
+
+            void onDnsRaw(int status, const unsigned char* abuf, int alen);
+
+         private:
+            DnsStub& mStub;
+            Data mTarget;
+            int mRRType;
+      };
+
    private:
       DnsStub(const DnsStub&);   // disable copy ctor.
       DnsStub& operator=(const DnsStub&);
@@ -423,6 +485,50 @@ class DnsStub : public ExternalDnsHandler
             GetDnsCacheDumpHandler* mHandler;
       };
 
+      void doSetDnsCacheSnapshot(const Data& filename, int saveIntervalSecs);
+
+      class SetDnsCacheSnapshotCommand : public Command
+      {
+         public:
+            SetDnsCacheSnapshotCommand(DnsStub& stub, const Data& filename, int saveIntervalSecs)
+               : mStub(stub), mFilename(filename), mSaveIntervalSecs(saveIntervalSecs)
+            {}
+            ~SetDnsCacheSnapshotCommand() {}
+            void execute()
+            {
+               mStub.doSetDnsCacheSnapshot(mFilename, mSaveIntervalSecs);
+            }
+
+         private:
+            DnsStub& mStub;
+            Data mFilename;
+            int mSaveIntervalSecs;
+      };
+
+      void doSaveDnsCache(const Data& filename);
+
+      class SaveDnsCacheCommand : public Command
+      {
+         public:
+            SaveDnsCacheCommand(DnsStub& stub, const Data& filename)
+               : mStub(stub), mFilename(filename)
+            {}
+            ~SaveDnsCacheCommand() {}
+            void execute()
+            {
+               mStub.doSaveDnsCache(mFilename);
+            }
+
+         private:
+            DnsStub& mStub;
+            Data mFilename;
+      };
+
+      void loadDnsCache(const Data& filename);
+      // Takes "elapsed" seconds off the TTLs in a saved response; false if
+      // any of its records have run out.
+      bool ageSavedResponse(unsigned char* abuf, int alen, UInt32 elapsed);
+
       SelectInterruptor mSelectInterruptor;
       FdPollItemHandle mInterruptorHandle;
 
@@ -437,6 +543,8 @@ class DnsStub : public ExternalDnsHandler
                                          std::vector<RROverlay>&,
                                          bool discard=false);
       void removeQuery(Query*);
+      void refreshCacheEntry(const Data& target, int rrType);
+      void refreshCacheEntries(const std::vector<Data>& targets, int rrType);
       void lookupRecords(const Data& target, unsigned short type, DnsRawSink* sink);
       Data errorMessage(int status);
 
@@ -444,6 +552,13 @@ class DnsStub : public ExternalDnsHandler
       ExternalDns* mDnsProvider;
       FdPollGrp* mPollGrp;
       std::set<Query*> mQueries;
+      PendingLookupMap mPendingLookups;
+      std::set<RefreshQuery*> mRefreshQueries;
+      UInt64 mIssuedQueries;
+      UInt64 mCoalescedQueries;
+      Data mSnapshotFile;
+      int mSnapshotInterval;
+      UInt64 mNextSnapshot;
 
       std::vector<Data> mEnumSuffixes; // where to do enum lookups
       std::map<Data,Data> mEnumDomains;
@@ -23,14 +23,13 @@
 #endif
 #endif
 
-#include <set>
 #include <vector>
 #include <list>
 #include <map>
 #include <cassert>
 #include "rutil/BaseException.hxx"
 #include "rutil/Data.hxx"
-#include "rutil/Timer.hxx"
+#include "rutil/compat.hxx"
 #include "rutil/dns/RRFactory.hxx"
 #include "rutil/dns/RROverlay.hxx"
 #include "rutil/dns/RRFactory.hxx"
@@ -46,11 +45,45 @@
 using namespace resip;
 using namespace std;
 
+// Host names stick to token characters, which the cheaper token hash is
+// built for; anything else just hashes less evenly, as operator== is exact.
+RRCacheKey::RRCacheKey(const Data& domain, int rrType)
+   : mDomain(&domain),
+     mRRType(rrType),
+     mHash(domain.caseInsensitiveTokenHash() ^ (size_t)rrType)
+{
+}
+
+bool
+RRCacheKey::operator==(const RRCacheKey& rhs) const
+{
+   return mHash == rhs.mHash &&
+      mRRType == rhs.mRRType &&
+      isEqualNoCase(*mDomain, *rhs.mDomain);
+}
+
+bool
+RRCacheKey::operator<(const RRCacheKey& rhs) const
+{
+   if (mRRType != rhs.mRRType)
+   {
+      return mRRType < rhs.mRRType;
+   }
+   return isLessThanNoCase(*mDomain, *rhs.mDomain);
+}
+
+HashValueImp(resip::RRCacheKey, data.hash());
+
 RRCache::RRCache() 
    : mHead(),
      mLruHead(LruListType::makeList(&mHead)),
      mUserDefinedTTL(DEFAULT_USER_DEFINED_TTL),
-     mSize(DEFAULT_SIZE)
+     mSize(DEFAULT_SIZE),
+     mMaxBytes(0),
+     mBytes(0),
+     mRefreshAheadSecs(0),
+     mRefreshAheadMinHits(0),
+     mServeStaleSecs(0)
 {
    mFactoryMap[T_CNAME] = &mCnameRecordFactory;
    mFactoryMap[T_NAPTR] = &mNaptrRecordFacotry;
@@ -70,22 +103,19 @@ void
 RRCache::updateCacheFromHostFile(const DnsHostRecord &record)
 {
    //FactoryMap::iterator it = mFactoryMap.find(T_A);
-   RRList* key = new RRList(record, 3600);         
-   RRSet::iterator lb = mRRSet.lower_bound(key);
-   if (lb != mRRSet.end() &&
-       !(mRRSet.key_comp()(key, *lb)))
+   RRMap::iterator it = mRRMap.find(Key(record.name(), T_A));
+   if (it != mRRMap.end())
    {
-      (*lb)->update(record, 3600);
-      touch(*lb);
+      mBytes -= it->second->bytes();
+      it->second->update(record, 3600);
+      mBytes += it->second->bytes();
+      touch(it->second);
+      purge();
    }
    else
    {
-      RRList* val = new RRList(record, 3600);
-      mRRSet.insert(val);
-      mLruHead->push_back(val);
-      purge();
+      insert(new RRList(record, 3600));
    }
-   delete key;
 }
 
 void 
@@ -97,22 +127,19 @@ RRCache::updateCache(const Data& target,
    Data domain = (*begin).domain();
    FactoryMap::iterator it = mFactoryMap.find(rrType);
    assert(it != mFactoryMap.end());
-   RRList* key = new RRList(domain, rrType);         
-   RRSet::iterator lb = mRRSet.lower_bound(key);
-   if (lb != mRRSet.end() &&
-       !(mRRSet.key_comp()(key, *lb)))
+   RRMap::iterator lb = mRRMap.find(Key(domain, rrType));
+   if (lb != mRRMap.end())
    {
-      (*lb)->update(it->second, begin, end, mUserDefinedTTL);
-      touch(*lb);
+      mBytes -= lb->second->bytes();
+      lb->second->update(it->second, begin, end, mUserDefinedTTL);
+      mBytes += lb->second->bytes();
+      touch(lb->second);
+      purge();
    }
    else
    {
-      RRList* val = new RRList(it->second, domain, rrType, begin, end, mUserDefinedTTL);
-      mRRSet.insert(val);
-      mLruHead->push_back(val);
-      purge();
+      insert(new RRList(it->second, domain, rrType, begin, end, mUserDefinedTTL));
    }
-   delete key;
 }
 
 void 
@@ -133,17 +160,12 @@ RRCache::cacheTTL(const Data& target,
       ttl = mUserDefinedTTL;
    }
 
-   RRList* val = new RRList(target, rrType, ttl, status);
-   RRSet::iterator it = mRRSet.find(val);
-   if (it != mRRSet.end())
+   RRMap::iterator it = mRRMap.find(Key(target, rrType));
+   if (it != mRRMap.end())
    {
-      (*it)->remove();
-      delete *it;
-      mRRSet.erase(it);
+      erase(it);
    }
-   mRRSet.insert(val);
-   mLruHead->push_back(val);
-   purge();
+   insert(new RRList(target, rrType, ttl, status));
 }
 
 bool 
@@ -152,40 +174,121 @@ RRCache::lookup(const Data& target,
                 const int protocol,
                 Result& records, 
                 int& status)
+{
+   return doLookup(target, type, protocol, records, status, 0);
+}
+
+bool 
+RRCache::lookup(const Data& target, 
+                const int type, 
+                const int protocol,
+                Result& records, 
+                int& status,
+                bool& refresh)
+{
+   refresh = false;
+   return doLookup(target, type, protocol, records, status, &refresh);
+}
+
+bool 
+RRCache::doLookup(const Data& target, 
+                  const int type, 
+                  const int protocol,
+                  Result& records, 
+                  int& status,
+                  bool* refresh)
 {
    records.empty();
    status = 0;
-   RRList* key = new RRList(target, type);
-   RRSet::iterator it = mRRSet.find(key);
-   delete key;
-   if (it == mRRSet.end())
+   RRMap::iterator it = mRRMap.find(Key(target, type));
+   if (it == mRRMap.end())
    {
       return false;
    }
    else
    {
-      if (Timer::getTimeSecs() >= (*it)->absoluteExpiry())
+      UInt64 now = RRList::now();
+      RRList* node = it->second;
+      if (isGone(node, now))
       {
-         delete *it;
-         mRRSet.erase(it);
+         erase(it);
          return false;
       }
       else
       {
-         records = (*it)->records(protocol);
-         status = (*it)->status();
-         touch(*it);
+         node->hit();
+         if (refresh && !node->refreshPending() && node->status() == 0)
+         {
+            // Stale, or about to expire and worth keeping.
+            if (now >= node->absoluteExpiry() ||
+                (mRefreshAheadSecs > 0 &&
+                 node->hits() >= mRefreshAheadMinHits &&
+                 now + mRefreshAheadSecs >= node->absoluteExpiry()))
+            {
+               node->setRefreshPending(true);
+               *refresh = true;
+            }
+         }
+         records = node->records(protocol);
+         status = node->status();
+         touch(node);
          return true;
       }
    }
 }
 
+void
+RRCache::endRefresh(const Data& target, const int type)
+{
+   RRMap::iterator it = mRRMap.find(Key(target, type));
+   if (it != mRRMap.end())
+   {
+      it->second->setRefreshPending(false);
+   }
+}
+
+bool
+RRCache::isGone(const RRList* node, UInt64 now) const
+{
+   // Only answers with records are worth serving stale.
+   if (mServeStaleSecs > 0 && node->status() == 0 && !node->empty())
+   {
+      return now >= node->absoluteExpiry() + mServeStaleSecs;
+   }
+   return now >= node->absoluteExpiry();
+}
+
+void
+RRCache::setMaxBytes(size_t maxBytes)
+{
+   mMaxBytes = maxBytes;
+   purge();
+}
+
 void 
 RRCache::clearCache()
 {
     cleanup();
 }
 
+void
+RRCache::insert(RRList* node)
+{
+   mRRMap[Key(node->key(), node->rrType())] = node;
+   mLruHead->push_back(node);
+   mBytes += node->bytes();
+   purge();
+}
+
+void
+RRCache::erase(RRMap::iterator it)
+{
+   RRList* node = it->second;
+   mBytes -= node->bytes();
+   mRRMap.erase(it);
+   delete node;
+}
+
 void 
 RRCache::touch(RRList* node)
 {
@@ -196,12 +299,12 @@ RRCache::touch(RRList* node)
 void 
 RRCache::cleanup()
 {
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); it++)
+   for (RRMap::iterator it = mRRMap.begin(); it != mRRMap.end(); it++)
    {
-      (*it)->remove();
-      delete *it;
+      delete it->second;
    }
-   mRRSet.clear();
+   mRRMap.clear();
+   mBytes = 0;
 }
 
 int 
@@ -226,29 +329,30 @@ RRCache::getTTL(const RROverlay& overlay)
 void 
 RRCache::purge()
 {
-   if (mRRSet.size() < mSize) return;
-   RRList* lst = *(mLruHead->begin());
-   RRSet::iterator it = mRRSet.find(lst);
-   assert(it != mRRSet.end());
-   lst->remove();
-   delete *it;
-   mRRSet.erase(it);
+   // The newest entry stays, however big it is.
+   while (mRRMap.size() > 1 &&
+          (mRRMap.size() >= mSize || (mMaxBytes && mBytes > mMaxBytes)))
+   {
+      RRList* lst = *(mLruHead->begin());
+      RRMap::iterator it = mRRMap.find(Key(lst->key(), lst->rrType()));
+      assert(it != mRRMap.end());
+      erase(it);
+   }
 }
 
 void 
 RRCache::logCache()
 {
-   UInt64 now = Timer::getTimeSecs();
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); )
+   UInt64 now = RRList::now();
+   for (RRMap::iterator it = mRRMap.begin(); it != mRRMap.end(); )
    {
-      if (now >= (*it)->absoluteExpiry())
+      if (isGone(it->second, now))
       {
-         delete *it;
-         mRRSet.erase(it++);
+         erase(it++);
       }
       else
       {
-         (*it)->log();
+         it->second->log();
          ++it;
       }
    }
@@ -257,24 +361,43 @@ RRCache::logCache()
 void 
 RRCache::getCacheDump(Data& dnsCacheDump)
 {
-   UInt64 now = Timer::getTimeSecs();
+   UInt64 now = RRList::now();
    DataStream strm(dnsCacheDump);
-   for (std::set<RRList*, CompareT>::iterator it = mRRSet.begin(); it != mRRSet.end(); )
+   for (RRMap::iterator it = mRRMap.begin(); it != mRRMap.end(); )
    {
-      if (now >= (*it)->absoluteExpiry())
+      if (isGone(it->second, now))
       {
-         delete *it;
-         mRRSet.erase(it++);
+         erase(it++);
       }
       else
       {
-         (*it)->encodeRRList(strm);
+         it->second->encodeRRList(strm);
          ++it;
       }
    }
    strm.flush();
 }
 
+void
+RRCache::getSnapshot(std::vector<Data>& responses)
+{
+   UInt64 now = RRList::now();
+   for (RRMap::iterator it = mRRMap.begin(); it != mRRMap.end(); ++it)
+   {
+      RRList* node = it->second;
+      if (node->absoluteExpiry() <= now)
+      {
+         continue;
+      }
+      UInt64 ttl = resipMin(node->absoluteExpiry() - now, (UInt64)0x7fffffff);
+      Data response;
+      if (node->encodeResponse(response, (UInt32)ttl))
+      {
+         responses.push_back(response);
+      }
+   }
+}
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
@@ -2,9 +2,9 @@
 #define RESIP_RRCACHE_HXX
 
 #include <map>
-#include <set>
 #include <memory>
 
+#include "rutil/HashMap.hxx"
 #include "rutil/dns/RRFactory.hxx"
 #include "rutil/dns/DnsResourceRecord.hxx"
 #include "rutil/dns/DnsAAAARecord.hxx"
@@ -18,6 +18,32 @@ namespace resip
 {
 class RROverlay;
 
+/**
+   What an RRCache entry is filed under: its domain, ignoring case, and
+   record type, with their hash worked out up front.  The domain isn't
+   copied; the cache's own keys refer to the one in their RRList.
+*/
+class RRCacheKey
+{
+   public:
+      RRCacheKey(const Data& domain, int rrType);
+      bool operator==(const RRCacheKey& rhs) const;
+      bool operator<(const RRCacheKey& rhs) const;
+      size_t hash() const { return mHash; }
+
+   private:
+      const Data* mDomain;
+      int mRRType;
+      size_t mHash;
+};
+
+}
+
+HashValue(resip::RRCacheKey);
+
+namespace resip
+{
+
 class RRCache
 {
    public:
@@ -31,6 +57,12 @@ class RRCache
       ~RRCache();
       void setTTL(int ttl) { if (ttl > 0) mUserDefinedTTL = ttl * MIN_TO_SEC; }
       void setSize(int size) { mSize = size; }
+      // Evicts the least recently used entries once they take up more than
+      // about "maxBytes" between them.  0 means no limit (the default).
+      void setMaxBytes(size_t maxBytes);
+      // Number of entries, and roughly how much memory they use.
+      size_t size() const { return mRRMap.size(); }
+      size_t bytes() const { return mBytes; }
       // Update existing cache record, or add a new one
       void updateCache(const Data& target,
                        const int rrType,
@@ -43,36 +75,50 @@ class RRCache
                     const int status,
                     RROverlay overlay);
       bool lookup(const Data& target, const int type, const int proto, Result& records, int& status);
+      // As above, but also sets "refresh" when the caller should re-query the
+      // records in the background (see setRefreshAhead() and setServeStale())
+      // and hand the answer to updateCache() or cacheTTL(), then call
+      // endRefresh() whatever the outcome.  Only one caller at a time is told
+      // to refresh a given entry.
+      bool lookup(const Data& target, const int type, const int proto, Result& records, int& status, bool& refresh);
+      void endRefresh(const Data& target, const int type);
+
+      // Entries that have been looked up at least "minHits" times ask to be
+      // refreshed once they are within "secsBeforeExpiry" of expiring, so
+      // that busy targets never drop out of the cache.  0 turns this off (the
+      // default).
+      void setRefreshAhead(int secsBeforeExpiry, unsigned int minHits)
+      {
+         mRefreshAheadSecs = secsBeforeExpiry > 0 ? secsBeforeExpiry : 0;
+         mRefreshAheadMinHits = minHits;
+      }
+      // Expired positive answers are still returned for up to "maxStaleSecs",
+      // asking to be refreshed, so lookups keep working while a refresh is in
+      // flight or while the DNS servers can't be reached.  0 turns this off
+      // (the default).
+      void setServeStale(int maxStaleSecs) { mServeStaleSecs = maxStaleSecs > 0 ? maxStaleSecs : 0; }
       void clearCache();
       void logCache();
       void getCacheDump(Data& dnsCacheDump);
+      // A DNS response for each unexpired, positive entry, with what is left
+      // of its TTL; feeding them back in through updateCache() restores the
+      // entries.
+      void getSnapshot(std::vector<Data>& responses);
 
    private:
       static const int MIN_TO_SEC = 60;
       static const int DEFAULT_USER_DEFINED_TTL = 10; // in seconds.
 
       static const int DEFAULT_SIZE = 512;
-      class CompareT  : public std::binary_function<const RRList*, const RRList*, bool>
-      {
-         public:
-            bool operator()(RRList* lhs, RRList* rhs) const
-            {
-               if (lhs->rrType() < rhs->rrType())
-               {
-                  return true;
-               }
-               else if (lhs->rrType() > rhs->rrType())
-               {
-                  return false;
-               }
-               else
-               {
-                  return lhs->key() < rhs->key();
-               }
-            }
-      };
 
+      typedef RRCacheKey Key;
+      typedef HashMap<Key, RRList*> RRMap;
+
+      void insert(RRList* node);
+      void erase(RRMap::iterator it);
       void touch(RRList* node);
+      bool doLookup(const Data& target, const int type, const int proto, Result& records, int& status, bool* refresh);
+      bool isGone(const RRList* node, UInt64 now) const;
       void cleanup();
       int getTTL(const RROverlay& overlay);
       void purge();
@@ -81,8 +127,7 @@ class RRCache
       LruListType* mLruHead;                     
       Result Empty;
 
-      typedef std::set<RRList*, CompareT> RRSet;
-      RRSet mRRSet;
+      RRMap mRRMap;
 
       RRFactory<DnsHostRecord> mHostRecordFactory;
       RRFactory<DnsSrvRecord> mSrvRecordFactory;
@@ -95,6 +140,11 @@ class RRCache
       
       int mUserDefinedTTL; // used when the ttl in RR is 0 or less than default(60). in seconds.
       unsigned int mSize;
+      size_t mMaxBytes;
+      size_t mBytes;
+      int mRefreshAheadSecs;
+      unsigned int mRefreshAheadMinHits;
+      int mServeStaleSecs;
 };
 
 }
@@ -12,6 +12,7 @@ class RRFactoryBase
    public:
       virtual ~RRFactoryBase() {}
       virtual DnsResourceRecord* create(const RROverlay&) const = 0;
+      virtual size_t recordSize() const = 0;
 };
 
 template<class T>
@@ -22,6 +23,7 @@ class RRFactory : public RRFactoryBase
       {
          return new T(overlay);
       }
+      virtual size_t recordSize() const { return sizeof(T); }
 };
 
 }
@@ -36,19 +36,27 @@ using namespace std;
 
 #define RESIPROCATE_SUBSYSTEM resip::Subsystem::DNS
 
-RRList::RRList() : mRRType(0), mStatus(0), mAbsoluteExpiry(ULONG_MAX) {}
+RRList::Clock RRList::mClock = &Timer::getTimeSecs;
+
+void
+RRList::setClock(Clock clock)
+{
+   mClock = clock ? clock : &Timer::getTimeSecs;
+}
+
+RRList::RRList() : mRRType(0), mStatus(0), mAbsoluteExpiry(ULONG_MAX), mHits(0), mRefreshPending(false), mBytes(sizeof(RRList)) {}
 
 RRList::RRList(const Data& key, 
                const int rrtype, 
                int ttl, 
                int status)
-   : mKey(key), mRRType(rrtype), mStatus(status)
+   : mKey(key), mRRType(rrtype), mStatus(status), mHits(0), mRefreshPending(false), mBytes(sizeof(RRList) + mKey.size())
 {
-   mAbsoluteExpiry = ttl + Timer::getTimeSecs();
+   mAbsoluteExpiry = ttl + now();
 }
 
 RRList::RRList(const DnsHostRecord &record, int ttl)
-   : mKey(record.name()), mRRType(T_A), mStatus(0), mAbsoluteExpiry(ULONG_MAX)
+   : mKey(record.name()), mRRType(T_A), mStatus(0), mAbsoluteExpiry(ULONG_MAX), mHits(0), mRefreshPending(false), mBytes(sizeof(RRList) + mKey.size())
 {
    update(record, ttl);
 }
@@ -60,11 +68,14 @@ void RRList::update(const DnsHostRecord &record, int ttl)
    RecordItem item;
    item.record = new DnsHostRecord(record);
    mRecords.push_back(item);
-   mAbsoluteExpiry = Timer::getTimeSecs() + ttl;
+   mBytes += sizeof(RecordItem) + sizeof(DnsHostRecord) + record.name().size();
+   mAbsoluteExpiry = now() + ttl;
+   mHits = 0;
+   mRefreshPending = false;
 }
       
 RRList::RRList(const Data& key, int rrtype)
-   : mKey(key), mRRType(rrtype), mStatus(0), mAbsoluteExpiry(ULONG_MAX)
+   : mKey(key), mRRType(rrtype), mStatus(0), mAbsoluteExpiry(ULONG_MAX), mHits(0), mRefreshPending(false), mBytes(sizeof(RRList) + mKey.size())
 {}
 
 RRList::~RRList()
@@ -78,7 +89,7 @@ RRList::RRList(const RRFactoryBase* factory,
                Itr begin,
                Itr end, 
                int ttl)
-   : mKey(key), mRRType(rrType), mStatus(0)
+   : mKey(key), mRRType(rrType), mStatus(0), mHits(0), mRefreshPending(false), mBytes(sizeof(RRList) + mKey.size())
 {
    update(factory, begin, end, ttl);
 }
@@ -87,6 +98,8 @@ void RRList::update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl)
 {
    this->clear();
    mAbsoluteExpiry = ULONG_MAX;
+   mHits = 0;
+   mRefreshPending = false;
    
    for (Itr it = begin; it != end; it++)
    {
@@ -95,6 +108,7 @@ void RRList::update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl)
          RecordItem item;
          item.record = factory->create(*it);
          mRecords.push_back(item);
+         mBytes += sizeof(RecordItem) + factory->recordSize() + it->domain().size() + it->dataLength();
          if ((UInt64)it->ttl() < mAbsoluteExpiry)
          {
             mAbsoluteExpiry = it->ttl();
@@ -111,7 +125,7 @@ void RRList::update(const RRFactoryBase* factory, Itr begin, Itr end, int ttl)
       mAbsoluteExpiry = ttl;
    }
 
-   mAbsoluteExpiry += Timer::getTimeSecs();
+   mAbsoluteExpiry += now();
 }
 
 RRList::Records RRList::records(const int protocol)
@@ -145,6 +159,7 @@ void RRList::clear()
       delete (*it).record;
    }
    mRecords.clear();
+   mBytes = sizeof(RRList) + mKey.size();
 }
 
 EncodeStream&
@@ -203,7 +218,20 @@ RRList::encodeRecordItem(RRList::RecordItem& item, EncodeStream& strm)
       break;
    }
 
-   strm << " secsToExpirey=" << (mAbsoluteExpiry - Timer::getTimeSecs()) << " status=" << mStatus;
+   UInt64 now = RRList::now();
+   if (now < mAbsoluteExpiry)
+   {
+      strm << " secsToExpirey=" << (mAbsoluteExpiry - now);
+   }
+   else
+   {
+      strm << " stale secsSinceExpiry=" << (now - mAbsoluteExpiry);
+   }
+   strm << " status=" << mStatus << " hits=" << mHits;
+   if (mRefreshPending)
+   {
+      strm << " refreshing";
+   }
    strm.flush();
    return strm;
 }
@@ -232,6 +260,183 @@ RRList:: encodeRRList(EncodeStream& strm)
 }
 
 
+static void
+appendShort(Data& msg, unsigned int v)
+{
+   msg += (char)((v >> 8) & 0xff);
+   msg += (char)(v & 0xff);
+}
+
+static void
+appendLong(Data& msg, UInt32 v)
+{
+   appendShort(msg, v >> 16);
+   appendShort(msg, v & 0xffff);
+}
+
+// Uncompressed, and empty for the root; false if the name can't be written
+// that way.
+static bool
+appendName(Data& msg, const Data& name)
+{
+   if (name.size() > 253)
+   {
+      return false;
+   }
+   const char* start = name.data();
+   const char* end = start + name.size();
+   while (start < end)
+   {
+      const char* dot = start;
+      while (dot < end && *dot != '.')
+      {
+         ++dot;
+      }
+      size_t len = dot - start;
+      if (len == 0 || len > 63)
+      {
+         return false;
+      }
+      msg += (char)len;
+      msg.append(start, (Data::size_type)len);
+      start = dot + 1;
+   }
+   msg += (char)0;
+   return true;
+}
+
+static bool
+appendString(Data& msg, const Data& str)
+{
+   if (str.size() > 255)
+   {
+      return false;
+   }
+   msg += (char)str.size();
+   msg += str;
+   return true;
+}
+
+bool
+RRList::encodeRecordData(RRList::RecordItem& item, Data& rdata)
+{
+   switch(mRRType)
+   {
+   case T_CNAME:
+      {
+         DnsCnameRecord* record = dynamic_cast<DnsCnameRecord*>(item.record);
+         assert(record);
+         return appendName(rdata, record->cname());
+      }
+
+   case T_NAPTR:
+      {
+         DnsNaptrRecord* record = dynamic_cast<DnsNaptrRecord*>(item.record);
+         assert(record);
+         appendShort(rdata, record->order());
+         appendShort(rdata, record->preference());
+
+         // Only the expression and its replacement survive parsing; put them
+         // back between delimiters that neither of them uses.
+         Data regexp;
+         const Data& expr = record->regexp().regexp();
+         const Data& repl = record->regexp().replacement();
+         if (!expr.empty() || !repl.empty())
+         {
+            const char* delims = "!#|/~%@";
+            for (; *delims; ++delims)
+            {
+               if (expr.find(Data(*delims)) == Data::npos && repl.find(Data(*delims)) == Data::npos)
+               {
+                  break;
+               }
+            }
+            if (!*delims)
+            {
+               return false;
+            }
+            regexp = Data(*delims) + expr + Data(*delims) + repl + Data(*delims);
+         }
+         return (appendString(rdata, record->flags()) &&
+                 appendString(rdata, record->service()) &&
+                 appendString(rdata, regexp) &&
+                 appendName(rdata, record->replacement()));
+      }
+
+   case T_SRV:
+      {
+         DnsSrvRecord* record = dynamic_cast<DnsSrvRecord*>(item.record);
+         assert(record);
+         appendShort(rdata, record->priority());
+         appendShort(rdata, record->weight());
+         appendShort(rdata, record->port());
+         return appendName(rdata, record->target());
+      }
+
+#ifdef USE_IPV6
+   case T_AAAA:
+      {
+         DnsAAAARecord* record = dynamic_cast<DnsAAAARecord*>(item.record);
+         assert(record);
+         rdata.append((const char*)&record->v6Address(), sizeof(in6_addr));
+         return true;
+      }
+#endif
+
+   case T_A:
+      {
+         DnsHostRecord* record = dynamic_cast<DnsHostRecord*>(item.record);
+         assert(record);
+         in_addr addr = record->addr();
+         rdata.append((const char*)&addr, sizeof(in_addr));
+         return true;
+      }
+   default:
+      return false;
+   }
+}
+
+bool
+RRList::encodeResponse(Data& msg, UInt32 ttl)
+{
+   if (mStatus != 0 || mRecords.empty())
+   {
+      return false;
+   }
+
+   Data response;
+   const unsigned char header[] = { 0, 0, 0x81, 0x80, 0, 1 };
+   response.append((const char*)header, sizeof(header));
+   appendShort(response, (unsigned int)mRecords.size());
+   appendLong(response, 0); // no authority or additional records
+   if (!appendName(response, mKey))
+   {
+      return false;
+   }
+   appendShort(response, mRRType);
+   appendShort(response, C_IN);
+
+   for (RecordArr::iterator it = mRecords.begin(); it != mRecords.end(); ++it)
+   {
+      Data rdata;
+      if (!appendName(response, it->record->name()) ||
+          !encodeRecordData(*it, rdata) ||
+          rdata.size() > 0xffff)
+      {
+         return false;
+      }
+      appendShort(response, mRRType);
+      appendShort(response, C_IN);
+      appendLong(response, ttl);
+      appendShort(response, (unsigned int)rdata.size());
+      response += rdata;
+   }
+
+   msg += response;
+   return true;
+}
+
+
 /* ====================================================================
  * The Vovida Software License, Version 1.0 
  * 
@@ -29,6 +29,13 @@ class RRList : public IntrusiveListElement<RRList*>
       typedef IntrusiveListElement<RRList*> LruList;
       typedef std::vector<RROverlay>::const_iterator Itr;
       typedef std::vector<Data> DataArr;
+      typedef UInt64 (*Clock)();
+
+      // Where the cache gets the time (in seconds) that expiry is measured
+      // against; Timer::getTimeSecs() unless a test has set another.  0
+      // restores the default.
+      static void setClock(Clock clock);
+      static UInt64 now() { return mClock(); }
 
       RRList();
       explicit RRList(const Data& key, const int rrtype, int ttl, int status);
@@ -52,10 +59,25 @@ class RRList : public IntrusiveListElement<RRList*>
       int rrType() const { return mRRType; }
       UInt64 absoluteExpiry() const { return mAbsoluteExpiry; }
       UInt64& absoluteExpiry() { return mAbsoluteExpiry; }
+      bool empty() const { return mRecords.empty(); }
+
+      // Lookups since the records were last filled in.
+      unsigned int hits() const { return mHits; }
+      void hit() { ++mHits; }
+      // Whether someone is already re-querying these records.
+      bool refreshPending() const { return mRefreshPending; }
+      void setRefreshPending(bool pending) { mRefreshPending = pending; }
+      // Roughly how much memory this entry and its records take up.
+      size_t bytes() const { return mBytes; }
       void log();
       EncodeStream& encodeRRList(EncodeStream& strm);
+      // Appends a DNS response carrying these records, as if they had just
+      // been looked up with "ttl" seconds to live.  False, and nothing
+      // appended, for failed lookups or records that can't be written out.
+      bool encodeResponse(Data& msg, UInt32 ttl);
 
    private:
+      static Clock mClock;
 
       struct RecordItem
       {
@@ -73,10 +95,14 @@ class RRList : public IntrusiveListElement<RRList*>
 
       int mStatus; // dns query status.
       UInt64 mAbsoluteExpiry;
+      unsigned int mHits;
+      bool mRefreshPending;
+      size_t mBytes;
 
       RecordItr find(const Data&);
       void clear();
       EncodeStream& encodeRecordItem(RRList::RecordItem& item, EncodeStream& strm);
+      bool encodeRecordData(RRList::RecordItem& item, Data& rdata);
 };
 
 }
@@ -0,0 +1,550 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "rutil/dns/AresCompat.hxx"
+#include "rutil/dns/DnsStub.hxx"
+#include "rutil/dns/ExternalDns.hxx"
+#include "rutil/dns/ExternalDnsFactory.hxx"
+#include "rutil/dns/QueryTypes.hxx"
+#include "rutil/dns/RRList.hxx"
+#include "rutil/ParseBuffer.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+// The cache's clock, which the tests move on rather than waiting.
+static UInt64 gSecsPassed = 0;
+
+static UInt64
+testClock()
+{
+   return Timer::getTimeSecs() + gSecsPassed;
+}
+
+// Stands in for ares: remembers what it was asked, and the test answers.
+class FakeDns : public ExternalDns
+{
+   public:
+      struct Lookup
+      {
+         Data target;
+         unsigned short type;
+         ExternalDnsHandler* handler;
+         void* userData;
+      };
+
+      virtual int init(const std::vector<GenericIPAddress>&, AfterSocketCreationFuncPtr,
+                       int, int, unsigned int) { return Success; }
+      virtual bool checkDnsChange() { return false; }
+      virtual unsigned int getTimeTillNextProcessMS() { return 1000; }
+      virtual void buildFdSet(fd_set&, fd_set&, int&) {}
+      virtual void process(fd_set&, fd_set&) {}
+      virtual void setPollGrp(FdPollGrp*) {}
+      virtual void processTimers() {}
+      virtual void freeResult(ExternalDnsRawResult) {}
+      virtual void freeResult(ExternalDnsHostResult) {}
+      virtual char* errorMessage(long errorCode)
+      {
+         Data msg("error " + Data((int)errorCode));
+         char* copy = new char[msg.size() + 1];
+         strcpy(copy, msg.c_str());
+         return copy;
+      }
+      virtual void lookup(const char* target, unsigned short type, ExternalDnsHandler* handler, void* userData)
+      {
+         Lookup lookup;
+         lookup.target = target;
+         lookup.type = type;
+         lookup.handler = handler;
+         lookup.userData = userData;
+         mLookups.push_back(lookup);
+      }
+      virtual bool hostFileLookup(const char*, in_addr&) { return false; }
+      virtual bool hostFileLookupLookupOnlyMode() { return false; }
+
+      // Answers the oldest outstanding lookup.
+      static void answer(int status, const Data& response)
+      {
+         assert(!mLookups.empty());
+         Lookup lookup = mLookups.front();
+         mLookups.erase(mLookups.begin());
+         lookup.handler->handleDnsRaw(ExternalDnsRawResult(status,
+                                                           (unsigned char*)response.data(),
+                                                           (int)response.size(),
+                                                           lookup.userData));
+      }
+
+      static vector<Lookup> mLookups;
+};
+
+vector<FakeDns::Lookup> FakeDns::mLookups;
+
+class FakeDnsCreator : public ExternalDnsCreator
+{
+   public:
+      virtual ExternalDns* createExternalDns() { return new FakeDns; }
+};
+
+class Sink : public DnsResultSink
+{
+   public:
+      Sink() : mResults(0), mErrors(0) {}
+
+      virtual void onDnsResult(const DNSResult<DnsHostRecord>& result)
+      {
+         record(result.status, result.records.size());
+         if (result.status == 0)
+         {
+            assert(result.records[0].host() == "192.0.2.7");
+         }
+      }
+      virtual void onDnsResult(const DNSResult<DnsAAAARecord>& result) { record(result.status, result.records.size()); }
+      virtual void onDnsResult(const DNSResult<DnsSrvRecord>& result) { record(result.status, result.records.size()); }
+      virtual void onDnsResult(const DNSResult<DnsNaptrRecord>& result) { record(result.status, result.records.size()); }
+      virtual void onDnsResult(const DNSResult<DnsCnameRecord>& result) { record(result.status, result.records.size()); }
+
+      void record(int status, size_t records)
+      {
+         if (status == 0)
+         {
+            assert(records == 1);
+            ++mResults;
+         }
+         else
+         {
+            ++mErrors;
+         }
+      }
+
+      int mResults;
+      int mErrors;
+};
+
+class DumpHandler : public GetDnsCacheDumpHandler
+{
+   public:
+      virtual void onDnsCacheDumpRetrieved(std::pair<unsigned long, unsigned long>, const Data& dnsCache)
+      {
+         mDump = dnsCache;
+      }
+
+      Data mDump;
+};
+
+static Data
+encodeName(const Data& name)
+{
+   Data r;
+   ParseBuffer pb(name);
+   while (!pb.eof())
+   {
+      const char* start = pb.position();
+      pb.skipToChar('.');
+      r += (char)(pb.position() - start);
+      r.append(start, (Data::size_type)(pb.position() - start));
+      if (!pb.eof())
+      {
+         pb.skipChar();
+      }
+   }
+   r += (char)0;
+   return r;
+}
+
+static Data
+charString(const Data& str)
+{
+   return Data((char)str.size()) + str;
+}
+
+// A response to a "type" query for "name", with one answer holding "rdata".
+static Data
+response(const Data& name, unsigned char type, UInt32 ttl, const Data& rdata)
+{
+   Data r;
+   const unsigned char header[] = { 0x12, 0x34, 0x81, 0x80, 0, 1, 0, 1, 0, 0, 0, 0 };
+   r.append((const char*)header, sizeof(header));
+   r += encodeName(name);
+   const unsigned char question[] = { 0, type, 0, 1 };
+   r.append((const char*)question, sizeof(question));
+   const unsigned char answer[] = { 0xc0, 0x0c, 0, type, 0, 1,
+                                    (unsigned char)(ttl >> 24), (unsigned char)(ttl >> 16),
+                                    (unsigned char)(ttl >> 8), (unsigned char)ttl,
+                                    (unsigned char)(rdata.size() >> 8), (unsigned char)rdata.size() };
+   r.append((const char*)answer, sizeof(answer));
+   r += rdata;
+   return r;
+}
+
+// A response to an A query for "name", with one answer of 192.0.2.7.
+static Data
+aResponse(const Data& name, UInt32 ttl)
+{
+   const unsigned char addr[] = { 192, 0, 2, 7 };
+   return response(name, 1, ttl, Data((const char*)addr, sizeof(addr)));
+}
+
+static Data
+cnameResponse(const Data& name, UInt32 ttl, const Data& cname)
+{
+   return response(name, 5, ttl, encodeName(cname));
+}
+
+static Data
+srvResponse(const Data& name, UInt32 ttl, const Data& target)
+{
+   const unsigned char fixed[] = { 0, 10, 0, 20, 0x13, 0xc4 }; // port 5060
+   return response(name, 33, ttl, Data((const char*)fixed, sizeof(fixed)) + encodeName(target));
+}
+
+static Data
+naptrResponse(const Data& name, UInt32 ttl, const Data& regexp)
+{
+   const unsigned char fixed[] = { 0, 10, 0, 100 };
+   return response(name, 35, ttl,
+                   Data((const char*)fixed, sizeof(fixed)) +
+                   charString("u") + charString("E2U+sip") + charString(regexp) + Data((char)0));
+}
+
+static void
+testCoalescing()
+{
+   cerr << "!! Test coalescing" << endl;
+   DnsStub stub;
+   Sink sink;
+
+   // Five transactions want the same trunk while its A record is missing;
+   // the name's case doesn't matter.
+   for (int i = 0; i < 5; ++i)
+   {
+      stub.lookup<RR_A>(i % 2 ? "trunk.example.com" : "Trunk.Example.COM", Protocol::Sip, &sink);
+   }
+   stub.processTimers();
+   assert(FakeDns::mLookups.size() == 1);
+   assert(stub.getIssuedQueryCount() == 1);
+   assert(stub.getCoalescedQueryCount() == 4);
+   assert(sink.mResults == 0);
+
+   // Something else for the same name goes out on its own.
+   stub.lookup<RR_SRV>("trunk.example.com", Protocol::Sip, &sink);
+   stub.lookup<RR_SRV>("trunk.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(FakeDns::mLookups.size() == 2);
+   assert(stub.getIssuedQueryCount() == 2);
+   assert(stub.getCoalescedQueryCount() == 5);
+
+   // They all get the one answer.
+   FakeDns::answer(0, aResponse("trunk.example.com", 600));
+   assert(sink.mResults == 5);
+   assert(sink.mErrors == 0);
+
+   // ... and the one failure.
+   FakeDns::answer(ARES_ETIMEOUT, Data::Empty);
+   assert(sink.mErrors == 2);
+
+   // Now it's cached.
+   stub.lookup<RR_A>("trunk.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(FakeDns::mLookups.empty());
+   assert(sink.mResults == 6);
+   assert(stub.getIssuedQueryCount() == 2);
+
+   // Once an answer is in, the next lookup for it goes out again.
+   stub.lookup<RR_SRV>("trunk.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(FakeDns::mLookups.size() == 1);
+   assert(stub.getIssuedQueryCount() == 3);
+   assert(stub.getCoalescedQueryCount() == 5);
+
+   // Whatever is still in flight is cleaned up with the stub.
+}
+
+static void
+testRefreshAhead()
+{
+   cerr << "!! Test refresh ahead" << endl;
+   DnsStub stub;
+   stub.setDnsCacheRefreshAhead(60, 3);
+   Sink sink;
+
+   stub.lookup<RR_A>("busy.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   FakeDns::answer(0, aResponse("busy.example.com", 30));
+   assert(sink.mResults == 1);
+
+   // Expires within the minute, but isn't used enough yet...
+   stub.lookup<RR_A>("busy.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(FakeDns::mLookups.empty());
+   assert(sink.mResults == 2);
+
+   // ... now it is.  The answer comes from the cache, and it's refreshed.
+   stub.lookup<RR_A>("busy.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(sink.mResults == 3);
+   assert(FakeDns::mLookups.size() == 1);
+   assert(FakeDns::mLookups[0].target == "busy.example.com");
+
+   // Once is enough.
+   stub.lookup<RR_A>("busy.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(sink.mResults == 4);
+   assert(FakeDns::mLookups.size() == 1);
+
+   // A longer TTL this time, so it's a while before the next refresh.
+   FakeDns::answer(0, aResponse("busy.example.com", 3600));
+   for (int i = 0; i < 5; ++i)
+   {
+      stub.lookup<RR_A>("busy.example.com", Protocol::Sip, &sink);
+   }
+   stub.processTimers();
+   assert(sink.mResults == 9);
+   assert(FakeDns::mLookups.empty());
+   assert(sink.mErrors == 0);
+}
+
+static void
+testServeStale()
+{
+   cerr << "!! Test serve stale" << endl;
+   DnsStub stub;
+   stub.setDnsCacheServeStale(60);
+   Sink sink;
+
+   stub.lookup<RR_A>("trunk.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   // The cache keeps everything for at least 10 seconds.
+   FakeDns::answer(0, aResponse("trunk.example.com", 1));
+   assert(sink.mResults == 1);
+   gSecsPassed += 11;
+
+   // Expired, but still answered from the cache while it is refreshed.
+   stub.lookup<RR_A>("trunk.example.com", Protocol::Sip, &sink);
+   stub.lookup<RR_A>("trunk.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(sink.mResults == 3);
+   assert(FakeDns::mLookups.size() == 1);
+
+   DumpHandler dump;
+   stub.getDnsCacheDump(std::make_pair(0ul, 0ul), &dump);
+   stub.processTimers();
+   assert(dump.mDump.find("stale") != Data::npos);
+   assert(dump.mDump.find("refreshing") != Data::npos);
+
+   // The DNS servers are down; carry on with what we have, and try again
+   // next time.
+   FakeDns::answer(ARES_ETIMEOUT, Data::Empty);
+   stub.lookup<RR_A>("trunk.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(sink.mResults == 4);
+   assert(FakeDns::mLookups.size() == 1);
+
+   // They're back.
+   FakeDns::answer(0, aResponse("trunk.example.com", 600));
+   stub.lookup<RR_A>("trunk.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(sink.mResults == 5);
+   assert(FakeDns::mLookups.empty());
+   assert(sink.mErrors == 0);
+
+   stub.getDnsCacheDump(std::make_pair(0ul, 0ul), &dump);
+   stub.processTimers();
+   assert(dump.mDump.find("stale") == Data::npos);
+   assert(dump.mDump.find("secsToExpirey=") != Data::npos);
+}
+
+static void
+testStaleCnameChain()
+{
+   cerr << "!! Test stale CNAME chain" << endl;
+   DnsStub stub;
+   stub.setDnsCacheServeStale(60);
+   Sink sink;
+
+   // sip -> edge -> host, a hop at a time.
+   stub.lookup<RR_A>("sip.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   FakeDns::answer(0, cnameResponse("sip.example.com", 1, "edge.example.com"));
+   assert(FakeDns::mLookups.size() == 1);
+   assert(FakeDns::mLookups[0].target == "edge.example.com");
+   FakeDns::answer(0, cnameResponse("edge.example.com", 1, "host.example.com"));
+   assert(FakeDns::mLookups.size() == 1);
+   assert(FakeDns::mLookups[0].target == "host.example.com");
+   FakeDns::answer(0, aResponse("host.example.com", 600));
+   assert(sink.mResults == 1);
+   gSecsPassed += 11;
+
+   // Both CNAMEs have expired; the chain is still followed, and each hop is
+   // refreshed once.
+   stub.lookup<RR_A>("sip.example.com", Protocol::Sip, &sink);
+   stub.lookup<RR_A>("sip.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(sink.mResults == 3);
+   assert(FakeDns::mLookups.size() == 2);
+   assert(FakeDns::mLookups[0].target == "sip.example.com");
+   assert(FakeDns::mLookups[0].type == 5);
+   assert(FakeDns::mLookups[1].target == "edge.example.com");
+   assert(FakeDns::mLookups[1].type == 5);
+
+   FakeDns::answer(0, cnameResponse("sip.example.com", 600, "edge.example.com"));
+   FakeDns::answer(0, cnameResponse("edge.example.com", 600, "host.example.com"));
+   stub.lookup<RR_A>("sip.example.com", Protocol::Sip, &sink);
+   stub.processTimers();
+   assert(sink.mResults == 4);
+   assert(FakeDns::mLookups.empty());
+   assert(sink.mErrors == 0);
+
+   DumpHandler dump;
+   stub.getDnsCacheDump(std::make_pair(0ul, 0ul), &dump);
+   stub.processTimers();
+   assert(dump.mDump.find("stale") == Data::npos);
+   assert(dump.mDump.find("refreshing") == Data::npos);
+}
+
+static void
+testSnapshot()
+{
+   cerr << "!! Test snapshot" << endl;
+   const Data file("testDnsStub.snapshot");
+   remove(file.c_str());
+   DumpHandler dump;
+
+   {
+      DnsStub stub;
+      stub.setDnsCacheSnapshot(file);
+      Sink sink;
+      stub.lookup<RR_A>("trunk.example.com", Protocol::Sip, &sink);
+      stub.lookup<RR_SRV>("_sip._udp.example.com", Protocol::Sip, &sink);
+      stub.lookup<RR_NAPTR>("7.6.5.4.3.2.1.e164.arpa", Protocol::Enum, &sink);
+      stub.processTimers();
+      assert(FakeDns::mLookups.size() == 3);
+      FakeDns::answer(0, aResponse("trunk.example.com", 600));
+      FakeDns::answer(0, srvResponse("_sip._udp.example.com", 600, "sip1.example.com"));
+      FakeDns::answer(0, naptrResponse("7.6.5.4.3.2.1.e164.arpa", 600, "!^.*$!sip:info@example.com!"));
+      assert(sink.mResults == 3);
+   }
+
+   // The new stub starts out with what the last one had...
+   {
+      DnsStub stub;
+      stub.setDnsCacheSnapshot(file);
+      Sink sink;
+      stub.lookup<RR_A>("trunk.example.com", Protocol::Sip, &sink);
+      stub.lookup<RR_SRV>("_sip._udp.example.com", Protocol::Sip, &sink);
+      stub.lookup<RR_NAPTR>("7.6.5.4.3.2.1.e164.arpa", Protocol::Enum, &sink);
+      stub.processTimers();
+      assert(FakeDns::mLookups.empty());
+      assert(sink.mResults == 3);
+      assert(sink.mErrors == 0);
+
+      stub.getDnsCacheDump(std::make_pair(0ul, 0ul), &dump);
+      stub.processTimers();
+      assert(dump.mDump.find("-> sip1.example.com:5060 priority=10 weight=20") != Data::npos);
+      assert(dump.mDump.find("regexp=^.*$") != Data::npos);
+      assert(dump.mDump.find("secsToExpirey=600 ") != Data::npos ||
+             dump.mDump.find("secsToExpirey=599 ") != Data::npos);
+   }
+
+   // ... unless the snapshot is older than the records in it.
+   Data snapshot = Data::fromFile(file);
+   const size_t stamp = strlen("resip DNS cache 1\n");
+   UInt32 saved = ((unsigned char)snapshot[stamp] << 24 | (unsigned char)snapshot[stamp + 1] << 16 |
+                   (unsigned char)snapshot[stamp + 2] << 8 | (unsigned char)snapshot[stamp + 3]);
+   saved -= 601;
+   Data backdated(snapshot.substr(0, stamp));
+   backdated += (char)(saved >> 24);
+   backdated += (char)(saved >> 16);
+   backdated += (char)(saved >> 8);
+   backdated += (char)saved;
+   backdated += snapshot.substr(stamp + 4);
+   {
+      ofstream os(file.c_str(), ios::binary | ios::trunc);
+      os.write(backdated.data(), backdated.size());
+   }
+   {
+      DnsStub stub;
+      stub.setDnsCacheSnapshot(file);
+      Sink sink;
+      stub.lookup<RR_A>("trunk.example.com", Protocol::Sip, &sink);
+      stub.processTimers();
+      assert(FakeDns::mLookups.size() == 1);
+      FakeDns::mLookups.clear();
+   }
+
+   remove(file.c_str());
+   remove((file + ".tmp").c_str());
+}
+
+int
+main(int argc, char* argv[])
+{
+   FakeDnsCreator creator;
+   ExternalDnsFactory::setExternalCreator(&creator);
+   RRList::setClock(&testClock);
+
+   testCoalescing();
+   // What testCoalescing() left in flight went with its stub.
+   FakeDns::mLookups.clear();
+   testRefreshAhead();
+   testServeStale();
+   testStaleCnameChain();
+   testSnapshot();
+
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -4,6 +4,7 @@
 #include "rutil/FiniteFifo.hxx"
 #include "rutil/TimeLimitFifo.hxx"
 #include "rutil/Data.hxx"
+#include "rutil/ParseBuffer.hxx"
 #include "rutil/ThreadIf.hxx"
 #include "rutil/Timer.hxx"
 #ifndef WIN32
@@ -146,6 +147,46 @@ void Producer::thread()
    }
 }
 
+// Used with a lock-free Fifo; each message carries "producer:sequence" so
+// the consumer can check that per-producer ordering is preserved.
+class FifoProducer: public ThreadIf
+{
+  public:
+      FifoProducer(Fifo<Foo>& fifo, int id, unsigned int count) :
+         mFifo(fifo),
+         mId(id),
+         mCount(count)
+      {}
+      virtual ~FifoProducer()
+      {
+         shutdown();
+         join();
+      }
+
+      void thread()
+      {
+         Fifo<Foo>::Messages batch;
+         for(unsigned int n = 0; n < mCount; ++n)
+         {
+            Foo* foo = new Foo(Data(mId) + ":" + Data(n));
+            if(n % 3)
+            {
+               mFifo.add(foo);
+            }
+            else
+            {
+               batch.push_back(foo);
+               mFifo.addMultiple(batch);
+            }
+         }
+      }
+
+   private:
+      Fifo<Foo>& mFifo;
+      int mId;
+      unsigned int mCount;
+};
+
 bool
 isNear(int value, int reference, int epsilon=250)
 {
@@ -459,6 +500,79 @@ main()
       sleepMS(1000);
    }
 
+   {
+      cerr << "!! Test lock-free fifo" << endl;
+
+      Fifo<Foo> lf;
+      assert(lf.setLockFree(true));
+      assert(lf.isLockFree());
+      assert(lf.empty());
+      assert(lf.getNext(RESIP_FIFO_NOWAIT) == 0);
+
+      UInt64 begin(Timer::getTimeMs());
+      assert(lf.getNext(500) == 0);
+      assert(isNear((int)(Timer::getTimeMs() - begin), 500));
+
+      lf.add(new Foo("first"));
+      lf.add(new Foo("second"));
+      assert(lf.size() == 2);
+      assert(lf.messageAvailable());
+      Foo* fp = lf.getNext();
+      assert(fp->mVal == "first");
+      delete fp;
+      // Can't switch modes while there is something in the fifo
+      assert(!lf.setLockFree(false));
+      lf.clear();
+      assert(lf.empty());
+      assert(lf.size() == 0);
+      assert(lf.setLockFree(false));
+      assert(lf.setLockFree(true));
+
+      const int numProducers = 8;
+      const unsigned int perProducer = 20000;
+      unsigned int next[numProducers];
+      FifoProducer* producers[numProducers];
+      for(int i = 0; i < numProducers; ++i)
+      {
+         next[i] = 0;
+         producers[i] = new FifoProducer(lf, i, perProducer);
+      }
+      for(int i = 0; i < numProducers; ++i)
+      {
+         producers[i]->run();
+      }
+
+      unsigned int received = 0;
+      Fifo<Foo>::Messages batch;
+      while(received < numProducers*perProducer)
+      {
+         assert(lf.getMultiple(2000, batch, 64));
+         assert(batch.size() <= 64);
+         while(!batch.empty())
+         {
+            Foo* foo = batch.front();
+            batch.pop_front();
+            ParseBuffer pb(foo->mVal);
+            int id = pb.integer();
+            pb.skipChar(':');
+            unsigned int seq = pb.uInt32();
+            assert(id >= 0 && id < numProducers);
+            assert(seq == next[id]);
+            ++next[id];
+            ++received;
+            delete foo;
+         }
+      }
+
+      for(int i = 0; i < numProducers; ++i)
+      {
+         delete producers[i];
+         assert(next[i] == perProducer);
+      }
+      assert(lf.empty());
+      assert(lf.getCountDepth() == 0);
+   }
+
    cerr << "All OK" << endl;
    return 0;
 }
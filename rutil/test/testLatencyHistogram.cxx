@@ -0,0 +1,192 @@
+#include <cassert>
+#include <iostream>
+
+#include "rutil/LatencyHistogram.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Random.hxx"
+
+using namespace resip;
+using namespace std;
+
+static void
+testBuckets()
+{
+   cerr << "!! Test buckets" << endl;
+
+   // Small values are exact.
+   for(UInt64 v = 0; v < LatencyHistogram::SubBuckets; ++v)
+   {
+      assert(LatencyHistogram::bucketIndex(v) == v);
+      assert(LatencyHistogram::lowestValue((unsigned int)v) == v);
+      assert(LatencyHistogram::highestValue((unsigned int)v) == v);
+   }
+
+   // Buckets are contiguous, and every value lands in the bucket that claims
+   // it.
+   for(unsigned int i = 1; i < LatencyHistogram::BucketCount; ++i)
+   {
+      assert(LatencyHistogram::lowestValue(i) == LatencyHistogram::highestValue(i - 1) + 1);
+      assert(LatencyHistogram::bucketIndex(LatencyHistogram::lowestValue(i)) == i);
+      assert(LatencyHistogram::bucketIndex(LatencyHistogram::highestValue(i)) == i);
+   }
+
+   // Relative error stays within a bucket's width.
+   for(int n = 0; n < 100000; ++n)
+   {
+      UInt64 v = ((UInt64)Random::getRandom() << 4) + (UInt64)Random::getRandom() % 16;
+      unsigned int i = LatencyHistogram::bucketIndex(v);
+      assert(LatencyHistogram::lowestValue(i) <= v);
+      assert(LatencyHistogram::highestValue(i) >= v);
+      assert(LatencyHistogram::highestValue(i) - LatencyHistogram::lowestValue(i) <= v / 16);
+   }
+
+   // Too large to tell apart; they all end up at the top.
+   unsigned int last = LatencyHistogram::BucketCount - 1;
+   assert(LatencyHistogram::bucketIndex(UInt64(1) << LatencyHistogram::MaxValueBits) == last);
+   assert(LatencyHistogram::bucketIndex(~UInt64(0)) == last);
+}
+
+static void
+testPercentiles()
+{
+   cerr << "!! Test percentiles" << endl;
+   LatencyHistogram h;
+   assert(h.count() == 0);
+   assert(h.valueAtPercentile(50) == 0);
+   assert(h.max() == 0);
+
+   for(UInt64 v = 1; v <= 1000; ++v)
+   {
+      h.record(v);
+   }
+   assert(h.count() == 1000);
+   assert(h.sum() == 500500);
+   assert(h.mean() == 500);
+
+   UInt64 p50 = h.valueAtPercentile(50);
+   assert(p50 >= 500 && p50 <= 500 + 500 / 16);
+   UInt64 p99 = h.valueAtPercentile(99);
+   assert(p99 >= 990 && p99 <= 990 + 990 / 16);
+   UInt64 top = h.valueAtPercentile(100);
+   assert(top >= 1000 && top == h.max());
+   assert(h.valueAtPercentile(0) == 1);
+
+   LatencyHistogram other;
+   other.record(1000000);
+   h.merge(other);
+   assert(h.count() == 1001);
+   assert(h.max() >= 1000000 && h.max() <= 1000000 + 1000000 / 16);
+
+   // Taking away an earlier copy leaves just what came after it.
+   LatencyHistogram before(h);
+   h.record(7);
+   h.subtract(before);
+   assert(h.count() == 1);
+   assert(h.sum() == 7);
+   assert(h.valueAtPercentile(50) == 7);
+
+   h.clear();
+   assert(h.count() == 0 && h.sum() == 0);
+}
+
+class Recorder : public ThreadIf
+{
+   public:
+      Recorder(LatencyHistogram& h, int count) : mHistogram(h), mCount(count) {}
+
+      virtual void thread()
+      {
+         for(int n = 0; n < mCount; ++n)
+         {
+            mHistogram.record(n % 5000);
+         }
+      }
+
+   private:
+      LatencyHistogram& mHistogram;
+      int mCount;
+};
+
+static void
+testConcurrentReads()
+{
+   cerr << "!! Test reading while recording" << endl;
+   const int count = 2000000;
+   LatencyHistogram h;
+   Recorder recorder(h, count);
+   recorder.run();
+
+   // Whatever we see must only ever grow.
+   UInt64 last = 0;
+   while(last < (UInt64)count)
+   {
+      LatencyHistogram seen;
+      seen.merge(h);
+      UInt64 now = seen.count();
+      assert(now >= last);
+      assert(now <= (UInt64)count);
+      last = now;
+   }
+   recorder.join();
+   assert(h.count() == (UInt64)count);
+}
+
+int
+main(int argc, char* argv[])
+{
+   testBuckets();
+   testPercentiles();
+   testConcurrentReads();
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
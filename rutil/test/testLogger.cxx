@@ -1,4 +1,10 @@
 
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
 #include "rutil/Logger.hxx"
 #include "rutil/Data.hxx"
 #include "rutil/ThreadIf.hxx"
@@ -130,6 +136,129 @@ testThreadLocalLoggers(const char *appname)
    }
 }
 
+class AsyncLogThread : public ThreadIf
+{
+   public:
+      AsyncLogThread(int id, int count) : mId(id), mCount(count) {}
+
+      void thread()
+      {
+         for (int i = 0; i < mCount; ++i)
+         {
+            InfoLog(<< "async line " << mId << " " << i);
+         }
+      }
+   private:
+      int mId;
+      int mCount;
+};
+
+static int
+countAsyncLines(const char* fileName)
+{
+   std::ifstream in(fileName);
+   std::string line;
+   int count = 0;
+   while (std::getline(in, line))
+   {
+      if (line.find("async line ") != std::string::npos)
+      {
+         ++count;
+      }
+   }
+   return count;
+}
+
+static void
+runAsyncLogThreads(int threads, int lines)
+{
+   std::vector<AsyncLogThread*> logThreads;
+   for (int i = 0; i < threads; ++i)
+   {
+      logThreads.push_back(new AsyncLogThread(i, lines));
+      logThreads.back()->run();
+   }
+   for (int i = 0; i < threads; ++i)
+   {
+      logThreads[i]->join();
+      delete logThreads[i];
+   }
+}
+
+void
+testAsyncLogging(const char *appname)
+{
+   const char* fileName = "testLogger-async.txt";
+   const int threads = 4;
+   const int lines = 20000;
+
+   // Drop when full: every line is either written or counted as dropped.
+   remove(fileName);
+   Log::initialize("file-async", "INFO", appname, fileName);
+   assert(Log::isAsync());
+   Log::setAsync(true, Log::DropWhenFull, 4096);
+   unsigned long droppedBefore = Log::asyncDroppedLines();
+   UInt64 start = Timer::getTimeMs();
+   runAsyncLogThreads(threads, lines);
+   UInt64 logged = Timer::getTimeMs();
+   Log::flushAsync();
+   unsigned long dropped = Log::asyncDroppedLines() - droppedBefore;
+   int written = countAsyncLines(fileName);
+   cerr << "Async (drop): logged " << threads*lines << " lines in " << logged - start
+        << "ms, wrote " << written << ", dropped " << dropped << endl;
+   assert(written + dropped == (unsigned long)(threads*lines));
+
+   // Block when full: nothing is lost.
+   remove(fileName);
+   Log::initialize("file", "INFO", appname, fileName);
+   assert(!Log::isAsync());
+   Log::setAsync(true, Log::BlockWhenFull);
+   droppedBefore = Log::asyncDroppedLines();
+   start = Timer::getTimeMs();
+   runAsyncLogThreads(threads, lines);
+   logged = Timer::getTimeMs();
+   Log::setAsync(false);
+   assert(Log::asyncDroppedLines() == droppedBefore);
+   written = countAsyncLines(fileName);
+   cerr << "Async (block): logged " << threads*lines << " lines in " << logged - start
+        << "ms, wrote " << written << endl;
+   assert(written == threads*lines);
+
+   // Disabled while threads are blocked on a full buffer: they carry on
+   // synchronously, and nothing is lost.
+   remove(fileName);
+   Log::initialize("file", "INFO", appname, fileName);
+   Log::setAsync(true, Log::BlockWhenFull, 4096);
+   {
+      std::vector<AsyncLogThread*> logThreads;
+      for (int i = 0; i < threads; ++i)
+      {
+         logThreads.push_back(new AsyncLogThread(i, lines));
+         logThreads.back()->run();
+      }
+      sleepMs(5);
+      Log::setAsync(false);
+      for (int i = 0; i < threads; ++i)
+      {
+         logThreads[i]->join();
+         delete logThreads[i];
+      }
+   }
+   Log::flushAsync();
+   written = countAsyncLines(fileName);
+   cerr << "Async (block, disabled while logging): wrote " << written << endl;
+   assert(written == threads*lines);
+
+   // Synchronous, for comparison
+   remove(fileName);
+   Log::initialize("file", "INFO", appname, fileName);
+   start = Timer::getTimeMs();
+   runAsyncLogThreads(threads, lines);
+   cerr << "Sync: logged " << threads*lines << " lines in " << Timer::getTimeMs() - start << "ms" << endl;
+   assert(countAsyncLines(fileName) == threads*lines);
+   remove(fileName);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -248,6 +377,8 @@ main(int argc, char* argv[])
    cout << endl;
    testThreadLocalLoggers(argv[0]);
 
+   testAsyncLogging(argv[0]);
+
    return 0;
 }
 
@@ -239,11 +239,15 @@ doThreadedTest(int numCycles, int numThreads, int storeBytes)
    return doneUs - startUs;
 }
 
-static void
+/**
+   Returns the average number of microseconds per cycle.
+**/
+static double
 doVariationTest(int numCycles, int numThreads, int numPass, int storeBytes)
 {
    UInt64 msMin = 0, msMax = 0;
    UInt64 msSum = 0;
+   UInt64 usSum = 0;
    UInt64 msSumSq = 0;
    int passIdx=0;
    for (passIdx=0; passIdx < numPass; passIdx++)
@@ -252,6 +256,7 @@ doVariationTest(int numCycles, int numThreads, int numPass, int storeBytes)
          ?  doSingleTest(numCycles) 
          : doThreadedTest(numCycles, numThreads, storeBytes);
       UInt64 usPerCycle = usTot/numCycles;
+      usSum += usPerCycle;
 #if 0
       std::cerr << numCycles << " cycles/thread (1M plain 32-bit ints)"
          << " with " << numThreads << " threads"
@@ -274,19 +279,48 @@ doVariationTest(int numCycles, int numThreads, int numPass, int storeBytes)
          Random::getImplName(),
          numCycles, numThreads, numPass,
          (int)msMin,(int)msAvg,(int)msMax, msStd, msStdPct);
+   return usSum/(numPass+0.0);
+}
+
+/**
+   Runs the same per-thread load with more and more threads. If the
+   generator scales, a cycle takes as long with N threads as with one, and
+   throughput grows N-fold (as far as there are cores to run them).
+**/
+static void
+doSweepTest(int numCycles, int maxThreads, int numPass)
+{
+   double base = 0;
+   for (int numThreads=1; numThreads <= maxThreads; numThreads *= 2)
+   {
+      double usAvg = doVariationTest(numCycles, numThreads, numPass, 0);
+      // each thread makes a million per cycle, so this is millions/sec
+      double rate = usAvg > 0 ? numThreads*(RANDINT_PER_CYCLE/usAvg) : 0;
+      if ( numThreads==1 )
+      {
+         base = rate;
+      }
+      fprintf(stderr,"RESULT:sweep:%s:threads=%d:%.1fM/s,scaling=%.2f\n",
+            Random::getImplName(), numThreads, rate,
+            base > 0 ? rate/base : 0.0);
+   }
 }
 
 
 int main(int argc, char** argv)
 {
    bool doSweep = true;
-   int numCycles = 2;
-   int numThreads = 3;
-   int numPass = 10;
+   int numCycles = 1;
+   int numThreads = 8;
+   int numPass = 3;
    int storeBytes = 0;
 
+   if (argc >= 2)
    {
       doSweep = false;
+      numCycles = 2;
+      numThreads = 3;
+      numPass = 10;
       if(argc >= 2)
          numCycles = atoi(argv[1]);
       if(argc >= 3)
@@ -301,6 +335,8 @@ int main(int argc, char** argv)
    {
        std::cerr
           << "usage: testRandomThread [numCycles numThreads numPasses storeBytes]" << std::endl
+           << "With no arguments, sweeps 1, 2, 4 and 8 threads and reports" << std::endl
+           << "    throughput and how it scales against one thread." << std::endl
            << "numCycles>0 is number of cycles to run in each thread." << std::endl
            << "    each cycle is one million random 32bit integers" << std::endl
            << "    each cycle is one thousand random sequences when storing (see below) " << std::endl
@@ -328,6 +364,11 @@ int main(int argc, char** argv)
 
    std::cerr << "Starting..." << std::endl;
 
+   if (doSweep)
+   {
+      doSweepTest(numCycles, numThreads, numPass);
+   }
+   else
    {
       doVariationTest(numCycles, numThreads, numPass, storeBytes);
    }
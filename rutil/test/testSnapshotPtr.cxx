@@ -0,0 +1,162 @@
+#include <cassert>
+#include <iostream>
+
+#include "rutil/AtomicOps.hxx"
+#include "rutil/SnapshotPtr.hxx"
+#include "rutil/ThreadIf.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+static volatile long liveValues = 0;
+
+// Both halves are always equal while the value is alive; a reader that sees
+// them differ has been handed a value that was already deleted.
+class Value
+{
+   public:
+      explicit Value(long n) : mA(n), mB(n)
+      {
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         atomicFetchAdd(liveValues, 1L);
+#endif
+      }
+      ~Value()
+      {
+         mA = -1;
+         mB = -2;
+#ifdef RESIP_HAVE_ATOMIC_OPS
+         atomicFetchSub(liveValues, 1L);
+#endif
+      }
+      volatile long mA;
+      volatile long mB;
+};
+
+class ReaderThread : public ThreadIf
+{
+   public:
+      ReaderThread(SnapshotPtr<Value>& ptr) : mPtr(ptr), mReads(0) {}
+      virtual void thread()
+      {
+         long last = 0;
+         while(!isShutdown())
+         {
+            SnapshotPtr<Value>::Reader value(mPtr);
+            const long a = value->mA;
+            for(int i = 0; i < 100; ++i)
+            {
+               assert(value->mB == a);
+            }
+            // Writers only ever publish increasing values.
+            assert(a >= last);
+            last = a;
+            ++mReads;
+         }
+      }
+      SnapshotPtr<Value>& mPtr;
+      unsigned long mReads;
+};
+
+int
+main(int argc, char* argv[])
+{
+   {
+      SnapshotPtr<Value> ptr(new Value(0));
+      {
+         SnapshotPtr<Value>::Reader value(ptr);
+         assert(value->mA == 0);
+      }
+      ptr.reset(new Value(1));
+      {
+         SnapshotPtr<Value>::Reader value(ptr);
+         SnapshotPtr<Value>::Reader nested(ptr);
+         assert(value.get() == nested.get());
+         assert((*value).mA == 1);
+      }
+
+      const int numReaders = 4;
+      ReaderThread* readers[numReaders];
+      for(int i = 0; i < numReaders; ++i)
+      {
+         readers[i] = new ReaderThread(ptr);
+         readers[i]->run();
+      }
+
+      const UInt64 end = Timer::getTimeMs() + 2000;
+      long updates = 1;
+      while(Timer::getTimeMs() < end)
+      {
+         ptr.reset(new Value(++updates));
+      }
+
+      unsigned long reads = 0;
+      for(int i = 0; i < numReaders; ++i)
+      {
+         readers[i]->shutdown();
+         readers[i]->join();
+         reads += readers[i]->mReads;
+         delete readers[i];
+      }
+      cerr << updates << " updates, " << reads << " reads" << endl;
+#ifdef RESIP_HAVE_ATOMIC_OPS
+      assert(liveValues == 1);
+#endif
+   }
+#ifdef RESIP_HAVE_ATOMIC_OPS
+   assert(liveValues == 0);
+#endif
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
@@ -0,0 +1,330 @@
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <vector>
+
+#include "rutil/GenericTimerQueue.hxx"
+#include "rutil/TimingWheel.hxx"
+#include "rutil/Random.hxx"
+#include "rutil/Timer.hxx"
+
+using namespace resip;
+using namespace std;
+
+class TestTimer
+{
+   public:
+      TestTimer(UInt64 when, int tag) : mWhen(when), mTag(tag) {}
+      UInt64 getWhen() const { return mWhen; }
+      int tag() const { return mTag; }
+      bool operator>(const TestTimer& rhs) const { return mWhen > rhs.mWhen; }
+
+   private:
+      UInt64 mWhen;
+      int mTag;
+};
+
+typedef TimingWheel<TestTimer> Wheel;
+
+// Expires everything due at now, checking that it comes out in order.
+static int
+expire(Wheel& wheel, UInt64 now, UInt64& last)
+{
+   int count = 0;
+   const TestTimer* timer;
+   while((timer = wheel.nextExpired(now)) != 0)
+   {
+      assert(timer->getWhen() <= now);
+      assert(timer->getWhen() >= last);
+      last = timer->getWhen();
+      wheel.popExpired();
+      ++count;
+   }
+   return count;
+}
+
+static void
+testBasics()
+{
+   cerr << "!! Test basics" << endl;
+   Wheel wheel(1000);
+   assert(wheel.empty());
+   assert(wheel.nextExpired(5000) == 0);
+
+   // The wheel has moved on to 5000; anything at or before that is due now.
+   Wheel::Id late = wheel.add(TestTimer(4000, 1));
+   assert(wheel.top().tag() == 1);
+   assert(wheel.nextExpired(5000)->tag() == 1);
+   assert(!wheel.cancel(late));
+   wheel.popExpired();
+   assert(!wheel.pending(late));
+   assert(wheel.empty());
+
+   Wheel::Id a = wheel.add(TestTimer(5100, 2));
+   Wheel::Id b = wheel.add(TestTimer(5000 + 64*64*64 + 7, 3));
+   Wheel::Id c = wheel.add(TestTimer(5050, 4));
+   assert(wheel.size() == 3);
+   assert(wheel.top().tag() == 4);
+   assert(wheel.pending(a) && wheel.pending(b) && wheel.pending(c));
+
+   assert(wheel.cancel(c));
+   assert(!wheel.cancel(c));
+   assert(!wheel.pending(c));
+   assert(wheel.top().tag() == 2);
+
+   // A new timer reusing c's storage must not be reachable through c.
+   Wheel::Id d = wheel.add(TestTimer(5200, 5));
+   assert(d != c);
+   assert(!wheel.cancel(c));
+   assert(wheel.pending(d));
+
+   assert(wheel.nextExpired(5099) == 0);
+   assert(wheel.nextExpired(5100)->tag() == 2);
+   // Timers can be added while one is being expired.
+   wheel.add(TestTimer(5100, 6));
+   wheel.popExpired();
+   assert(wheel.nextExpired(5100)->tag() == 6);
+   wheel.popExpired();
+   assert(wheel.top().tag() == 5);
+
+   assert(wheel.nextExpired(5000 + 64*64*64 + 6)->tag() == 5);
+   wheel.popExpired();
+   assert(wheel.nextExpired(5000 + 64*64*64 + 6) == 0);
+   assert(wheel.top().tag() == 3);
+   assert(wheel.nextExpired(5000 + 64*64*64 + 7)->tag() == 3);
+   wheel.popExpired();
+   assert(wheel.empty());
+
+   // Far future, across the top levels of the wheel.
+   const UInt64 far = UInt64(1) << 60;
+   wheel.add(TestTimer(far + 1, 7));
+   wheel.add(TestTimer(far, 8));
+   assert(wheel.top().tag() == 8);
+   assert(wheel.nextExpired(far - 1) == 0);
+   assert(wheel.nextExpired(far)->tag() == 8);
+   wheel.popExpired();
+   assert(wheel.nextExpired(far) == 0);
+   assert(wheel.nextExpired(far + 1)->tag() == 7);
+   wheel.popExpired();
+   assert(wheel.empty());
+}
+
+static void
+testRandom()
+{
+   cerr << "!! Test random" << endl;
+   UInt64 now = 1000000;
+   Wheel wheel(now);
+   vector<Wheel::Id> ids;
+   size_t live = 0;
+   UInt64 last = 0;
+   for(int round = 0; round < 2000; ++round)
+   {
+      for(int i = 0; i < 50; ++i)
+      {
+         const UInt64 when = now + (Random::getRandom() % (1 << (Random::getRandom() % 24)));
+         ids.push_back(wheel.add(TestTimer(when, i)));
+         ++live;
+      }
+      for(int i = 0; i < 10; ++i)
+      {
+         if(wheel.cancel(ids[Random::getRandom() % ids.size()]))
+         {
+            --live;
+         }
+      }
+      if(!wheel.empty())
+      {
+         // top() must agree with what actually expires next.
+         const UInt64 next = wheel.top().getWhen();
+         assert(next >= now);
+         if(next > now)
+         {
+            assert(wheel.nextExpired(next - 1) == 0);
+         }
+      }
+      now += Random::getRandom() % 5000;
+      last = 0;
+      live -= expire(wheel, now, last);
+      assert(wheel.size() == live);
+   }
+}
+
+class TestEvent
+{
+   public:
+      TestEvent(int& count) : mCount(count) { ++mCount; }
+      ~TestEvent() { --mCount; }
+      int& mCount;
+};
+
+class TestTimerQueue : public GenericTimerQueue<TestEvent>
+{
+   public:
+      TestTimerQueue() : mFiredCount(0) {}
+      virtual void processTimer(TestEvent* event)
+      {
+         ++mFiredCount;
+         // Timers added from here must not be processed in the same pass.
+         add(new TestEvent(event->mCount), 0);
+         delete event;
+      }
+      int mFiredCount;
+};
+
+static void
+testGenericTimerQueue()
+{
+   cerr << "!! Test GenericTimerQueue" << endl;
+   int live = 0;
+   {
+      TestTimerQueue queue;
+      TestTimerQueue::Id due = queue.add(new TestEvent(live), 0);
+      TestTimerQueue::Id later = queue.add(new TestEvent(live), 100000);
+      queue.add(new TestEvent(live), 100000);
+      assert(live == 3);
+      assert(queue.msTillNextTimer() == 0);
+
+      assert(queue.cancel(later));
+      assert(!queue.cancel(later));
+      assert(live == 2);
+
+      queue.process();
+      assert(queue.mFiredCount == 1);
+      assert(!queue.pending(due));
+      assert(queue.size() == 2);
+      assert(live == 2);
+   }
+   // Pending events are deleted along with the queue.
+   assert(live == 0);
+}
+
+static void
+testPerformance()
+{
+   const int count = 1000000;
+   const UInt64 horizon = 64000; // timers spread over 64s, like T1..TimerB/H
+   cerr << "!! Performance with " << count << " pending timers" << endl;
+
+   vector<UInt64> whens;
+   whens.reserve(count);
+   for(int i = 0; i < count; ++i)
+   {
+      whens.push_back(Random::getRandom() % horizon);
+   }
+
+   {
+      UInt64 start = Timer::getTimeMicroSec();
+      priority_queue<TestTimer, vector<TestTimer>, greater<TestTimer> > heap;
+      for(int i = 0; i < count; ++i)
+      {
+         heap.push(TestTimer(whens[i], i));
+      }
+      UInt64 added = Timer::getTimeMicroSec();
+      int expired = 0;
+      for(UInt64 now = 0; now <= horizon; ++now)
+      {
+         while(!heap.empty() && heap.top().getWhen() <= now)
+         {
+            heap.pop();
+            ++expired;
+         }
+      }
+      assert(expired == count);
+      UInt64 done = Timer::getTimeMicroSec();
+      cerr << "priority_queue: add " << (added - start)/1000 << "ms, expire "
+           << (done - added)/1000 << "ms (no cancellation possible)" << endl;
+   }
+
+   {
+      UInt64 start = Timer::getTimeMicroSec();
+      Wheel wheel(0);
+      vector<Wheel::Id> ids;
+      ids.reserve(count);
+      for(int i = 0; i < count; ++i)
+      {
+         ids.push_back(wheel.add(TestTimer(whens[i], i)));
+      }
+      UInt64 added = Timer::getTimeMicroSec();
+      // Most transaction timers are cancelled in practice; cancel half.
+      for(int i = 0; i < count; i += 2)
+      {
+         wheel.cancel(ids[i]);
+      }
+      UInt64 cancelled = Timer::getTimeMicroSec();
+      int expired = 0;
+      UInt64 last = 0;
+      for(UInt64 now = 0; now <= horizon; ++now)
+      {
+         expired += expire(wheel, now, last);
+      }
+      assert(expired == count/2);
+      assert(wheel.empty());
+      UInt64 done = Timer::getTimeMicroSec();
+      cerr << "TimingWheel: add " << (added - start)/1000 << "ms, cancel "
+           << (cancelled - added)/1000 << "ms, expire "
+           << (done - cancelled)/1000 << "ms" << endl;
+   }
+}
+
+int
+main(int argc, char* argv[])
+{
+   testBasics();
+   testRandom();
+   testGenericTimerQueue();
+   testPerformance();
+   cerr << "All OK" << endl;
+   return 0;
+}
+
+/* ====================================================================
+ * The Vovida Software License, Version 1.0
+ *
+ * Copyright (c) 2000-2005 Vovida Networks, Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The names "VOCAL", "Vovida Open Communication Application Library",
+ *    and "Vovida Open Communication Application Library (VOCAL)" must
+ *    not be used to endorse or promote products derived from this
+ *    software without prior written permission. For written
+ *    permission, please contact vocal@vovida.org.
+ *
+ * 4. Products derived from this software may not be called "VOCAL", nor
+ *    may "VOCAL" appear in their name, without prior written
+ *    permission of Vovida Networks, Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, TITLE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL VOVIDA
+ * NETWORKS, INC. OR ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT DAMAGES
+ * IN EXCESS OF $1,000, NOR FOR ANY INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by Vovida
+ * Networks, Inc. and many individuals on behalf of Vovida Networks,
+ * Inc.  For more information on Vovida Networks, Inc., please see
+ * <http://www.vovida.org/>.
+ *
+ */
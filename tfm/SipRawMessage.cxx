@@ -22,6 +22,12 @@ SipRawMessage::encode(std::ostream& str) const
    str << mRawMessage;
    return str;
 }
+
+void
+SipRawMessage::encodeToBuffer(resip::Data& buffer) const
+{
+   buffer += mRawMessage;
+}
 /*
   Copyright (c) 2005, PurpleComm, Inc. 
   All rights reserved.
@@ -11,6 +11,7 @@ class SipRawMessage : public resip::SipMessage
       SipRawMessage(const SipMessage& carrier, const resip::Data& rawMessage);
       resip::Data& raw() const;
       virtual std::ostream& encode(std::ostream& str) const;
+      virtual void encodeToBuffer(resip::Data& buffer) const;
 
 
    private: